@@ -6,7 +6,6 @@ In this file are all definitions and includes for datatypes and name aliases, wh
 
 #include <stdint.h>
 #include "Vector.h"
-#include "DuePinMapping.h"
 
 namespace JAFD
 {
@@ -213,206 +212,20 @@ namespace JAFD
 		right
 	};
 
-	inline RelativeDir makeRelative(const AbsoluteDir& absoluteDir, const AbsoluteDir heading)
-	{
-		switch (absoluteDir)
-		{
-		case AbsoluteDir::north:
-		{
-			switch (heading)
-			{
-			case AbsoluteDir::north:
-				return RelativeDir::forward;
-				break;
-			case AbsoluteDir::east:
-				return RelativeDir::left;
-				break;
-			case AbsoluteDir::south:
-				return RelativeDir::backward;
-				break;
-			case AbsoluteDir::west:
-				return RelativeDir::right;
-				break;
-			default:
-				break;
-			}
-
-			break;
-		}
+	// Relative direction for every clockwise quarter turn offset between absolute direction and heading
+	constexpr RelativeDir relativeDirByTurns[4] = { RelativeDir::forward, RelativeDir::right, RelativeDir::backward, RelativeDir::left };
 
-		case AbsoluteDir::east:
-		{
-			switch (heading)
-			{
-			case AbsoluteDir::north:
-				return RelativeDir::right;
-				break;
-			case AbsoluteDir::east:
-				return RelativeDir::forward;
-				break;
-			case AbsoluteDir::south:
-				return RelativeDir::left;
-				break;
-			case AbsoluteDir::west:
-				return RelativeDir::backward;
-				break;
-			default:
-				break;
-			}
-
-			break;
-		}
+	// Clockwise quarter turns from the heading for every relative direction (index = RelativeDir)
+	constexpr uint8_t turnsByRelativeDir[4] = { 0, 2, 3, 1 };
 
-		case AbsoluteDir::south:
-		{
-			switch (heading)
-			{
-			case AbsoluteDir::north:
-				return RelativeDir::backward;
-				break;
-			case AbsoluteDir::east:
-				return RelativeDir::right;
-				break;
-			case AbsoluteDir::south:
-				return RelativeDir::forward;
-				break;
-			case AbsoluteDir::west:
-				return RelativeDir::left;
-				break;
-			default:
-				break;
-			}
-
-			break;
-		}
-
-		case AbsoluteDir::west:
-		{
-			switch (heading)
-			{
-			case AbsoluteDir::north:
-				return RelativeDir::left;
-				break;
-			case AbsoluteDir::east:
-				return RelativeDir::backward;
-				break;
-			case AbsoluteDir::south:
-				return RelativeDir::right;
-				break;
-			case AbsoluteDir::west:
-				return RelativeDir::forward;
-				break;
-			default:
-				break;
-			}
-
-			break;
-		}
-
-		default:
-			break;
-		}
+	inline RelativeDir makeRelative(const AbsoluteDir& absoluteDir, const AbsoluteDir heading)
+	{
+		return relativeDirByTurns[(static_cast<uint8_t>(absoluteDir) - static_cast<uint8_t>(heading)) & 0x3];
 	}
 
 	inline AbsoluteDir makeAbsolute(const RelativeDir& relativeDir, const AbsoluteDir heading)
 	{
-		switch (relativeDir)
-		{
-		case RelativeDir::forward:
-		{
-			switch (heading)
-			{
-			case AbsoluteDir::north:
-				return AbsoluteDir::north;
-				break;
-			case AbsoluteDir::east:
-				return AbsoluteDir::east;
-				break;
-			case AbsoluteDir::south:
-				return AbsoluteDir::south;
-				break;
-			case AbsoluteDir::west:
-				return AbsoluteDir::west;
-				break;
-			default:
-				break;
-			}
-
-			break;
-		}
-
-		case RelativeDir::right:
-		{
-			switch (heading)
-			{
-			case AbsoluteDir::north:
-				return AbsoluteDir::east;
-				break;
-			case AbsoluteDir::east:
-				return AbsoluteDir::south;
-				break;
-			case AbsoluteDir::south:
-				return AbsoluteDir::west;
-				break;
-			case AbsoluteDir::west:
-				return AbsoluteDir::north;
-				break;
-			default:
-				break;
-			}
-
-			break;
-		}
-
-		case RelativeDir::backward:
-		{
-			switch (heading)
-			{
-			case AbsoluteDir::north:
-				return AbsoluteDir::south;
-				break;
-			case AbsoluteDir::east:
-				return AbsoluteDir::west;
-				break;
-			case AbsoluteDir::south:
-				return AbsoluteDir::north;
-				break;
-			case AbsoluteDir::west:
-				return AbsoluteDir::east;
-				break;
-			default:
-				break;
-			}
-
-			break;
-		}
-
-		case RelativeDir::left:
-		{
-			switch (heading)
-			{
-			case AbsoluteDir::north:
-				return AbsoluteDir::west;
-				break;
-			case AbsoluteDir::east:
-				return AbsoluteDir::north;
-				break;
-			case AbsoluteDir::south:
-				return AbsoluteDir::east;
-				break;
-			case AbsoluteDir::west:
-				return AbsoluteDir::south;
-				break;
-			default:
-				break;
-			}
-
-			break;
-		}
-
-		default:
-			break;
-		}
+		return static_cast<AbsoluteDir>((static_cast<uint8_t>(heading) + turnsByRelativeDir[static_cast<uint8_t>(relativeDir)]) & 0x3);
 	}
 
 	// State of robot
@@ -643,6 +456,48 @@ namespace JAFD
 		}
 	};
 
+	// Time (millis()) when each distance got measured
+	struct DistSensTimestamps
+	{
+		uint32_t frontLeft;
+		uint32_t frontRight;
+		uint32_t frontLong;
+		uint32_t leftFront;
+		uint32_t leftBack;
+		uint32_t rightFront;
+		uint32_t rightBack;
+
+		constexpr DistSensTimestamps() : frontLeft(0), frontRight(0), frontLong(0), leftFront(0), leftBack(0), rightFront(0), rightBack(0) {}
+		DistSensTimestamps(const volatile DistSensTimestamps& times) : frontLeft(times.frontLeft), frontRight(times.frontRight), frontLong(times.frontLong), leftFront(times.leftFront), leftBack(times.leftBack), rightFront(times.rightFront), rightBack(times.rightBack) {}
+		constexpr DistSensTimestamps(const DistSensTimestamps& times) : frontLeft(times.frontLeft), frontRight(times.frontRight), frontLong(times.frontLong), leftFront(times.leftFront), leftBack(times.leftBack), rightFront(times.rightFront), rightBack(times.rightBack) {}
+
+		inline const volatile DistSensTimestamps& operator=(const volatile DistSensTimestamps times) volatile
+		{
+			frontLeft = times.frontLeft;
+			frontRight = times.frontRight;
+			frontLong = times.frontLong;
+			leftFront = times.leftFront;
+			leftBack = times.leftBack;
+			rightFront = times.rightFront;
+			rightBack = times.rightBack;
+
+			return *this;
+		}
+
+		inline const DistSensTimestamps& operator=(const DistSensTimestamps& times)
+		{
+			frontLeft = times.frontLeft;
+			frontRight = times.frontRight;
+			frontLong = times.frontLong;
+			leftFront = times.leftFront;
+			leftBack = times.leftBack;
+			rightFront = times.rightFront;
+			rightBack = times.rightBack;
+
+			return *this;
+		}
+	};
+
 	// Data from color sensor
 	struct ColorSensData
 	{
@@ -677,12 +532,13 @@ namespace JAFD
 		GridCell gridCell;			// Current grid cell
 		float gridCellCertainty;	// Certainty about the grid cell
 		Distances distances; 		// Results of distance measurement in mm
+		DistSensTimestamps distSensTimestamps;	// Time of each distance measurement
 		DistSensorStates distSensorState;	// States of all distance sensors
 		ColorSensData colorSensData;	// Data from color sensor at the bottom (includes color temperature and brightness in lux)
 
-		constexpr FusedData() : robotState(), gridCell(), gridCellCertainty(0.0f), distances(), distSensorState(), colorSensData() {}
-		FusedData(const volatile FusedData& data) : robotState(data.robotState), gridCell(data.gridCell), gridCellCertainty(data.gridCellCertainty), distances(data.distances), distSensorState(data.distSensorState), colorSensData(data.colorSensData) {}
-		constexpr FusedData(const FusedData& data) : robotState(data.robotState), gridCell(data.gridCell), gridCellCertainty(data.gridCellCertainty), distances(data.distances), distSensorState(data.distSensorState), colorSensData(data.colorSensData)  {}
+		constexpr FusedData() : robotState(), gridCell(), gridCellCertainty(0.0f), distances(), distSensTimestamps(), distSensorState(), colorSensData() {}
+		FusedData(const volatile FusedData& data) : robotState(data.robotState), gridCell(data.gridCell), gridCellCertainty(data.gridCellCertainty), distances(data.distances), distSensTimestamps(data.distSensTimestamps), distSensorState(data.distSensorState), colorSensData(data.colorSensData) {}
+		constexpr FusedData(const FusedData& data) : robotState(data.robotState), gridCell(data.gridCell), gridCellCertainty(data.gridCellCertainty), distances(data.distances), distSensTimestamps(data.distSensTimestamps), distSensorState(data.distSensorState), colorSensData(data.colorSensData)  {}
 
 		inline const volatile FusedData& operator=(const volatile FusedData data) volatile
 		{
@@ -690,6 +546,7 @@ namespace JAFD
 			gridCell = data.gridCell;
 			gridCellCertainty = data.gridCellCertainty;
 			distances = data.distances;
+			distSensTimestamps = data.distSensTimestamps;
 			distSensorState = data.distSensorState;
 			colorSensData = data.colorSensData;
 
@@ -702,6 +559,7 @@ namespace JAFD
 			gridCell = data.gridCell;
 			gridCellCertainty = data.gridCellCertainty;
 			distances = data.distances;
+			distSensTimestamps = data.distSensTimestamps;
 			distSensorState = data.distSensorState;
 			colorSensData = data.colorSensData;
 
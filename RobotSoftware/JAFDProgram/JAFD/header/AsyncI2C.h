@@ -0,0 +1,78 @@
+/*
+This part is responsible for interrupt driven, non blocking I2C transactions on Wire (TWI1) and Wire1 (TWI0)
+*/
+
+#pragma once
+
+#if defined(ARDUINO) && ARDUINO >= 100
+#include "arduino.h"
+#else
+#include "WProgram.h"
+#endif
+
+#include <stdint.h>
+
+#include "AllDatatypes.h"
+
+namespace JAFD
+{
+	namespace AsyncI2C
+	{
+		enum class Bus : uint8_t
+		{
+			wire,	// Wire (TWI1) - with the I2C multiplexer
+			wire1	// Wire1 (TWI0)
+		};
+
+		enum class TransactionState : uint8_t
+		{
+			idle,		// Never submitted
+			queued,		// Waiting for the bus
+			running,	// On the bus
+			done,		// Finished successfully
+			error,		// NACK or arbitration lost
+			timeout		// Took longer than the timeout
+		};
+
+		constexpr uint8_t noMuxCh = 0xff;	// Transaction doesn't need a multiplexer channel
+
+		struct Transaction
+		{
+			uint8_t address = 0;						// 7 bit device address
+			uint32_t reg = 0;							// Internal (register) address
+			uint8_t regSize = 0;						// Size of the register address (0 - 3 bytes)
+			uint8_t* data = nullptr;					// Data to read / write
+			uint8_t length = 0;							// Number of data bytes
+			bool read = true;							// Read or write?
+			uint8_t muxCh = noMuxCh;					// Channel of the I2C multiplexer (only Wire)
+			uint16_t timeout = 0;						// Timeout (ms); 0 = default timeout
+			void (*callback)(Transaction&) = nullptr;	// Called after the transaction finished (in interrupt context!)
+			void* context = nullptr;					// User data for the callback
+			volatile TransactionState state = TransactionState::idle;
+			uint32_t startTime = 0;						// Time the transaction got on the bus (ms)
+		};
+
+		// Statistics of a bus since the last reset
+		struct BusStats
+		{
+			uint32_t transactions;	// Finished transactions
+			uint32_t errors;		// Transactions with NACK / arbitration lost
+			uint32_t timeouts;		// Aborted transactions
+			uint32_t muxSwitches;	// Multiplexer channel switches
+			uint32_t busyTime;		// Time the bus was busy (us)
+			uint32_t totalTime;		// Time since the last reset (us)
+		};
+
+		ReturnCode setup();													// Install the interrupt handlers
+		ReturnCode submit(const Bus bus, Transaction& transaction);		// Queue a transaction; transaction has to stay valid until it is finished
+		void update();														// Abort transactions that took too long (call regularly)
+		bool isBusy(const Bus bus);											// Is a transaction running or waiting?
+		void lock(const Bus bus);											// Wait until the bus is free and stop starting transactions; needed around blocking Wire / Wire1 calls
+		void suspend(const Bus bus);										// Abort the running transaction and stop starting transactions without waiting (e.g. for a bus recovery); continue with unlock()
+		void unlock(const Bus bus);											// Continue with the waiting transactions
+		BusStats getStats(const Bus bus);									// Get the statistics since the last reset
+		float getUtilisation(const Bus bus);								// Portion of time the bus was busy since the last reset (0.0 - 1.0)
+		float getTransactionRate(const Bus bus);							// Finished transactions per second since the last reset
+		void resetStats(const Bus bus);										// Reset the statistics
+	}
+}
@@ -18,6 +18,7 @@ namespace JAFD
 	namespace Bno055
 	{
 		ReturnCode setup();
+		ReturnCode resetup();				// Set up again after a power reset in non blocking steps; aborted = not finished yet, call again
 		ReturnCode calibrate();
 		void updateValues();
 		void tare();
@@ -0,0 +1,39 @@
+/*
+This part is responsible for the piecewise linear calibration tables of the distance sensors
+*/
+
+#pragma once
+
+#include <stdint.h>
+
+#include "../../JAFDSettings.h"
+#include "AllDatatypes.h"
+
+namespace JAFD
+{
+	// Calibration table with equally spaced points (measured distance -> true distance); the outer segments are extended
+	class CalibrationTable
+	{
+	private:
+		static const uint8_t _maxPoints = JAFDSettings::DistanceSensors::calibTablePoints;
+
+		uint16_t _start;					// Measured distance of the first point (mm)
+		uint16_t _step;						// Measured distance between two points (mm)
+		float _invStep;						// 1 / _step
+		uint8_t _points;					// Number of points
+		int16_t _trueDist[_maxPoints];		// True distance at each point (mm)
+		float _slope[_maxPoints];			// Slope of the segment starting at each point
+
+		void calcSlopes();
+		ReturnCode restoreLegacy(const uint32_t address);	// Convert the linear k / d data of version 1 to a 2 point table
+
+	public:
+		CalibrationTable();
+		void reset();																					// No calibration (true distance = measured distance)
+		ReturnCode build(const uint16_t* trueDist, const uint16_t* measured, const uint16_t count);	// Build the table from pairs of true / measured distances (any order)
+		float apply(const uint16_t measured) const;														// Calibrated distance (mm)
+		void store(const uint32_t address) const;														// Store the table in the SPI NVSRAM
+		ReturnCode restore(const uint32_t address, const uint32_t legacyAddress);						// Read the table from the SPI NVSRAM; aborted if converted from linear k / d data, error (no calibration) if there is no valid data
+		uint8_t getPoints() const;
+	};
+}
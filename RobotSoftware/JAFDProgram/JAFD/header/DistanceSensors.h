@@ -16,6 +16,9 @@ This file is responsible for all distance sensors
 #include "../../JAFDSettings.h"
 #include "AllDatatypes.h"
 #include "Interrupts.h"
+#include "AsyncI2C.h"
+#include "CalibrationTable.h"
+#include "TFMiniParser.h"
 
 namespace JAFD
 {
@@ -44,17 +47,45 @@ namespace JAFD
 			static const uint16_t minDist = 20;
 			static const uint16_t maxDist = 150;
 
-			VL6180(uint8_t multiplexCh, uint8_t id);
-			ReturnCode setup() const;
-			uint16_t getDistance();		// Get distance in mm
+			VL6180(uint8_t multiplexCh, uint8_t interruptPin, uint8_t id);
+			ReturnCode setup();
+			void interrupt(const Interrupts::InterruptSource source, const uint32_t isr);	// Has to be called by the PIO interrupt; GPIO1 signals a new measurement
+			void update();					// Start reading the next measurement asynchronously; reports a timeout if there is no measurement for too long
+			void recover();					// Restart the continuous mode after a timeout; done asynchronously by the next update() calls
+			bool hasNewDistance() const;	// Has a new measurement been read since the last getDistance()?
+			uint16_t getDistance();			// Get the last distance in mm
+			uint32_t getTimestamp() const;	// Time the last measurement was ready
+			uint32_t getReadTime() const;	// Time needed to read the last measurement from the sensor (us)
+			float getSampleRate() const;	// Measurements per second since the last resetSampleRate()
+			void resetSampleRate();
 			Status getStatus() const;
 			void calcCalibData(uint16_t firstTrue, uint16_t firstMeasure, uint16_t secondTrue, uint16_t secondMeasure);
+			ReturnCode calcCalibData(const uint16_t* trueDist, const uint16_t* measured, const uint16_t count);	// Calibration table from pairs of true / measured distances
 			void storeCalibData();
-			void restoreCalibData();
+			ReturnCode restoreCalibData();	// aborted: Converted old calibration data, error: No calibration data
 			void resetCalibData();
-			void clearInterrupt();
+			void clearInterrupt();			// Discard the current measurement
 
 		private:
+			// Steps of reading a measurement asynchronously
+			enum class AsyncStep : uint8_t
+			{
+				idle,
+				statusBlock,	// Read error code and interrupt status in one burst
+				range,			// Read range
+				intClear,		// Clear interrupt
+				rangeStop,		// Select single mode (stops the continuous mode)
+				stopWait,		// Wait until the continuous mode stopped (no transaction)
+				rangeStart		// Start the continuous mode
+			};
+
+			// Register with the value written to it
+			struct CachedWrite
+			{
+				uint16_t address;
+				uint8_t data;
+			};
+
 			// Register addresses
 			static const uint8_t _regModelID = 0x000;				// Device model identification
 			static const uint8_t _regIntConfig = 0x014;				// Interrupt configuration
@@ -68,17 +99,48 @@ namespace JAFD
 			static const uint8_t _regRangeResult = 0x062;			// Range reading result
 
 			static const uint8_t _i2cAddr = 0x29;
+			static const uint8_t _writeCacheSize = 40;
 			const uint8_t _multiplexCh;
+			const uint8_t _interruptPin;	// Pin connected to GPIO1
 
 			const uint8_t _id;
 
 			Status _status;
 
-			// Calibration data
-			float _k = 1.0f;
-			int16_t _d = 0;
+			CalibrationTable _calib;
+
+			// Asynchronous reading
+			AsyncI2C::Transaction _transaction;
+			uint8_t _buffer[_regIntStatus - _regRangeStatus + 1];
+			volatile AsyncStep _step;
+			volatile bool _newDistance;		// Is there a new measurement?
+			volatile bool _discard;			// Discard the current measurement
+			volatile bool _resultRead;		// Has the result of the current measurement been read?
+			volatile uint8_t _rawDistance;
+			volatile uint8_t _rawStatus;
+			volatile uint32_t _timestamp;
+			volatile uint32_t _lastResult;	// Time of the last finished read (for timeout detection)
+			uint32_t _lastUpdate;			// Time of the last update() (for timeout detection)
+			volatile uint32_t _readStart;	// Time the current measurement was ready (us)
+			volatile uint32_t _readTime;
+			volatile bool _dataReady;		// Has GPIO1 signaled a new measurement?
+			volatile uint32_t _readyTime;	// Time the current measurement was ready (ms)
+			volatile uint32_t _sampleCount;	// Measurements since the last resetSampleRate()
+			uint32_t _rateStart;
+			bool _timedOut;
+			volatile bool _restart;			// Restart the continuous mode with the next update()
+			volatile bool _restartFailed;	// Couldn't write the mode to the sensor
+			volatile uint32_t _stopTime;	// Time the continuous mode got stopped (ms)
+
+			// Settings already written to the sensor
+			CachedWrite _writeCache[_writeCacheSize];
+			uint8_t _writeCacheCount;
 
-			void loadSettings() const;
+			static void asyncCallback(AsyncI2C::Transaction& transaction);
+			void startStep(AsyncStep step);
+
+			void loadSettings();
+			void writeCached8(uint16_t address, uint8_t data);	// Write 1 byte, unless the register already has this value
 			void write8(uint16_t address, uint8_t data) const;
 			void write16(uint16_t address, uint16_t data) const;
 			uint16_t read16(uint16_t address) const;
@@ -102,32 +164,38 @@ namespace JAFD
 
 			TFMini(SerialType serialType, uint8_t id);
 			ReturnCode setup();
-			uint16_t getDistance();	// Get distance in mm
+			void interrupt();				// Has to be called by the interrupt of the USART; parses the received frames
+			void update();					// Report a timeout if no valid frame has been received for too long
+			bool hasNewDistance() const;	// Has a new frame been received since the last getDistance()?
+			uint16_t getDistance();			// Get the distance of the latest frame in mm
+			uint32_t getTimestamp() const;	// Time the latest frame was received
+			uint32_t getBadChecksums() const;	// Number of frames with a wrong checksum
 			Status getStatus() const;
 			void calcCalibData(uint16_t firstTrue, uint16_t firstMeasure, uint16_t secondTrue, uint16_t secondMeasure);
+			ReturnCode calcCalibData(const uint16_t* trueDist, const uint16_t* measured, const uint16_t count);	// Calibration table from pairs of true / measured distances
 			void storeCalibData();
-			void restoreCalibData();
+			ReturnCode restoreCalibData();	// aborted: Converted old calibration data, error: No calibration data
 			void resetCalibData();
 
 		private:
 			static const uint32_t _baudrate = 115200;
-			static const uint8_t _maxBytesBeforeHeader = 10;
-			static const uint8_t _frameSize = 7;
-			static const uint8_t _maxMeasurementTries = 2;
 
 			const uint8_t _id;
 
-			// Calibration data
-			float _k = 1.0f;
-			float _d = 0.0f;
+			CalibrationTable _calib;
 
 			const SerialType _serialType;
-			Stream* _streamPtr;
-			uint16_t _distance;
+			Usart* _usart;
 			Status _status;
 
-			void clearSerialBuffer();
-			Status takeMeasurement();
+			TFMiniParser _parser;			// Frame parser (interrupt context)
+
+			// Latest valid frame
+			volatile uint16_t _rawDistance;
+			volatile uint32_t _timestamp;
+			volatile bool _newDistance;
+			volatile bool _timedOut;
+			volatile uint32_t _badChecksums;
 		};
 
 		class VL53L0
@@ -145,26 +213,87 @@ namespace JAFD
 			static const uint16_t minDist = 35;
 			static const uint16_t maxDist = 1200;
 
-			VL53L0(uint8_t multiplexCh, uint8_t id);
+			VL53L0(uint8_t multiplexCh, uint8_t interruptPin, uint8_t id);
 			ReturnCode setup();
-			uint16_t getDistance();		// Get distance in mm
+			void interrupt(const Interrupts::InterruptSource source, const uint32_t isr);	// Has to be called by the PIO interrupt; GPIO1 signals a new measurement
+			void update();					// Start reading the next measurement asynchronously; reports a timeout if there is no measurement for too long
+			void recover();					// Start a recovery of the bus after a timeout (non blocking)
+			bool hasNewDistance() const;	// Has a new measurement been read since the last getDistance()?
+			uint16_t getDistance();			// Get the last distance in mm
+			uint32_t getTimestamp() const;	// Time the last measurement was ready
+			uint32_t getReadTime() const;	// Time needed to read the last measurement from the sensor (us)
+			float getSampleRate() const;	// Measurements per second since the last resetSampleRate()
+			void resetSampleRate();
 			Status getStatus() const;
 			void calcCalibData(uint16_t firstTrue, uint16_t firstMeasure, uint16_t secondTrue, uint16_t secondMeasure);
+			ReturnCode calcCalibData(const uint16_t* trueDist, const uint16_t* measured, const uint16_t count);	// Calibration table from pairs of true / measured distances
 			void storeCalibData();
-			void restoreCalibData();
+			ReturnCode restoreCalibData();	// aborted: Converted old calibration data, error: No calibration data
 			void resetCalibData();
-			void clearInterrupt();
+			void clearInterrupt();			// Discard the current measurement
 
 		private:
+			// Steps of reading a measurement asynchronously
+			enum class AsyncStep : uint8_t
+			{
+				idle,
+				intStatus,		// Read interrupt status
+				rangeResult,	// Read range
+				intClear		// Clear interrupt
+			};
+
 			const uint8_t _multiplexCh;
+			const uint8_t _interruptPin;	// Pin connected to GPIO1
 			const uint8_t _id;
 
-			// Calibration data
-			float _k = 1.0f;
-			float _d = 0.0f;
+			CalibrationTable _calib;
 
 			VL53L0X _sensor;
 			Status _status;
+
+			// Asynchronous reading
+			AsyncI2C::Transaction _transaction;
+			uint8_t _buffer[2];
+			volatile AsyncStep _step;
+			volatile bool _newDistance;		// Is there a new measurement?
+			volatile bool _discard;			// Discard the current measurement
+			volatile bool _resultRead;		// Has the result of the current measurement been read?
+			volatile uint16_t _rawDistance;
+			volatile uint32_t _timestamp;
+			volatile uint32_t _lastResult;	// Time of the last finished read (for timeout detection)
+			uint32_t _lastUpdate;			// Time of the last update() (for timeout detection)
+			volatile uint32_t _readStart;	// Time the current measurement was ready (us)
+			volatile uint32_t _readTime;
+			volatile bool _dataReady;		// Has GPIO1 signaled a new measurement?
+			volatile uint32_t _readyTime;	// Time the current measurement was ready (ms)
+			volatile uint32_t _sampleCount;	// Measurements since the last resetSampleRate()
+			uint32_t _rateStart;
+			bool _timedOut;
+
+			static void asyncCallback(AsyncI2C::Transaction& transaction);
+			void startStep(AsyncStep step);
+		};
+
+		// Short distance sensors handled by the sensor manager
+		enum class SensorID : uint8_t
+		{
+			frontLeft,
+			frontRight,
+			leftFront,
+			leftBack,
+			rightFront,
+			rightBack
+		};
+
+		// Statistics of a short distance sensor since the last reset
+		struct SensorStats
+		{
+			uint32_t samples;		// Measurements (including overflows / underflows)
+			uint32_t errors;		// Measurements with an error
+			uint32_t timeouts;		// Timeouts
+			uint32_t quarantines;	// How often the sensor was quarantined
+			uint16_t interval;		// Current sampling interval (ms); 0 = every measurement
+			bool quarantined;		// Is the sensor quarantined at the moment?
 		};
 
 		extern VL53L0 frontLeft;	// Front-Left short distance sensor
@@ -177,8 +306,13 @@ namespace JAFD
 
 		ReturnCode setup();
 		ReturnCode reset();
-		void updateDistSensors();
-		void forceNewMeasurement();
+		void interrupt(const Interrupts::InterruptSource source, const uint32_t isr);	// Has to be called by the PIO interrupts
+		void updateDistSensors();		// Start the asynchronous reads and pass the new measurements to the sensor fusion
+		SensorStats getStats(const SensorID sensor);	// Get the statistics of a short distance sensor since the last reset
+		float getUpdateRate();							// Distance updates passed to the sensor fusion per second since the last reset
+		void resetStats();								// Reset the statistics
+		void forceNewMeasurement();		// Discard the current measurements
 		void averagedCalibration();
+		ReturnCode autoCalibration();	// Calibrate the front sensors by driving backwards from a wall (the encoders give the true distance)
 	}
 }
\ No newline at end of file
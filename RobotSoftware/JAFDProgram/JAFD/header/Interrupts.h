@@ -1,5 +1,5 @@
 /*
-In this part are the InterruptSource enums
+In this part are the InterruptSource enums and the timing of the timed loop
 */
 
 #pragma once
@@ -24,5 +24,32 @@ namespace JAFD
 			pioC = ID_PIOC,
 			pioD = ID_PIOD
 		};
+
+		// Stages of the timed loops; a faster stage has a higher priority
+		enum class Stage : uint8_t
+		{
+			speed,			// TC3 (1kHz): Speed estimation and speed PID-Controller
+			fusion,			// TC4 (100Hz): Sensor filtering
+			trajectory		// TC5 (20 - 50Hz): Smooth driving
+		};
+
+		// Statistics of the real time between two calls of a stage and of its run time
+		struct TimingStats
+		{
+			float minDt;			// Minimum dt (s)
+			float maxDt;			// Maximum dt (s)
+			float meanDt;			// Mean dt (s)
+			uint32_t count;			// Number of measured dts
+			uint32_t maxRunTime;	// Longest run (us); includes interruptions by faster stages
+			uint32_t overruns;		// Runs longer than the budget of the stage
+			float cpuShare;			// Portion of the time spent in the stage (0.0 - 1.0); without faster stages, but with other interrupts (ADC, I2C, PIO)
+		};
+
+		void setTimedLoopFreq(const float freq);			// Change the frequency of the trajectory stage (Hz)
+		TimingStats getTimingStats(const Stage stage);		// Get the timing statistics of a stage since the last reset
+		void resetTimingStats();							// Reset the timing statistics of all stages
+
+		// Install an interrupt handler at runtime (e.g. if a library already defines the handler); moves the vector table to the RAM
+		void setInterruptHandler(const IRQn_Type irq, void (*handler)());
 	}
 }
\ No newline at end of file
@@ -0,0 +1,25 @@
+/*
+This part of the library is responsible for the Monte-Carlo re-localization of the robot against the stored map
+*/
+
+#pragma once
+
+#if defined(ARDUINO) && ARDUINO >= 100
+#include "arduino.h"
+#else
+#include "WProgram.h"
+#endif
+
+#include "AllDatatypes.h"
+
+namespace JAFD
+{
+	namespace Localization
+	{
+		void start();									// Spread the particles around the current robot pose and start the localization
+		void stop();									// Stop the localization
+		bool isRunning();								// Is the localization running?
+		void update();									// Move and weight some particles; has to be called regularly in the main loop
+		void getEstimate(Vec3f& position, float& heading, float& spread);	// Mean pose of all particles and their position spread (cm)
+	}
+}
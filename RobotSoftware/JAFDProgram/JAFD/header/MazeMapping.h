@@ -56,7 +56,14 @@ namespace JAFD
 		void getGridCell(uint8_t* bfsValue, const MapCoordinate coor);
 		void getGridCell(GridCell* gridCell, uint8_t* bfsValue, const MapCoordinate coor);
 
-		// Set current cell and recalculate certainty
-		void setCurrentCell(const GridCell gridCell, float& currentCertainty, const float updateCertainty, MapCoordinate coor);
+		// Read / write the log-odds of the four walls of a cell (index = AbsoluteDir)
+		void getWallLogOdds(int8_t* logOdds, const MapCoordinate coor);
+		void setWallLogOdds(const int8_t* logOdds, const MapCoordinate coor);
+
+		// Load a cell and its four neighbours into the cell cache, so reading them doesn't need the SPI bus
+		void cacheCells(const MapCoordinate coor);
+
+		// Update the wall log-odds of the current cell with new observations (index = AbsoluteDir), commit walls and recalculate certainty
+		void setCurrentCell(GridCell& gridCell, float& currentCertainty, const int8_t* wallObservations, const MapCoordinate coor);
 	}
 }
@@ -23,19 +23,28 @@ namespace JAFD
 		// Get more accurate measured velocity
 		FloatWheelSpeeds getFloatSpeeds();
 
-		// Interrupthandler for speed calculation
-		void calcMotorSpeed(const uint8_t freq);
+		// Get desired velocity
+		WheelSpeeds getDesSpeeds();
+
+		// Interrupthandler for speed calculation (dt: real time since the last call)
+		void calcMotorSpeed(const float dt);
 
 		// Interrupthandler for speed PID-Loop
-		void speedPID(const uint8_t freq);
+		void speedPID(const float dt);
 
 		// Interrupthandler for Encoder
 		void encoderInterrupt(const Interrupts::InterruptSource source, const uint32_t isr);
 
+		// Timestamp changes of the quadrature decoder counts for the speed estimation (TC3, every ms; only with USE_TC_QDEC); the timestamps are the poll times
+		void pollEncoders();
+
 		// Set motor speed (cm/2)
 		void setSpeeds(const WheelSpeeds wheelSpeeds);
 
-		// Get the current
+		// Interrupthandler for the ADC (buffer block full)
+		void adcInterrupt();
+
+		// Get the motor current in the on phase of the PWM (A); filtered, doesn't wait for the ADC; last value at small duty cycles
 		float getCurrent(const Motor motor);
 	}
 }
\ No newline at end of file
@@ -0,0 +1,230 @@
+/*
+This part is responsible for robust filters (running median, Hampel filter, trimmed mean) over a fixed window of measurements
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <type_traits>
+
+namespace JAFD
+{
+	enum class RobustFilterType : uint8_t
+	{
+		none,			// Pass the latest value through
+		median,			// Median of the window
+		hampel,			// Latest value; replaced by the median if it is an outlier
+		trimmedMean		// Mean of the window without the smallest and largest values
+	};
+
+	struct RobustFilterSettings
+	{
+		RobustFilterType type;
+		float hampelThreshold;	// Hampel filter: Maximum deviation from the median in standard deviations (estimated by the MAD)
+		uint8_t trim;			// Trimmed mean: Number of values removed at each end
+
+		constexpr RobustFilterSettings(RobustFilterType type, float hampelThreshold = 3.0f, uint8_t trim = 1) : type(type), hampelThreshold(hampelThreshold), trim(trim) {}
+	};
+
+	// Template class for a robust filter over the last N values
+	// The window is also kept sorted: finding a value is O(log N), moving the others O(N) - for the small windows used here cheaper than heaps or trees
+	template<typename T, uint8_t N>
+	class RobustFilter
+	{
+		static_assert(N > 0, "The window of a RobustFilter must not be empty");
+
+	private:
+		static constexpr float _madToSigma = 1.4826f;	// Standard deviation / MAD for normal distributed values
+
+		const RobustFilterSettings _settings;
+		T _window[N];			// Values in order of arrival (ring buffer)
+		T _sorted[N];			// Values in ascending order
+		uint32_t _times[N];		// Timestamps of the values in _window
+		uint8_t _next;			// Index for the next value in _window
+		uint8_t _count;			// Number of values
+		bool _delayed;			// Is the last output taken from the whole window (and not just the latest value)?
+		uint32_t _lastTime;		// Timestamp of the last output
+		bool _hasLastTime;		// Is there a last output with a timestamp?
+
+		// Index of the first sorted value which isn't less than value
+		uint8_t lowerBound(const T value) const
+		{
+			uint8_t low = 0;
+			uint8_t high = _count;
+
+			while (low < high)
+			{
+				const uint8_t mid = (low + high) / 2;
+
+				if (_sorted[mid] < value) low = mid + 1;
+				else high = mid;
+			}
+
+			return low;
+		}
+
+		inline T absDiff(const T a, const T b) const
+		{
+			return a > b ? a - b : b - a;
+		}
+
+		// Timestamp of the value i values before the latest one
+		inline uint32_t timeBefore(const uint8_t i) const
+		{
+			return _times[(_next + 2 * N - 1 - i) % N];
+		}
+
+		// Integer types get rounded, floating point types not
+		static inline T fromFloat(const float value, const std::true_type /* isIntegral */)
+		{
+			return static_cast<T>(value + 0.5f);
+		}
+
+		static inline T fromFloat(const float value, const std::false_type /* isIntegral */)
+		{
+			return static_cast<T>(value);
+		}
+
+	public:
+		RobustFilter(const RobustFilterSettings settings) : _settings(settings), _window(), _sorted(), _times(), _next(0), _count(0), _delayed(false), _lastTime(0), _hasLastTime(false) {}
+
+		// Add a value with its timestamp and get the filtered value; the timestamp is replaced by the one of the filtered value
+		// The median of a window lags behind by half a window -> its timestamp is the one of the middle value (by arrival)
+		// The timestamps never go back (a Hampel filter switches between the latest value and the median), so they can be differentiated
+		T process(const T value, uint32_t& timestamp)
+		{
+			_times[_next] = timestamp;
+
+			const T filtered = process(value);
+
+			if (_delayed)
+			{
+				const uint8_t middle = (_count - 1) / 2;
+
+				if (_count % 2) timestamp = timeBefore(middle);
+				else timestamp = timeBefore(middle) - (timeBefore(middle) - timeBefore(middle + 1)) / 2;
+
+				if (_hasLastTime && static_cast<int32_t>(timestamp - _lastTime) < 0) timestamp = _lastTime;
+			}
+
+			_lastTime = timestamp;
+			_hasLastTime = true;
+
+			return filtered;
+		}
+
+		// Add a value and get the filtered value
+		T process(const T value)
+		{
+			uint8_t i;
+
+			// Remove the oldest value
+			if (_count == N)
+			{
+				i = lowerBound(_window[_next]);
+				_count--;
+
+				for (; i < _count; i++) _sorted[i] = _sorted[i + 1];
+			}
+
+			// Insert the new value
+			const uint8_t pos = lowerBound(value);
+
+			for (i = _count; i > pos; i--) _sorted[i] = _sorted[i - 1];
+
+			_sorted[pos] = value;
+			_count++;
+
+			_window[_next] = value;
+			_next = (_next + 1) % N;
+
+			_delayed = true;
+
+			switch (_settings.type)
+			{
+			case RobustFilterType::median:
+				return median();
+
+			case RobustFilterType::hampel:
+			{
+				const T med = median();
+
+				if (absDiff(value, med) > _settings.hampelThreshold * _madToSigma * medianAbsDeviation()) return med;
+
+				_delayed = false;
+				return value;
+			}
+
+			case RobustFilterType::trimmedMean:
+				return trimmedMean(_settings.trim);
+
+			default:
+				_delayed = false;
+				return value;
+			}
+		}
+
+		// Forget all values
+		void reset()
+		{
+			_next = 0;
+			_count = 0;
+		}
+
+		uint8_t size() const
+		{
+			return _count;
+		}
+
+		T median() const
+		{
+			if (_count == 0) return T();
+
+			if (_count % 2) return _sorted[_count / 2];
+			else return static_cast<T>((_sorted[_count / 2 - 1] + _sorted[_count / 2]) / 2);
+		}
+
+		// Median absolute deviation from the median (lower one of the middle deviations); O(N) by walking outwards from the median
+		T medianAbsDeviation() const
+		{
+			if (_count < 2) return T();
+
+			const T med = median();
+			uint8_t high = lowerBound(med);		// Next value above (or equal to) the median
+			int16_t low = high - 1;				// Next value below the median
+			T deviation = T();
+
+			// The deviations on both sides are sorted -> merge until the middle one
+			for (uint8_t i = 0; i <= (_count - 1) / 2; i++)
+			{
+				if (low < 0 || (high < _count && _sorted[high] - med <= med - _sorted[low]))
+				{
+					deviation = _sorted[high] - med;
+					high++;
+				}
+				else
+				{
+					deviation = med - _sorted[low];
+					low--;
+				}
+			}
+
+			return deviation;
+		}
+
+		// Mean without the trim smallest and trim largest values
+		T trimmedMean(uint8_t trim) const
+		{
+			if (_count == 0) return T();
+
+			// Keep at least one value
+			if (2 * trim >= _count) trim = (_count - 1) / 2;
+
+			float sum = 0.0f;
+
+			for (uint8_t i = trim; i < _count - trim; i++) sum += _sorted[i];
+
+			return fromFloat(sum / (_count - 2 * trim), std::is_integral<T>());
+		}
+	};
+}
@@ -16,12 +16,17 @@ namespace JAFD
 {
 	namespace SensorFusion
 	{
-		void sensorFiltering(const uint8_t freq);					// Apply filter and calculate robot state
-		void untimedFusion();										// Update sensor values
+		void sensorFiltering(const float dt, const float realDt);	// Apply filter and calculate robot state (dt: limited time for integration, realDt: real time for derivatives; in s)
+		bool untimedFusion();										// Update sensor values; false if no input changed since the last call
 		void updateSensors();										// Update all sensors
-		const volatile FusedData& getFusedData();					// Get current robot state
+		void readSnapshot(FusedData& data);							// Get a consistent copy of all fused data
+		RobotState getRobotState();									// Get a consistent copy of the current robot state
+		void readDistances(Distances& distances, DistSensorStates& distSensorStates);	// Get a consistent copy of the distances and their states
+		void readGridCell(GridCell& gridCell, float& gridCellCertainty);				// Get a consistent copy of the current cell and its certainty
 		void setCertainRobotPosition(Vec3f pos, float heading);		// Set a certain robot position and angle
-		void setDistances(Distances distances);
+		float getWheelTrust();										// How much are the wheel measurements trusted at the moment? (0.0 - 1.0)
+		bool isWheelStalled();										// Does a wheel stall at the moment?
+		void setDistances(Distances distances, DistSensTimestamps timestamps);
 		void setDistSensStates(DistSensorStates distSensorStates);
 	}
 }
\ No newline at end of file
@@ -0,0 +1,53 @@
+/*
+This part is responsible for the sequence lock between the stages of the timed loop and the main loop
+*/
+
+#pragma once
+
+#if defined(ARDUINO) && ARDUINO >= 100
+#include "arduino.h"
+#else
+#include "WProgram.h"
+#endif
+
+#include <stdint.h>
+
+namespace JAFD
+{
+	// Sequence counter; odd while a write is in progress.
+	// Writers must not be interrupted by another writer or by a reader (a reader inside an ISR would spin forever), readers retry their copy.
+	class SeqLock
+	{
+	private:
+		volatile uint32_t _seq;
+
+	public:
+		SeqLock() : _seq(0) {}
+
+		inline void beginWrite()
+		{
+			_seq = _seq + 1;
+			__DMB();
+		}
+
+		inline void endWrite()
+		{
+			__DMB();
+			_seq = _seq + 1;
+		}
+
+		// Readers: Retry the copy until no write happened in between
+		inline uint32_t beginRead() const
+		{
+			const uint32_t seq = _seq;
+			__DMB();
+			return seq;
+		}
+
+		inline bool retryRead(const uint32_t seq) const
+		{
+			__DMB();
+			return (seq & 0x1) || seq != _seq;
+		}
+	};
+}
@@ -0,0 +1,43 @@
+/*
+This part is responsible for detecting slipping or stalled wheels and deciding how much the wheel measurements can be trusted
+*/
+
+#pragma once
+
+#include <stdint.h>
+
+#include "AllDatatypes.h"
+
+namespace JAFD
+{
+	// Measurements of one sensorFiltering() cycle used for slip detection
+	struct SlipMeasurement
+	{
+		FloatWheelSpeeds wheelSpeeds;	// Measured wheel speeds (cm/s)
+		WheelSpeeds desSpeeds;			// Desired wheel speeds (cm/s)
+		float leftCurrent;				// Current of the left motor (A)
+		float rightCurrent;				// Current of the right motor (A)
+		float bnoYawVel;				// Yaw velocity measured by the Bno055 (rad/s)
+		bool bnoYawValid;				// Is the Bno055 yaw velocity valid?
+		float bnoForwardAcc;			// Forward acceleration measured by the Bno055 (cm/s^2)
+		float distSensSpeed;			// Speed measured by the distance sensors (cm/s)
+		float distSensSpeedTrust;		// How much can I trust the speed measured by the distance sensors? (0.0 - 1.0)
+	};
+
+	class SlipDetector
+	{
+	private:
+		float trust;					// Current trust of the wheel measurements (0.0 - 1.0)
+		float residual;					// Filtered, normalized difference between wheels and other sensors (1.0 = tolerance)
+		float lastForwardVel;			// Forward velocity of the wheels in the last cycle (cm/s)
+		bool hasLast;					// Is there a last forward velocity?
+		float leftStallTime;			// How long does the left wheel already stall? (s)
+		float rightStallTime;			// How long does the right wheel already stall? (s)
+	public:
+		SlipDetector();
+		float update(const SlipMeasurement& measurement, const float dt, const float realDt);	// Process the measurements of one cycle (dt: limited time, realDt: real time; in s); returns the new trust
+		float getTrust() const;												// How much can I trust the wheel measurements? (0.0 - 1.0)
+		bool isStalled() const;												// Does a wheel stall at the moment?
+		void reset();														// Trust the wheels completely again
+	};
+}
@@ -2,6 +2,7 @@
 
 #include "../../JAFDSettings.h"
 #include "../header/AllDatatypes.h"
+#include "../header/AsyncI2C.h"
 
 #include <malloc.h>
 #include <stdlib.h>
@@ -16,8 +17,33 @@ namespace JAFD
 
 	namespace I2CBus
 	{
+		// Devices which have to be set up again after a bus recovery with a power reset
+		enum class Device : uint8_t
+		{
+			distanceSensors,
+			heatSensor,
+			bno055,
+			colorSensor
+		};
+
+		// Statistics of the non blocking recoveries since the last reset
+		struct RecoveryStats
+		{
+			uint32_t recoveries;	// Finished recoveries
+			uint32_t powerResets;	// Recoveries with a power reset
+			uint32_t maxStepTime;	// Longest step in the TC3 interrupt (us)
+			uint32_t maxDuration;	// Longest time from the start of a recovery until the bus could be used again (us)
+		};
+
 		ReturnCode setup();
-		ReturnCode resetBus();
+		ReturnCode resetBus();											// Reset both buses and set up all devices again (blocking; only during the setup)
+		void startRecovery(const AsyncI2C::Bus bus);					// Start a non blocking recovery of a hanging bus; the bus can't be used until it is finished
+		void recoveryStep();											// Next step of the recovery (called by TC3 every ms)
+		void update();													// Finish a recovery (call regularly)
+		bool isRecovering(const AsyncI2C::Bus bus);						// Is the bus being recovered?
+		bool takeSetupRequest(const Device device);						// Has the device to be set up again since the last call? Set it up before using it
+		RecoveryStats getRecoveryStats();								// Get the statistics since the last reset
+		void resetRecoveryStats();										// Reset the statistics
 	}
 
 	namespace MemWatcher
@@ -27,6 +53,15 @@ namespace JAFD
 		uint32_t getFreeRam();
 	}
 
+	namespace LoopWatcher
+	{
+		void loopDone(const uint32_t loopTime, const bool idle);	// Report a finished iteration of the main loop (loopTime in us); idle = nothing new to calculate
+		float getLoopFreq();										// Iterations of the main loop per second
+		float getIdlePortion();										// Portion of time spent in idle iterations (0.0 - 1.0)
+		float getMuxSwitchesPerLoop();								// I2C multiplexer channel switches per iteration
+		uint32_t getMaxLoopTime();									// Longest iteration in the last second (us)
+	}
+
 	namespace Wait
 	{
 		void delayUnblocking(uint32_t ms);
@@ -21,11 +21,23 @@ namespace JAFD
 			lastEndState
 		};
 
+		// Type of a task; a TaskArray has the type of its current task
+		enum class TaskType : uint8_t
+		{
+			accelerate,
+			straight,
+			stop,
+			rotate,
+			forceSpeed,
+			alignFront
+		};
+
 		class ITask
 		{
 		public:
-			virtual WheelSpeeds updateSpeeds(const uint8_t freq) = 0;	// Update speeds for both wheels
+			virtual WheelSpeeds updateSpeeds(const float dt) = 0;		// Update speeds for both wheels (dt in s)
 			virtual ReturnCode startTask(RobotState startState) = 0;
+			virtual TaskType getType() const = 0;
 			bool isFinished();
 			RobotState getEndState();
 			virtual ~ITask() = default;
@@ -47,7 +59,8 @@ namespace JAFD
 		public:
 			explicit Accelerate(int16_t endSpeeds = 0, float distance = 0.0f);
 			ReturnCode startTask(RobotState startState);
-			WheelSpeeds updateSpeeds(const uint8_t freq);
+			WheelSpeeds updateSpeeds(const float dt);
+			TaskType getType() const;
 		};
 
 		class DriveStraight : public ITask
@@ -60,14 +73,16 @@ namespace JAFD
 		public:
 			explicit DriveStraight(float distance = 0);
 			ReturnCode startTask(RobotState startState);
-			WheelSpeeds updateSpeeds(const uint8_t freq);
+			WheelSpeeds updateSpeeds(const float dt);
+			TaskType getType() const;
 		};
 
 		class Stop : public ITask
 		{
 		public:
 			ReturnCode startTask(RobotState startState);
-			WheelSpeeds updateSpeeds(const uint8_t freq);
+			WheelSpeeds updateSpeeds(const float dt);
+			TaskType getType() const;
 		};
 
 		class Rotate : public ITask
@@ -81,7 +96,8 @@ namespace JAFD
 		public:
 			explicit Rotate(float maxAngularVel = 0, float angle = 0.0f);			// Set angular velocity in rad/s and angle in degree
 			ReturnCode startTask(RobotState startState);
-			WheelSpeeds updateSpeeds(const uint8_t freq);
+			WheelSpeeds updateSpeeds(const float dt);
+			TaskType getType() const;
 		};
 
 		class ForceSpeed : public ITask
@@ -94,7 +110,8 @@ namespace JAFD
 		public:
 			explicit ForceSpeed(int16_t speed = 0, float distance = 0);
 			ReturnCode startTask(RobotState startState);
-			WheelSpeeds updateSpeeds(const uint8_t freq);
+			WheelSpeeds updateSpeeds(const float dt);
+			TaskType getType() const;
 		};
 
 		class AlignFront : public ITask
@@ -104,7 +121,8 @@ namespace JAFD
 		public:
 			explicit AlignFront(uint16_t alignDist = JAFDSettings::SmoothDriving::minAlignDist);
 			ReturnCode startTask(RobotState startState);
-			WheelSpeeds updateSpeeds(const uint8_t freq);
+			WheelSpeeds updateSpeeds(const float dt);
+			TaskType getType() const;
 		};
 
 		class TaskArray : public ITask
@@ -205,12 +223,14 @@ namespace JAFD
 			}
 
 			ReturnCode startTask(RobotState startState);
-			WheelSpeeds updateSpeeds(const uint8_t freq);
+			WheelSpeeds updateSpeeds(const float dt);
+			TaskType getType() const;
 		};
 
-		void updateSpeeds(const uint8_t freq);								// Update speeds for both wheels
+		void updateSpeeds(const float dt);									// Update speeds for both wheels (dt in s)
 
 		bool isTaskFinished();												// Is the current task finished?
+		TaskType getCurrentTaskType();										// Type of the current task
 
 		// Set new Accelerate task
 		template<NewStateType stateType>
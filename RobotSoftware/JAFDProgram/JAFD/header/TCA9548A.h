@@ -16,5 +16,7 @@ namespace JAFD
 		ReturnCode setup();
 		uint8_t getChannel();
 		uint8_t selectChannel(uint8_t channel);
+		void channelSelected(uint8_t channel);	// The channel got selected without selectChannel() (e.g. by AsyncI2C); maxCh = unknown
+		uint32_t getSwitchCount();				// Number of channel switches since the start
 	}
 }
\ No newline at end of file
@@ -0,0 +1,105 @@
+/*
+This part is responsible for parsing the serial frames of the TFMini (header, header, distance, strength, mode, spare, checksum)
+*/
+
+#pragma once
+
+#include <stdint.h>
+
+namespace JAFD
+{
+	// Parser for the byte stream of a TFMini; no hardware access, so it can be called by the USART interrupt
+	class TFMiniParser
+	{
+	public:
+		enum class Result : uint8_t
+		{
+			none,			// Frame not complete yet
+			frame,			// Valid frame received
+			badChecksum		// Frame with a wrong checksum received
+		};
+
+	private:
+		enum class State : uint8_t
+		{
+			header1,	// Waiting for the first header byte
+			header2,	// Waiting for the second header byte
+			data		// Reading the frame
+		};
+
+		static const uint8_t _header = 0x59;
+		static const uint8_t _frameSize = 7;		// Frame without the two header bytes; the last byte is the checksum
+
+		State _state;
+		uint8_t _frame[_frameSize];
+		uint8_t _frameIndex;
+		uint8_t _checksum;
+		uint16_t _distance;		// Distance of the last valid frame (mm)
+
+	public:
+		TFMiniParser() : _state(State::header1), _frame(), _frameIndex(0), _checksum(0), _distance(0) {}
+
+		// Wait for the next header (e.g. after lost bytes)
+		void reset()
+		{
+			_state = State::header1;
+		}
+
+		Result parseByte(const uint8_t byte)
+		{
+			switch (_state)
+			{
+			case State::header1:
+				if (byte == _header) _state = State::header2;
+				break;
+
+			case State::header2:
+				if (byte == _header)
+				{
+					_state = State::data;
+					_frameIndex = 0;
+					_checksum = _header + _header;
+				}
+				else
+				{
+					_state = State::header1;
+				}
+				break;
+
+			case State::data:
+				_frame[_frameIndex++] = byte;
+
+				if (_frameIndex < _frameSize)
+				{
+					// Checksum = lower 8 bits of the sum of all other bytes (including the header)
+					_checksum += byte;
+				}
+				else
+				{
+					_state = State::header1;
+
+					if (_checksum != byte) return Result::badChecksum;
+
+					const uint32_t distance = ((_frame[1] << 8) | _frame[0]) * 10;	// cm to mm
+
+					_distance = distance > UINT16_MAX ? UINT16_MAX : distance;
+
+					return Result::frame;
+				}
+				break;
+
+			default:
+				_state = State::header1;
+				break;
+			}
+
+			return Result::none;
+		}
+
+		// Distance of the last valid frame (mm)
+		uint16_t getDistance() const
+		{
+			return _distance;
+		}
+	};
+}
@@ -0,0 +1,42 @@
+/*
+This part is responsible for detecting wall edges (start / end of a wall) in the measurements of a side distance sensor
+*/
+
+#pragma once
+
+#include <stdint.h>
+
+#include "AllDatatypes.h"
+
+namespace JAFD
+{
+	enum class WallEdgeType : uint8_t
+	{
+		none,		// No edge
+		started,	// Distance got shorter -> a wall starts
+		ended		// Distance got longer -> a wall ends
+	};
+
+	struct WallEdge
+	{
+		WallEdgeType type;
+		uint32_t time;		// Estimated time the sensor passed the edge (in between the two measurements around the jump)
+
+		constexpr WallEdge(WallEdgeType type = WallEdgeType::none, uint32_t time = 0) : type(type), time(time) {}
+	};
+
+	class WallEdgeDetector
+	{
+	private:
+		const uint16_t minDelta;		// Minimum change in distance that corresponds to an edge (mm)
+		uint16_t lastDistance;			// Last accepted distance (mm)
+		uint32_t lastTime;				// Time of the last accepted distance
+		bool hasLast;					// Is there a last distance?
+		WallEdge pendingEdge;			// Edge which needs to be confirmed by the next measurement
+		uint16_t pendingDistance;		// Distance after the pending edge
+	public:
+		WallEdgeDetector(const uint16_t minDelta);
+		WallEdge process(const uint32_t time, const uint16_t distance, const DistSensorStatus status);	// Process a new measurement; returns an edge once it has been confirmed
+		void reset();																					// Forget all measurements
+	};
+}
@@ -0,0 +1,35 @@
+/*
+This part is responsible for fitting a wall line to the hit points of a side distance sensor pair
+*/
+
+#pragma once
+
+#include <stdint.h>
+
+#include "../../JAFDSettings.h"
+
+namespace JAFD
+{
+	// Fitted wall line; "along" is the axis we drive along, "across" the axis perpendicular to it
+	struct WallLine
+	{
+		float slope;			// d(across) / d(along)
+		float slopeVariance;	// Variance of the slope
+		float across;			// Across coordinate of the wall at the requested along coordinate (cm)
+		float acrossVariance;	// Variance of the across coordinate (cm^2)
+	};
+
+	class WallLineEstimator
+	{
+	private:
+		float along[JAFDSettings::SensorFusion::wallLinePoints];	// Along coordinates of the hit points (cm)
+		float across[JAFDSettings::SensorFusion::wallLinePoints];	// Across coordinates of the hit points (cm)
+		uint8_t next;												// Index for the next hit point
+		uint8_t count;												// Number of hit points
+	public:
+		WallLineEstimator();
+		void addPoint(const float alongCoor, const float acrossCoor);	// Add a hit point; restarts the line if the point doesn't belong to the same wall
+		bool fit(const float alongCoor, WallLine& line) const;			// Fit a line to the hit points (least squares); false if there are not enough points
+		void reset();													// Remove all hit points
+	};
+}
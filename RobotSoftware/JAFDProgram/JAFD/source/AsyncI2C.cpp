@@ -0,0 +1,412 @@
+/*
+This part is responsible for interrupt driven, non blocking I2C transactions on Wire (TWI1) and Wire1 (TWI0)
+*/
+
+#include "../header/AsyncI2C.h"
+#include "../header/Interrupts.h"
+#include "../header/TCA9548A.h"
+#include "../../JAFDSettings.h"
+
+namespace JAFD
+{
+	namespace AsyncI2C
+	{
+		namespace
+		{
+			struct BusState
+			{
+				Twi* const twi;												// TWI peripheral
+				const bool hasMultiplexer;									// Is the I2C multiplexer on this bus?
+				Transaction* queue[JAFDSettings::AsyncI2C::queueLength];	// Waiting transactions
+				uint8_t queueHead;											// Index of the next transaction
+				uint8_t queueCount;											// Number of waiting transactions
+				Transaction* volatile active;								// Transaction on the bus
+				uint8_t index;												// Index of the next data byte
+				bool selectingMux;											// Is the multiplexer channel being selected before the transaction?
+				uint8_t muxCh;												// Channel being selected
+				uint8_t lockCount;											// Number of lock() calls without unlock()
+				uint8_t headDeferrals;										// How often the oldest transaction has been passed over
+				uint32_t busyStart;											// Time the current transaction got on the bus (us)
+				uint32_t statsStart;										// Time of the last statistics reset (us)
+				BusStats stats;
+
+				BusState(Twi* twi, bool hasMultiplexer) : twi(twi), hasMultiplexer(hasMultiplexer), queue(), queueHead(0), queueCount(0), active(nullptr), index(0), selectingMux(false), muxCh(0), lockCount(0), headDeferrals(0), busyStart(0), statsStart(0), stats() {}
+			};
+
+			BusState buses[2] = { BusState(TWI1, true), BusState(TWI0, false) };
+
+			inline BusState& getBus(const Bus bus)
+			{
+				return buses[static_cast<uint8_t>(bus)];
+			}
+
+			// Select the multiplexer channel: single byte write to the multiplexer
+			void startMuxSelect(BusState& bus)
+			{
+				bus.selectingMux = true;
+				bus.twi->TWI_MMR = TWI_MMR_DADR(JAFDSettings::DistanceSensors::multiplexerAddr);
+				bus.twi->TWI_THR = 1 << bus.muxCh;
+				bus.twi->TWI_IER = TWI_IER_TXRDY | TWI_IER_NACK | TWI_IER_ARBLST;
+			}
+
+			void startTransfer(BusState& bus)
+			{
+				Transaction& transaction = *bus.active;
+
+				bus.selectingMux = false;
+				bus.index = 0;
+
+				bus.twi->TWI_MMR = TWI_MMR_DADR(transaction.address) | (static_cast<uint32_t>(transaction.regSize) << 8) | (transaction.read ? TWI_MMR_MREAD : 0);
+				bus.twi->TWI_IADR = TWI_IADR_IADR(transaction.reg);
+
+				if (transaction.read)
+				{
+					// A single byte needs START and STOP at once
+					bus.twi->TWI_CR = transaction.length == 1 ? (TWI_CR_START | TWI_CR_STOP) : TWI_CR_START;
+					bus.twi->TWI_IER = TWI_IER_RXRDY | TWI_IER_NACK | TWI_IER_ARBLST;
+				}
+				else
+				{
+					// Writing the first byte starts the transfer
+					bus.twi->TWI_THR = transaction.data[bus.index++];
+					bus.twi->TWI_IER = TWI_IER_TXRDY | TWI_IER_NACK | TWI_IER_ARBLST;
+				}
+			}
+
+			inline bool needsMuxSwitch(const BusState& bus, const Transaction& transaction)
+			{
+				return bus.hasMultiplexer && transaction.muxCh != noMuxCh && transaction.muxCh != I2CMultiplexer::getChannel();
+			}
+
+			// Choose the next transaction: transactions on the current multiplexer channel go first, so all transactions of a channel are grouped
+			uint8_t chooseNext(BusState& bus)
+			{
+				if (!bus.hasMultiplexer || !needsMuxSwitch(bus, *bus.queue[bus.queueHead])) return 0;
+
+				if (bus.headDeferrals < JAFDSettings::AsyncI2C::maxChannelDeferrals)
+				{
+					for (uint8_t i = 1; i < bus.queueCount; i++)
+					{
+						if (!needsMuxSwitch(bus, *bus.queue[(bus.queueHead + i) % JAFDSettings::AsyncI2C::queueLength]))
+						{
+							bus.headDeferrals++;
+							return i;
+						}
+					}
+				}
+
+				return 0;
+			}
+
+			// Start the next waiting transaction (interrupts have to be disabled)
+			void startNext(BusState& bus)
+			{
+				if (bus.active || bus.lockCount > 0 || bus.queueCount == 0) return;
+
+				const uint8_t next = chooseNext(bus);
+
+				bus.active = bus.queue[(bus.queueHead + next) % JAFDSettings::AsyncI2C::queueLength];
+
+				if (next == 0)
+				{
+					bus.queueHead = (bus.queueHead + 1) % JAFDSettings::AsyncI2C::queueLength;
+					bus.headDeferrals = 0;
+				}
+				else
+				{
+					// Close the gap in the queue
+					for (uint8_t i = next; i < bus.queueCount - 1; i++)
+					{
+						bus.queue[(bus.queueHead + i) % JAFDSettings::AsyncI2C::queueLength] = bus.queue[(bus.queueHead + i + 1) % JAFDSettings::AsyncI2C::queueLength];
+					}
+				}
+
+				bus.queueCount--;
+
+				bus.active->state = TransactionState::running;
+				bus.active->startTime = millis();
+				bus.busyStart = micros();
+
+				if (needsMuxSwitch(bus, *bus.active))
+				{
+					bus.stats.muxSwitches++;
+					bus.muxCh = bus.active->muxCh;
+					startMuxSelect(bus);
+				}
+				else
+				{
+					startTransfer(bus);
+				}
+			}
+
+			// Finish the running transaction and start the next one (interrupts have to be disabled)
+			void finish(BusState& bus, const TransactionState state)
+			{
+				Transaction* transaction = bus.active;
+
+				bus.twi->TWI_IDR = ~0UL;
+				bus.active = nullptr;
+
+				bus.stats.transactions++;
+				bus.stats.busyTime += micros() - bus.busyStart;
+
+				if (state == TransactionState::error) bus.stats.errors++;
+				else if (state == TransactionState::timeout) bus.stats.timeouts++;
+
+				// The callback may already submit the next transaction
+				transaction->state = state;
+				if (transaction->callback) transaction->callback(*transaction);
+
+				startNext(bus);
+			}
+
+			void handleInterrupt(BusState& bus)
+			{
+				// Reading the status register clears NACK and ARBLST
+				const uint32_t status = bus.twi->TWI_SR & bus.twi->TWI_IMR;
+
+				if (!bus.active)
+				{
+					bus.twi->TWI_IDR = ~0UL;
+					return;
+				}
+
+				if (status & (TWI_SR_NACK | TWI_SR_ARBLST))
+				{
+					// The multiplexer channel is unknown now
+					if (bus.selectingMux) I2CMultiplexer::channelSelected(I2CMultiplexer::maxCh);
+
+					finish(bus, TransactionState::error);
+					return;
+				}
+
+				Transaction& transaction = *bus.active;
+
+				if (status & TWI_SR_RXRDY)
+				{
+					transaction.data[bus.index++] = bus.twi->TWI_RHR;
+
+					// STOP has to be requested before the last byte is received
+					if (bus.index == transaction.length - 1) bus.twi->TWI_CR = TWI_CR_STOP;
+
+					if (bus.index >= transaction.length)
+					{
+						bus.twi->TWI_IDR = TWI_IDR_RXRDY;
+						bus.twi->TWI_IER = TWI_IER_TXCOMP;
+					}
+				}
+				else if (status & TWI_SR_TXRDY)
+				{
+					if (!bus.selectingMux && bus.index < transaction.length)
+					{
+						bus.twi->TWI_THR = transaction.data[bus.index++];
+					}
+					else
+					{
+						bus.twi->TWI_CR = TWI_CR_STOP;
+						bus.twi->TWI_IDR = TWI_IDR_TXRDY;
+						bus.twi->TWI_IER = TWI_IER_TXCOMP;
+					}
+				}
+				else if (status & TWI_SR_TXCOMP)
+				{
+					bus.twi->TWI_IDR = TWI_IDR_TXCOMP;
+
+					if (bus.selectingMux)
+					{
+						I2CMultiplexer::channelSelected(bus.muxCh);
+						startTransfer(bus);
+					}
+					else
+					{
+						finish(bus, TransactionState::done);
+					}
+				}
+			}
+
+			void twi0Handler()
+			{
+				handleInterrupt(getBus(Bus::wire1));
+			}
+
+			void twi1Handler()
+			{
+				handleInterrupt(getBus(Bus::wire));
+			}
+
+			// Reset the TWI peripheral after a hanging transaction; keeps the clock settings
+			void resetPeripheral(BusState& bus)
+			{
+				const uint32_t clockSettings = bus.twi->TWI_CWGR;
+
+				bus.twi->TWI_IDR = ~0UL;
+				bus.twi->TWI_CR = TWI_CR_SWRST;
+				volatile uint32_t dummy = bus.twi->TWI_RHR;
+				bus.twi->TWI_CR = TWI_CR_MSDIS | TWI_CR_SVDIS;
+				bus.twi->TWI_CWGR = clockSettings;
+				bus.twi->TWI_CR = TWI_CR_MSEN;
+
+				if (bus.hasMultiplexer) I2CMultiplexer::channelSelected(I2CMultiplexer::maxCh);
+			}
+
+			// Abort the running transaction if it took too long (interrupts have to be disabled)
+			void checkTimeout(BusState& bus)
+			{
+				if (!bus.active) return;
+
+				const uint16_t timeout = bus.active->timeout > 0 ? bus.active->timeout : JAFDSettings::AsyncI2C::defaultTimeout;
+
+				if (millis() - bus.active->startTime > timeout)
+				{
+					resetPeripheral(bus);
+					finish(bus, TransactionState::timeout);
+				}
+			}
+		}
+
+		ReturnCode setup()
+		{
+			// Wire / Wire1 already define the TWI handlers for the slave mode
+			Interrupts::setInterruptHandler(TWI0_IRQn, twi0Handler);
+			Interrupts::setInterruptHandler(TWI1_IRQn, twi1Handler);
+
+			TWI0->TWI_IDR = ~0UL;
+			TWI1->TWI_IDR = ~0UL;
+
+			NVIC_SetPriority(TWI0_IRQn, JAFDSettings::AsyncI2C::interruptPriority);
+			NVIC_SetPriority(TWI1_IRQn, JAFDSettings::AsyncI2C::interruptPriority);
+			NVIC_EnableIRQ(TWI0_IRQn);
+			NVIC_EnableIRQ(TWI1_IRQn);
+
+			resetStats(Bus::wire);
+			resetStats(Bus::wire1);
+
+			return ReturnCode::ok;
+		}
+
+		ReturnCode submit(const Bus bus, Transaction& transaction)
+		{
+			BusState& busState = getBus(bus);
+
+			if (transaction.length == 0 || transaction.regSize > 3) return ReturnCode::error;
+
+			// Can be called by a callback, so restore the interrupt state instead of enabling the interrupts
+			const uint32_t primask = __get_PRIMASK();
+			__disable_irq();
+
+			if (busState.queueCount >= JAFDSettings::AsyncI2C::queueLength)
+			{
+				__set_PRIMASK(primask);
+				return ReturnCode::error;
+			}
+
+			transaction.state = TransactionState::queued;
+			busState.queue[(busState.queueHead + busState.queueCount) % JAFDSettings::AsyncI2C::queueLength] = &transaction;
+			busState.queueCount++;
+
+			startNext(busState);
+
+			__set_PRIMASK(primask);
+
+			return ReturnCode::ok;
+		}
+
+		void update()
+		{
+			__disable_irq();
+			checkTimeout(getBus(Bus::wire));
+			checkTimeout(getBus(Bus::wire1));
+			__enable_irq();
+		}
+
+		bool isBusy(const Bus bus)
+		{
+			const BusState& busState = getBus(bus);
+
+			return busState.active || busState.queueCount > 0;
+		}
+
+		void lock(const Bus bus)
+		{
+			BusState& busState = getBus(bus);
+
+			__disable_irq();
+			busState.lockCount++;
+			__enable_irq();
+
+			// Let the running transaction finish
+			while (busState.active)
+			{
+				__disable_irq();
+				checkTimeout(busState);
+				__enable_irq();
+			}
+		}
+
+		void suspend(const Bus bus)
+		{
+			BusState& busState = getBus(bus);
+
+			// Can be called while the interrupts are disabled
+			const uint32_t primask = __get_PRIMASK();
+			__disable_irq();
+
+			busState.lockCount++;
+
+			// Don't wait for a transaction on a hanging bus
+			if (busState.active)
+			{
+				resetPeripheral(busState);
+				finish(busState, TransactionState::error);
+			}
+
+			__set_PRIMASK(primask);
+		}
+
+		void unlock(const Bus bus)
+		{
+			BusState& busState = getBus(bus);
+
+			__disable_irq();
+			if (busState.lockCount > 0) busState.lockCount--;
+			startNext(busState);
+			__enable_irq();
+		}
+
+		BusStats getStats(const Bus bus)
+		{
+			const BusState& busState = getBus(bus);
+
+			__disable_irq();
+			BusStats stats = busState.stats;
+			stats.totalTime = micros() - busState.statsStart;
+			__enable_irq();
+
+			return stats;
+		}
+
+		float getUtilisation(const Bus bus)
+		{
+			const BusStats stats = getStats(bus);
+
+			return stats.totalTime > 0 ? static_cast<float>(stats.busyTime) / stats.totalTime : 0.0f;
+		}
+
+		float getTransactionRate(const Bus bus)
+		{
+			const BusStats stats = getStats(bus);
+
+			return stats.totalTime > 0 ? stats.transactions * 1000000.0f / stats.totalTime : 0.0f;
+		}
+
+		void resetStats(const Bus bus)
+		{
+			BusState& busState = getBus(bus);
+
+			__disable_irq();
+			busState.stats = BusStats();
+			busState.statsStart = micros();
+			__enable_irq();
+		}
+	}
+}
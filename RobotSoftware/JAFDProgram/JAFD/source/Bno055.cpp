@@ -13,6 +13,7 @@ This part of the Library is responsible for the 9 DOF-IMU (BNO055).
 #include "../header/Bno055.h"
 #include "../header/AllDatatypes.h"
 #include "../header/Math.h"
+#include "../header/AsyncI2C.h"
 
 #include <Adafruit_BNO055.h>
 #include <Adafruit_Sensor.h>
@@ -33,6 +34,76 @@ namespace JAFD
 			imu::Quaternion quat;				// tared quaternion
 			imu::Quaternion tareQuat;			// conjugate of quaternion to tare
 
+			// Asynchronous reading of gyroscope, euler angles, quaternion and linear acceleration in one burst
+			constexpr uint8_t i2cAddr = 0x28;
+			constexpr uint8_t burstStartReg = Adafruit_BNO055::BNO055_GYRO_DATA_X_LSB_ADDR;
+			constexpr uint8_t burstLength = Adafruit_BNO055::BNO055_LINEAR_ACCEL_DATA_X_LSB_ADDR + 6 - burstStartReg;
+			constexpr uint8_t quatOffset = Adafruit_BNO055::BNO055_QUATERNION_DATA_W_LSB_ADDR - burstStartReg;
+			constexpr uint8_t linAccOffset = Adafruit_BNO055::BNO055_LINEAR_ACCEL_DATA_X_LSB_ADDR - burstStartReg;
+
+			AsyncI2C::Transaction transaction;
+			uint8_t burstData[burstLength];
+			volatile bool newBurstData = false;
+
+			// Called in interrupt context
+			void burstCallback(AsyncI2C::Transaction& finishedTransaction)
+			{
+				if (finishedTransaction.state == AsyncI2C::TransactionState::done) newBurstData = true;
+			}
+
+			inline int16_t toInt16(const uint8_t* data)
+			{
+				return static_cast<int16_t>(data[0] | (data[1] << 8));
+			}
+
+			// Same scaling as Adafruit_BNO055
+			void takeBurstData()
+			{
+				rotSpeedEvent.type = SENSOR_TYPE_GYROSCOPE;
+				rotSpeedEvent.gyro.x = toInt16(burstData) / 16.0f;				// 1 dps = 16 LSB
+				rotSpeedEvent.gyro.y = toInt16(burstData + 2) / 16.0f;
+				rotSpeedEvent.gyro.z = toInt16(burstData + 4) / 16.0f;
+
+				constexpr float quatScale = 1.0f / (1 << 14);
+				quat = imu::Quaternion(toInt16(burstData + quatOffset) * quatScale, toInt16(burstData + quatOffset + 2) * quatScale, toInt16(burstData + quatOffset + 4) * quatScale, toInt16(burstData + quatOffset + 6) * quatScale) * tareQuat;
+
+				linearAccelEvent.type = SENSOR_TYPE_LINEAR_ACCELERATION;
+				linearAccelEvent.acceleration.x = toInt16(burstData + linAccOffset) / 100.0f;	// 1 m/s^2 = 100 LSB
+				linearAccelEvent.acceleration.y = toInt16(burstData + linAccOffset + 2) / 100.0f;
+				linearAccelEvent.acceleration.z = toInt16(burstData + linAccOffset + 4) / 100.0f;
+			}
+
+			// Non blocking setup after a power reset
+			enum class ResetupStep : uint8_t
+			{
+				idle,
+				booting		// Wait until the Bno055 has booted
+			};
+
+			ResetupStep resetupStep = ResetupStep::idle;
+			uint32_t resetupStart = 0;
+
+			// Blocking access to registers which Adafruit_BNO055 doesn't offer (bus has to be locked)
+			void write8(const uint8_t reg, const uint8_t value)
+			{
+				Wire1.beginTransmission(i2cAddr);
+				Wire1.write(reg);
+				Wire1.write(value);
+				Wire1.endTransmission();
+			}
+
+			// 0 if the Bno055 doesn't answer (e.g. while booting)
+			uint8_t readChipID()
+			{
+				Wire1.beginTransmission(i2cAddr);
+				Wire1.write(Adafruit_BNO055::BNO055_CHIP_ID_ADDR);
+
+				if (Wire1.endTransmission() != 0) return 0;
+				if (Wire1.requestFrom(i2cAddr, (uint8_t)1) != 1) return 0;
+
+				return Wire1.read();
+			}
+
 			// Convert linear motion to the global axis based on the robot start orientation
 			Vec3f toXYZ(Vec3f vec)
 			{
@@ -44,8 +115,12 @@ namespace JAFD
 		{
 			bno055 = Adafruit_BNO055(55, 0x28, &Wire1);
 
+			// The color sensor is read on the same bus
+			AsyncI2C::lock(AsyncI2C::Bus::wire1);
+
 			if (!bno055.begin())
 			{
+				AsyncI2C::unlock(AsyncI2C::Bus::wire1);
 				return ReturnCode::error;
 			}
 
@@ -55,11 +130,67 @@ namespace JAFD
 
 			calibFromRAM();
 
+			AsyncI2C::unlock(AsyncI2C::Bus::wire1);
+
+			transaction.address = i2cAddr;
+			transaction.reg = burstStartReg;
+			transaction.regSize = 1;
+			transaction.data = burstData;
+			transaction.length = burstLength;
+			transaction.read = true;
+			transaction.callback = burstCallback;
+
+			return ReturnCode::ok;
+		}
+
+		// begin() resets the Bno055 again and waits for it to boot (> 1s after a power reset) -> the setup is split up
+		ReturnCode resetup()
+		{
+			if (resetupStep == ResetupStep::idle)
+			{
+				resetupStep = ResetupStep::booting;
+				resetupStart = millis();
+				newBurstData = false;
+
+				return ReturnCode::aborted;
+			}
+
+			const uint32_t bootTime = millis() - resetupStart;
+
+			// Don't access the bus while the Bno055 boots
+			if (bootTime < JAFDSettings::I2CBus::Recovery::bno055BootTime) return ReturnCode::aborted;
+
+			AsyncI2C::lock(AsyncI2C::Bus::wire1);
+
+			if (readChipID() != BNO055_ID)
+			{
+				AsyncI2C::unlock(AsyncI2C::Bus::wire1);
+
+				if (bootTime < JAFDSettings::I2CBus::Recovery::bno055BootTimeout) return ReturnCode::aborted;
+
+				resetupStep = ResetupStep::idle;
+				return ReturnCode::error;
+			}
+
+			// After booting, the Bno055 is in config mode with the default settings
+			write8(Adafruit_BNO055::BNO055_PWR_MODE_ADDR, Adafruit_BNO055::POWER_MODE_NORMAL);
+			write8(Adafruit_BNO055::BNO055_PAGE_ID_ADDR, 0);
+			write8(Adafruit_BNO055::BNO055_SYS_TRIGGER_ADDR, 0x80);		// External crystal
+
+			bno055.setMode(Adafruit_BNO055::OPERATION_MODE_NDOF);
+
+			calibFromRAM();
+
+			AsyncI2C::unlock(AsyncI2C::Bus::wire1);
+
+			resetupStep = ResetupStep::idle;
 			return ReturnCode::ok;
 		}
 
 		ReturnCode calibrate()								// how to calibrate
 		{
+			AsyncI2C::lock(AsyncI2C::Bus::wire1);
+
 			bno055.setMode(bno055.OPERATION_MODE_NDOF_FMC_OFF);
 
 			delay(30);
@@ -100,11 +231,15 @@ namespace JAFD
 			Serial.println("Calibration complete!");
 
 			calibToRAM();
+
+			AsyncI2C::unlock(AsyncI2C::Bus::wire1);
 		}
 
 		void tare()
 		{
+			AsyncI2C::lock(AsyncI2C::Bus::wire1);
 			tareQuat = bno055.getQuat().conjugate();
+			AsyncI2C::unlock(AsyncI2C::Bus::wire1);
 		}
 
 		// Global heading in rad
@@ -112,7 +247,9 @@ namespace JAFD
 		{
 			updateValues();
 
+			AsyncI2C::lock(AsyncI2C::Bus::wire1);
 			auto isQuat = bno055.getQuat();
+			AsyncI2C::unlock(AsyncI2C::Bus::wire1);
 
 			imu::Quaternion shouldQuat;
 			shouldQuat.fromAxisAngle(imu::Vector<3>(0, 1.0f, 0), globalHeading);
@@ -122,11 +259,32 @@ namespace JAFD
 
 		void updateValues()					//gets values from the sensors
 		{
-			bno055.getEvent(&linearAccelEvent, Adafruit_BNO055::VECTOR_LINEARACCEL);
+			if (JAFDSettings::AsyncI2C::parallelBno055)
+			{
+				// Last burst still running -> keep the last values
+				if (transaction.state == AsyncI2C::TransactionState::queued || transaction.state == AsyncI2C::TransactionState::running) return;
 
-			quat = bno055.getQuat() * tareQuat;
+				if (newBurstData)
+				{
+					takeBurstData();
+					newBurstData = false;
+				}
 
-			bno055.getEvent(&rotSpeedEvent, Adafruit_BNO055::VECTOR_GYROSCOPE);
+				// The next burst runs in parallel to the distance sensors on Wire
+				AsyncI2C::submit(AsyncI2C::Bus::wire1, transaction);
+			}
+			else
+			{
+				AsyncI2C::lock(AsyncI2C::Bus::wire1);
+
+				bno055.getEvent(&linearAccelEvent, Adafruit_BNO055::VECTOR_LINEARACCEL);
+
+				quat = bno055.getQuat() * tareQuat;
+
+				bno055.getEvent(&rotSpeedEvent, Adafruit_BNO055::VECTOR_GYROSCOPE);
+
+				AsyncI2C::unlock(AsyncI2C::Bus::wire1);
+			}
 		}
 
 		Vec3f getLinAcc()
@@ -173,7 +331,9 @@ namespace JAFD
 		{
 			adafruit_bno055_offsets_t calib_data;	//Calibration data of bno055 structure
 
+			AsyncI2C::lock(AsyncI2C::Bus::wire1);
 			bno055.getSensorOffsets(calib_data);		//write values in structure calib_data
+			AsyncI2C::unlock(AsyncI2C::Bus::wire1);
 
 			auto accel_offset_x = calib_data.accel_offset_x;
 			auto accel_offset_y = calib_data.accel_offset_y;
@@ -241,7 +401,9 @@ namespace JAFD
 			calib_data.mag_offset_z = (SpiNVSRAM::readByte(JAFDSettings::SpiNVSRAM::bno055StartAddr + 18) << 8) + SpiNVSRAM::readByte(JAFDSettings::SpiNVSRAM::bno055StartAddr + 19);
 			calib_data.mag_radius = (SpiNVSRAM::readByte(JAFDSettings::SpiNVSRAM::bno055StartAddr + 20) << 8) + SpiNVSRAM::readByte(JAFDSettings::SpiNVSRAM::bno055StartAddr + 21);
 
+			AsyncI2C::lock(AsyncI2C::Bus::wire1);
 			bno055.setSensorOffsets(calib_data);	//write values to sensor offsets
+			AsyncI2C::unlock(AsyncI2C::Bus::wire1);
 		}
 	}
 }
\ No newline at end of file
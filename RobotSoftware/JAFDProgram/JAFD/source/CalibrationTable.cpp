@@ -0,0 +1,240 @@
+/*
+This part is responsible for the piecewise linear calibration tables of the distance sensors
+*/
+
+#include <algorithm>
+#include <math.h>
+#include <stdlib.h>
+
+#include "../header/CalibrationTable.h"
+#include "../header/SpiNVSRAM.h"
+
+namespace JAFD
+{
+	namespace
+	{
+		constexpr uint8_t headerSize = 6;	// Version, number of points, start, step
+
+		// Plausible linear k / d data (version 1): k * 100 and d (mm, sign and magnitude)
+		constexpr uint16_t legacyMinK = 50;
+		constexpr uint16_t legacyMaxK = 200;
+		constexpr uint16_t legacyMaxAbsD = 500;
+	}
+
+	CalibrationTable::CalibrationTable()
+	{
+		reset();
+	}
+
+	void CalibrationTable::reset()
+	{
+		_start = 0;
+		_step = 1;
+		_points = 2;
+		_trueDist[0] = 0;
+		_trueDist[1] = 1;
+
+		calcSlopes();
+	}
+
+	void CalibrationTable::calcSlopes()
+	{
+		_invStep = 1.0f / _step;
+
+		for (uint8_t i = 0; i < _points - 1; i++)
+		{
+			_slope[i] = (_trueDist[i + 1] - _trueDist[i]) * _invStep;
+		}
+	}
+
+	ReturnCode CalibrationTable::build(const uint16_t* trueDist, const uint16_t* measured, const uint16_t count)
+	{
+		if (count == 0) return ReturnCode::error;
+
+		uint16_t minMeasured = measured[0];
+		uint16_t maxMeasured = measured[0];
+		float meanTrue = 0.0f;
+		float meanMeasured = 0.0f;
+
+		for (uint16_t i = 0; i < count; i++)
+		{
+			if (measured[i] < minMeasured) minMeasured = measured[i];
+			if (measured[i] > maxMeasured) maxMeasured = measured[i];
+
+			meanTrue += trueDist[i];
+			meanMeasured += measured[i];
+		}
+
+		meanTrue /= count;
+		meanMeasured /= count;
+
+		// Least squares line; used within the segments and where there are no measurements
+		float k = 1.0f;
+
+		if (maxMeasured - minMeasured >= JAFDSettings::DistanceSensors::minCalibDataDiff)
+		{
+			float sumXY = 0.0f;
+			float sumXX = 0.0f;
+
+			for (uint16_t i = 0; i < count; i++)
+			{
+				sumXY += (measured[i] - meanMeasured) * (trueDist[i] - meanTrue);
+				sumXX += (measured[i] - meanMeasured) * (measured[i] - meanMeasured);
+			}
+
+			k = sumXY / sumXX;
+
+			if (k <= 0.0f) k = 1.0f;
+		}
+
+		const float d = meanTrue - k * meanMeasured;
+
+		_start = minMeasured;
+
+		// Too close together for a table -> only correct the offset
+		if (maxMeasured - minMeasured < JAFDSettings::DistanceSensors::minCalibDataDiff)
+		{
+			_points = 2;
+			_step = JAFDSettings::DistanceSensors::minCalibDataDiff;
+		}
+		else
+		{
+			_points = count < _maxPoints ? count : _maxPoints;
+			_step = (maxMeasured - minMeasured + _points - 2) / (_points - 1);
+		}
+
+		for (uint8_t i = 0; i < _points; i++)
+		{
+			const float point = _start + i * _step;
+			float sum = 0.0f;
+			float sumWeights = 0.0f;
+
+			// Average of the neighbouring measurements (triangular weights), moved to the point with the slope of the line
+			for (uint16_t j = 0; j < count; j++)
+			{
+				const float diff = fabsf(measured[j] - point);
+
+				if (diff >= _step) continue;
+
+				const float weight = 1.0f - diff / _step;
+
+				sum += weight * (trueDist[j] - k * (measured[j] - point));
+				sumWeights += weight;
+			}
+
+			if (sumWeights > 0.0f) _trueDist[i] = roundf(sum / sumWeights);
+			else _trueDist[i] = roundf(k * point + d);
+		}
+
+		calcSlopes();
+
+		return ReturnCode::ok;
+	}
+
+	float CalibrationTable::apply(const uint16_t measured) const
+	{
+		const float offset = static_cast<float>(measured) - _start;
+
+		// Segment of the measurement; no search needed because the points are equally spaced
+		const int16_t i = std::min<int16_t>(std::max<int16_t>(offset * _invStep, 0), _points - 2);
+
+		return _trueDist[i] + _slope[i] * (offset - i * _step);
+	}
+
+	void CalibrationTable::store(const uint32_t address) const
+	{
+		uint8_t buffer[JAFDSettings::DistanceSensors::bytesPerCalibData];
+		uint8_t checksum = 0;
+
+		buffer[0] = JAFDSettings::DistanceSensors::calibVersion;
+		buffer[1] = _points;
+		buffer[2] = _start & 0xff;
+		buffer[3] = _start >> 8;
+		buffer[4] = _step & 0xff;
+		buffer[5] = _step >> 8;
+
+		for (uint8_t i = 0; i < _points; i++)
+		{
+			buffer[headerSize + 2 * i] = static_cast<uint16_t>(_trueDist[i]) & 0xff;
+			buffer[headerSize + 2 * i + 1] = static_cast<uint16_t>(_trueDist[i]) >> 8;
+		}
+
+		for (uint8_t i = 0; i < headerSize + 2 * _points; i++) checksum += buffer[i];
+
+		buffer[headerSize + 2 * _points] = checksum;
+
+		SpiNVSRAM::writeStream(address, buffer, headerSize + 2 * _points + 1);
+	}
+
+	ReturnCode CalibrationTable::restore(const uint32_t address, const uint32_t legacyAddress)
+	{
+		uint8_t buffer[JAFDSettings::DistanceSensors::bytesPerCalibData];
+		uint8_t checksum = 0;
+
+		SpiNVSRAM::readStream(address, buffer, headerSize);
+
+		const uint8_t points = buffer[1];
+		const uint16_t step = buffer[4] | (static_cast<uint16_t>(buffer[5]) << 8);
+
+		// Tables of an older version (or no table at all)
+		if (buffer[0] != JAFDSettings::DistanceSensors::calibVersion || points < 2 || points > _maxPoints || step == 0)
+		{
+			return restoreLegacy(legacyAddress);
+		}
+
+		SpiNVSRAM::readStream(address + headerSize, buffer + headerSize, 2 * points + 1);
+
+		for (uint8_t i = 0; i < headerSize + 2 * points; i++) checksum += buffer[i];
+
+		if (checksum != buffer[headerSize + 2 * points])
+		{
+			return restoreLegacy(legacyAddress);
+		}
+
+		_points = points;
+		_start = buffer[2] | (static_cast<uint16_t>(buffer[3]) << 8);
+		_step = step;
+
+		for (uint8_t i = 0; i < _points; i++)
+		{
+			_trueDist[i] = static_cast<int16_t>(buffer[headerSize + 2 * i] | (static_cast<uint16_t>(buffer[headerSize + 2 * i + 1]) << 8));
+		}
+
+		calcSlopes();
+
+		return ReturnCode::ok;
+	}
+
+	ReturnCode CalibrationTable::restoreLegacy(const uint32_t address)
+	{
+		uint8_t buffer[4];
+
+		SpiNVSRAM::readStream(address, buffer, 4);
+
+		const uint16_t k = buffer[0] | (static_cast<uint16_t>(buffer[1]) << 8);
+		const uint16_t storedD = buffer[2] | (static_cast<uint16_t>(buffer[3]) << 8);
+		const int16_t d = (storedD & 0x7fff) * ((storedD >> 15) ? -1 : 1);
+
+		if (k < legacyMinK || k > legacyMaxK || abs(d) > legacyMaxAbsD)
+		{
+			reset();
+			return ReturnCode::error;
+		}
+
+		// true = k / 100 * measured + d as a 2 point table: With a step of 100 mm, both points are exact integers
+		_start = 0;
+		_step = 100;
+		_points = 2;
+		_trueDist[0] = d;
+		_trueDist[1] = d + k;
+
+		calcSlopes();
+
+		return ReturnCode::aborted;
+	}
+
+	uint8_t CalibrationTable::getPoints() const
+	{
+		return _points;
+	}
+}
@@ -8,15 +8,59 @@ This file is responsible for all distance sensors
 #include "../header/SpiNVSRAM.h"
 #include "../header/SensorFusion.h"
 #include "../header/SmallThings.h"
+#include "../header/DuePinMapping.h"
+#include "../header/RobustFilter.h"
+#include "../header/MotorControl.h"
+#include "../header/SmoothDriving.h"
 
 namespace JAFD
 {
 	namespace DistanceSensors
 	{
+		namespace
+		{
+			// Setup GPIO1-Pin / Falling Edge Detection
+			void setupInterruptPin(const uint8_t pin)
+			{
+				const auto interruptPin = PinMapping::MappedPins[pin];
+
+				interruptPin.port->PIO_PER = interruptPin.pin;
+				interruptPin.port->PIO_ODR = interruptPin.pin;
+				interruptPin.port->PIO_PUER = interruptPin.pin;
+				interruptPin.port->PIO_IER = interruptPin.pin;
+				interruptPin.port->PIO_AIMER = interruptPin.pin;
+				interruptPin.port->PIO_ESR = interruptPin.pin;
+				interruptPin.port->PIO_FELLSR = interruptPin.pin;
+			}
+
+			// GPIO1 is active low
+			inline bool interruptPinActive(const uint8_t pin)
+			{
+				const auto interruptPin = PinMapping::MappedPins[pin];
+
+				return !(interruptPin.port->PIO_PDSR & interruptPin.pin);
+			}
+
+			inline bool isInterruptPin(const uint8_t pin, const Interrupts::InterruptSource source, const uint32_t isr)
+			{
+				const auto interruptPin = PinMapping::MappedPins[pin];
+
+				return interruptPin.portID == static_cast<uint8_t>(source) && (isr & interruptPin.pin);
+			}
+		}
+
 		// VL6180 class - begin
-		VL6180::VL6180(uint8_t multiplexCh, uint8_t id) : _multiplexCh(multiplexCh), _status(Status::unknownError), _id(id) {}
+		VL6180::VL6180(uint8_t multiplexCh, uint8_t interruptPin, uint8_t id) : _multiplexCh(multiplexCh), _interruptPin(interruptPin), _status(Status::unknownError), _id(id), _buffer(), _step(AsyncStep::idle), _newDistance(false), _discard(false), _resultRead(false), _rawDistance(0), _rawStatus(0), _timestamp(0), _lastResult(0), _lastUpdate(0), _readStart(0), _readTime(0), _dataReady(false), _readyTime(0), _sampleCount(0), _rateStart(0), _timedOut(false), _restart(false), _restartFailed(false), _stopTime(0), _writeCache(), _writeCacheCount(0)
+		{
+			_transaction.address = _i2cAddr;
+			_transaction.regSize = 2;
+			_transaction.data = _buffer;
+			_transaction.muxCh = multiplexCh;
+			_transaction.callback = asyncCallback;
+			_transaction.context = this;
+		}
 
-		ReturnCode VL6180::setup() const
+		ReturnCode VL6180::setup()
 		{
 			if (I2CMultiplexer::getChannel() != _multiplexCh)
 			{
@@ -30,129 +74,158 @@ namespace JAFD
 				}
 			}
 
+			// All registers are back at their defaults after a reset of the sensor
+			if (read8(_regSysFreshOutOfReset) & 0x01) _writeCacheCount = 0;
+
 			loadSettings();
 
 			write8(_regSysFreshOutOfReset, 0x00);
 
-			return ReturnCode::ok;
-		}
+			// The continuous mode gets (re)started asynchronously by update()
+			_restart = true;
+			_lastResult = millis();
+			_timedOut = false;
 
-		void VL6180::calcCalibData(uint16_t firstTrue, uint16_t firstMeasure, uint16_t secondTrue, uint16_t secondMeasure)
-		{
-			if (abs((int32_t)secondMeasure - firstMeasure) < JAFDSettings::DistanceSensors::minCalibDataDiff)
-			{
-				_k = 1.0f;
-			}
-			else
+			if (JAFDSettings::DistanceSensors::dataReadyInterrupt)
 			{
-				_k = (float)((int32_t)secondTrue - firstTrue) / (float)((int32_t)secondMeasure - firstMeasure);
+				setupInterruptPin(_interruptPin);
 
-				if (_k < 0.0f) _k = 1.0f;
+				// A measurement that is already waiting doesn't cause another edge
+				if (interruptPinActive(_interruptPin))
+				{
+					_readyTime = millis();
+					_dataReady = true;
+				}
 			}
 
-			_d = (int16_t)(((firstTrue - _k * firstMeasure) + (secondTrue - _k * secondMeasure)) / 2.0f);
+			resetSampleRate();
 
-			Serial.println(_k);
-			Serial.println(_d);
+			return ReturnCode::ok;
 		}
 
-		void VL6180::storeCalibData()
+		void VL6180::interrupt(const Interrupts::InterruptSource source, const uint32_t isr)
 		{
-			uint32_t startAddr = JAFDSettings::SpiNVSRAM::distSensStartAddr + JAFDSettings::DistanceSensors::bytesPerCalibData * _id;
+			if (isInterruptPin(_interruptPin, source, isr))
+			{
+				_readyTime = millis();
+				_lastResult = _readyTime;
+				_dataReady = true;
+			}
+		}
 
-			uint16_t storeK = _k * 100.0f;
-			uint16_t storeD = ((uint16_t)(abs(_d)) & 0x7fff) | ((_d < 0) ? 1 << 15 : 0);
+		void VL6180::calcCalibData(uint16_t firstTrue, uint16_t firstMeasure, uint16_t secondTrue, uint16_t secondMeasure)
+		{
+			const uint16_t trueDist[2] = { firstTrue, secondTrue };
+			const uint16_t measured[2] = { firstMeasure, secondMeasure };
 
-			SpiNVSRAM::writeByte(startAddr, storeK & 0xff);
-			SpiNVSRAM::writeByte(startAddr + 1, storeK >> 8);
-			SpiNVSRAM::writeByte(startAddr + 2, storeD & 0xff);
-			SpiNVSRAM::writeByte(startAddr + 3, storeD >> 8);
+			_calib.build(trueDist, measured, 2);
 		}
 
-		void VL6180::restoreCalibData()
+		ReturnCode VL6180::calcCalibData(const uint16_t* trueDist, const uint16_t* measured, const uint16_t count)
 		{
-			uint32_t startAddr = JAFDSettings::SpiNVSRAM::distSensStartAddr + JAFDSettings::DistanceSensors::bytesPerCalibData * _id;
+			return _calib.build(trueDist, measured, count);
+		}
 
-			uint16_t storeK = SpiNVSRAM::readByte(startAddr) | (SpiNVSRAM::readByte(startAddr + 1) << 8);
-			_k = storeK / 100.0f;
+		void VL6180::storeCalibData()
+		{
+			_calib.store(JAFDSettings::SpiNVSRAM::distSensStartAddr + JAFDSettings::DistanceSensors::bytesPerCalibData * _id);
+		}
 
-			uint16_t storeD = SpiNVSRAM::readByte(startAddr + 2) | ((uint16_t)SpiNVSRAM::readByte(startAddr + 3) << 8);
-			_d = (storeD & 0x7fff) * ((storeD >> 15) ? -1 : 1);
+		ReturnCode VL6180::restoreCalibData()
+		{
+			return _calib.restore(JAFDSettings::SpiNVSRAM::distSensStartAddr + JAFDSettings::DistanceSensors::bytesPerCalibData * _id, JAFDSettings::SpiNVSRAM::distSensStartAddr + JAFDSettings::DistanceSensors::legacyBytesPerCalibData * _id);
 		}
 
 		void VL6180::resetCalibData()
 		{
-			_k = 1.0f;
-			_d = 0;
+			_calib.reset();
 		}
 
-		void VL6180::loadSettings() const
+		void VL6180::loadSettings()
 		{
 			if (I2CMultiplexer::getChannel() != _multiplexCh)
 			{
 				I2CMultiplexer::selectChannel(_multiplexCh);
 			}
 
+			// Settings are only written if they changed (see setup())
 			// Private settings from page 24 of app note
-			write8(0x0207, 0x01);
-			write8(0x0208, 0x01);
-			write8(0x0096, 0x00);
-			write8(0x0097, 0xfd);
-			write8(0x00e3, 0x00);
-			write8(0x00e4, 0x04);
-			write8(0x00e5, 0x02);
-			write8(0x00e6, 0x01);
-			write8(0x00e7, 0x03);
-			write8(0x00f5, 0x02);
-			write8(0x00d9, 0x05);
-			write8(0x00db, 0xce);
-			write8(0x00dc, 0x03);
-			write8(0x00dd, 0xf8);
-			write8(0x009f, 0x00);
-			write8(0x00a3, 0x3c);
-			write8(0x00b7, 0x00);
-			write8(0x00bb, 0x3c);
-			write8(0x00b2, 0x09);
-			write8(0x00ca, 0x09);
-			write8(0x0198, 0x01);
-			write8(0x01b0, 0x17);
-			write8(0x01ad, 0x00);
-			write8(0x00ff, 0x05);
-			write8(0x0100, 0x05);
-			write8(0x0199, 0x05);
-			write8(0x01a6, 0x1b);
-			write8(0x01ac, 0x3e);
-			write8(0x01a7, 0x1f);
-			write8(0x0030, 0x00);
+			writeCached8(0x0207, 0x01);
+			writeCached8(0x0208, 0x01);
+			writeCached8(0x0096, 0x00);
+			writeCached8(0x0097, 0xfd);
+			writeCached8(0x00e3, 0x00);
+			writeCached8(0x00e4, 0x04);
+			writeCached8(0x00e5, 0x02);
+			writeCached8(0x00e6, 0x01);
+			writeCached8(0x00e7, 0x03);
+			writeCached8(0x00f5, 0x02);
+			writeCached8(0x00d9, 0x05);
+			writeCached8(0x00db, 0xce);
+			writeCached8(0x00dc, 0x03);
+			writeCached8(0x00dd, 0xf8);
+			writeCached8(0x009f, 0x00);
+			writeCached8(0x00a3, 0x3c);
+			writeCached8(0x00b7, 0x00);
+			writeCached8(0x00bb, 0x3c);
+			writeCached8(0x00b2, 0x09);
+			writeCached8(0x00ca, 0x09);
+			writeCached8(0x0198, 0x01);
+			writeCached8(0x01b0, 0x17);
+			writeCached8(0x01ad, 0x00);
+			writeCached8(0x00ff, 0x05);
+			writeCached8(0x0100, 0x05);
+			writeCached8(0x0199, 0x05);
+			writeCached8(0x01a6, 0x1b);
+			writeCached8(0x01ac, 0x3e);
+			writeCached8(0x01a7, 0x1f);
+			writeCached8(0x0030, 0x00);
 
 			// Recommended : Public registers - See data sheet for more detail
-			write8(0x0011, 0x10);	// Enables polling for New Sample ready
-									// when measurement completes
-			write8(0x010a, 0x28);	// Set the averaging sample period
-									// (compromise between lower noise and
-									// increased execution time)
-			write8(0x003f, 0x46);	// Sets the light and dark gain (upper
-									// nibble). Dark gain should not be
-									// changed.
-			write8(0x0031, 0xFF);	// sets the # of range measurements after
-									// which auto calibration of system is
-									// performed
+			writeCached8(0x0011, 0x10);	// Enables polling for New Sample ready
+										// when measurement completes
+			writeCached8(0x010a, 0x28);	// Set the averaging sample period
+										// (compromise between lower noise and
+										// increased execution time)
+			writeCached8(0x003f, 0x46);	// Sets the light and dark gain (upper
+										// nibble). Dark gain should not be
+										// changed.
+			writeCached8(0x0031, 0xFF);	// sets the # of range measurements after
+										// which auto calibration of system is
+										// performed
 			write8(0x002e, 0x01);	// perform a single temperature calibration
 									// of the ranging sensor
-			write8(0x0014, 0x24);	// Configures interrupt on New Sample
-									// Ready threshold event
+			writeCached8(0x0014, 0x24);	// Configures interrupt on New Sample
+										// Ready threshold event
+
+			// Continuous mode
+			writeCached8(0x001c, 63);		// max convergence time = 63ms
+			writeCached8(0x001b, JAFDSettings::DistanceSensors::vl6180Period / 10 - 1);	// inter measurement period (= value * 10ms + 10ms)
+		}
+
+		void VL6180::writeCached8(uint16_t address, uint8_t data)
+		{
+			for (uint8_t i = 0; i < _writeCacheCount; i++)
+			{
+				if (_writeCache[i].address == address)
+				{
+					if (_writeCache[i].data == data) return;
 
-			// 10 Hz continuos mode
-			write8(0x001c, 63);		// max convergence time = 63ms
-			write8(0x001b, 9);		// inter measurement period = 100ms (= 9 * 10ms + 10ms)
+					write8(address, data);
+					_writeCache[i].data = data;
 
-			// Select single mode (to stop eventual continuous )
-			write8(_regRangeStart, 0x01);
+					return;
+				}
+			}
 
-			delay(100);
+			write8(address, data);
 
-			// Start continuous mode
-			write8(_regRangeStart, 0x03);
+			if (_writeCacheCount < _writeCacheSize)
+			{
+				_writeCache[_writeCacheCount].address = address;
+				_writeCache[_writeCacheCount].data = data;
+				_writeCacheCount++;
+			}
 		}
 
 		// Write 1 byte
@@ -207,56 +280,276 @@ namespace JAFD
 			return data;
 		}
 
-		uint16_t VL6180::getDistance()
+		// Called in interrupt context after each step
+		void VL6180::asyncCallback(AsyncI2C::Transaction& transaction)
 		{
-			uint16_t distance;
+			VL6180& sensor = *static_cast<VL6180*>(transaction.context);
 
-			if (I2CMultiplexer::getChannel() != _multiplexCh)
+			// Failed steps are retried by the next update()
+			if (transaction.state != AsyncI2C::TransactionState::done)
 			{
-				I2CMultiplexer::selectChannel(_multiplexCh);
+				// GPIO1 stays active until the interrupt is cleared -> no new edge
+				sensor._dataReady = true;
+
+				// The sensor doesn't answer -> the next update() starts a bus recovery
+				if (sensor._step == AsyncStep::rangeStop || sensor._step == AsyncStep::rangeStart) sensor._restartFailed = true;
+
+				sensor._resultRead = false;
+				sensor._step = AsyncStep::idle;
+				return;
 			}
 
-			// Poll until data is available
-			auto startMillis = millis();
-			while (!(read8(_regIntStatus) & 0x04))
+			switch (sensor._step)
 			{
-				if (millis() - startMillis > JAFDSettings::DistanceSensors::timeout)
+			case AsyncStep::statusBlock:
+				// With the data ready interrupt, the edge already set the ready time
+				if ((sensor._buffer[_regIntStatus - _regRangeStatus] & 0x04) && !JAFDSettings::DistanceSensors::dataReadyInterrupt)
+				{
+					sensor._readyTime = millis();
+					sensor._lastResult = sensor._readyTime;
+				}
+
+				if (sensor._discard)
+				{
+					sensor._discard = false;
+					sensor.startStep(AsyncStep::intClear);
+				}
+				else if (sensor._buffer[_regIntStatus - _regRangeStatus] & 0x04)
+				{
+					sensor.startStep(AsyncStep::range);
+				}
+				else
+				{
+					sensor._step = AsyncStep::idle;
+				}
+				break;
+
+			case AsyncStep::range:
+				sensor._rawStatus = sensor._buffer[0] >> 4;
+				sensor._rawDistance = sensor._buffer[_regIntStatus - _regRangeStatus];
+				sensor._timestamp = sensor._readyTime;
+				sensor._resultRead = true;
+				sensor.startStep(AsyncStep::intClear);
+				break;
+
+			case AsyncStep::intClear:
+				// Only publish the measurement once the sensor can start the next one
+				if (sensor._resultRead)
 				{
-					// Select single mode (to stop eventual continuous )
-					write8(_regRangeStart, 0x01);
+					sensor._resultRead = false;
+					sensor._readTime = micros() - sensor._readStart;
+					sensor._sampleCount++;
+					sensor._newDistance = true;
+				}
 
-					delay(100);
+				sensor._step = AsyncStep::idle;
+				break;
 
-					// Start continuous mode
-					write8(_regRangeStart, 0x03);
+			case AsyncStep::rangeStop:
+				sensor._stopTime = millis();
+				sensor._step = AsyncStep::stopWait;
+				break;
 
-					if (read8(_regModelID) != 0xB4)
-					{
-						Serial.println("I2C problem");
-						I2CBus::resetBus();
-					}
+			case AsyncStep::rangeStart:
+				// A measurement of the old run may be waiting -> clear the interrupt as well
+				sensor._lastResult = millis();
+				sensor.startStep(AsyncStep::intClear);
+				break;
 
-					Serial.print("to");
-					Serial.print(_id);
+			default:
+				sensor._step = AsyncStep::idle;
+				break;
+			}
+		}
 
-					// Timeout
-					clearInterrupt();
-					_status = Status::timeout;
-					return 0;
-				}
+		void VL6180::startStep(AsyncStep step)
+		{
+			_step = step;
+
+			switch (step)
+			{
+			case AsyncStep::statusBlock:
+				// Error code, ALS status, interrupt status (auto increment)
+				_transaction.reg = _regRangeStatus;
+				_transaction.data = _buffer;
+				_transaction.length = sizeof(_buffer);
+				_transaction.read = true;
+				break;
+
+			case AsyncStep::range:
+				// Overwrites the interrupt status, the error code stays for the result
+				_transaction.reg = _regRangeResult;
+				_transaction.data = _buffer + (_regIntStatus - _regRangeStatus);
+				_transaction.length = 1;
+				_transaction.read = true;
+				break;
+
+			case AsyncStep::intClear:
+				_transaction.reg = _regIntClear;
+				_transaction.data = _buffer;
+				_transaction.length = 1;
+				_transaction.read = false;
+				_buffer[0] = 0x07;
+				break;
+
+			case AsyncStep::rangeStop:
+				_transaction.reg = _regRangeStart;
+				_transaction.data = _buffer;
+				_transaction.length = 1;
+				_transaction.read = false;
+				_buffer[0] = 0x01;
+				break;
+
+			case AsyncStep::rangeStart:
+				_transaction.reg = _regRangeStart;
+				_transaction.data = _buffer;
+				_transaction.length = 1;
+				_transaction.read = false;
+				_buffer[0] = 0x03;
+				break;
+
+			default:
+				_step = AsyncStep::idle;
+				return;
+			}
+
+			if (AsyncI2C::submit(AsyncI2C::Bus::wire, _transaction) != ReturnCode::ok)
+			{
+				// Try the restart again with the next update()
+				if (step == AsyncStep::rangeStop || step == AsyncStep::rangeStart) _restart = true;
+
+				_step = AsyncStep::idle;
+			}
+		}
+
+		void VL6180::update()
+		{
+			// Restart: Stop the continuous mode, wait until the sensor stopped, start it again
+			if (_step == AsyncStep::stopWait)
+			{
+				if (millis() - _stopTime >= JAFDSettings::DistanceSensors::vl6180StopTime) startStep(AsyncStep::rangeStart);
+				return;
+			}
+
+			if (_step != AsyncStep::idle) return;
+
+			if (_restartFailed)
+			{
+				Serial.println("I2C problem");
+
+				// The sensor is set up again after a power reset of the bus
+				_restartFailed = false;
+				_restart = true;
+				_lastResult = millis();
+				I2CBus::startRecovery(AsyncI2C::Bus::wire);
+				return;
+			}
+
+			if (_restart)
+			{
+				_restart = false;
+				_lastResult = millis();
+				startStep(AsyncStep::rangeStop);
+				return;
+			}
+
+			// The sensor manager may pause the sampling for longer than the timeout - the timeout only runs while the sensor gets updated
+			if (millis() - _lastUpdate > JAFDSettings::DistanceSensors::timeout) _lastResult = millis();
+
+			_lastUpdate = millis();
+
+			if (millis() - _lastResult > JAFDSettings::DistanceSensors::timeout)
+			{
+				Serial.print("to");
+				Serial.println(_id);
+
+				__disable_irq();
+				_timedOut = true;
+				_newDistance = true;
+				_timestamp = millis();
+				_lastResult = millis();
+				__enable_irq();
+
+				// Clearing the interrupt rearms GPIO1; restarting the sensor is up to the sensor manager
+				startStep(AsyncStep::intClear);
+				return;
+			}
+
+			// With the data ready interrupt, only access the bus if there is a new measurement
+			if (JAFDSettings::DistanceSensors::dataReadyInterrupt)
+			{
+				if (!_dataReady) return;
+
+				_dataReady = false;
+			}
+
+			_readStart = micros();
+			startStep(AsyncStep::statusBlock);
+		}
+
+		// Restart the continuous mode after a timeout; the steps are done by update() without blocking
+		void VL6180::recover()
+		{
+			_restart = true;
+			_lastResult = millis();
+		}
+
+		bool VL6180::hasNewDistance() const
+		{
+			return _newDistance;
+		}
+
+		uint32_t VL6180::getReadTime() const
+		{
+			return _readTime;
+		}
+
+		uint32_t VL6180::getTimestamp() const
+		{
+			return _timestamp;
+		}
+
+		float VL6180::getSampleRate() const
+		{
+			const uint32_t time = millis() - _rateStart;
+
+			if (time == 0) return 0.0f;
+
+			return _sampleCount * 1000.0f / time;
+		}
+
+		void VL6180::resetSampleRate()
+		{
+			__disable_irq();
+			_sampleCount = 0;
+			_rateStart = millis();
+			__enable_irq();
+		}
+
+		uint16_t VL6180::getDistance()
+		{
+			uint16_t distance;
+
+			__disable_irq();
+			const uint8_t rawDistance = _rawDistance;
+			const uint8_t rawStatus = _rawStatus;
+			_newDistance = false;
+			__enable_irq();
+
+			if (_timedOut)
+			{
+				_timedOut = false;
+				_status = Status::timeout;
+				return 0;
 			}
 
-			// Read range in mm
-			float tempDist = read8(_regRangeResult) * _k + _d;
+			// Range in mm
+			float tempDist = _calib.apply(rawDistance);
 
 			if (tempDist < 0.0f) distance = 0;
 			else distance = (uint16_t)roundf(tempDist);
 
-			// Clear interrupt
-			clearInterrupt();
-
-			// Read status
-			_status = static_cast<Status>(read8(_regRangeStatus) >> 4);
+			_status = static_cast<Status>(rawStatus);
 
 			if (_status == Status::noError || _status == Status::eceFailure || _status == Status::noiseError)
 			{
@@ -277,13 +570,11 @@ namespace JAFD
 
 		void VL6180::clearInterrupt()
 		{
-			if (I2CMultiplexer::getChannel() != _multiplexCh)
-			{
-				I2CMultiplexer::selectChannel(_multiplexCh);
-			}
-
-			// Clear interrupt
-			write8(_regIntClear, 0x07);
+			// The interrupt gets cleared by the next asynchronous read
+			__disable_irq();
+			_newDistance = false;
+			_discard = true;
+			__enable_irq();
 		}
 
 		VL6180::Status VL6180::getStatus() const
@@ -295,229 +586,203 @@ namespace JAFD
 
 		// TFMini class - begin
 
-		TFMini::TFMini(SerialType serialType, uint8_t id) : _serialType(serialType), _status(Status::noError), _distance(0), _id(id) {}
+		namespace
+		{
+			TFMini* usartTFMini[3] = { nullptr, nullptr, nullptr };	// TFMini on USART0 / USART1 / USART3
+
+			void usart0Handler()
+			{
+				usartTFMini[0]->interrupt();
+			}
+
+			void usart1Handler()
+			{
+				usartTFMini[1]->interrupt();
+			}
+
+			void usart3Handler()
+			{
+				usartTFMini[2]->interrupt();
+			}
+		}
+
+		TFMini::TFMini(SerialType serialType, uint8_t id) : _serialType(serialType), _usart(nullptr), _status(Status::noError), _id(id), _parser(), _rawDistance(0), _timestamp(0), _newDistance(false), _timedOut(false), _badChecksums(0) {}
 
 		ReturnCode TFMini::setup()
 		{
+			IRQn_Type irq;
+			void (*handler)();
+
 			switch (_serialType)
 			{
-			case JAFD::SerialType::zero:
-				Serial.begin(_baudrate);
-				_streamPtr = &Serial;
-				break;
-
 			case JAFD::SerialType::one:
 				Serial1.begin(_baudrate);
-				_streamPtr = &Serial1;
+				_usart = USART0;
+				usartTFMini[0] = this;
+				irq = USART0_IRQn;
+				handler = usart0Handler;
 				break;
 
 			case JAFD::SerialType::two:
 				Serial2.begin(_baudrate);
-				_streamPtr = &Serial2;
+				_usart = USART1;
+				usartTFMini[1] = this;
+				irq = USART1_IRQn;
+				handler = usart1Handler;
 				break;
 
 			case JAFD::SerialType::three:
 				Serial3.begin(_baudrate);
-				_streamPtr = &Serial3;
+				_usart = USART3;
+				usartTFMini[2] = this;
+				irq = USART3_IRQn;
+				handler = usart3Handler;
 				break;
 
 			default:
+				// Serial (UART) is needed for debugging
 				return ReturnCode::error;
 			}
 
-			delay(100);
+			_parser.reset();
+			_newDistance = false;
+			_timedOut = false;
+
+			// Parse the bytes directly in the interrupt instead of the ring buffer of the Arduino core
+			Interrupts::setInterruptHandler(irq, handler);
+
+			_usart->US_IDR = ~0UL;
+			_usart->US_IER = US_IER_RXRDY | US_IER_OVRE | US_IER_FRAME;
 
-			uint8_t numCharsRead = 0;
-			uint8_t lastChar = 0x00;
+			// Wait for the first valid frame
 			auto startMillis = millis();
 
-			while (true)
+			while (!_newDistance)
 			{
 				if (millis() - startMillis > JAFDSettings::DistanceSensors::timeout)
 				{
 					return ReturnCode::error;
 				}
-
-				if (_streamPtr->available())
-				{
-					uint8_t curChar = _streamPtr->read();
-
-					if ((lastChar == 0x59) && (curChar == 0x59))
-					{
-						// Header start
-						break;
-					}
-					else
-					{
-						// Continue reading
-						lastChar = curChar;
-						numCharsRead += 1;
-					}
-				}
-
-				if (numCharsRead > _maxBytesBeforeHeader)
-				{
-					return ReturnCode::error;
-				}
 			}
 
 			return ReturnCode::ok;
 		}
 
-		TFMini::Status TFMini::takeMeasurement()
+		void TFMini::interrupt()
 		{
-			uint8_t numCharsRead = 0;
-			uint8_t lastChar = 0x00;
+			const uint32_t status = _usart->US_CSR;
 
-			// Read the serial stream until we see the beginning of the TF Mini header, or we timeout reading too many characters.
-			auto startMillis = millis();
-			while (1)
+			if (status & (US_CSR_OVRE | US_CSR_FRAME))
 			{
-				if (millis() - startMillis > JAFDSettings::DistanceSensors::timeout / _maxMeasurementTries)
-				{
-					_distance = 0;
-					_status = Status::noSerialHeader;
-					return _status;
-				}
-
-				if (_streamPtr->available())
-				{
-					uint8_t curChar = _streamPtr->read();
-
-					if ((lastChar == 0x59) && (curChar == 0x59))
-					{
-						// Header start
-						break;
-					}
-					else
-					{
-						// Continue reading
-						lastChar = curChar;
-						numCharsRead += 1;
-					}
-				}
-
-				// Error detection:  If we read more than X characters without finding a frame header, then it's likely there is an issue with 
-				// the Serial connection, and we should timeout and throw an error. 
-				if (numCharsRead > _maxBytesBeforeHeader)
-				{
-					_status = Status::noSerialHeader;
-					return _status;
-				}
+				// Bytes got lost -> wait for the next header
+				_usart->US_CR = US_CR_RSTSTA;
+				_parser.reset();
 			}
 
-			// Read one frame from the TFMini
-			uint8_t frame[_frameSize];
-
-			uint8_t checksum = 0x59 + 0x59;
-
-			for (int i = 0; i < _frameSize; i++)
+			if (status & US_CSR_RXRDY)
 			{
-				// Whait for character
-				while (!_streamPtr->available());
-
-				// Read character
-				frame[i] = _streamPtr->read();
-
-				// Store running checksum
-				if (i < _frameSize - 2) {
-					checksum += frame[i];
+				switch (_parser.parseByte(_usart->US_RHR))
+				{
+				case TFMiniParser::Result::frame:
+					_rawDistance = _parser.getDistance();
+					_timestamp = millis();
+					_timedOut = false;
+					_newDistance = true;
+					break;
+
+				case TFMiniParser::Result::badChecksum:
+					_badChecksums++;
+					break;
+
+				default:
+					break;
 				}
 			}
+		}
 
-			// Compare checksum
-			// Last byte in the frame is an 8-bit checksum 
-			if (checksum != frame[_frameSize - 1])
+		void TFMini::update()
+		{
+			__disable_irq();
+
+			if (millis() - _timestamp > JAFDSettings::DistanceSensors::timeout)
 			{
-				_status = Status::badChecksum;
-				return _status;
+				_timedOut = true;
+				_newDistance = true;
+				_timestamp = millis();
 			}
 
-			// Interpret frame
-			uint16_t st = (frame[3] << 8) + frame[2];
+			__enable_irq();
+		}
 
-			_distance = ((frame[1] << 8) + frame[0]) * 10;		// cm to mm
+		bool TFMini::hasNewDistance() const
+		{
+			return _newDistance;
+		}
 
-			// Return success
-			_status = Status::noError;
+		uint32_t TFMini::getTimestamp() const
+		{
+			return _timestamp;
+		}
 
-			return _status;
+		uint32_t TFMini::getBadChecksums() const
+		{
+			return _badChecksums;
 		}
 
 		uint16_t TFMini::getDistance()
 		{
-			uint8_t numMeasurementAttempts = 0;
+			__disable_irq();
+			uint16_t distance = _rawDistance;
+			const bool timedOut = _timedOut;
+			_newDistance = false;
+			_timedOut = false;
+			__enable_irq();
 
-			do
+			if (timedOut)
 			{
-				numMeasurementAttempts++;
-
-				if (numMeasurementAttempts > _maxMeasurementTries)
-				{
-					clearSerialBuffer();
-					return 0;
-				}
-
-				takeMeasurement();
-			} while (_status != Status::noError);
+				_status = Status::noSerialHeader;
+				return 0;
+			}
 
-			clearSerialBuffer();
+			float tempDist = _calib.apply(distance);
 
-			float tempDist = _distance * _k + _d;
+			if (tempDist < 0.0f) distance = 0;
+			else distance = (uint16_t)roundf(tempDist);
 
-			if (tempDist < 0.0f) _distance = 0;
-			else _distance = (uint16_t)roundf(tempDist);
+			_status = Status::noError;
 
-			if (_distance >= maxDist) _status = Status::overflow;
-			else if (_distance <= minDist) _status = Status::underflow;
+			if (distance >= maxDist) _status = Status::overflow;
+			else if (distance <= minDist) _status = Status::underflow;
 
-			return _distance;
+			return distance;
 		}
 
 		void TFMini::calcCalibData(uint16_t firstTrue, uint16_t firstMeasure, uint16_t secondTrue, uint16_t secondMeasure)
 		{
-			if (abs((int32_t)secondMeasure - firstMeasure) < JAFDSettings::DistanceSensors::minCalibDataDiff)
-			{
-				_k = 1.0f;
-			}
-			else
-			{
-				_k = (float)((int32_t)secondTrue - firstTrue) / (float)((int32_t)secondMeasure - firstMeasure);
+			const uint16_t trueDist[2] = { firstTrue, secondTrue };
+			const uint16_t measured[2] = { firstMeasure, secondMeasure };
 
-				if (_k < 0.0f) _k = 1.0f;
-			}
+			_calib.build(trueDist, measured, 2);
+		}
 
-			_d = (int16_t)(((firstTrue - _k * firstMeasure) + (secondTrue - _k * secondMeasure)) / 2.0f);
+		ReturnCode TFMini::calcCalibData(const uint16_t* trueDist, const uint16_t* measured, const uint16_t count)
+		{
+			return _calib.build(trueDist, measured, count);
 		}
 
 		void TFMini::storeCalibData()
 		{
-			uint32_t startAddr = JAFDSettings::SpiNVSRAM::distSensStartAddr + JAFDSettings::DistanceSensors::bytesPerCalibData * _id;
-
-			uint16_t storeK = _k * 100.0f;
-			uint16_t storeD = ((uint16_t)(abs(_d)) & 0x7fff) | ((_d < 0) ? 1 << 15 : 0);
-
-			SpiNVSRAM::writeByte(startAddr, storeK & 0xff);
-			SpiNVSRAM::writeByte(startAddr + 1, storeK >> 8);
-			SpiNVSRAM::writeByte(startAddr + 2, storeD & 0xff);
-			SpiNVSRAM::writeByte(startAddr + 3, storeD >> 8);
+			_calib.store(JAFDSettings::SpiNVSRAM::distSensStartAddr + JAFDSettings::DistanceSensors::bytesPerCalibData * _id);
 		}
 
-		void TFMini::restoreCalibData()
+		ReturnCode TFMini::restoreCalibData()
 		{
-			uint32_t startAddr = JAFDSettings::SpiNVSRAM::distSensStartAddr + JAFDSettings::DistanceSensors::bytesPerCalibData * _id;
-
-			uint16_t storeK = SpiNVSRAM::readByte(startAddr) | (SpiNVSRAM::readByte(startAddr + 1) << 8);
-			_k = storeK / 100.0f;
-
-			uint16_t storeD = SpiNVSRAM::readByte(startAddr + 2) | ((uint16_t)SpiNVSRAM::readByte(startAddr + 3) << 8);
-			_d = (storeD & 0x7fff) * ((storeD >> 15) ? -1 : 1);
+			return _calib.restore(JAFDSettings::SpiNVSRAM::distSensStartAddr + JAFDSettings::DistanceSensors::bytesPerCalibData * _id, JAFDSettings::SpiNVSRAM::distSensStartAddr + JAFDSettings::DistanceSensors::legacyBytesPerCalibData * _id);
 		}
 
 		void TFMini::resetCalibData()
 		{
-			_k = 1.0f;
-			_d = 0;
+			_calib.reset();
 		}
 
 		TFMini::Status TFMini::getStatus() const
@@ -525,16 +790,18 @@ namespace JAFD
 			return _status;
 		}
 
-		void TFMini::clearSerialBuffer()
-		{
-			while (_streamPtr->available()) volatile auto temp = _streamPtr->read();
-		}
-
 		// TFMini class - end
 
 		// VL53L0 class - begin
 
-		VL53L0::VL53L0(uint8_t multiplexCh, uint8_t id) : _multiplexCh(multiplexCh), _status(Status::undefinedError), _id(id) {}
+		VL53L0::VL53L0(uint8_t multiplexCh, uint8_t interruptPin, uint8_t id) : _multiplexCh(multiplexCh), _interruptPin(interruptPin), _status(Status::undefinedError), _id(id), _buffer(), _step(AsyncStep::idle), _newDistance(false), _discard(false), _resultRead(false), _rawDistance(0), _timestamp(0), _lastResult(0), _lastUpdate(0), _readStart(0), _readTime(0), _dataReady(false), _readyTime(0), _sampleCount(0), _rateStart(0), _timedOut(false)
+		{
+			_transaction.regSize = 1;
+			_transaction.data = _buffer;
+			_transaction.muxCh = multiplexCh;
+			_transaction.callback = asyncCallback;
+			_transaction.context = this;
+		}
 
 		ReturnCode VL53L0::setup()
 		{
@@ -548,516 +815,702 @@ namespace JAFD
 
 			_sensor.startContinuous();
 
-			return ReturnCode::ok;
-		}
+			_transaction.address = _sensor.getAddress();
+			_lastResult = millis();
+			_timedOut = false;
 
-		uint16_t VL53L0::getDistance()
-		{
-			if (I2CMultiplexer::getChannel() != _multiplexCh)
+			if (JAFDSettings::DistanceSensors::dataReadyInterrupt)
 			{
-				I2CMultiplexer::selectChannel(_multiplexCh);
-			}
-
-			uint16_t distance = _sensor.readRangeContinuousMillimeters();
+				setupInterruptPin(_interruptPin);
 
-			float tempDist = distance * _k + _d;
+				// A measurement that is already waiting doesn't cause another edge
+				if (interruptPinActive(_interruptPin))
+				{
+					_readyTime = millis();
+					_dataReady = true;
+				}
+			}
 
-			if (tempDist < 0.0f) distance = 0;
-			else distance = (uint16_t)roundf(tempDist);
+			resetSampleRate();
 
-			_status = Status::noError;
+			return ReturnCode::ok;
+		}
 
-			if (_sensor.timeoutOccurred())
+		void VL53L0::interrupt(const Interrupts::InterruptSource source, const uint32_t isr)
+		{
+			if (isInterruptPin(_interruptPin, source, isr))
 			{
-				Serial.print("to");
-				Serial.println(_id);
-				_status = Status::timeOut;
-				I2CBus::resetBus();
+				_readyTime = millis();
+				_lastResult = _readyTime;
+				_dataReady = true;
 			}
-			else
+		}
+
+		// Called in interrupt context after each step
+		void VL53L0::asyncCallback(AsyncI2C::Transaction& transaction)
+		{
+			VL53L0& sensor = *static_cast<VL53L0*>(transaction.context);
+
+			// Failed steps are retried by the next update()
+			if (transaction.state != AsyncI2C::TransactionState::done)
 			{
-				if (distance > maxDist) _status = Status::overflow;
-				else if (distance < minDist) _status = Status::underflow;
+				// GPIO1 stays active until the interrupt is cleared -> no new edge
+				if (sensor._step != AsyncStep::intStatus) sensor._dataReady = true;
+
+				sensor._resultRead = false;
+				sensor._step = AsyncStep::idle;
+				return;
 			}
 
-			return distance;
+			switch (sensor._step)
+			{
+			case AsyncStep::intStatus:
+				if (sensor._buffer[0] & 0x07)
+				{
+					sensor._readyTime = millis();
+					sensor._lastResult = sensor._readyTime;
+				}
+
+				if (sensor._discard)
+				{
+					sensor._discard = false;
+					sensor.startStep(AsyncStep::intClear);
+				}
+				else if (sensor._buffer[0] & 0x07)
+				{
+					sensor._readStart = micros();
+					sensor.startStep(AsyncStep::rangeResult);
+				}
+				else
+				{
+					sensor._step = AsyncStep::idle;
+				}
+				break;
+
+			case AsyncStep::rangeResult:
+				sensor._rawDistance = (static_cast<uint16_t>(sensor._buffer[0]) << 8) | sensor._buffer[1];
+				sensor._timestamp = sensor._readyTime;
+				sensor._resultRead = true;
+				sensor.startStep(AsyncStep::intClear);
+				break;
+
+			case AsyncStep::intClear:
+				// Only publish the measurement once the sensor can start the next one
+				if (sensor._resultRead)
+				{
+					sensor._resultRead = false;
+					sensor._readTime = micros() - sensor._readStart;
+					sensor._sampleCount++;
+					sensor._newDistance = true;
+				}
+
+				sensor._step = AsyncStep::idle;
+				break;
+
+			default:
+				sensor._step = AsyncStep::idle;
+				break;
+			}
 		}
 
-		void VL53L0::clearInterrupt()
+		void VL53L0::startStep(AsyncStep step)
 		{
-			if (I2CMultiplexer::getChannel() != _multiplexCh)
+			_step = step;
+
+			switch (step)
 			{
-				I2CMultiplexer::selectChannel(_multiplexCh);
+			case AsyncStep::intStatus:
+				_transaction.reg = VL53L0X::RESULT_INTERRUPT_STATUS;
+				_transaction.length = 1;
+				_transaction.read = true;
+				break;
+
+			case AsyncStep::rangeResult:
+				// Same register as used by VL53L0X::readRangeContinuousMillimeters()
+				_transaction.reg = VL53L0X::RESULT_RANGE_STATUS + 10;
+				_transaction.length = 2;
+				_transaction.read = true;
+				break;
+
+			case AsyncStep::intClear:
+				_transaction.reg = VL53L0X::SYSTEM_INTERRUPT_CLEAR;
+				_transaction.length = 1;
+				_transaction.read = false;
+				_buffer[0] = 0x01;
+				break;
+
+			default:
+				_step = AsyncStep::idle;
+				return;
 			}
 
-			_sensor.writeReg(_sensor.SYSTEM_INTERRUPT_CLEAR, 0x01);
+			if (AsyncI2C::submit(AsyncI2C::Bus::wire, _transaction) != ReturnCode::ok) _step = AsyncStep::idle;
 		}
 
-		void VL53L0::calcCalibData(uint16_t firstTrue, uint16_t firstMeasure, uint16_t secondTrue, uint16_t secondMeasure)
+		void VL53L0::update()
 		{
-			if (abs((int32_t)secondMeasure - firstMeasure) < JAFDSettings::DistanceSensors::minCalibDataDiff)
+			if (_step != AsyncStep::idle) return;
+
+			// The sensor manager may pause the sampling for longer than the timeout - the timeout only runs while the sensor gets updated
+			if (millis() - _lastUpdate > JAFDSettings::DistanceSensors::timeout) _lastResult = millis();
+
+			_lastUpdate = millis();
+
+			if (millis() - _lastResult > JAFDSettings::DistanceSensors::timeout)
 			{
-				_k = 1.0f;
+				Serial.print("to");
+				Serial.println(_id);
+
+				__disable_irq();
+				_timedOut = true;
+				_newDistance = true;
+				_timestamp = millis();
+				_lastResult = millis();
+				__enable_irq();
+
+				// Clearing the interrupt rearms GPIO1; resetting the bus is up to the sensor manager
+				startStep(AsyncStep::intClear);
+				return;
 			}
-			else
-			{
-				_k = (float)((int32_t)secondTrue - firstTrue) / (float)((int32_t)secondMeasure - firstMeasure);
 
-				if (_k < 0.0f) _k = 1.0f;
+			if (!JAFDSettings::DistanceSensors::dataReadyInterrupt)
+			{
+				startStep(AsyncStep::intStatus);
+				return;
 			}
 
-			_d = (int16_t)(((firstTrue - _k * firstMeasure) + (secondTrue - _k * secondMeasure)) / 2.0f);
+			// Only access the bus if there is a new measurement
+			if (!_dataReady) return;
 
-			Serial.println(_k);
-			Serial.println(_d);
+			_dataReady = false;
+
+			if (_discard)
+			{
+				_discard = false;
+				startStep(AsyncStep::intClear);
+			}
+			else
+			{
+				_readStart = micros();
+				startStep(AsyncStep::rangeResult);
+			}
 		}
 
-		void VL53L0::storeCalibData()
+		// Recover the bus after a timeout; the other sensors and the control loop keep running meanwhile
+		void VL53L0::recover()
 		{
-			uint32_t startAddr = JAFDSettings::SpiNVSRAM::distSensStartAddr + JAFDSettings::DistanceSensors::bytesPerCalibData * _id;
+			I2CBus::startRecovery(AsyncI2C::Bus::wire);
 
-			uint16_t storeK = _k * 100.0f;
-			uint16_t storeD = ((uint16_t)(abs(_d)) & 0x7fff) | ((_d < 0) ? 1 << 15 : 0);
-
-			SpiNVSRAM::writeByte(startAddr, storeK & 0xff);
-			SpiNVSRAM::writeByte(startAddr + 1, storeK >> 8);
-			SpiNVSRAM::writeByte(startAddr + 2, storeD & 0xff);
-			SpiNVSRAM::writeByte(startAddr + 3, storeD >> 8);
+			_lastResult = millis();
 		}
 
-		void VL53L0::restoreCalibData()
+		bool VL53L0::hasNewDistance() const
 		{
-			uint32_t startAddr = JAFDSettings::SpiNVSRAM::distSensStartAddr + JAFDSettings::DistanceSensors::bytesPerCalibData * _id;
-
-			uint16_t storeK = SpiNVSRAM::readByte(startAddr) | (SpiNVSRAM::readByte(startAddr + 1) << 8);
-			_k = storeK / 100.0f;
-
-			uint16_t storeD = SpiNVSRAM::readByte(startAddr + 2) | ((uint16_t)SpiNVSRAM::readByte(startAddr + 3) << 8);
-			_d = (storeD & 0x7fff) * ((storeD >> 15) ? -1 : 1);
+			return _newDistance;
 		}
 
-		void VL53L0::resetCalibData()
+		uint32_t VL53L0::getReadTime() const
 		{
-			_k = 1.0f;
-			_d = 0;
+			return _readTime;
 		}
 
-		VL53L0::Status VL53L0::getStatus() const
+		uint32_t VL53L0::getTimestamp() const
 		{
-			return _status;
+			return _timestamp;
 		}
 
-		// VL53L0 class - end
+		float VL53L0::getSampleRate() const
+		{
+			const uint32_t time = millis() - _rateStart;
 
-		VL53L0 frontLeft(JAFDSettings::DistanceSensors::FrontLeft::multiplexCh, 0);
-		VL53L0 frontRight(JAFDSettings::DistanceSensors::FrontRight::multiplexCh, 1);
-		TFMini frontLong(JAFDSettings::DistanceSensors::FrontLong::serialType, 2);
-		VL6180 leftFront(JAFDSettings::DistanceSensors::LeftFront::multiplexCh, 4);
-		VL6180 leftBack(JAFDSettings::DistanceSensors::LeftBack::multiplexCh, 5);
-		VL6180 rightFront(JAFDSettings::DistanceSensors::RightFront::multiplexCh, 6);
-		VL6180 rightBack(JAFDSettings::DistanceSensors::RightBack::multiplexCh, 7);
+			if (time == 0) return 0.0f;
 
-		ReturnCode reset()
+			return _sampleCount * 1000.0f / time;
+		}
+
+		void VL53L0::resetSampleRate()
 		{
-			return setup();
+			__disable_irq();
+			_sampleCount = 0;
+			_rateStart = millis();
+			__enable_irq();
 		}
 
-		ReturnCode setup()
+		uint16_t VL53L0::getDistance()
 		{
-			ReturnCode code = ReturnCode::ok;
+			__disable_irq();
+			uint16_t distance = _rawDistance;
+			_newDistance = false;
+			__enable_irq();
 
-			if (leftFront.setup() != ReturnCode::ok)
+			if (_timedOut)
 			{
-				Serial.println("lf");
-				code = ReturnCode::fatalError;
+				_timedOut = false;
+				_status = Status::timeOut;
+				return 0;
 			}
 
-			if (leftBack.setup() != ReturnCode::ok)
-			{
-				Serial.println("lb");
-				code = ReturnCode::fatalError;
-			}
+			float tempDist = _calib.apply(distance);
 
-			if (rightFront.setup() != ReturnCode::ok)
-			{
-				Serial.println("rf");
-				code = ReturnCode::fatalError;
-			}
+			if (tempDist < 0.0f) distance = 0;
+			else distance = (uint16_t)roundf(tempDist);
 
-			if (rightBack.setup() != ReturnCode::ok)
-			{
-				Serial.println("rb");
-				code = ReturnCode::fatalError;
-			}
+			_status = Status::noError;
 
-			if (frontLeft.setup() != ReturnCode::ok)
-			{
-				Serial.println("fl");
-				code = ReturnCode::fatalError;
-			}
+			if (distance > maxDist) _status = Status::overflow;
+			else if (distance < minDist) _status = Status::underflow;
 
-			if (frontRight.setup() != ReturnCode::ok)
-			{
-				Serial.println("fr");
-				code = ReturnCode::fatalError;
-			}
+			return distance;
+		}
 
-			//if (frontLong.setup() != ReturnCode::ok)
-			//{
-			//	Serial.println("f");
-			//	code = ReturnCode::fatalError;
-			//}
+		void VL53L0::clearInterrupt()
+		{
+			// The interrupt gets cleared by the next asynchronous read
+			__disable_irq();
+			_newDistance = false;
+			_discard = true;
+			__enable_irq();
+		}
 
-			// Read calibration data for distance sensors
-			DistanceSensors::leftFront.restoreCalibData();
-			DistanceSensors::leftBack.restoreCalibData();
-			DistanceSensors::rightBack.restoreCalibData();
-			DistanceSensors::rightFront.restoreCalibData();
-			DistanceSensors::frontRight.restoreCalibData();
-			DistanceSensors::frontLeft.restoreCalibData();
+		void VL53L0::calcCalibData(uint16_t firstTrue, uint16_t firstMeasure, uint16_t secondTrue, uint16_t secondMeasure)
+		{
+			const uint16_t trueDist[2] = { firstTrue, secondTrue };
+			const uint16_t measured[2] = { firstMeasure, secondMeasure };
 
-			return code;
+			_calib.build(trueDist, measured, 2);
 		}
 
-		void updateDistSensors()
+		ReturnCode VL53L0::calcCalibData(const uint16_t* trueDist, const uint16_t* measured, const uint16_t count)
 		{
-			struct TempData
-			{
-				uint32_t tempAverageDist = 0;
-				uint8_t numCorrectSamples = 0;
-				uint8_t numOverflowSamples = 0;
-				uint8_t numUnderflowSamples = 0;
-			};
+			return _calib.build(trueDist, measured, count);
+		}
 
-			TempData flData, frData, lfData, lbData, rfData, rbData;
-			uint16_t tempDist = 0;
-
-			auto tempFusedData = SensorFusion::getFusedData();
-
-			//// Front long
-			//tempDist = DistanceSensors::frontLong.getDistance();
-
-			//if (DistanceSensors::frontLong.getStatus() == decltype(DistanceSensors::frontLong)::Status::noError)
-			//{
-			//	if (tempFusedData.distSensorState.frontLong == DistSensorStatus::ok)
-			//	{
-			//		tempFusedData.distances.frontLong = tempDist * JAFDSettings::SensorFusion::longDistSensIIRFactor + tempFusedData.distances.frontLong * (1.0f - JAFDSettings::SensorFusion::longDistSensIIRFactor);
-			//	}
-			//	else
-			//	{
-			//		tempFusedData.distances.frontLong = tempDist;
-			//	}
-
-			//	tempFusedData.distSensorState.frontLong = DistSensorStatus::ok;
-			//}
-			//else if (DistanceSensors::frontLong.getStatus() == decltype(DistanceSensors::frontLong)::Status::overflow)
-			//{
-			//	tempFusedData.distSensorState.frontLong = DistSensorStatus::overflow;
-			//	tempFusedData.distances.frontLong = 0;
-			//}
-			//else if (DistanceSensors::frontLong.getStatus() == decltype(DistanceSensors::frontLong)::Status::underflow)
-			//{
-			//	tempFusedData.distSensorState.frontLong = DistSensorStatus::underflow;
-			//	tempFusedData.distances.frontLong = 0;
-			//}
-			//else
-			//{
-			//	tempFusedData.distSensorState.frontLong = DistSensorStatus::error;
-			//	tempFusedData.distances.frontLong = 0;
-			//}
-
-			tempFusedData.distSensorState.frontLong = DistSensorStatus::error;
+		void VL53L0::storeCalibData()
+		{
+			_calib.store(JAFDSettings::SpiNVSRAM::distSensStartAddr + JAFDSettings::DistanceSensors::bytesPerCalibData * _id);
+		}
 
-			// Front Left
-			tempDist = DistanceSensors::frontLeft.getDistance();
+		ReturnCode VL53L0::restoreCalibData()
+		{
+			return _calib.restore(JAFDSettings::SpiNVSRAM::distSensStartAddr + JAFDSettings::DistanceSensors::bytesPerCalibData * _id, JAFDSettings::SpiNVSRAM::distSensStartAddr + JAFDSettings::DistanceSensors::legacyBytesPerCalibData * _id);
+		}
 
-			if (DistanceSensors::frontLeft.getStatus() == decltype(DistanceSensors::frontLeft)::Status::noError)
-			{
-				flData.numCorrectSamples++;
-				flData.tempAverageDist += tempDist;
-			}
-			else if (DistanceSensors::frontLeft.getStatus() == decltype(DistanceSensors::frontLeft)::Status::overflow)
-			{
-				flData.numOverflowSamples++;
-			}
-			else if (DistanceSensors::frontLeft.getStatus() == decltype(DistanceSensors::frontLeft)::Status::underflow)
-			{
-				flData.numUnderflowSamples++;
-			}
+		void VL53L0::resetCalibData()
+		{
+			_calib.reset();
+		}
 
-			// Front Right
-			tempDist = DistanceSensors::frontRight.getDistance();
+		VL53L0::Status VL53L0::getStatus() const
+		{
+			return _status;
+		}
 
-			if (DistanceSensors::frontRight.getStatus() == decltype(DistanceSensors::frontRight)::Status::noError)
-			{
-				frData.numCorrectSamples++;
-				frData.tempAverageDist += tempDist;
-			}
-			else if (DistanceSensors::frontRight.getStatus() == decltype(DistanceSensors::frontRight)::Status::overflow)
-			{
-				frData.numOverflowSamples++;
-			}
-			else if (DistanceSensors::frontRight.getStatus() == decltype(DistanceSensors::frontRight)::Status::underflow)
-			{
-				frData.numUnderflowSamples++;
-			}
+		// VL53L0 class - end
 
-			// Left Back
-			tempDist = DistanceSensors::leftBack.getDistance();
+		namespace
+		{
+			typedef RobustFilter<uint16_t, JAFDSettings::DistanceSensors::filterWindow> DistFilter;
 
-			if (DistanceSensors::leftBack.getStatus() == decltype(DistanceSensors::leftBack)::Status::noError)
-			{
-				lbData.numCorrectSamples++;
-				lbData.tempAverageDist += tempDist;
-			}
-			else if (DistanceSensors::leftBack.getStatus() == decltype(DistanceSensors::leftBack)::Status::overflow)
-			{
-				lbData.numOverflowSamples++;
-			}
-			else if (DistanceSensors::leftBack.getStatus() == decltype(DistanceSensors::leftBack)::Status::underflow)
+			// Robust filter of each sensor; only gets valid measurements
+			DistFilter frontLeftFilter(JAFDSettings::DistanceSensors::FrontLeft::filter);
+			DistFilter frontRightFilter(JAFDSettings::DistanceSensors::FrontRight::filter);
+			DistFilter frontLongFilter(JAFDSettings::DistanceSensors::FrontLong::filter);
+			DistFilter leftFrontFilter(JAFDSettings::DistanceSensors::LeftFront::filter);
+			DistFilter leftBackFilter(JAFDSettings::DistanceSensors::LeftBack::filter);
+			DistFilter rightFrontFilter(JAFDSettings::DistanceSensors::RightFront::filter);
+			DistFilter rightBackFilter(JAFDSettings::DistanceSensors::RightBack::filter);
+
+			// Take the new measurement of a distance sensor (if there is one); returns if there was a new measurement
+			template<typename Sensor>
+			bool takeNewDistance(Sensor& sensor, DistFilter& filter, uint16_t& distance, DistSensorStatus& state, uint32_t& timestamp, const float iirFactor)
 			{
-				lbData.numUnderflowSamples++;
-			}
+				if (!sensor.hasNewDistance()) return false;
 
-			// Left Front
-			tempDist = DistanceSensors::leftFront.getDistance();
+				uint16_t tempDist = sensor.getDistance();
+				timestamp = sensor.getTimestamp();
 
-			if (DistanceSensors::leftFront.getStatus() == decltype(DistanceSensors::leftFront)::Status::noError)
-			{
-				lfData.numCorrectSamples++;
-				lfData.tempAverageDist += tempDist;
-			}
-			else if (DistanceSensors::leftFront.getStatus() == decltype(DistanceSensors::leftFront)::Status::overflow)
-			{
-				lfData.numOverflowSamples++;
-			}
-			else if (DistanceSensors::leftFront.getStatus() == decltype(DistanceSensors::leftFront)::Status::underflow)
-			{
-				lfData.numUnderflowSamples++;
-			}
+				if (sensor.getStatus() == Sensor::Status::noError)
+				{
+					// Old measurements don't belong to the current wall anymore
+					if (state != DistSensorStatus::ok) filter.reset();
 
-			// Right Back
-			tempDist = DistanceSensors::rightBack.getDistance();
+					tempDist = filter.process(tempDist, timestamp);		// The filtered distance lags behind the latest measurement
 
-			if (DistanceSensors::rightBack.getStatus() == decltype(DistanceSensors::rightBack)::Status::noError)
-			{
-				rbData.numCorrectSamples++;
-				rbData.tempAverageDist += tempDist;
-			}
-			else if (DistanceSensors::rightBack.getStatus() == decltype(DistanceSensors::rightBack)::Status::overflow)
-			{
-				rbData.numOverflowSamples++;
+					if (state == DistSensorStatus::ok)
+					{
+						distance = static_cast<uint16_t>(tempDist * iirFactor + distance * (1.0f - iirFactor));
+					}
+					else
+					{
+						distance = tempDist;
+					}
+
+					state = DistSensorStatus::ok;
+				}
+				else
+				{
+					if (sensor.getStatus() == Sensor::Status::overflow)
+					{
+						state = DistSensorStatus::overflow;
+					}
+					else if (sensor.getStatus() == Sensor::Status::underflow)
+					{
+						state = DistSensorStatus::underflow;
+					}
+					else
+					{
+						state = DistSensorStatus::error;
+					}
+
+					distance = 0;
+				}
+
+				return true;
 			}
-			else if (DistanceSensors::rightBack.getStatus() == decltype(DistanceSensors::rightBack)::Status::underflow)
+
+			// State of a short distance sensor in the sensor manager
+			struct ManagedSensor
 			{
-				rbData.numUnderflowSamples++;
-			}
+				SensorStats stats;
+				uint32_t lastSample;		// Time the last measurement was taken (ms)
+				uint32_t quarantineStart;	// Time the sensor got quarantined (ms)
+				uint8_t failures;			// Consecutive errors / timeouts
+				bool needsSetup;			// Lost its power during a bus recovery
 
-			// Right Front
-			tempDist = DistanceSensors::rightFront.getDistance();
+				ManagedSensor() : stats(), lastSample(0), quarantineStart(0), failures(0), needsSetup(false) {}
+			};
 
-			if (DistanceSensors::rightFront.getStatus() == decltype(DistanceSensors::rightFront)::Status::noError)
+			ManagedSensor managedSensors[6];	// Indexed by SensorID
+			bool setupDone = false;				// Has a sensor been set up again in this update?
+			uint32_t distUpdates = 0;			// Distance updates passed to the sensor fusion since the last reset
+			uint32_t statsStart = 0;			// Time of the last reset (ms)
+
+			inline ManagedSensor& getManaged(const SensorID sensor)
 			{
-				rfData.numCorrectSamples++;
-				rfData.tempAverageDist += tempDist;
+				return managedSensors[static_cast<uint8_t>(sensor)];
 			}
-			else if (DistanceSensors::rightFront.getStatus() == decltype(DistanceSensors::rightFront)::Status::overflow)
+
+			inline bool isTimeout(const VL6180& sensor)
 			{
-				rfData.numOverflowSamples++;
+				return sensor.getStatus() == VL6180::Status::timeout;
 			}
-			else if (DistanceSensors::rightFront.getStatus() == decltype(DistanceSensors::rightFront)::Status::underflow)
+
+			inline bool isTimeout(const VL53L0& sensor)
 			{
-				rfData.numUnderflowSamples++;
+				return sensor.getStatus() == VL53L0::Status::timeOut;
 			}
 
-			if (flData.numCorrectSamples > 0)
+			// Sampling intervals for the current movement
+			void assignIntervals(const Distances& distances, const DistSensorStates& states)
 			{
-				if (tempFusedData.distSensorState.frontLeft == DistSensorStatus::ok)
-				{
-					tempFusedData.distances.frontLeft = static_cast<uint16_t>((static_cast<float>(flData.tempAverageDist) / flData.numCorrectSamples) * JAFDSettings::SensorFusion::shortDistSensIIRFactor + tempFusedData.distances.frontLeft * (1.0f - JAFDSettings::SensorFusion::shortDistSensIIRFactor));
-				}
-				else
-				{
-					tempFusedData.distances.frontLeft = static_cast<uint16_t>(static_cast<float>(flData.tempAverageDist) / flData.numCorrectSamples);
-				}
+				using namespace JAFDSettings::DistanceSensors::Sampling;
 
-				tempFusedData.distSensorState.frontLeft = DistSensorStatus::ok;
-			}
-			else
-			{
-				if (flData.numOverflowSamples > 0)
-				{
-					tempFusedData.distSensorState.frontLeft = DistSensorStatus::overflow;
-				}
-				else if (flData.numUnderflowSamples > 0)
-				{
-					tempFusedData.distSensorState.frontLeft = DistSensorStatus::underflow;
-				}
-				else
-				{
-					tempFusedData.distSensorState.frontLeft = DistSensorStatus::error;
-				}
+				// The side sensors can't see a wall for long while rotating
+				const bool rotating = SmoothDriving::getCurrentTaskType() == SmoothDriving::TaskType::rotate;
+
+				// The long distance sensor is enough if the front wall is far away
+				const bool farFront = states.frontLong == DistSensorStatus::overflow || (states.frontLong == DistSensorStatus::ok && distances.frontLong > longRangeDist);
+
+				const uint16_t sideInterval = rotating ? slowInterval : fastInterval;
+				const uint16_t frontInterval = farFront ? slowInterval : fastInterval;
 
-				tempFusedData.distances.frontLeft = 0;
+				getManaged(SensorID::frontLeft).stats.interval = frontInterval;
+				getManaged(SensorID::frontRight).stats.interval = frontInterval;
+				getManaged(SensorID::leftFront).stats.interval = sideInterval;
+				getManaged(SensorID::leftBack).stats.interval = sideInterval;
+				getManaged(SensorID::rightFront).stats.interval = sideInterval;
+				getManaged(SensorID::rightBack).stats.interval = sideInterval;
 			}
 
-			if (frData.numCorrectSamples > 0)
+			// Read a short distance sensor at its sampling interval and keep track of its health; returns if there was a new measurement
+			template<typename Sensor>
+			bool manageSensor(Sensor& sensor, ManagedSensor& managed, DistFilter& filter, uint16_t& distance, DistSensorStatus& state, uint32_t& timestamp)
 			{
-				if (tempFusedData.distSensorState.frontRight == DistSensorStatus::ok)
+				uint32_t now = millis();
+
+				// Wire can't be used while it is recovered
+				if (I2CBus::isRecovering(AsyncI2C::Bus::wire))
 				{
-					tempFusedData.distances.frontRight = static_cast<uint16_t>((static_cast<float>(frData.tempAverageDist) / frData.numCorrectSamples) * JAFDSettings::SensorFusion::shortDistSensIIRFactor + tempFusedData.distances.frontRight * (1.0f - JAFDSettings::SensorFusion::shortDistSensIIRFactor));
+					if (state == DistSensorStatus::error) return false;
+
+					state = DistSensorStatus::error;
+					return true;
 				}
-				else
+
+				// Set up again lazily; only one sensor per update because the setup is blocking
+				if (managed.needsSetup)
 				{
-					tempFusedData.distances.frontRight = static_cast<uint16_t>(static_cast<float>(frData.tempAverageDist) / frData.numCorrectSamples);
+					if (setupDone) return false;
+
+					AsyncI2C::lock(AsyncI2C::Bus::wire);
+					sensor.setup();
+					AsyncI2C::unlock(AsyncI2C::Bus::wire);
+
+					setupDone = true;
+					managed.needsSetup = false;
+					managed.lastSample = millis();
+
+					return false;
 				}
 
-				tempFusedData.distSensorState.frontRight = DistSensorStatus::ok;
-			}
-			else
-			{
-				if (frData.numOverflowSamples > 0)
+				if (managed.stats.quarantined)
 				{
-					tempFusedData.distSensorState.frontRight = DistSensorStatus::overflow;
+					if (now - managed.quarantineStart < JAFDSettings::DistanceSensors::Health::quarantineTime) return false;
+
+					// Try again with a restarted sensor
+					sensor.recover();
+
+					now = millis();
+					managed.stats.quarantined = false;
+					managed.lastSample = now;
 				}
-				else if (frData.numUnderflowSamples > 0)
+
+				if (now - managed.lastSample >= managed.stats.interval) sensor.update();
+
+				if (!takeNewDistance(sensor, filter, distance, state, timestamp, JAFDSettings::SensorFusion::shortDistSensIIRFactor)) return false;
+
+				managed.lastSample = now;
+
+				if (state != DistSensorStatus::error)
 				{
-					tempFusedData.distSensorState.frontRight = DistSensorStatus::underflow;
+					managed.stats.samples++;
+					managed.failures = 0;
 				}
 				else
 				{
-					tempFusedData.distSensorState.frontRight = DistSensorStatus::error;
+					if (isTimeout(sensor)) managed.stats.timeouts++;
+					else managed.stats.errors++;
+
+					// Don't access a failing sensor for some time; its state stays "error" meanwhile
+					if (++managed.failures >= JAFDSettings::DistanceSensors::Health::maxFailures)
+					{
+						managed.failures = 0;
+						managed.stats.quarantined = true;
+						managed.stats.quarantines++;
+						managed.quarantineStart = now;
+					}
 				}
 
-				tempFusedData.distances.frontRight = 0;
+				return true;
 			}
 
-			if (lbData.numCorrectSamples > 0)
+			// Points for the automatic calibration of a sensor
+			struct CalibPoints
 			{
-				if (tempFusedData.distSensorState.leftBack == DistSensorStatus::ok)
-				{
-					tempFusedData.distances.leftBack = static_cast<uint16_t>((static_cast<float>(lbData.tempAverageDist) / lbData.numCorrectSamples) * JAFDSettings::SensorFusion::shortDistSensIIRFactor + tempFusedData.distances.leftBack * (1.0f - JAFDSettings::SensorFusion::shortDistSensIIRFactor));
-				}
-				else
+				uint16_t trueDist[JAFDSettings::DistanceSensors::AutoCalib::steps];
+				uint16_t measured[JAFDSettings::DistanceSensors::AutoCalib::steps];
+				uint8_t count;
+
+				CalibPoints() : trueDist(), measured(), count(0) {}
+
+				void add(const uint16_t trueDistance, const float sum, const uint16_t num)
 				{
-					tempFusedData.distances.leftBack = static_cast<uint16_t>(static_cast<float>(lbData.tempAverageDist) / lbData.numCorrectSamples);
+					if (num == 0) return;
+
+					trueDist[count] = trueDistance;
+					measured[count] = roundf(sum / num);
+					count++;
 				}
+			};
 
-				tempFusedData.distSensorState.leftBack = DistSensorStatus::ok;
+			// Distance driven forward according to the encoders (cm)
+			inline float encoderDistance()
+			{
+				return (MotorControl::getDistance(Motor::left) + MotorControl::getDistance(Motor::right)) / 2.0f;
 			}
-			else
+
+			template<typename Sensor>
+			ReturnCode finishAutoCalibration(Sensor& sensor, const CalibPoints& points)
 			{
-				if (lbData.numOverflowSamples > 0)
-				{
-					tempFusedData.distSensorState.leftBack = DistSensorStatus::overflow;
-				}
-				else if (lbData.numUnderflowSamples > 0)
-				{
-					tempFusedData.distSensorState.leftBack = DistSensorStatus::underflow;
-				}
-				else
+				// Keep the old calibration if there are not enough points in range
+				if (points.count < 2 || sensor.calcCalibData(points.trueDist, points.measured, points.count) != ReturnCode::ok)
 				{
-					tempFusedData.distSensorState.leftBack = DistSensorStatus::error;
+					sensor.restoreCalibData();
+					return ReturnCode::error;
 				}
 
-				tempFusedData.distances.leftBack = 0;
+				sensor.storeCalibData();
+
+				return ReturnCode::ok;
 			}
+		}
 
-			if (lfData.numCorrectSamples > 0)
-			{
-				if (tempFusedData.distSensorState.leftFront == DistSensorStatus::ok)
-				{
-					tempFusedData.distances.leftFront = static_cast<uint16_t>((static_cast<float>(lfData.tempAverageDist) / lfData.numCorrectSamples) * JAFDSettings::SensorFusion::shortDistSensIIRFactor + tempFusedData.distances.leftFront * (1.0f - JAFDSettings::SensorFusion::shortDistSensIIRFactor));
-				}
-				else
-				{
-					tempFusedData.distances.leftFront = static_cast<uint16_t>(static_cast<float>(lfData.tempAverageDist) / lfData.numCorrectSamples);
-				}
+		VL53L0 frontLeft(JAFDSettings::DistanceSensors::FrontLeft::multiplexCh, JAFDSettings::DistanceSensors::FrontLeft::interruptPin, 0);
+		VL53L0 frontRight(JAFDSettings::DistanceSensors::FrontRight::multiplexCh, JAFDSettings::DistanceSensors::FrontRight::interruptPin, 1);
+		TFMini frontLong(JAFDSettings::DistanceSensors::FrontLong::serialType, 2);
+		VL6180 leftFront(JAFDSettings::DistanceSensors::LeftFront::multiplexCh, JAFDSettings::DistanceSensors::LeftFront::interruptPin, 4);
+		VL6180 leftBack(JAFDSettings::DistanceSensors::LeftBack::multiplexCh, JAFDSettings::DistanceSensors::LeftBack::interruptPin, 5);
+		VL6180 rightFront(JAFDSettings::DistanceSensors::RightFront::multiplexCh, JAFDSettings::DistanceSensors::RightFront::interruptPin, 6);
+		VL6180 rightBack(JAFDSettings::DistanceSensors::RightBack::multiplexCh, JAFDSettings::DistanceSensors::RightBack::interruptPin, 7);
+
+		ReturnCode reset()
+		{
+			return setup();
+		}
+
+		void interrupt(const Interrupts::InterruptSource source, const uint32_t isr)
+		{
+			frontLeft.interrupt(source, isr);
+			frontRight.interrupt(source, isr);
+			leftFront.interrupt(source, isr);
+			leftBack.interrupt(source, isr);
+			rightFront.interrupt(source, isr);
+			rightBack.interrupt(source, isr);
+		}
+
+		ReturnCode setup()
+		{
+			ReturnCode code = ReturnCode::ok;
 
-				tempFusedData.distSensorState.leftFront = DistSensorStatus::ok;
+			// The sensors are set up with blocking Wire calls
+			AsyncI2C::lock(AsyncI2C::Bus::wire);
+
+			if (leftFront.setup() != ReturnCode::ok)
+			{
+				Serial.println("lf");
+				code = ReturnCode::fatalError;
 			}
-			else
+
+			if (leftBack.setup() != ReturnCode::ok)
 			{
-				if (lfData.numOverflowSamples > 0)
-				{
-					tempFusedData.distSensorState.leftFront = DistSensorStatus::overflow;
-				}
-				else if (lfData.numUnderflowSamples > 0)
-				{
-					tempFusedData.distSensorState.leftFront = DistSensorStatus::underflow;
-				}
-				else
-				{
-					tempFusedData.distSensorState.leftFront = DistSensorStatus::error;
-				}
+				Serial.println("lb");
+				code = ReturnCode::fatalError;
+			}
 
-				tempFusedData.distances.leftFront = 0;
+			if (rightFront.setup() != ReturnCode::ok)
+			{
+				Serial.println("rf");
+				code = ReturnCode::fatalError;
 			}
 
-			if (rbData.numCorrectSamples > 0)
+			if (rightBack.setup() != ReturnCode::ok)
 			{
-				if (tempFusedData.distSensorState.rightBack == DistSensorStatus::ok)
-				{
-					tempFusedData.distances.rightBack = static_cast<uint16_t>((static_cast<float>(rbData.tempAverageDist) / rbData.numCorrectSamples) * JAFDSettings::SensorFusion::shortDistSensIIRFactor + tempFusedData.distances.rightBack * (1.0f - JAFDSettings::SensorFusion::shortDistSensIIRFactor));
-				}
-				else
-				{
-					tempFusedData.distances.rightBack = static_cast<uint16_t>(static_cast<float>(rbData.tempAverageDist) / rbData.numCorrectSamples);
-				}
+				Serial.println("rb");
+				code = ReturnCode::fatalError;
+			}
 
-				tempFusedData.distSensorState.rightBack = DistSensorStatus::ok;
+			if (frontLeft.setup() != ReturnCode::ok)
+			{
+				Serial.println("fl");
+				code = ReturnCode::fatalError;
 			}
-			else
+
+			if (frontRight.setup() != ReturnCode::ok)
 			{
-				if (rbData.numOverflowSamples > 0)
-				{
-					tempFusedData.distSensorState.rightBack = DistSensorStatus::overflow;
-				}
-				else if (rbData.numUnderflowSamples > 0)
-				{
-					tempFusedData.distSensorState.rightBack = DistSensorStatus::underflow;
-				}
-				else
-				{
-					tempFusedData.distSensorState.rightBack = DistSensorStatus::error;
-				}
+				Serial.println("fr");
+				code = ReturnCode::fatalError;
+			}
 
-				tempFusedData.distances.rightBack = 0;
+			if (frontLong.setup() != ReturnCode::ok)
+			{
+				Serial.println("f");
+				code = ReturnCode::fatalError;
 			}
 
-			if (rfData.numCorrectSamples > 0)
+			AsyncI2C::unlock(AsyncI2C::Bus::wire);
+
+			// Read calibration data for distance sensors
+			const ReturnCode calibCodes[7] = {
+				DistanceSensors::leftFront.restoreCalibData(),
+				DistanceSensors::leftBack.restoreCalibData(),
+				DistanceSensors::rightBack.restoreCalibData(),
+				DistanceSensors::rightFront.restoreCalibData(),
+				DistanceSensors::frontRight.restoreCalibData(),
+				DistanceSensors::frontLeft.restoreCalibData(),
+				DistanceSensors::frontLong.restoreCalibData()
+			};
+
+			// Missing calibrations or old linear ones (converted to a 2 point table) are less accurate
+			for (const auto calibCode : calibCodes)
 			{
-				if (tempFusedData.distSensorState.rightFront == DistSensorStatus::ok)
+				if (calibCode != ReturnCode::ok)
 				{
-					tempFusedData.distances.rightFront = static_cast<uint16_t>((static_cast<float>(rfData.tempAverageDist) / rfData.numCorrectSamples) * JAFDSettings::SensorFusion::shortDistSensIIRFactor + tempFusedData.distances.rightFront * (1.0f - JAFDSettings::SensorFusion::shortDistSensIIRFactor));
-				}
-				else
-				{
-					tempFusedData.distances.rightFront = static_cast<uint16_t>(static_cast<float>(rfData.tempAverageDist) / rfData.numCorrectSamples);
+					Serial.println("Recalibrate distance sensors");
+					break;
 				}
+			}
 
-				tempFusedData.distSensorState.rightFront = DistSensorStatus::ok;
+			return code;
+		}
+
+		void updateDistSensors()
+		{
+			static DistSensTimestamps timestamps;
+
+			FusedData tempFusedData;
+			SensorFusion::readDistances(tempFusedData.distances, tempFusedData.distSensorState);
+
+			// Read the short distance sensors only as often as they are needed
+			assignIntervals(tempFusedData.distances, tempFusedData.distSensorState);
+
+			// The sensors lost their power during a bus recovery
+			if (I2CBus::takeSetupRequest(I2CBus::Device::distanceSensors))
+			{
+				for (auto& managed : managedSensors) managed.needsSetup = true;
 			}
-			else
+
+			setupDone = false;
+
+			bool newDistances = false;
+
+			// Front long
+			frontLong.update();
+
+			if (takeNewDistance(frontLong, frontLongFilter, tempFusedData.distances.frontLong, tempFusedData.distSensorState.frontLong, timestamps.frontLong, JAFDSettings::SensorFusion::longDistSensIIRFactor)) newDistances = true;
+
+			// Front Left
+			if (manageSensor(frontLeft, getManaged(SensorID::frontLeft), frontLeftFilter, tempFusedData.distances.frontLeft, tempFusedData.distSensorState.frontLeft, timestamps.frontLeft)) newDistances = true;
+
+			// Front Right
+			if (manageSensor(frontRight, getManaged(SensorID::frontRight), frontRightFilter, tempFusedData.distances.frontRight, tempFusedData.distSensorState.frontRight, timestamps.frontRight)) newDistances = true;
+
+			// Left Back
+			if (manageSensor(leftBack, getManaged(SensorID::leftBack), leftBackFilter, tempFusedData.distances.leftBack, tempFusedData.distSensorState.leftBack, timestamps.leftBack)) newDistances = true;
+
+			// Left Front
+			if (manageSensor(leftFront, getManaged(SensorID::leftFront), leftFrontFilter, tempFusedData.distances.leftFront, tempFusedData.distSensorState.leftFront, timestamps.leftFront)) newDistances = true;
+
+			// Right Back
+			if (manageSensor(rightBack, getManaged(SensorID::rightBack), rightBackFilter, tempFusedData.distances.rightBack, tempFusedData.distSensorState.rightBack, timestamps.rightBack)) newDistances = true;
+
+			// Right Front
+			if (manageSensor(rightFront, getManaged(SensorID::rightFront), rightFrontFilter, tempFusedData.distances.rightFront, tempFusedData.distSensorState.rightFront, timestamps.rightFront)) newDistances = true;
+
+			// Every measurement is only passed on once
+			if (newDistances)
 			{
-				if (rfData.numOverflowSamples > 0)
-				{
-					tempFusedData.distSensorState.rightFront = DistSensorStatus::overflow;
-				}
-				else if (rfData.numUnderflowSamples > 0)
-				{
-					tempFusedData.distSensorState.rightFront = DistSensorStatus::underflow;
-				}
-				else
-				{
-					tempFusedData.distSensorState.rightFront = DistSensorStatus::error;
-				}
+				SensorFusion::setDistances(tempFusedData.distances, timestamps);
+				SensorFusion::setDistSensStates(tempFusedData.distSensorState);
+				distUpdates++;
+			}
+		}
+
+		SensorStats getStats(const SensorID sensor)
+		{
+			return getManaged(sensor).stats;
+		}
+
+		float getUpdateRate()
+		{
+			const uint32_t time = millis() - statsStart;
 
-				tempFusedData.distances.rightFront = 0;
+			if (time == 0) return 0.0f;
+
+			return distUpdates * 1000.0f / time;
+		}
+
+		void resetStats()
+		{
+			for (auto& managed : managedSensors)
+			{
+				managed.stats.samples = 0;
+				managed.stats.errors = 0;
+				managed.stats.timeouts = 0;
+				managed.stats.quarantines = 0;
 			}
 
-			SensorFusion::setDistances(tempFusedData.distances);
-			SensorFusion::setDistSensStates(tempFusedData.distSensorState);
+			distUpdates = 0;
+			statsStart = millis();
 		}
 
 		void forceNewMeasurement()
@@ -1082,11 +1535,13 @@ namespace JAFD
 			{
 				SensorFusion::updateSensors();
 				SensorFusion::untimedFusion();
-				auto fusedData = SensorFusion::getFusedData();
+				Distances distances;
+				DistSensorStates distSensorStates;
+				SensorFusion::readDistances(distances, distSensorStates);
 
-				if (fusedData.distSensorState.rightBack == DistSensorStatus::ok)
+				if (distSensorStates.rightBack == DistSensorStatus::ok)
 				{
-					avgDist += fusedData.distances.rightBack;
+					avgDist += distances.rightBack;
 					avgCount++;
 				}
 			}
@@ -1109,11 +1564,13 @@ namespace JAFD
 			{
 				SensorFusion::updateSensors();
 				SensorFusion::untimedFusion();
-				auto fusedData = SensorFusion::getFusedData();
+				Distances distances;
+				DistSensorStates distSensorStates;
+				SensorFusion::readDistances(distances, distSensorStates);
 
-				if (fusedData.distSensorState.rightBack == DistSensorStatus::ok)
+				if (distSensorStates.rightBack == DistSensorStatus::ok)
 				{
-					avgDist += fusedData.distances.rightBack;
+					avgDist += distances.rightBack;
 					avgCount++;
 				}
 			}
@@ -1126,5 +1583,106 @@ namespace JAFD
 			DistanceSensors::rightBack.calcCalibData(trueFirst, measFirst, trueSecond, measSecond);
 			DistanceSensors::rightBack.storeCalibData();
 		}
+
+		ReturnCode autoCalibration()
+		{
+			using namespace JAFDSettings::DistanceSensors::AutoCalib;
+
+			CalibPoints frontLeftPoints;
+			CalibPoints frontRightPoints;
+			CalibPoints frontLongPoints;
+			ReturnCode code = ReturnCode::ok;
+
+			frontLeft.resetCalibData();
+			frontRight.resetCalibData();
+			frontLong.resetCalibData();
+
+			const float startPos = encoderDistance();
+
+			for (uint8_t i = 0; i < steps; i++)
+			{
+				if (i > 0)
+				{
+					if (SmoothDriving::setNewTask<SmoothDriving::NewStateType::currentState>(SmoothDriving::TaskArray(SmoothDriving::ForceSpeed(-speed, -stepDist), SmoothDriving::Stop()), true) != ReturnCode::ok)
+					{
+						code = ReturnCode::error;
+						break;
+					}
+
+					Wait::waitForFinishedTask();
+				}
+
+				// Wait until the filters only contain measurements at this point
+				auto startTime = millis();
+
+				while (millis() - startTime < settleTime)
+				{
+					SensorFusion::updateSensors();
+					SensorFusion::untimedFusion();
+				}
+
+				float frontLeftSum = 0.0f;
+				float frontRightSum = 0.0f;
+				float frontLongSum = 0.0f;
+				uint16_t frontLeftNum = 0;
+				uint16_t frontRightNum = 0;
+				uint16_t frontLongNum = 0;
+
+				startTime = millis();
+
+				while (millis() - startTime < averageTime)
+				{
+					SensorFusion::updateSensors();
+					SensorFusion::untimedFusion();
+					Distances distances;
+					DistSensorStates distSensorStates;
+					SensorFusion::readDistances(distances, distSensorStates);
+
+					if (distSensorStates.frontLeft == DistSensorStatus::ok)
+					{
+						frontLeftSum += distances.frontLeft;
+						frontLeftNum++;
+					}
+
+					if (distSensorStates.frontRight == DistSensorStatus::ok)
+					{
+						frontRightSum += distances.frontRight;
+						frontRightNum++;
+					}
+
+					if (distSensorStates.frontLong == DistSensorStatus::ok)
+					{
+						frontLongSum += distances.frontLong;
+						frontLongNum++;
+					}
+				}
+
+				const uint16_t trueDist = startDist + roundf((startPos - encoderDistance()) * 10.0f);
+
+				frontLeftPoints.add(trueDist, frontLeftSum, frontLeftNum);
+				frontRightPoints.add(trueDist, frontRightSum, frontRightNum);
+				frontLongPoints.add(trueDist + JAFDSettings::DistanceSensors::FrontLong::calibOffset, frontLongSum, frontLongNum);
+			}
+
+			if (finishAutoCalibration(frontLeft, frontLeftPoints) != ReturnCode::ok)
+			{
+				Serial.println("fl");
+				code = ReturnCode::error;
+			}
+
+			if (finishAutoCalibration(frontRight, frontRightPoints) != ReturnCode::ok)
+			{
+				Serial.println("fr");
+				code = ReturnCode::error;
+			}
+
+			if (finishAutoCalibration(frontLong, frontLongPoints) != ReturnCode::ok)
+			{
+				Serial.println("f");
+				code = ReturnCode::error;
+			}
+
+			return code;
+		}
 	}
 }
\ No newline at end of file
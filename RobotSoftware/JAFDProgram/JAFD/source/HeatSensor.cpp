@@ -10,10 +10,13 @@ This part of the Library is responsible for heat sensors
 
 #include "../../JAFDSettings.h"
 #include "../header/AllDatatypes.h"
+#include "../header/AsyncI2C.h"
 #include "../header/HeatSensor.h"
+#include "../header/SmallThings.h"
 #include "../header/TCA9548A.h"
 #include <Adafruit_AMG88xx.h>
 #include <TPA81.h>
+#include <Wire.h>
 
 #include <algorithm>
 #include <functional>
@@ -62,7 +65,11 @@ namespace JAFD
 #else
 				int pixels[8];
 
-				I2CMultiplexer::selectChannel(JAFDSettings::HeatSensors::Left::i2cChannel);
+				if (I2CMultiplexer::getChannel() != JAFDSettings::HeatSensors::Left::i2cChannel)
+				{
+					I2CMultiplexer::selectChannel(JAFDSettings::HeatSensors::Left::i2cChannel);
+				}
+
 				int leftAmbient = tpaLeft.getAll(pixels);
 
 				if (leftAmbient == 0 || leftAmbient > 40) return ReturnCode::error;
@@ -72,7 +79,11 @@ namespace JAFD
 					ambientTemp += pixels[i];
 				}
 
-				I2CMultiplexer::selectChannel(JAFDSettings::HeatSensors::Right::i2cChannel);
+				if (I2CMultiplexer::getChannel() != JAFDSettings::HeatSensors::Right::i2cChannel)
+				{
+					I2CMultiplexer::selectChannel(JAFDSettings::HeatSensors::Right::i2cChannel);
+				}
+
 				int rightAmbient = tpaRight.getAll(pixels);
 
 				if (rightAmbient == 0 || rightAmbient > 40) return ReturnCode::error;
@@ -103,15 +114,31 @@ namespace JAFD
 			amgRight.setMovingAverageMode(false);
 #else
 #endif
-			I2CMultiplexer::selectChannel(JAFDSettings::HeatSensors::Left::i2cChannel);
+			AsyncI2C::lock(AsyncI2C::Bus::wire);
+			Wire.setClock(JAFDSettings::I2CBus::tpa81Clock);
+
+			if (I2CMultiplexer::getChannel() != JAFDSettings::HeatSensors::Left::i2cChannel)
+			{
+				I2CMultiplexer::selectChannel(JAFDSettings::HeatSensors::Left::i2cChannel);
+			}
+
 			tpaLeft.setup(0xD0);
 
 
 
-			I2CMultiplexer::selectChannel(JAFDSettings::HeatSensors::Right::i2cChannel);
+			if (I2CMultiplexer::getChannel() != JAFDSettings::HeatSensors::Right::i2cChannel)
+			{
+				I2CMultiplexer::selectChannel(JAFDSettings::HeatSensors::Right::i2cChannel);
+			}
+
 			tpaRight.setup(0xD0);
 
-			return readAmbientTemp();
+			const ReturnCode code = readAmbientTemp();
+
+			Wire.setClock(JAFDSettings::I2CBus::clock);
+			AsyncI2C::unlock(AsyncI2C::Bus::wire);
+
+			return code;
 		}
 
 		bool detectVictim(HeatSensorSide sensor)
@@ -124,12 +151,24 @@ namespace JAFD
 			int pixels[numPix];
 #endif
 
+			// Wire is being recovered
+			if (I2CBus::isRecovering(AsyncI2C::Bus::wire)) return false;
+
+			if (I2CBus::takeSetupRequest(I2CBus::Device::heatSensor)) setup();
+
+			AsyncI2C::lock(AsyncI2C::Bus::wire);
+			Wire.setClock(JAFDSettings::I2CBus::tpa81Clock);
+
 			if (sensor == HeatSensorSide::left)
 			{
 #ifdef USE_AMG833
 				amgLeft.readPixels(pixels);
 #else
-				I2CMultiplexer::selectChannel(JAFDSettings::HeatSensors::Left::i2cChannel);
+				if (I2CMultiplexer::getChannel() != JAFDSettings::HeatSensors::Left::i2cChannel)
+				{
+					I2CMultiplexer::selectChannel(JAFDSettings::HeatSensors::Left::i2cChannel);
+				}
+
 				tpaLeft.getAll(pixels);
 #endif
 			}
@@ -138,11 +177,18 @@ namespace JAFD
 #ifdef USE_AMG833
 				amgLeft.readPixels(pixels);
 #else
-				I2CMultiplexer::selectChannel(JAFDSettings::HeatSensors::Right::i2cChannel);
+				if (I2CMultiplexer::getChannel() != JAFDSettings::HeatSensors::Right::i2cChannel)
+				{
+					I2CMultiplexer::selectChannel(JAFDSettings::HeatSensors::Right::i2cChannel);
+				}
+
 				tpaRight.getAll(pixels);
 #endif
 			}
 
+			Wire.setClock(JAFDSettings::I2CBus::clock);
+			AsyncI2C::unlock(AsyncI2C::Bus::wire);
+
 #ifdef USE_AMG833
 			std::sort(pixels, pixels + numPix, std::greater<float>());
 #else
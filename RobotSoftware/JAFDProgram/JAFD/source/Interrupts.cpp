@@ -10,11 +10,184 @@ In this part are all interrupt handler
 #include "../header/Bno055.h"
 #include "../header/TCS34725.h"
 #include "../header/DistanceSensors.h"
+#include "../header/SmallThings.h"
+#include "../../JAFDSettings.h"
+
+namespace JAFD
+{
+	namespace Interrupts
+	{
+		namespace
+		{
+			// Timing of a stage; only changed by its own ISR
+			struct StageTiming
+			{
+				volatile float nominalDt;	// Nominal time between two calls (s)
+				const uint16_t budget;		// Maximum run time (us)
+				uint32_t lastStart;			// Start of the last call (us)
+				uint32_t nestedStart;		// stagesRunTime at the start of the last call (us)
+
+				// Statistics
+				float minDt;
+				float maxDt;
+				float dtSum;
+				uint32_t dtCount;
+				uint32_t runTimeSum;		// Without interruptions by faster stages (us)
+				uint32_t maxRunTime;		// (us)
+				uint32_t overruns;
+				uint32_t statsStart;		// Time of the last reset (us)
+
+				StageTiming(const float nominalDt, const uint16_t budget) : nominalDt(nominalDt), budget(budget), lastStart(0), nestedStart(0), minDt(0.0f), maxDt(0.0f), dtSum(0.0f), dtCount(0), runTimeSum(0), maxRunTime(0), overruns(0), statsStart(0) {}
+			};
+
+			StageTiming stages[3] = {
+				StageTiming(0.001f, JAFDSettings::TimedLoop::Speed::budget),
+				StageTiming(1.0f / JAFDSettings::TimedLoop::Fusion::freq, JAFDSettings::TimedLoop::Fusion::budget),
+				StageTiming(1.0f / JAFDSettings::TimedLoop::freq, JAFDSettings::TimedLoop::Trajectory::budget)
+			};
+
+			volatile uint32_t stagesRunTime = 0;	// Sum of the run times of all stages without their interruptions (us)
+
+			inline StageTiming& getStage(const Stage stage)
+			{
+				return stages[static_cast<uint8_t>(stage)];
+			}
+
+			// Time since the last call of a stage
+			struct StageDt
+			{
+				float real;		// Measured time (s); for derivatives
+				float limited;	// Measured time limited to maxDtFactor * nominal dt (s); for integration
+			};
+
+			// Start of a stage: Measure the real time since its last call; the ISR can be delayed by faster stages or long I2C transfers
+			StageDt startStage(const Stage stage)
+			{
+				StageTiming& timing = getStage(stage);
+				const uint32_t now = micros();
+				float dt = timing.nominalDt;
+
+				if (timing.lastStart != 0)
+				{
+					dt = (now - timing.lastStart) * 1.0e-6f;
+
+					if (timing.dtCount == 0 || dt < timing.minDt) timing.minDt = dt;
+					if (timing.dtCount == 0 || dt > timing.maxDt) timing.maxDt = dt;
+
+					timing.dtSum += dt;
+					timing.dtCount++;
+				}
+
+				timing.lastStart = now;
+				timing.nestedStart = stagesRunTime;
+
+				// A single very long delay shouldn't make the integration explode; derivatives need the real time though
+				return StageDt{ dt, fminf(dt, timing.nominalDt * JAFDSettings::TimedLoop::maxDtFactor) };
+			}
+
+			// End of a stage: Check the run time against the budget
+			void endStage(const Stage stage)
+			{
+				StageTiming& timing = getStage(stage);
+
+				// Faster stages which interrupted this one added their run time to stagesRunTime meanwhile
+				__disable_irq();
+				const uint32_t runTime = micros() - timing.lastStart;
+				const uint32_t ownRunTime = runTime - (stagesRunTime - timing.nestedStart);
+				stagesRunTime += ownRunTime;
+				__enable_irq();
+
+				timing.runTimeSum += ownRunTime;
+
+				if (runTime > timing.maxRunTime) timing.maxRunTime = runTime;
+				if (runTime > timing.budget) timing.overruns++;
+			}
+
+			// Vector table in the RAM (16 system exceptions + peripheral interrupts); has to be aligned to its size rounded up to a power of two
+			__attribute__((aligned(256))) uint32_t ramVectorTable[16 + PERIPH_COUNT_IRQn];
+			bool vectorTableInRam = false;
+		}
+
+		void setTimedLoopFreq(const float freq)
+		{
+			// TC5 runs with MCK / 128
+			const uint32_t rc = static_cast<uint32_t>(VARIANT_MCK / 128.0f / freq + 0.5f);
+
+			__disable_irq();
+			TC1->TC_CHANNEL[2].TC_RC = rc;
+
+			// The counter would miss the compare and run through 2^32
+			if (TC1->TC_CHANNEL[2].TC_CV >= rc) TC1->TC_CHANNEL[2].TC_CCR = TC_CCR_SWTRG;
+			__enable_irq();
+			getStage(Stage::trajectory).nominalDt = 1.0f / freq;
+		}
+
+		TimingStats getTimingStats(const Stage stage)
+		{
+			const StageTiming& timing = getStage(stage);
+			TimingStats stats;
+
+			__disable_irq();
+			const uint32_t totalTime = micros() - timing.statsStart;
+
+			stats.minDt = timing.minDt;
+			stats.maxDt = timing.maxDt;
+			stats.meanDt = timing.dtCount > 0 ? timing.dtSum / timing.dtCount : 0.0f;
+			stats.count = timing.dtCount;
+			stats.maxRunTime = timing.maxRunTime;
+			stats.overruns = timing.overruns;
+			stats.cpuShare = totalTime > 0 ? static_cast<float>(timing.runTimeSum) / totalTime : 0.0f;
+			__enable_irq();
+
+			return stats;
+		}
+
+		void resetTimingStats()
+		{
+			__disable_irq();
+
+			for (auto& timing : stages)
+			{
+				timing.minDt = 0.0f;
+				timing.maxDt = 0.0f;
+				timing.dtSum = 0.0f;
+				timing.dtCount = 0;
+				timing.runTimeSum = 0;
+				timing.maxRunTime = 0;
+				timing.overruns = 0;
+				timing.statsStart = micros();
+			}
+
+			__enable_irq();
+		}
+
+		void setInterruptHandler(const IRQn_Type irq, void (*handler)())
+		{
+			__disable_irq();
+
+			if (!vectorTableInRam)
+			{
+				const uint32_t* flashVectorTable = reinterpret_cast<const uint32_t*>(SCB->VTOR);
+
+				for (uint8_t i = 0; i < 16 + PERIPH_COUNT_IRQn; i++) ramVectorTable[i] = flashVectorTable[i];
+
+				SCB->VTOR = reinterpret_cast<uint32_t>(ramVectorTable);
+				vectorTableInRam = true;
+			}
+
+			ramVectorTable[16 + irq] = reinterpret_cast<uint32_t>(handler);
+
+			__DSB();
+			__enable_irq();
+		}
+	}
+}
 
 void handleISR(JAFD::Interrupts::InterruptSource interruptSrc, uint32_t isr)
 {
 	JAFD::MotorControl::encoderInterrupt(interruptSrc, isr);
 	JAFD::ColorSensor::interrupt(interruptSrc, isr);
+	JAFD::DistanceSensors::interrupt(interruptSrc, isr);
 }
 
 void PIOA_Handler()
@@ -37,19 +210,38 @@ void PIOD_Handler()
 	handleISR(JAFD::Interrupts::InterruptSource::pioD, PIOD->PIO_ISR);
 }
 
-// TC0 - TC2 are reserved for Arduino Framework
+void ADC_Handler()
+{
+	JAFD::MotorControl::adcInterrupt();
+}
+
+// Timer counter channels in use:
+// TC0 (TC0 channel 0) / TC6 (TC2 channel 0): Quadrature decoders of the encoders (USE_TC_QDEC; the blocks of the encoder pins)
+// TC2 (TC0 channel 2): ADC trigger (TIOA2) for the current and voltage feedback
+// TC3 - TC5 (TC1 channel 0 - 2): Timed loops below
 
 // 1kHz 
-// Not active
+// Active
+// Speed stage
 void TC3_Handler()
 {
 	{
 		volatile auto dummy = TC1->TC_CHANNEL[0].TC_SR;
 	}
+
+	const auto dt = JAFD::Interrupts::startStage(JAFD::Interrupts::Stage::speed);
+
+	JAFD::MotorControl::pollEncoders();
+	JAFD::MotorControl::calcMotorSpeed(dt.real);
+	JAFD::MotorControl::speedPID(dt.limited);
+	JAFD::I2CBus::recoveryStep();
+
+	JAFD::Interrupts::endStage(JAFD::Interrupts::Stage::speed);
 }
 
-// 100Hz
-// Not active
+// 100Hz (TimedLoop::Fusion::freq)
+// Active
+// Fusion stage
 void TC4_Handler()
 {
 	static uint8_t i = 0;
@@ -60,16 +252,24 @@ void TC4_Handler()
 
 	i++;
 
+	const auto dt = JAFD::Interrupts::startStage(JAFD::Interrupts::Stage::fusion);
+
 	// 100Hz:
+	JAFD::SensorFusion::sensorFiltering(dt.limited, dt.real);
 
 	if (i % 2 == 0)
 	{
+		i = 0;
+
 		// 50Hz:
 	}
+
+	JAFD::Interrupts::endStage(JAFD::Interrupts::Stage::fusion);
 }
 
 // 20Hz
 // Active
+// Trajectory stage
 void TC5_Handler()
 {
 	static uint8_t i = 0;
@@ -80,11 +280,10 @@ void TC5_Handler()
 
 	i++;
 
-	// 20Hz:
-	JAFD::MotorControl::calcMotorSpeed(20);
-	JAFD::SensorFusion::sensorFiltering(20);
-	JAFD::SmoothDriving::updateSpeeds(20);
-	JAFD::MotorControl::speedPID(20);
+	const auto dt = JAFD::Interrupts::startStage(JAFD::Interrupts::Stage::trajectory);
+
+	// 20Hz (nominal):
+	JAFD::SmoothDriving::updateSpeeds(dt.limited);
 
 	if (i % 2 == 0)
 	{
@@ -103,4 +302,6 @@ void TC5_Handler()
 			}
 		}
 	}
+
+	JAFD::Interrupts::endStage(JAFD::Interrupts::Stage::trajectory);
 }
\ No newline at end of file
@@ -19,6 +19,7 @@
 #include "../header/SpiNVSRAM.h"
 #include "../header/DistanceSensors.h"
 #include "../header/AllDatatypes.h"
+#include "../header/AsyncI2C.h"
 #include "../header/RobotLogic.h"
 #include "../header/SmoothDriving.h"
 #include "../header/TCS34725.h"
@@ -27,6 +28,7 @@
 #include "../header/SmallThings.h"
 #include "../header/CamRec.h"
 #include "../header/Math.h"
+#include "../header/Localization.h"
 
 #include <SPI.h>
 #include <Wire.h>
@@ -73,6 +75,12 @@ namespace JAFD
 			Serial.println("Error I2C bus power");
 		}
 
+		// Setup of asynchronous I2C
+		if (AsyncI2C::setup() != ReturnCode::ok)
+		{
+			Serial.println("Error asynchronous I2C");
+		}
+
 		// Setup of SPI NVSRAM
 		if (SpiNVSRAM::setup() != ReturnCode::ok)
 		{
@@ -166,44 +174,44 @@ namespace JAFD
 			temp = PIOD->PIO_ISR;
 		}
 
-		////Setup TC3 for an interrupt every ms -> 1kHz (MCK / 32 / 2625)
-		//PMC->PMC_PCER0 = 1 << ID_TC3;
+		// Setup TC3 for an interrupt every ms -> 1kHz (MCK / 32 / 2625); speed PID-Controller and I2C bus recovery
+		PMC->PMC_PCER0 = 1 << ID_TC3;
 
-		//TC1->TC_CHANNEL[0].TC_CMR = TC_CMR_TCCLKS_TIMER_CLOCK3 | TC_CMR_WAVE | TC_CMR_WAVSEL_UP_RC;
-		//TC1->TC_CHANNEL[0].TC_RC = 2625;
+		TC1->TC_CHANNEL[0].TC_CMR = TC_CMR_TCCLKS_TIMER_CLOCK3 | TC_CMR_WAVE | TC_CMR_WAVSEL_UP_RC;
+		TC1->TC_CHANNEL[0].TC_RC = 2625;
 
-		//TC1->TC_CHANNEL[0].TC_IER = TC_IER_CPCS;
-		//TC1->TC_CHANNEL[0].TC_IDR = ~TC_IER_CPCS;
+		TC1->TC_CHANNEL[0].TC_IER = TC_IER_CPCS;
+		TC1->TC_CHANNEL[0].TC_IDR = ~TC_IER_CPCS;
 
-		//NVIC_EnableIRQ(TC3_IRQn);
-		//NVIC_SetPriority(TC3_IRQn, 1);
-		//TC1->TC_CHANNEL[0].TC_CCR = TC_CCR_SWTRG | TC_CCR_CLKEN;
+		NVIC_EnableIRQ(TC3_IRQn);
+		NVIC_SetPriority(TC3_IRQn, JAFDSettings::TimedLoop::Speed::priority);
+		TC1->TC_CHANNEL[0].TC_CCR = TC_CCR_SWTRG | TC_CCR_CLKEN;
 
-		////Setup TC4 for an interrupt every 10ms -> 100Hz (MCK / 32 / 26250)
-		//PMC->PMC_PCER0 = 1 << ID_TC4;
+		// Setup TC4 for the sensor fusion -> 100Hz (MCK / 32 / 26250)
+		PMC->PMC_PCER0 = 1 << ID_TC4;
 
-		//TC1->TC_CHANNEL[1].TC_CMR = TC_CMR_TCCLKS_TIMER_CLOCK3 | TC_CMR_WAVE | TC_CMR_WAVSEL_UP_RC;
-		//TC1->TC_CHANNEL[1].TC_RC = 26250;
+		TC1->TC_CHANNEL[1].TC_CMR = TC_CMR_TCCLKS_TIMER_CLOCK3 | TC_CMR_WAVE | TC_CMR_WAVSEL_UP_RC;
+		TC1->TC_CHANNEL[1].TC_RC = static_cast<uint32_t>(VARIANT_MCK / 32.0f / JAFDSettings::TimedLoop::Fusion::freq + 0.5f);
 
-		//TC1->TC_CHANNEL[1].TC_IER = TC_IER_CPCS;
-		//TC1->TC_CHANNEL[1].TC_IDR = ~TC_IER_CPCS;
+		TC1->TC_CHANNEL[1].TC_IER = TC_IER_CPCS;
+		TC1->TC_CHANNEL[1].TC_IDR = ~TC_IER_CPCS;
 
-		//NVIC_EnableIRQ(TC4_IRQn);
-		//NVIC_SetPriority(TC4_IRQn, 1);
+		NVIC_EnableIRQ(TC4_IRQn);
+		NVIC_SetPriority(TC4_IRQn, JAFDSettings::TimedLoop::Fusion::priority);
 
-		//TC1->TC_CHANNEL[1].TC_CCR = TC_CCR_SWTRG | TC_CCR_CLKEN;
+		TC1->TC_CHANNEL[1].TC_CCR = TC_CCR_SWTRG | TC_CCR_CLKEN;
 
-		// Setup TC4 for an interrupt every ~50ms -> 19.9997Hz (MCK / 128 / 32813)
+		// Setup TC5 for the trajectory loop -> 20Hz at start (MCK / 128 / 32813)
 		PMC->PMC_PCER1 = PMC_PCER1_PID32;
 
 		TC1->TC_CHANNEL[2].TC_CMR = TC_CMR_TCCLKS_TIMER_CLOCK4 | TC_CMR_WAVE | TC_CMR_WAVSEL_UP_RC;
-		TC1->TC_CHANNEL[2].TC_RC = 32813;
+		Interrupts::setTimedLoopFreq(JAFDSettings::TimedLoop::freq);
 
 		TC1->TC_CHANNEL[2].TC_IER = TC_IER_CPCS;
 		TC1->TC_CHANNEL[2].TC_IDR = ~TC_IER_CPCS;
 
 		NVIC_EnableIRQ(TC5_IRQn);
-		NVIC_SetPriority(TC5_IRQn, 1);
+		NVIC_SetPriority(TC5_IRQn, JAFDSettings::TimedLoop::Trajectory::priority);
 		TC1->TC_CHANNEL[2].TC_CCR = TC_CCR_SWTRG | TC_CCR_CLKEN;
 
 		delay(500);
@@ -218,9 +226,7 @@ namespace JAFD
 
 	void robotLoop()
 	{
-		static float fps = 0.0f;
-
-		auto time = millis();
+		const auto loopStart = micros();
 		
 		using namespace SmoothDriving;
 
@@ -245,16 +251,16 @@ namespace JAFD
 		//}
 
 		SensorFusion::updateSensors();
-		SensorFusion::untimedFusion();
+		const bool newData = SensorFusion::untimedFusion();
+		Localization::update();
 		//RobotLogic::loop();
 		
-		auto fusedData = SensorFusion::getFusedData();
-		fusedData.robotState.globalHeading;
+		auto robotState = SensorFusion::getRobotState();
+		robotState.globalHeading;
 
 		auto freeRam = MemWatcher::getFreeRam();
 
-		if (fps < 0.01f) fps = 1000.0f / (millis() - time);
-		else fps = fps * 0.4f + 600.0f / (millis() - time);
+		LoopWatcher::loopDone(micros() - loopStart, !newData);
 
 		return;
 	}
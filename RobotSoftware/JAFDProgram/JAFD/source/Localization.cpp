@@ -0,0 +1,407 @@
+/*
+This part of the library is responsible for the Monte-Carlo re-localization of the robot against the stored map
+*/
+
+#if defined(ARDUINO) && ARDUINO >= 100
+#include "arduino.h"
+#else
+#include "WProgram.h"
+#endif
+
+#include "../../JAFDSettings.h"
+#include "../header/Localization.h"
+#include "../header/SensorFusion.h"
+#include "../header/MazeMapping.h"
+#include "../header/DistanceSensors.h"
+#include "../header/Math.h"
+
+namespace JAFD
+{
+	namespace Localization
+	{
+		namespace
+		{
+			constexpr uint16_t numParticles = JAFDSettings::Localization::numParticles;
+			constexpr int8_t windowRadius = JAFDSettings::Localization::mapWindowRadius;
+			constexpr uint8_t windowSize = 2 * windowRadius + 1;
+			constexpr uint8_t unknownCell = 0xff;
+			constexpr uint8_t numDistSensors = 7;
+
+			// Particles (position in cm, heading in rad)
+			float particleX[numParticles];
+			float particleY[numParticles];
+			float particleHeading[numParticles];
+			float particleWeight[numParticles];
+
+			// Buffers for resampling
+			float resampledX[numParticles];
+			float resampledY[numParticles];
+			float resampledHeading[numParticles];
+
+			// Mounting of a distance sensor relative to the robot middle (x = forward, y = left)
+			struct SensorMount
+			{
+				float x;
+				float y;
+				float angle;
+				float minDist;	// cm
+				float maxDist;	// cm
+			};
+
+			// Same order as in Distances
+			const SensorMount sensorMounts[numDistSensors] = {
+				{ JAFDSettings::Mechanics::distSensFrontBackDist / 2.0f, JAFDSettings::Mechanics::distSensFrontSpacing / 2.0f, 0.0f, DistanceSensors::VL53L0::minDist / 10.0f, DistanceSensors::VL53L0::maxDist / 10.0f },
+				{ JAFDSettings::Mechanics::distSensFrontBackDist / 2.0f, -JAFDSettings::Mechanics::distSensFrontSpacing / 2.0f, 0.0f, DistanceSensors::VL53L0::minDist / 10.0f, DistanceSensors::VL53L0::maxDist / 10.0f },
+				{ JAFDSettings::Mechanics::distSensFrontBackDist / 2.0f, 0.0f, 0.0f, DistanceSensors::TFMini::minDist / 10.0f, DistanceSensors::TFMini::maxDist / 10.0f },
+				{ JAFDSettings::Mechanics::distSensLRSpacing / 2.0f, JAFDSettings::Mechanics::distSensLeftRightDist / 2.0f, M_PI_2, DistanceSensors::VL6180::minDist / 10.0f, DistanceSensors::VL6180::maxDist / 10.0f },
+				{ -JAFDSettings::Mechanics::distSensLRSpacing / 2.0f, JAFDSettings::Mechanics::distSensLeftRightDist / 2.0f, M_PI_2, DistanceSensors::VL6180::minDist / 10.0f, DistanceSensors::VL6180::maxDist / 10.0f },
+				{ JAFDSettings::Mechanics::distSensLRSpacing / 2.0f, -JAFDSettings::Mechanics::distSensLeftRightDist / 2.0f, -M_PI_2, DistanceSensors::VL6180::minDist / 10.0f, DistanceSensors::VL6180::maxDist / 10.0f },
+				{ -JAFDSettings::Mechanics::distSensLRSpacing / 2.0f, -JAFDSettings::Mechanics::distSensLeftRightDist / 2.0f, -M_PI_2, DistanceSensors::VL6180::minDist / 10.0f, DistanceSensors::VL6180::maxDist / 10.0f }
+			};
+
+			// Cell connections of the map around the robot (unknownCell = not visited yet)
+			uint8_t mapWindow[windowSize][windowSize];
+			MapCoordinate windowMiddle;
+			bool windowValid = false;
+
+			// State of the localization
+			bool running = false;
+			uint16_t nextParticle = 0;					// Next particle to be weighted in this round
+			uint8_t rounds = 0;							// Finished rounds since start()
+			RobotState roundState;						// Robot state at the beginning of the current round
+			float measurements[numDistSensors];			// Measured distances of this round (cm); < 0 = no valid measurement
+
+			// Result
+			float estimateX = 0.0f;
+			float estimateY = 0.0f;
+			float estimateHeading = 0.0f;
+			float estimateSpread = 0.0f;
+
+			// xorshift32 - much faster than random()
+			uint32_t randomState = 2463534242;
+
+			inline float randomFloat()
+			{
+				randomState ^= randomState << 13;
+				randomState ^= randomState >> 17;
+				randomState ^= randomState << 5;
+
+				return (randomState >> 8) * (1.0f / 16777216.0f);
+			}
+
+			// Approximately normal distributed with standard deviation 1 (sum of four uniform values)
+			inline float randomGaussian()
+			{
+				return (randomFloat() + randomFloat() + randomFloat() + randomFloat() - 2.0f) * 1.7320508f;
+			}
+
+			void loadMapWindow(const MapCoordinate middle)
+			{
+				GridCell cell;
+
+				for (int8_t i = 0; i < windowSize; i++)
+				{
+					for (int8_t j = 0; j < windowSize; j++)
+					{
+						MazeMapping::getGridCell(&cell, MapCoordinate(middle.x + i - windowRadius, middle.y + j - windowRadius));
+
+						mapWindow[i][j] = (cell.cellState & CellState::visited) ? (cell.cellConnections & CellConnections::directionMask) : unknownCell;
+					}
+				}
+
+				windowMiddle = middle;
+				windowValid = true;
+			}
+
+			inline uint8_t getWindowCell(const int8_t x, const int8_t y)
+			{
+				const int8_t i = x - windowMiddle.x + windowRadius;
+				const int8_t j = y - windowMiddle.y + windowRadius;
+
+				if (i < 0 || i >= windowSize || j < 0 || j >= windowSize) return unknownCell;
+
+				return mapWindow[i][j];
+			}
+
+			// Distance from (x, y) in direction "angle" to the next wall; maxDist if there is none in range, -1 if the ray leaves the known map
+			float castRay(const float x, const float y, const float angle, const float maxDist)
+			{
+				const float dirX = cosf(angle);
+				const float dirY = sinf(angle);
+
+				int8_t cellX = roundf(x / JAFDSettings::Field::cellWidth);
+				int8_t cellY = roundf(y / JAFDSettings::Field::cellWidth);
+
+				const int8_t stepX = dirX >= 0.0f ? 1 : -1;
+				const int8_t stepY = dirY >= 0.0f ? 1 : -1;
+
+				// North = +x, west = +y
+				const uint8_t wallX = stepX > 0 ? EntranceDirections::north : EntranceDirections::south;
+				const uint8_t wallY = stepY > 0 ? EntranceDirections::west : EntranceDirections::east;
+
+				// Ray length between two borders / to the next border
+				const float deltaX = fabsf(dirX) > 0.0001f ? fabsf(JAFDSettings::Field::cellWidth / dirX) : 1.0e9f;
+				const float deltaY = fabsf(dirY) > 0.0001f ? fabsf(JAFDSettings::Field::cellWidth / dirY) : 1.0e9f;
+				float nextX = fabsf(dirX) > 0.0001f ? ((cellX + stepX * 0.5f) * JAFDSettings::Field::cellWidth - x) / dirX : 1.0e9f;
+				float nextY = fabsf(dirY) > 0.0001f ? ((cellY + stepY * 0.5f) * JAFDSettings::Field::cellWidth - y) / dirY : 1.0e9f;
+
+				while (true)
+				{
+					const uint8_t cell = getWindowCell(cellX, cellY);
+
+					if (cell == unknownCell) return -1.0f;
+
+					if (nextX < nextY)
+					{
+						if (nextX > maxDist) return maxDist;
+						if (!(cell & wallX)) return nextX;
+
+						cellX += stepX;
+						nextX += deltaX;
+					}
+					else
+					{
+						if (nextY > maxDist) return maxDist;
+						if (!(cell & wallY)) return nextY;
+
+						cellY += stepY;
+						nextY += deltaY;
+					}
+				}
+			}
+
+			// Likelihood of the measurements of this round for one particle
+			float calcWeight(const uint16_t i)
+			{
+				const float headingCos = cosf(particleHeading[i]);
+				const float headingSin = sinf(particleHeading[i]);
+
+				float weight = 1.0f;
+
+				for (uint8_t s = 0; s < numDistSensors; s++)
+				{
+					if (measurements[s] < 0.0f) continue;
+
+					const SensorMount& mount = sensorMounts[s];
+
+					const float sensorX = particleX[i] + headingCos * mount.x - headingSin * mount.y;
+					const float sensorY = particleY[i] + headingSin * mount.x + headingCos * mount.y;
+
+					float expected = castRay(sensorX, sensorY, particleHeading[i] + mount.angle, mount.maxDist);
+
+					if (expected < 0.0f) continue;
+					if (expected < mount.minDist) expected = mount.minDist;
+
+					const float error = (measurements[s] - expected) / JAFDSettings::Localization::distSensSigma;
+
+					weight *= expf(-0.5f * error * error) * (1.0f - JAFDSettings::Localization::minLikelihood) + JAFDSettings::Localization::minLikelihood;
+				}
+
+				return weight;
+			}
+
+			// Convert a measurement to cm; over- / underflows are clipped to the range of the sensor
+			float toMeasurement(const uint16_t distance, const DistSensorStatus status, const SensorMount& mount)
+			{
+				switch (status)
+				{
+				case DistSensorStatus::ok:
+					return distance / 10.0f;
+				case DistSensorStatus::overflow:
+					return mount.maxDist;
+				case DistSensorStatus::underflow:
+					return mount.minDist;
+				default:
+					return -1.0f;
+				}
+			}
+
+			// Move all particles by the movement of the robot since the last round and take a new set of measurements
+			void beginRound()
+			{
+				const RobotState state = SensorFusion::getRobotState();
+
+				// Movement in robot coordinates
+				const float lastCos = cosf(roundState.globalHeading);
+				const float lastSin = sinf(roundState.globalHeading);
+				const float deltaX = state.position.x - roundState.position.x;
+				const float deltaY = state.position.y - roundState.position.y;
+				const float forward = lastCos * deltaX + lastSin * deltaY;
+				const float left = -lastSin * deltaX + lastCos * deltaY;
+				const float rotation = state.globalHeading - roundState.globalHeading;
+
+				for (uint16_t i = 0; i < numParticles; i++)
+				{
+					const float headingCos = cosf(particleHeading[i]);
+					const float headingSin = sinf(particleHeading[i]);
+
+					particleX[i] += headingCos * forward - headingSin * left + randomGaussian() * JAFDSettings::Localization::motionNoise;
+					particleY[i] += headingSin * forward + headingCos * left + randomGaussian() * JAFDSettings::Localization::motionNoise;
+					particleHeading[i] += rotation + randomGaussian() * JAFDSettings::Localization::headingNoise;
+				}
+
+				roundState = state;
+
+				Distances distances;
+				DistSensorStates states;
+
+				SensorFusion::readDistances(distances, states);
+
+				measurements[0] = toMeasurement(distances.frontLeft, states.frontLeft, sensorMounts[0]);
+				measurements[1] = toMeasurement(distances.frontRight, states.frontRight, sensorMounts[1]);
+				measurements[2] = toMeasurement(distances.frontLong, states.frontLong, sensorMounts[2]);
+				measurements[3] = toMeasurement(distances.leftFront, states.leftFront, sensorMounts[3]);
+				measurements[4] = toMeasurement(distances.leftBack, states.leftBack, sensorMounts[4]);
+				measurements[5] = toMeasurement(distances.rightFront, states.rightFront, sensorMounts[5]);
+				measurements[6] = toMeasurement(distances.rightBack, states.rightBack, sensorMounts[6]);
+
+				if (!windowValid || windowMiddle != state.mapCoordinate) loadMapWindow(state.mapCoordinate);
+			}
+
+			// Calculate the estimate and resample (low variance resampling)
+			void endRound()
+			{
+				float weightSum = 0.0f;
+
+				for (uint16_t i = 0; i < numParticles; i++) weightSum += particleWeight[i];
+
+				if (weightSum <= 0.0f) return;
+
+				float sumX = 0.0f;
+				float sumY = 0.0f;
+				float sumCos = 0.0f;
+				float sumSin = 0.0f;
+
+				for (uint16_t i = 0; i < numParticles; i++)
+				{
+					particleWeight[i] /= weightSum;
+
+					sumX += particleWeight[i] * particleX[i];
+					sumY += particleWeight[i] * particleY[i];
+					sumCos += particleWeight[i] * cosf(particleHeading[i]);
+					sumSin += particleWeight[i] * sinf(particleHeading[i]);
+				}
+
+				float variance = 0.0f;
+
+				for (uint16_t i = 0; i < numParticles; i++)
+				{
+					variance += particleWeight[i] * ((particleX[i] - sumX) * (particleX[i] - sumX) + (particleY[i] - sumY) * (particleY[i] - sumY));
+				}
+
+				estimateX = sumX;
+				estimateY = sumY;
+				estimateHeading = makeRotationCoherent(roundState.globalHeading, atan2f(sumSin, sumCos));
+				estimateSpread = sqrtf(variance);
+
+				const float step = 1.0f / numParticles;
+				float target = randomFloat() * step;
+				float cumulated = particleWeight[0];
+				uint16_t j = 0;
+
+				for (uint16_t i = 0; i < numParticles; i++)
+				{
+					while (target > cumulated && j < numParticles - 1)
+					{
+						j++;
+						cumulated += particleWeight[j];
+					}
+
+					resampledX[i] = particleX[j];
+					resampledY[i] = particleY[j];
+					resampledHeading[i] = particleHeading[j];
+
+					target += step;
+				}
+
+				for (uint16_t i = 0; i < numParticles; i++)
+				{
+					particleX[i] = resampledX[i];
+					particleY[i] = resampledY[i];
+					particleHeading[i] = resampledHeading[i];
+				}
+			}
+		}
+
+		void start()
+		{
+			roundState = SensorFusion::getRobotState();
+
+			for (uint16_t i = 0; i < numParticles; i++)
+			{
+				particleX[i] = roundState.position.x + (randomFloat() * 2.0f - 1.0f) * JAFDSettings::Localization::startSpread;
+				particleY[i] = roundState.position.y + (randomFloat() * 2.0f - 1.0f) * JAFDSettings::Localization::startSpread;
+				particleHeading[i] = roundState.globalHeading + (randomFloat() * 2.0f - 1.0f) * JAFDSettings::Localization::startHeadingSpread;
+				particleWeight[i] = 1.0f;
+			}
+
+			windowValid = false;
+			nextParticle = 0;
+			rounds = 0;
+			running = true;
+		}
+
+		void stop()
+		{
+			running = false;
+		}
+
+		bool isRunning()
+		{
+			return running;
+		}
+
+		void update()
+		{
+			if (!running) return;
+
+			if (nextParticle == 0) beginRound();
+
+			// Only weight some particles per call, so one main loop iteration doesn't take too long
+			uint16_t end = nextParticle + JAFDSettings::Localization::particlesPerUpdate;
+			if (end > numParticles) end = numParticles;
+
+			for (; nextParticle < end; nextParticle++)
+			{
+				particleWeight[nextParticle] = calcWeight(nextParticle);
+			}
+
+			if (nextParticle < numParticles) return;
+
+			endRound();
+
+			nextParticle = 0;
+			rounds++;
+
+			if (estimateSpread < JAFDSettings::Localization::convergedSpread)
+			{
+				// The estimate belongs to the beginning of this round - add the movement since then
+				const RobotState state = SensorFusion::getRobotState();
+				const float rotation = estimateHeading - roundState.globalHeading;
+				const float deltaX = state.position.x - roundState.position.x;
+				const float deltaY = state.position.y - roundState.position.y;
+
+				Vec3f position = state.position;
+				position.x = estimateX + cosf(rotation) * deltaX - sinf(rotation) * deltaY;
+				position.y = estimateY + sinf(rotation) * deltaX + cosf(rotation) * deltaY;
+
+				SensorFusion::setCertainRobotPosition(position, state.globalHeading + rotation);
+
+				running = false;
+			}
+			else if (rounds >= JAFDSettings::Localization::maxRounds)
+			{
+				running = false;
+			}
+		}
+
+		void getEstimate(Vec3f& position, float& heading, float& spread)
+		{
+			position = roundState.position;
+			position.x = estimateX;
+			position.y = estimateY;
+			heading = estimateHeading;
+			spread = estimateSpread;
+		}
+	}
+}
@@ -16,6 +16,31 @@ namespace JAFD
 {
 	namespace MazeMapping
 	{
+		namespace
+		{
+			// Cached cell (current cell and its neighbours); all writes go through to the NVSRAM
+			struct CachedCell
+			{
+				MapCoordinate coor;
+				GridCell gridCell;
+				int8_t logOdds[4];
+				bool valid;
+			};
+
+			constexpr uint8_t cellCacheSize = 5;	// Current cell + four neighbours
+			CachedCell cellCache[cellCacheSize];
+
+			CachedCell* findCachedCell(const MapCoordinate coor)
+			{
+				for (uint8_t i = 0; i < cellCacheSize; i++)
+				{
+					if (cellCache[i].valid && cellCache[i].coor == coor) return &cellCache[i];
+				}
+
+				return nullptr;
+			}
+		}
+
 		// Setup the MazeMapper
 		ReturnCode setup()
 		{
@@ -48,11 +73,14 @@ namespace JAFD
 		
 		void resetAllCells()
 		{
+			const int8_t logOdds[4] = { 0, 0, 0, 0 };
+
 			for (int8_t x = minX; x <= maxX; x++)
 			{
 				for (int8_t y = minY; y <= maxY; y++)
 				{
 					setGridCell(GridCell(), 0, MapCoordinate { x, y });
+					setWallLogOdds(logOdds, MapCoordinate { x, y });
 				}
 			}
 		}
@@ -60,6 +88,16 @@ namespace JAFD
 		// Set a grid cell in the RAM
 		void setGridCell(const GridCell gridCell, const MapCoordinate coor)
 		{
+			CachedCell* cached = findCachedCell(coor);
+
+			if (cached)
+			{
+				// Nothing changed -> no need to write
+				if (cached->gridCell.cellConnections == gridCell.cellConnections && cached->gridCell.cellState == gridCell.cellState) return;
+
+				cached->gridCell = gridCell;
+			}
+
 			// Memory address
 			uint32_t address = JAFDSettings::SpiNVSRAM::mazeMappingStartAddr;
 			
@@ -77,6 +115,14 @@ namespace JAFD
 		// Read a grid cell from the RAM
 		void getGridCell(GridCell* gridCell, const MapCoordinate coor)
 		{
+			const CachedCell* cached = findCachedCell(coor);
+
+			if (cached)
+			{
+				*gridCell = cached->gridCell;
+				return;
+			}
+
 			// Memory address
 			uint32_t address = JAFDSettings::SpiNVSRAM::mazeMappingStartAddr;
 
@@ -128,6 +174,10 @@ namespace JAFD
 		// Set a grid cell in the RAM (including informations for the BF Algorithm)
 		void setGridCell(const GridCell gridCell, const uint8_t bfsValue, const MapCoordinate coor)
 		{
+			CachedCell* cached = findCachedCell(coor);
+
+			if (cached) cached->gridCell = gridCell;
+
 			// Memory address
 			uint32_t address = JAFDSettings::SpiNVSRAM::mazeMappingStartAddr;
 
@@ -164,11 +214,140 @@ namespace JAFD
 			*bfsValue = bytes[2];
 		}
 
-		// Set current cell and recalculate certainty
-		void setCurrentCell(const GridCell gridCell, float& currentCertainty, const float updateCertainty, MapCoordinate coor)
+		// Read the log-odds of the four walls of a cell
+		void getWallLogOdds(int8_t* logOdds, const MapCoordinate coor)
 		{
-			currentCertainty = 0.25f * updateCertainty + 0.5f * updateCertainty * updateCertainty + 0.15f * currentCertainty + 0.55f * currentCertainty * updateCertainty - 0.7f * currentCertainty * updateCertainty * updateCertainty + 0.3f * currentCertainty * currentCertainty + 0.1f * currentCertainty * currentCertainty * updateCertainty - 0.2f * currentCertainty * currentCertainty * updateCertainty * updateCertainty + 0.05;
+			const CachedCell* cached = findCachedCell(coor);
+
+			if (cached)
+			{
+				for (uint8_t i = 0; i < 4; i++) logOdds[i] = cached->logOdds[i];
+				return;
+			}
+
+			// Memory address
+			uint32_t address = JAFDSettings::SpiNVSRAM::mazeMappingStartAddr;
+
+			// Calculate address
+			address += ((coor.x + 0x20) & 0x3f) << 3;	// Bit 4 - 9 = x-Axis / 0 = 0x20
+			address += ((coor.y + 0x20) & 0x3f) << 9;	// Bit 10 - 15 = y-Axis / 0 = 0x20
+			address += 3;								// Go to the wall log-odds (byte 3 - 6)
+
+			// Read data
+			SpiNVSRAM::readStream(address, reinterpret_cast<uint8_t*>(logOdds), 4);
+		}
+
+		// Write the log-odds of the four walls of a cell
+		void setWallLogOdds(const int8_t* logOdds, const MapCoordinate coor)
+		{
+			CachedCell* cached = findCachedCell(coor);
+
+			if (cached)
+			{
+				// Nothing changed -> no need to write
+				if (cached->logOdds[0] == logOdds[0] && cached->logOdds[1] == logOdds[1] && cached->logOdds[2] == logOdds[2] && cached->logOdds[3] == logOdds[3]) return;
+
+				for (uint8_t i = 0; i < 4; i++) cached->logOdds[i] = logOdds[i];
+			}
+
+			// Memory address
+			uint32_t address = JAFDSettings::SpiNVSRAM::mazeMappingStartAddr;
+
+			// Calculate address
+			address += ((coor.x + 0x20) & 0x3f) << 3;	// Bit 4 - 9 = x-Axis / 0 = 0x20
+			address += ((coor.y + 0x20) & 0x3f) << 9;	// Bit 10 - 15 = y-Axis / 0 = 0x20
+			address += 3;								// Go to the wall log-odds (byte 3 - 6)
+
+			// Data as a byte array
+			uint8_t bytes[4] = { static_cast<uint8_t>(logOdds[0]), static_cast<uint8_t>(logOdds[1]), static_cast<uint8_t>(logOdds[2]), static_cast<uint8_t>(logOdds[3]) };
+
+			// Write data
+			SpiNVSRAM::writeStream(address, bytes, 4);
+		}
+
+		// Load a cell and its four neighbours into the cell cache
+		void cacheCells(const MapCoordinate coor)
+		{
+			const MapCoordinate coors[cellCacheSize] = { coor, MapCoordinate(coor.x + 1, coor.y), MapCoordinate(coor.x, coor.y + 1), MapCoordinate(coor.x - 1, coor.y), MapCoordinate(coor.x, coor.y - 1) };
+			CachedCell newCache[cellCacheSize];
+
+			for (uint8_t i = 0; i < cellCacheSize; i++)
+			{
+				const CachedCell* cached = findCachedCell(coors[i]);
+
+				if (cached)
+				{
+					// Already cached -> no need to read it again
+					newCache[i] = *cached;
+				}
+				else if (coors[i].x < minX || coors[i].x > maxX || coors[i].y < minY || coors[i].y > maxY)
+				{
+					// Cells outside of the map would alias other cells in the RAM
+					newCache[i].valid = false;
+				}
+				else
+				{
+					// Memory address
+					uint32_t address = JAFDSettings::SpiNVSRAM::mazeMappingStartAddr;
+
+					// Calculate address
+					address += ((coors[i].x + 0x20) & 0x3f) << 3;	// Bit 4 - 9 = x-Axis / 0 = 0x20
+					address += ((coors[i].y + 0x20) & 0x3f) << 9;	// Bit 10 - 15 = y-Axis / 0 = 0x20
+
+					// Cell (byte 0 - 1), solver value (byte 2), wall log-odds (byte 3 - 6)
+					uint8_t bytes[7];
+
+					// Read data
+					SpiNVSRAM::readStream(address, bytes, 7);
+
+					newCache[i].coor = coors[i];
+					newCache[i].gridCell.cellConnections = bytes[0];
+					newCache[i].gridCell.cellState = bytes[1];
+
+					for (uint8_t j = 0; j < 4; j++) newCache[i].logOdds[j] = static_cast<int8_t>(bytes[3 + j]);
+
+					newCache[i].valid = true;
+				}
+			}
+
+			for (uint8_t i = 0; i < cellCacheSize; i++) cellCache[i] = newCache[i];
+		}
+
+		// Update the wall log-odds of the current cell, commit walls which crossed the threshold and recalculate certainty
+		void setCurrentCell(GridCell& gridCell, float& currentCertainty, const int8_t* wallObservations, const MapCoordinate coor)
+		{
+			int8_t logOdds[4];
+
+			// Walls of a cell we have never been in are unknown; treat them as open until they are committed
+			uint8_t connections = (gridCell.cellState & CellState::visited) ? (gridCell.cellConnections & CellConnections::directionMask) : CellConnections::directionMask;
+
+			getWallLogOdds(logOdds, coor);
+
+			currentCertainty = 0.0f;
+
+			for (uint8_t i = 0; i < 4; i++)
+			{
+				int16_t value = logOdds[i] + wallObservations[i];
+
+				if (value > JAFDSettings::MazeMapping::wallLogOddsMax) value = JAFDSettings::MazeMapping::wallLogOddsMax;
+				else if (value < -JAFDSettings::MazeMapping::wallLogOddsMax) value = -JAFDSettings::MazeMapping::wallLogOddsMax;
+
+				logOdds[i] = static_cast<int8_t>(value);
+
+				// Bit i of the connections corresponds to AbsoluteDir i
+				if (value >= JAFDSettings::MazeMapping::wallLogOddsThreshold) connections &= ~(1 << i);
+				else if (value <= -JAFDSettings::MazeMapping::wallLogOddsThreshold) connections |= (1 << i);
+
+				currentCertainty += (abs(value) >= JAFDSettings::MazeMapping::wallLogOddsCertain) ? 1.0f : abs(value) / static_cast<float>(JAFDSettings::MazeMapping::wallLogOddsCertain);
+			}
+
+			currentCertainty /= 4.0f;
+
+			gridCell.cellConnections = (gridCell.cellConnections & CellConnections::rampMask) | connections;
+			gridCell.cellState |= CellState::visited;
+
 			setGridCell(gridCell, coor);
+			setWallLogOdds(logOdds, coor);
 		}
 
 		namespace BFAlgorithm
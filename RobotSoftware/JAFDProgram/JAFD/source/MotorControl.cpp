@@ -44,6 +44,29 @@ namespace JAFD
 			constexpr auto rEncA = PinMapping::MappedPins[JAFDSettings::MotorControl::Right::encA];		// Encoder Pin A right motor
 			constexpr auto rEncB = PinMapping::MappedPins[JAFDSettings::MotorControl::Right::encB];		// Encoder Pin B right motor
 
+#ifdef USE_TC_QDEC
+			// The quadrature decoder of a TC block uses TIOA and TIOB of its first channel
+			constexpr bool isQdecPin(const PinMapping::PinInformation pin)
+			{
+				return pin.tcChannel != PinMapping::TCChannel::noTC && static_cast<uint8_t>(pin.tcChannel) % 6 < 2;
+			}
+
+			constexpr bool isTIOB(const PinMapping::PinInformation pin)
+			{
+				return static_cast<uint8_t>(pin.tcChannel) % 2 == 1;
+			}
+
+			static_assert(isQdecPin(lEncA) && isQdecPin(lEncB) && PinMapping::getTCChannel(lEncA) == PinMapping::getTCChannel(lEncB) && isTIOB(lEncA) != isTIOB(lEncB), "The left encoder has to be on TIOA / TIOB of the first channel of a TC block");
+			static_assert(isQdecPin(rEncA) && isQdecPin(rEncB) && PinMapping::getTCChannel(rEncA) == PinMapping::getTCChannel(rEncB) && isTIOB(rEncA) != isTIOB(rEncB), "The right encoder has to be on TIOA / TIOB of the first channel of a TC block");
+			static_assert(PinMapping::getTCChannel(lEncA) != PinMapping::getTCChannel(rEncA), "The encoders need different TC blocks");
+			static_assert(PinMapping::getTCChannel(lEncA) != 1 && PinMapping::getTCChannel(rEncA) != 1, "TC1 is used for the timed interrupts");
+
+			Tc* const qdecTCs[] = { TC0, TC1, TC2 };
+
+			Tc* const lQdecTC = qdecTCs[PinMapping::getTCChannel(lEncA)];	// TC block decoding the left encoder
+			Tc* const rQdecTC = qdecTCs[PinMapping::getTCChannel(rEncA)];	// TC block decoding the right encoder
+#endif
+
 			constexpr auto cmPSToPerc = JAFDSettings::MotorControl::cmPSToPerc;		// Conversion factor from cm/s to motor PWM duty cycle
 
 			constexpr uint8_t lPWMCh = PinMapping::getPWMChannel(lPWM);		// Left motor PWM channel
@@ -58,35 +81,166 @@ namespace JAFD
 			constexpr uint8_t rVoltADCChA = PinMapping::getADCChannel(rVoltFbA);	// Right motor ADC channel for voltage measurement / A
 			constexpr uint8_t rVoltADCChB = PinMapping::getADCChannel(rVoltFbB);	// Right motor ADC channel for voltage measurement / B
 
+			constexpr uint16_t pwmPeriod = 2100;	// Center aligned: The counter counts up to pwmPeriod and down again -> 2 * 2100 MCK cycles (20kHz); the on phase is in the middle of counter 0
+
+			constexpr uint32_t adcChannels = 1 << lCurADCCh | 1 << rCurADCCh | 1 << lVoltADCChA | 1 << lVoltADCChB | 1 << rVoltADCChA | 1 << rVoltADCChB;	// Enabled ADC channels
+
+			// Number of set bits
+			constexpr uint8_t countBits(const uint32_t mask)
+			{
+				return mask == 0 ? 0 : (mask & 1) + countBits(mask >> 1);
+			}
+
+			// Position of a channel in a conversion sequence (the ADC converts the channels in ascending order)
+			constexpr uint8_t adcSeqPos(const uint8_t channel)
+			{
+				return countBits(adcChannels & ((1UL << channel) - 1));
+			}
+
+			constexpr uint8_t adcSeqLength = countBits(adcChannels);	// Samples per conversion sequence
+
+			static_assert(adcSeqLength == 6, "The current and voltage feedback pins need six different ADC channels");
+
+			constexpr uint16_t adcBlockSize = adcSeqLength * JAFDSettings::MotorControl::adcBlockPeriods;	// Samples per buffer block
+
+			constexpr uint8_t adcLeftSeqMask = 1 << adcSeqPos(lCurADCCh) | 1 << adcSeqPos(lVoltADCChA) | 1 << adcSeqPos(lVoltADCChB);	// Positions of the left motor channels in a sequence
+
+			// The conversions start adcSampleLead before the middle of the on phase and end about as long after it -> shorter on phases give samples of the off phase
+			constexpr float adcMinDuty = 2.0f * JAFDSettings::MotorControl::adcSampleLead / (2.0f * pwmPeriod / (VARIANT_MCK / 1.0e6f));
+
+			// The ADC is triggered by TIOA2 (TC0 channel 2); the quadrature decoders only use channel 0 and 1 of a TC block
+			TcChannel* const adcTrigger = &(TC0->TC_CHANNEL[2]);
+
+			uint16_t adcBuffer[2][adcBlockSize];	// Buffer blocks for the PDC; one is filled while the other one is evaluated
+			uint8_t adcNextBlock = 0;				// Block the PDC finishes next
+			volatile float adcValues[adcSeqLength];	// Filtered samples in the order of a conversion sequence (ADC units)
+
 			PIDController leftPID(JAFDSettings::Controller::Motor::pidSettings);		// Left speed PID-Controller
 			PIDController rightPID(JAFDSettings::Controller::Motor::pidSettings);		// Right speed PID-Controller
 
-			volatile int32_t lEncCnt = 0;		// Encoder count left motor
-			volatile int32_t rEncCnt = 0;		// Encoder count right motor
+			volatile int32_t lEncCnt = 0;		// Encoder count left motor (quadrature decoder: count at the last poll)
+			volatile int32_t rEncCnt = 0;		// Encoder count right motor (quadrature decoder: count at the last poll)
+
+			volatile uint32_t lEdgeTime = 0;	// Time lEncCnt changed the last time (us)
+			volatile uint32_t rEdgeTime = 0;	// Time rEncCnt changed the last time (us)
+
+			// State of the speed estimation of one wheel
+			struct SpeedEstimator
+			{
+				int32_t lastCount;			// Count at the last calculation
+				uint32_t lastEdgeTime;		// Time of the last edge at the last calculation (us)
+				float periodSpeed;			// Speed by the time between the edges (cm/s)
+			};
+
+			SpeedEstimator lEstimator = SpeedEstimator{ 0, 0, 0.0f };
+			SpeedEstimator rEstimator = SpeedEstimator{ 0, 0, 0.0f };
 
 			volatile FloatWheelSpeeds speeds = FloatWheelSpeeds { 0.0f, 0.0f };		// Current motor speeds (cm/s)
 
 			volatile WheelSpeeds desSpeeds = WheelSpeeds{ 0.0f, 0.0f };				// Desired motor speed (cm/s)
 
-			// Get output voltage of motor
-			float getVoltage(const Motor motor)
+			volatile FloatWheelSpeeds lastPWMVal = FloatWheelSpeeds{ 0.0f, 0.0f };	// Last PWM values (duty cycle with direction)
+
+#ifdef USE_TC_QDEC
+			// Count all edges of both encoder channels in the quadrature decoder of a TC block - no CPU time per edge
+			void setupQdec(const PinMapping::PinInformation encA, const PinMapping::PinInformation encB, Tc* const tc)
 			{
-				// Wait for end of conversion
-				while (!(ADC->ADC_ISR & ADC_ISR_DRDY));
+				const uint8_t peripheralID = ID_TC0 + 3 * PinMapping::getTCChannel(encA);
 
-				if (motor == Motor::left)
+				if (peripheralID < 32) PMC->PMC_PCER0 = 1 << peripheralID;
+				else PMC->PMC_PCER1 = 1 << (peripheralID - 32);
+
+				encA.port->PIO_PUER = encA.pin;
+				encB.port->PIO_PUER = encB.pin;
+				encA.port->PIO_PDR = encA.pin;
+				encB.port->PIO_PDR = encB.pin;
+
+				if (PinMapping::toABPeripheral(encA)) encA.port->PIO_ABSR |= encA.pin;
+				else encA.port->PIO_ABSR &= ~encA.pin;
+
+				if (PinMapping::toABPeripheral(encB)) encB.port->PIO_ABSR |= encB.pin;
+				else encB.port->PIO_ABSR &= ~encB.pin;
+
+				// Position mode, 4x resolution; swap the phases if encoder pin A is on TIOB, so the direction stays the same
+				tc->TC_CHANNEL[0].TC_CMR = TC_CMR_TCCLKS_XC0;
+				tc->TC_BMR = TC_BMR_QDEN | TC_BMR_POSEN | TC_BMR_EDGPHA | TC_BMR_MAXFILT(JAFDSettings::MotorControl::qdecFilter) | (isTIOB(encA) ? TC_BMR_SWAP : 0);
+				tc->TC_CHANNEL[0].TC_CCR = TC_CCR_CLKEN | TC_CCR_SWTRG;
+			}
+#endif
+
+			// Speed of one wheel by the time between the last edges of two calculations (cm/s)
+			// At 1kHz there are only a few edges per calculation (max. ~2, ~8 with the quadrature decoder) - the count based speed would have a
+			// resolution of one edge per ms (~21cm/s, ~5cm/s with the quadrature decoder), so it is only used for the first edges after a standstill
+			float estimateSpeed(SpeedEstimator& estimator, const int32_t count, const uint32_t edgeTime, const float dt)
+			{
+				constexpr float distPerPulse = JAFDSettings::Mechanics::wheelDiameter * PI / JAFDSettings::MotorControl::pulsePerRev;	// Distance per encoder edge (cm)
+
+				const int32_t pulses = count - estimator.lastCount;
+				const float countSpeed = pulses * distPerPulse / dt;
+				const float timeSinceEdge = (micros() - estimator.lastEdgeTime) * 1.0e-6f;
+
+				if (pulses != 0)
 				{
-					float voltA = ADC->ADC_CDR[lVoltADCChA] * 3.3f / ((1 << 12) - 1) * JAFDSettings::MotorControl::voltageSensFactor;
-					float voltB = ADC->ADC_CDR[lVoltADCChB] * 3.3f / ((1 << 12) - 1) * JAFDSettings::MotorControl::voltageSensFactor;
+					const uint32_t edgeDt = edgeTime - estimator.lastEdgeTime;
 
-					return fabsf(voltA - voltB);
+					// The last edge before a standstill doesn't mark the start of the movement
+					if (edgeDt == 0 || timeSinceEdge > JAFDSettings::MotorControl::standstillTime) estimator.periodSpeed = countSpeed;
+					else estimator.periodSpeed = pulses * distPerPulse * 1.0e6f / edgeDt;
+
+					estimator.lastEdgeTime = edgeTime;
+				}
+				else if (timeSinceEdge > JAFDSettings::MotorControl::standstillTime)
+				{
+					estimator.periodSpeed = 0.0f;
 				}
 				else
 				{
-					float voltA = ADC->ADC_CDR[rVoltADCChA] * 3.3f / (1 << 12 - 1) * JAFDSettings::MotorControl::voltageSensFactor;
-					float voltB = ADC->ADC_CDR[rVoltADCChB] * 3.3f / (1 << 12 - 1) * JAFDSettings::MotorControl::voltageSensFactor;
+					// No new edge -> the wheel can't be faster than one edge since the last one
+					const float maxSpeed = distPerPulse / timeSinceEdge;
+
+					if (fabsf(estimator.periodSpeed) > maxSpeed) estimator.periodSpeed = maxSpeed * sgn(estimator.periodSpeed);
+				}
+
+				estimator.lastCount = count;
+
+				return estimator.periodSpeed;
+			}
+
+			// Encoder counts
+			inline int32_t getLeftCount()
+			{
+#ifdef USE_TC_QDEC
+				return static_cast<int32_t>(lQdecTC->TC_CHANNEL[0].TC_CV);
+#else
+				return lEncCnt;
+#endif
+			}
+
+			inline int32_t getRightCount()
+			{
+#ifdef USE_TC_QDEC
+				return static_cast<int32_t>(rQdecTC->TC_CHANNEL[0].TC_CV);
+#else
+				return rEncCnt;
+#endif
+			}
 
-					return fabsf(voltA - voltB);
+			// Filtered voltage at an ADC pin (V)
+			inline float getADCVoltage(const uint8_t channel)
+			{
+				return adcValues[adcSeqPos(channel)] * 3.3f / ((1 << 12) - 1);
+			}
+
+			// Get mean output voltage of motor; the samples are from the on phase -> times the duty cycle
+			float getVoltage(const Motor motor)
+			{
+				if (motor == Motor::left)
+				{
+					return fabsf(getADCVoltage(lVoltADCChA) - getADCVoltage(lVoltADCChB)) * JAFDSettings::MotorControl::voltageSensFactor * fabsf(lastPWMVal.left);
+				}
+				else
+				{
+					return fabsf(getADCVoltage(rVoltADCChA) - getADCVoltage(rVoltADCChB)) * JAFDSettings::MotorControl::voltageSensFactor * fabsf(lastPWMVal.right);
 				}
 			}
 		}
@@ -97,7 +251,7 @@ namespace JAFD
 			if (!PinMapping::hasPWM(lPWM) || !PinMapping::hasPWM(rPWM) ||
 				!PinMapping::hasADC(lCurFb) || !PinMapping::hasADC(rCurFb) ||
 				!PinMapping::hasADC(lVoltFbA) || !PinMapping::hasADC(lVoltFbB) ||
-				!PinMapping::hasADC(lVoltFbA) || !PinMapping::hasADC(lVoltFbB))
+				!PinMapping::hasADC(rVoltFbA) || !PinMapping::hasADC(rVoltFbB))
 			{
 				return ReturnCode::fatalError;
 			}
@@ -123,6 +277,10 @@ namespace JAFD
 			rInB.port->PIO_OER = rInB.pin;
 			rInB.port->PIO_CODR = rInB.pin;
 
+#ifdef USE_TC_QDEC
+			setupQdec(lEncA, lEncB, lQdecTC);
+			setupQdec(rEncA, rEncB, rQdecTC);
+#else
 			// Left Encoder A
 			lEncA.port->PIO_PER = lEncA.pin;
 			lEncA.port->PIO_ODR = lEncA.pin;
@@ -162,12 +320,11 @@ namespace JAFD
 			rEncB.port->PIO_DIFSR = rEncB.pin;
 			rEncB.port->PIO_SCDR = PIO_SCDR_DIV(0);
 			rEncB.port->PIO_IFER = rEncB.pin;
+#endif
 
-			// Setup PWM - Controller (20kHz)
-			PWM->PWM_ENA = 1 << lPWMCh | 1 << rPWMCh;
-
-			PWM->PWM_CH_NUM[lPWMCh].PWM_CMR = PWM_CMR_CPRE_CLKA;
-			PWM->PWM_CH_NUM[lPWMCh].PWM_CPRD = 4200;
+			// Setup PWM - Controller (20kHz, center aligned)
+			PWM->PWM_CH_NUM[lPWMCh].PWM_CMR = PWM_CMR_CPRE_CLKA | PWM_CMR_CALG;
+			PWM->PWM_CH_NUM[lPWMCh].PWM_CPRD = pwmPeriod;
 			PWM->PWM_CH_NUM[lPWMCh].PWM_CDTY = 0;
 
 			if (PinMapping::getPWMStartState(lPWM) == PinMapping::PWMStartState::high)
@@ -175,8 +332,8 @@ namespace JAFD
 				PWM->PWM_CH_NUM[lPWMCh].PWM_CMR |= PWM_CMR_CPOL;
 			}
 
-			PWM->PWM_CH_NUM[rPWMCh].PWM_CMR = PWM_CMR_CPRE_CLKA;
-			PWM->PWM_CH_NUM[rPWMCh].PWM_CPRD = 4200;
+			PWM->PWM_CH_NUM[rPWMCh].PWM_CMR = PWM_CMR_CPRE_CLKA | PWM_CMR_CALG;
+			PWM->PWM_CH_NUM[rPWMCh].PWM_CPRD = pwmPeriod;
 			PWM->PWM_CH_NUM[rPWMCh].PWM_CDTY = 0;
 
 			if (PinMapping::getPWMStartState(rPWM) == PinMapping::PWMStartState::high)
@@ -205,45 +362,75 @@ namespace JAFD
 				rPWM.port->PIO_ABSR &= ~rPWM.pin;
 			}
 
-			// Setup ADC (Freerunning mode / 21MHz); No Gain and Offset
+			// Setup ADC (Triggered by TIOA2 / 21MHz); No Gain and Offset
 			PMC->PMC_PCER1 = PMC_PCER1_PID37;
 
-			ADC->ADC_MR = ADC_MR_FREERUN_ON | ADC_MR_PRESCAL(3) | ADC_MR_STARTUP_SUT896 | ADC_MR_SETTLING_AST5 | ADC_MR_TRACKTIM(0) | ADC_MR_TRANSFER(1);
-			ADC->ADC_CHER = 1 << lCurADCCh | 1 << rCurADCCh | 1 << lVoltADCChA | 1 << rVoltADCChA | 1 << lVoltADCChB | 1 << rVoltADCChB;
+			ADC->ADC_MR = ADC_MR_TRGEN_EN | ADC_MR_TRGSEL_ADC_TRIG3 | ADC_MR_PRESCAL(1) | ADC_MR_STARTUP_SUT896 | ADC_MR_SETTLING_AST5 | ADC_MR_TRACKTIM(0) | ADC_MR_TRANSFER(1);
+			ADC->ADC_CHER = adcChannels;
+
+			// The PDC writes the samples to the buffer blocks; an interrupt after each block evaluates it and hands it back
+			ADC->ADC_RPR = reinterpret_cast<uint32_t>(adcBuffer[0]);
+			ADC->ADC_RCR = adcBlockSize;
+			ADC->ADC_RNPR = reinterpret_cast<uint32_t>(adcBuffer[1]);
+			ADC->ADC_RNCR = adcBlockSize;
+			ADC->ADC_PTCR = ADC_PTCR_RXTEN;
+			ADC->ADC_IDR = ~0UL;
+			ADC->ADC_IER = ADC_IER_ENDRX;
+
+			NVIC_SetPriority(ADC_IRQn, JAFDSettings::MotorControl::adcInterruptPriority);
+			NVIC_EnableIRQ(ADC_IRQn);
+
+			// Setup ADC trigger: Same period as the PWM (MCK / 2 -> pwmPeriod counts); TIOA2 rises adcSampleLead before the middle of the on phase
+			PMC->PMC_PCER0 = 1 << ID_TC2;
+
+			adcTrigger->TC_CMR = TC_CMR_TCCLKS_TIMER_CLOCK1 | TC_CMR_WAVE | TC_CMR_WAVSEL_UP_RC | TC_CMR_ACPA_SET | TC_CMR_ACPC_CLEAR;
+			adcTrigger->TC_RC = pwmPeriod - 1;	// Counts from 0 to RC
+			adcTrigger->TC_RA = pwmPeriod - static_cast<uint32_t>(JAFDSettings::MotorControl::adcSampleLead * VARIANT_MCK / 2.0e6f + 0.5f);
+
+			// Start PWM and ADC trigger together, so that the samples stay in the middle of the on phase
+			__disable_irq();
+			PWM->PWM_ENA = 1 << lPWMCh | 1 << rPWMCh;
+			adcTrigger->TC_CCR = TC_CCR_CLKEN | TC_CCR_SWTRG;
+			__enable_irq();
 
 			return ReturnCode::ok;
 		}
 
-		void calcMotorSpeed(const uint8_t freq)
+		void calcMotorSpeed(const float dt)
 		{
-			static int32_t lastLeftCnt = 0;
-			static int32_t lastRightCnt = 0;
+			// Count and time of the last edge have to match
+			__disable_irq();
+			const int32_t leftCnt = lEncCnt;
+			const uint32_t leftEdgeTime = lEdgeTime;
+			const int32_t rightCnt = rEncCnt;
+			const uint32_t rightEdgeTime = rEdgeTime;
+			__enable_irq();
 
 			// Calculate speeds
-			speeds.left = ((lEncCnt - lastLeftCnt) / (JAFDSettings::MotorControl::pulsePerRev) * JAFDSettings::Mechanics::wheelDiameter * PI * freq);
-			speeds.right = ((rEncCnt - lastRightCnt) / (JAFDSettings::MotorControl::pulsePerRev) * JAFDSettings::Mechanics::wheelDiameter * PI * freq);
-
-			lastLeftCnt = lEncCnt;
-			lastRightCnt = rEncCnt;
+			speeds.left = estimateSpeed(lEstimator, leftCnt, leftEdgeTime, dt);
+			speeds.right = estimateSpeed(rEstimator, rightCnt, rightEdgeTime, dt);
 		}
 
-		void speedPID(const uint8_t freq)
+		void speedPID(const float dt)
 		{
 			FloatWheelSpeeds setSpeed;	// Speed calculated by PID
 
-			static FloatWheelSpeeds lastPWMVal = FloatWheelSpeeds { 0.0f, 0.0f };	// Last PWM values
 			static float leftPWMReduction = JAFDSettings::MotorControl::initPWMReduction;	// PWM reduction to prevent overvoltage
 			static float rightPWMReduction = JAFDSettings::MotorControl::initPWMReduction;	// PWM reduction to prevent overvoltage
 
+			// The IIR factor refers to a fixed time step, not to a call
+			float pwmRedFactor = JAFDSettings::MotorControl::pwmRedIIRFactor * dt / JAFDSettings::MotorControl::pwmRedIIRTime;
+			if (pwmRedFactor > 1.0f) pwmRedFactor = 1.0f;
+
 			// Update PWM reduction factor with IIR
 			if (lastPWMVal.left > 0.2)
 			{
-				leftPWMReduction = JAFDSettings::MotorControl::pwmRedIIRFactor * (lastPWMVal.left * 6.0f / getVoltage(Motor::left)) + (1 - JAFDSettings::MotorControl::pwmRedIIRFactor) * leftPWMReduction;
+				leftPWMReduction = pwmRedFactor * (lastPWMVal.left * 6.0f / getVoltage(Motor::left)) + (1 - pwmRedFactor) * leftPWMReduction;
 			}
 
 			if (lastPWMVal.right > 0.2)
 			{
-				rightPWMReduction = JAFDSettings::MotorControl::pwmRedIIRFactor * (lastPWMVal.right * 6.0f / getVoltage(Motor::right)) + (1 - JAFDSettings::MotorControl::pwmRedIIRFactor) * rightPWMReduction;
+				rightPWMReduction = pwmRedFactor * (lastPWMVal.right * 6.0f / getVoltage(Motor::right)) + (1 - pwmRedFactor) * rightPWMReduction;
 			}
 
 			if (leftPWMReduction > 2.0f * JAFDSettings::MotorControl::initPWMReduction) leftPWMReduction = JAFDSettings::MotorControl::initPWMReduction;
@@ -257,7 +444,7 @@ namespace JAFD
 			}
 			else
 			{
-				setSpeed.left = leftPID.process(desSpeeds.left, speeds.left, 1.0f / freq);
+				setSpeed.left = leftPID.process(desSpeeds.left, speeds.left, dt);
 
 				if (setSpeed.left < JAFDSettings::MotorControl::minSpeed && setSpeed.left > -JAFDSettings::MotorControl::minSpeed) setSpeed.left = JAFDSettings::MotorControl::minSpeed * sgn(desSpeeds.left);
 				
@@ -273,7 +460,7 @@ namespace JAFD
 			}
 			else
 			{
-				setSpeed.right = rightPID.process(desSpeeds.right, speeds.right, 1.0f / freq);
+				setSpeed.right = rightPID.process(desSpeeds.right, speeds.right, dt);
 
 				if (setSpeed.right < JAFDSettings::MotorControl::minSpeed && setSpeed.right > -JAFDSettings::MotorControl::minSpeed) setSpeed.right = JAFDSettings::MotorControl::minSpeed * sgn(desSpeeds.right);
 			
@@ -311,7 +498,8 @@ namespace JAFD
 			setSpeed.right *= rightPWMReduction;
 
 			// Update last PWM values
-			lastPWMVal = setSpeed;
+			lastPWMVal.left = setSpeed.left;
+			lastPWMVal.right = setSpeed.right;
 
 			// Set PWM Value
 			PWM->PWM_CH_NUM[lPWMCh].PWM_CDTYUPD = (PWM->PWM_CH_NUM[lPWMCh].PWM_CPRD * fabsf(setSpeed.left));
@@ -329,20 +517,26 @@ namespace JAFD
 			return FloatWheelSpeeds{ speeds.left, -speeds.right };
 		}
 
+		WheelSpeeds getDesSpeeds()
+		{
+			return WheelSpeeds{ desSpeeds.left, static_cast<int16_t>(-desSpeeds.right) };
+		}
+
 		float getDistance(const Motor motor)
 		{
 			if (motor == Motor::left)
 			{
-				return lEncCnt / JAFDSettings::MotorControl::pulsePerRev * JAFDSettings::Mechanics::wheelDiameter * PI;
+				return getLeftCount() / JAFDSettings::MotorControl::pulsePerRev * JAFDSettings::Mechanics::wheelDiameter * PI;
 			}
 			else
 			{
-				return rEncCnt / JAFDSettings::MotorControl::pulsePerRev * JAFDSettings::Mechanics::wheelDiameter * PI * -1;
+				return getRightCount() / JAFDSettings::MotorControl::pulsePerRev * JAFDSettings::Mechanics::wheelDiameter * PI * -1;
 			}
 		}
 
 		void encoderInterrupt(const Interrupts::InterruptSource source, const uint32_t isr)
 		{
+#ifndef USE_TC_QDEC
 			if (lEncA.portID == static_cast<uint8_t>(source) && (isr & lEncA.pin))
 			{
 				if (lEncB.port->PIO_PDSR & lEncB.pin)
@@ -353,6 +547,8 @@ namespace JAFD
 				{
 					lEncCnt++;
 				}
+
+				lEdgeTime = micros();
 			}
 			
 			if (rEncA.portID == static_cast<uint8_t>(source) && (isr & rEncA.pin))
@@ -365,40 +561,90 @@ namespace JAFD
 				{
 					rEncCnt++;
 				}
+
+				rEdgeTime = micros();
+			}
+#endif
+		}
+
+		void pollEncoders()
+		{
+#ifdef USE_TC_QDEC
+			// The TC can't capture the edge times: Channel 0 is clocked by the decoded edges, and the speed mode (TC_BMR_SPEEDEN) only captures the count
+			// at a time base from channel 2 (which triggers the ADC). So the "edge time" is the time of the poll, and the time between edges is a multiple of 1ms -
+			// the edge time based speed becomes the number of edges over the whole ms since the last change, without the sub-ms resolution of the PIO interrupts
+			const int32_t leftCnt = getLeftCount();
+			const int32_t rightCnt = getRightCount();
+
+			if (leftCnt != lEncCnt)
+			{
+				lEncCnt = leftCnt;
+				lEdgeTime = micros();
+			}
+
+			if (rightCnt != rEncCnt)
+			{
+				rEncCnt = rightCnt;
+				rEdgeTime = micros();
 			}
+#endif
 		}
 
 		void setSpeeds(const WheelSpeeds wheelSpeeds)
 		{
-			desSpeeds.left = wheelSpeeds.left;
-			desSpeeds.right = -wheelSpeeds.right;
+			WheelSpeeds newSpeeds = WheelSpeeds{ wheelSpeeds.left, static_cast<int16_t>(-wheelSpeeds.right) };
+
+			if (newSpeeds.left < JAFDSettings::MotorControl::minSpeed && newSpeeds.left > -JAFDSettings::MotorControl::minSpeed) newSpeeds.left = 0;
 
-			if (desSpeeds.left < JAFDSettings::MotorControl::minSpeed && desSpeeds.left > -JAFDSettings::MotorControl::minSpeed) desSpeeds.left = 0;
+			if (newSpeeds.right < JAFDSettings::MotorControl::minSpeed && newSpeeds.right > -JAFDSettings::MotorControl::minSpeed) newSpeeds.right = 0;
 
-			if (desSpeeds.right < JAFDSettings::MotorControl::minSpeed && desSpeeds.right > -JAFDSettings::MotorControl::minSpeed) desSpeeds.right = 0;
+			// The speed PID-Controller (TC3) can interrupt the trajectory loop; called from the main loop too
+			const uint32_t primask = __get_PRIMASK();
+			__disable_irq();
+			desSpeeds.left = newSpeeds.left;
+			desSpeeds.right = newSpeeds.right;
+			__set_PRIMASK(primask);
 		}
 
-		float getCurrent(const Motor motor)
+		void adcInterrupt()
 		{
-			float result = 0.0f;
+			uint32_t sums[adcSeqLength] = {};
+			const uint16_t* block = adcBuffer[adcNextBlock];
 
-			// Sample values and return average
-			for (uint8_t i = 0; i < JAFDSettings::MotorControl::currentADCSampleCount; i++)
+			for (uint16_t i = 0; i < adcBlockSize; i += adcSeqLength)
 			{
-				// Wait for end of conversion
-				while (!(ADC->ADC_ISR & ADC_ISR_DRDY));
+				for (uint8_t j = 0; j < adcSeqLength; j++) sums[j] += block[i + j];
+			}
 
-				if (motor == Motor::left)
-				{
-					result += ADC->ADC_CDR[lCurADCCh] * 3.3f / (1 << 12 - 1) * JAFDSettings::MotorControl::currentSensFactor;
-				}
-				else
-				{
-					result += ADC->ADC_CDR[rCurADCCh] * 3.3f / (1 << 12 - 1) * JAFDSettings::MotorControl::currentSensFactor;
-				}
+			// Keep the last values of a motor if its on phase is shorter than the conversion sequence
+			const bool leftValid = fabsf(lastPWMVal.left) >= adcMinDuty;
+			const bool rightValid = fabsf(lastPWMVal.right) >= adcMinDuty;
+
+			for (uint8_t j = 0; j < adcSeqLength; j++)
+			{
+				if (!((adcLeftSeqMask & (1 << j)) ? leftValid : rightValid)) continue;
+
+				adcValues[j] = JAFDSettings::MotorControl::adcIIRFactor * sums[j] / JAFDSettings::MotorControl::adcBlockPeriods + (1.0f - JAFDSettings::MotorControl::adcIIRFactor) * adcValues[j];
 			}
 
-			return result / JAFDSettings::MotorControl::currentADCSampleCount;
+			// The PDC fills the other block at the moment -> this one is the next block again
+			ADC->ADC_RNPR = reinterpret_cast<uint32_t>(block);
+			ADC->ADC_RNCR = adcBlockSize;
+
+			adcNextBlock ^= 1;
+		}
+
+		float getCurrent(const Motor motor)
+		{
+			// The samples are from the on phase -> current through the motor, not the mean supply current (on phase current times the duty cycle)
+			if (motor == Motor::left)
+			{
+				return getADCVoltage(lCurADCCh) * JAFDSettings::MotorControl::currentSensFactor;
+			}
+			else
+			{
+				return getADCVoltage(rCurADCCh) * JAFDSettings::MotorControl::currentSensFactor;
+			}
 		}
 	}
 }
\ No newline at end of file
@@ -19,9 +19,11 @@ namespace JAFD
 			RelativeDir relativeTurnDir;
 			bool found = false;
 
-			const auto tempFusedData = SensorFusion::getFusedData();
+			GridCell tempCell;
+			float tempCertainty;
+			SensorFusion::readGridCell(tempCell, tempCertainty);
 
-			if (tempFusedData.gridCellCertainty >= 0.5f)
+			if (tempCertainty >= 0.5f)
 			{
 				switch (relativeTurnDir)
 				{
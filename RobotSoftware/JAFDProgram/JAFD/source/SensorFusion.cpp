@@ -8,10 +8,17 @@ This file of the library is responsible for the sensor fusion
 #include "../header/Math.h"
 #include "../header/SensorFusion.h"
 #include "../header/MotorControl.h"
+#include "../header/AsyncI2C.h"
+#include "../header/SmallThings.h"
 #include "../header/DistanceSensors.h"
 #include "../header/Bno055.h"
 #include "../header/TCS34725.h"
 #include "../header/RobotLogic.h"
+#include "../header/WallLineEstimator.h"
+#include "../header/WallEdgeDetector.h"
+#include "../header/SlipDetector.h"
+#include "../header/Localization.h"
+#include "../header/SeqLock.h"
 #include "../../JAFDSettings.h"
 
 #include <cmath>
@@ -23,20 +30,314 @@ namespace JAFD
 	{
 		namespace
 		{
-			volatile FusedData fusedData;				// Fused data
+			FusedData fusedData;						// Fused data (guarded by fusedDataSeq)
+			SeqLock fusedDataSeq;						// Sequence lock of fusedData
 			volatile float totalHeadingOff = 0.0f;		// Total heading offset
 			volatile float distSensSpeed = 0.0f;		// Linear speed measured by distance sensors
 			volatile float distSensSpeedTrust = 0.0f;	// How much can I trust the measured speed by the distance sensors? (0.0 - 1.0)
 			volatile float distSensAngle = 0.0f;		// Angle measured by distance sensors (rad)
 			volatile float distSensAngleTrust = 0.0f;	// How much can I trust the measured angle? (0.0 - 1.0)
-			volatile bool trustWheels = false;			// Should I trust the wheel measurements? Or are they slipping?
+			volatile uint32_t distSensAngleTime = 0;	// Time of the newest distance used for distSensAngle
+			volatile uint32_t distSensAngleCount = 0;	// Number of angles measured with new distances
+			volatile float wheelTrust = 1.0f;			// How much can I trust the wheel measurements? Or are they slipping? (0.0 - 1.0)
+			volatile bool wheelStalled = false;			// Does a wheel stall?
 			volatile float distSensX = 0.0f;
 			volatile float distSensY = 0.0f;
 			volatile float distSensXTrust = 0.0f;
 			volatile float distSensYTrust = 0.0f;
+
+			// Sequence numbers of the inputs of untimedFusion() (guarded by fusedDataSeq as well)
+			struct UpdateCounts
+			{
+				uint32_t robotState = 0;		// Number of robot state updates
+				uint32_t distances = 0;			// Number of distance updates (to use every measurement only once for the map)
+				uint32_t distSensStates = 0;	// Number of distance sensor state updates
+			} updateCounts;
+
+			WallLineEstimator leftWallLine;				// Wall line fitted to the hit points of the left sensors (only used by untimedFusion())
+			WallLineEstimator rightWallLine;			// Wall line fitted to the hit points of the right sensors (only used by untimedFusion())
+
+			// Bno055 drift and scale estimation (only used by sensorFiltering())
+			volatile bool resetBnoCorrection = true;	// Restart the correction (e.g. after a tare)
+			float lastRawBnoHeading = 0.0f;				// Last uncorrected Bno055 heading
+			float correctedBnoHeading = 0.0f;			// Corrected Bno055 heading (continuous)
+			float unbiasedBnoTurn = 0.0f;				// Total Bno055 rotation without drift, but without scale correction
+			float bnoBias = 0.0f;						// Heading drift of the Bno055 (rad/s)
+			float bnoScale = 1.0f;						// Scale of the Bno055 rotation
+			float standstillTime = 0.0f;				// How long is the robot already standing still? (s)
+			float lastRefHeading = 0.0f;				// Last heading reference from the distance sensors (continuous)
+			float lastRefBnoTurn = 0.0f;				// unbiasedBnoTurn at the last heading reference
+			bool hasHeadingRef = false;					// Is there a last heading reference?
+			uint32_t lastRefAngleCount = 0;				// distSensAngleCount at the last heading reference check
+
+			// Slip detection (only used by sensorFiltering())
+			SlipDetector slipDetector;
+			float lastBnoHeading = 0.0f;				// Corrected Bno055 heading in the last cycle
+
+			// Wall edge detectors of the side sensors (only used by untimedFusion())
+			WallEdgeDetector leftFrontEdges(JAFDSettings::SensorFusion::minDeltaDistForEdge);
+			WallEdgeDetector leftBackEdges(JAFDSettings::SensorFusion::minDeltaDistForEdge);
+			WallEdgeDetector rightFrontEdges(JAFDSettings::SensorFusion::minDeltaDistForEdge);
+			WallEdgeDetector rightBackEdges(JAFDSettings::SensorFusion::minDeltaDistForEdge);
+
+			// Past poses for latency compensation of distance measurements (guarded by fusedDataSeq as well)
+			struct PoseHistoryEntry
+			{
+				uint32_t time;				// Time of the pose (millis())
+				Vec3f position;				// Position at this time
+				float globalHeading;		// Heading at this time
+				float bnoTurn;				// unbiasedBnoTurn at this time
+			};
+
+			// The filtered distances are stamped with the time of the median sample -> up to half a filter window of samples old
+			static_assert(JAFDSettings::SensorFusion::maxSampleAge >= (JAFDSettings::DistanceSensors::filterWindow - 1) / 2 * JAFDSettings::DistanceSensors::Sampling::slowInterval + JAFDSettings::DistanceSensors::vl6180Period, "The pose history doesn't cover the delay of the distance filters");
+			static_assert(JAFDSettings::SensorFusion::maxSampleAge / 1000.0f * JAFDSettings::TimedLoop::Fusion::freq + 3.0f <= 255.0f, "The pose history is too long");
+
+			PoseHistoryEntry poseHistory[JAFDSettings::SensorFusion::poseHistoryLength];
+			uint8_t poseHistoryHead = 0;	// Index of newest pose
+			uint8_t poseHistoryCount = 0;	// Number of valid poses
+
+			// Pose of the robot at the time a distance got measured
+			struct SensorPose
+			{
+				Vec3f position;				// Position when the measurement was taken
+				float globalHeading;		// Heading when the measurement was taken
+				float headingCos;
+				float headingSin;
+				Vec3f shift;				// Movement since the measurement (current position - position)
+			};
+
+			// Writers: sensorFiltering() in the fusion stage (TC4) writes without further locking; faster stages (TC3) must not read fusedData.
+			// Writers in the main loop have to disable interrupts around beginWrite() / endWrite(), so a reader inside an ISR never sees a write in progress.
+
+			// Only called inside of fusedDataSeq.beginWrite() / endWrite()
+			void addPoseToHistory(const uint32_t time, const RobotState& robotState)
+			{
+				poseHistoryHead = (poseHistoryHead + 1) % JAFDSettings::SensorFusion::poseHistoryLength;
+				poseHistory[poseHistoryHead].time = time;
+				poseHistory[poseHistoryHead].position = robotState.position;
+				poseHistory[poseHistoryHead].globalHeading = robotState.globalHeading;
+				poseHistory[poseHistoryHead].bnoTurn = unbiasedBnoTurn;
+
+				if (poseHistoryCount < JAFDSettings::SensorFusion::poseHistoryLength) poseHistoryCount++;
+			}
+
+			// Linear interpolation between the two poses around "time". Clamps to the oldest / newest pose.
+			PoseHistoryEntry interpolatePose(const uint32_t time)
+			{
+				PoseHistoryEntry pose;
+				uint32_t seq;
+
+				pose.time = time;
+
+				do
+				{
+					seq = fusedDataSeq.beginRead();
+
+					pose.position = fusedData.robotState.position;
+					pose.globalHeading = fusedData.robotState.globalHeading;
+					pose.bnoTurn = unbiasedBnoTurn;
+
+					if (poseHistoryCount > 0)
+					{
+						const PoseHistoryEntry* newer = &poseHistory[poseHistoryHead];
+
+						pose.position = newer->position;
+						pose.globalHeading = newer->globalHeading;
+						pose.bnoTurn = newer->bnoTurn;
+
+						if (static_cast<int32_t>(time - newer->time) < 0)
+						{
+							for (uint8_t i = 1; i < poseHistoryCount; i++)
+							{
+								const PoseHistoryEntry* older = &poseHistory[(poseHistoryHead + JAFDSettings::SensorFusion::poseHistoryLength - i) % JAFDSettings::SensorFusion::poseHistoryLength];
+
+								if (static_cast<int32_t>(time - older->time) >= 0)
+								{
+									const float factor = (newer->time != older->time) ? static_cast<float>(time - older->time) / static_cast<float>(newer->time - older->time) : 1.0f;
+
+									pose.position = older->position + (newer->position - older->position) * factor;
+									pose.globalHeading = older->globalHeading + (newer->globalHeading - older->globalHeading) * factor;
+									pose.bnoTurn = older->bnoTurn + (newer->bnoTurn - older->bnoTurn) * factor;
+									break;
+								}
+
+								// Use the oldest pose if "time" is older than all entries
+								pose.position = older->position;
+								pose.globalHeading = older->globalHeading;
+								pose.bnoTurn = older->bnoTurn;
+								newer = older;
+							}
+						}
+					}
+				} while (fusedDataSeq.retryRead(seq));
+
+				return pose;
+			}
+
+			// Take the timestamp of a distance used for the angle measurement; the angle is as old as its newest distance
+			void useForAngle(const uint32_t timestamp, const bool fresh, uint32_t& angleTime, bool& newAngle)
+			{
+				if (static_cast<int32_t>(timestamp - angleTime) > 0) angleTime = timestamp;
+
+				newAngle |= fresh;
+			}
+
+			SensorPose getSensorPose(const uint32_t time, const RobotState& currentState)
+			{
+				SensorPose pose;
+				const PoseHistoryEntry pastPose = interpolatePose(time);
+
+				pose.position = pastPose.position;
+				pose.globalHeading = pastPose.globalHeading;
+
+				pose.headingCos = cosf(pose.globalHeading);
+				pose.headingSin = sinf(pose.globalHeading);
+				pose.shift = currentState.position - pose.position;
+
+				return pose;
+			}
+
+			// Unit vector and angle of every AbsoluteDir (north = +x, west = +y)
+			constexpr int8_t dirUnitX[4] = { 1, 0, -1, 0 };
+			constexpr int8_t dirUnitY[4] = { 0, -1, 0, 1 };
+			constexpr float dirAngle[4] = { 0.0f, -M_PI_2, M_PI, M_PI_2 };
+
+			// Add the offset to the cell middle if the wall in the given direction is at distance distToMiddle from the robot middle
+			void addWallOffset(const AbsoluteDir dir, const float distToMiddle, const Vec3f& shift, float& xOffset, float& yOffset, float& xTrust, float& yTrust)
+			{
+				const uint8_t i = static_cast<uint8_t>(dir);
+
+				xOffset += dirUnitX[i] * (distToMiddle + dirUnitX[i] * shift.x);
+				yOffset += dirUnitY[i] * (distToMiddle + dirUnitY[i] * shift.y);
+				xTrust += dirUnitX[i] * dirUnitX[i];
+				yTrust += dirUnitY[i] * dirUnitY[i];
+			}
+
+			// Heading error of the robot which makes a straight wall appear with the slope of the fitted wall line; false if the line is too uncertain
+			bool wallLineHeadingError(const WallLine& line, const uint8_t headingIndex, float& error)
+			{
+				// Variance of atan(slope) ~ slopeVariance / (1 + slope^2)^2
+				if (line.slopeVariance > JAFDSettings::SensorFusion::wallLineMaxAngleVar * (1.0f + line.slope * line.slope) * (1.0f + line.slope * line.slope)) return false;
+
+				// Along = x for north / south, along = y for east / west (mirrored)
+				error = (headingIndex & 0x1) ? -atanf(line.slope) : atanf(line.slope);
+
+				return true;
+			}
+
+			// Position correction along the driving axis if a side sensor passed a wall edge; wall edges are always at cell borders
+			// sensorOffset: Distance of the sensor in front of the robot middle (cm); false if there is no usable edge
+			bool edgeCorrection(const WallEdge& edge, const float sensorOffset, const uint8_t headingIndex, float& correction)
+			{
+				if (edge.type == WallEdgeType::none) return false;
+
+				const Vec3f position = interpolatePose(edge.time).position;
+
+				// Along coordinate of the sensor when it passed the edge
+				const float edgeCoor = (headingIndex & 0x1) ? position.y + dirUnitY[headingIndex] * sensorOffset : position.x + dirUnitX[headingIndex] * sensorOffset;
+				const float border = (floorf(edgeCoor / JAFDSettings::Field::cellWidth) + 0.5f) * JAFDSettings::Field::cellWidth;
+
+				correction = border - edgeCoor;
+
+				return fabsf(correction) <= JAFDSettings::SensorFusion::edgeMaxCorrection;
+			}
+
+			// Shift the current position and all past poses (only called in the main loop)
+			void shiftPosition(const Vec3f& shift)
+			{
+				__disable_irq();
+				fusedDataSeq.beginWrite();
+
+				fusedData.robotState.position += shift;
+				updateCounts.robotState++;
+
+				for (uint8_t i = 0; i < poseHistoryCount; i++)
+				{
+					poseHistory[(poseHistoryHead + JAFDSettings::SensorFusion::poseHistoryLength - i) % JAFDSettings::SensorFusion::poseHistoryLength].position += shift;
+				}
+
+				fusedDataSeq.endWrite();
+				__enable_irq();
+			}
+
+			// Remove drift and scale error from the Bno055 heading
+			float correctBnoHeading(const float rawHeading, const FloatWheelSpeeds& wheelSpeeds, const float dt, const float realDt)
+			{
+				if (resetBnoCorrection)
+				{
+					lastRawBnoHeading = rawHeading;
+					correctedBnoHeading = rawHeading;
+					standstillTime = 0.0f;
+					hasHeadingRef = false;
+					resetBnoCorrection = false;
+
+					return rawHeading;
+				}
+
+				const float delta = fitAngleToInterval(rawHeading - lastRawBnoHeading);
+				lastRawBnoHeading = rawHeading;
+
+				// Zero velocity update: At standstill every change of the heading is drift
+				const WheelSpeeds desSpeeds = MotorControl::getDesSpeeds();
+
+				if (fabsf(wheelSpeeds.left) < JAFDSettings::SensorFusion::zeroVelMaxSpeed && fabsf(wheelSpeeds.right) < JAFDSettings::SensorFusion::zeroVelMaxSpeed && desSpeeds.left == 0 && desSpeeds.right == 0)
+				{
+					standstillTime += dt;
+
+					if (standstillTime >= JAFDSettings::SensorFusion::zeroVelMinTime)
+					{
+						bnoBias = delta / realDt * JAFDSettings::SensorFusion::bno055BiasIIRFactor + bnoBias * (1.0f - JAFDSettings::SensorFusion::bno055BiasIIRFactor);
+
+						if (bnoBias > JAFDSettings::SensorFusion::bno055MaxBias) bnoBias = JAFDSettings::SensorFusion::bno055MaxBias;
+						else if (bnoBias < -JAFDSettings::SensorFusion::bno055MaxBias) bnoBias = -JAFDSettings::SensorFusion::bno055MaxBias;
+					}
+				}
+				else
+				{
+					standstillTime = 0.0f;
+				}
+
+				const float unbiasedDelta = delta - bnoBias * realDt;	// The drift accumulated over the real time
+
+				unbiasedBnoTurn += unbiasedDelta;
+				correctedBnoHeading += unbiasedDelta * bnoScale;
+
+				// Scale: Compare the Bno055 rotation between two heading references of the distance sensors (e.g. before and after a 90 turn)
+				// Only an angle from new distances is a new reference; it gets paired with the Bno055 rotation at the time of these distances
+				if (distSensAngleCount != lastRefAngleCount && distSensAngleTrust >= JAFDSettings::SensorFusion::headingRefMinTrust)
+				{
+					const float refHeading = makeRotationCoherent(lastRefHeading, fitAngleToInterval(distSensAngle));
+					const float refBnoTurn = interpolatePose(distSensAngleTime).bnoTurn;
+
+					if (hasHeadingRef && fabsf(refHeading - lastRefHeading) >= JAFDSettings::SensorFusion::bno055ScaleMinTurn)
+					{
+						const float scale = (refHeading - lastRefHeading) / (refBnoTurn - lastRefBnoTurn);
+
+						if (fabsf(scale - 1.0f) < JAFDSettings::SensorFusion::bno055MaxScaleError)
+						{
+							bnoScale = scale * JAFDSettings::SensorFusion::bno055ScaleIIRFactor + bnoScale * (1.0f - JAFDSettings::SensorFusion::bno055ScaleIIRFactor);
+						}
+					}
+
+					lastRefHeading = refHeading;
+					lastRefBnoTurn = refBnoTurn;
+					hasHeadingRef = true;
+				}
+
+				lastRefAngleCount = distSensAngleCount;
+
+				return fitAngleToInterval(correctedBnoHeading);
+			}
+
+			// Log-odds change of one wall for the given number of sensors that detected it / looked through it
+			int8_t wallObservation(const uint8_t wallsDetected, const uint8_t freeDetected)
+			{
+				return static_cast<int8_t>(wallsDetected * JAFDSettings::MazeMapping::wallLogOddsHit - freeDetected * JAFDSettings::MazeMapping::wallLogOddsFree);
+			}
 		}
 
-		void sensorFiltering(const uint8_t freq)
+		void sensorFiltering(const float dt, const float realDt)
 		{
 			RobotState tempRobotState = fusedData.robotState;
 
@@ -50,9 +351,10 @@ namespace JAFD
 			float currHeading = 0.0f;	// We don't handle rotation of robot on ramp (pitch != 0) completely correct! But it shouldn't matter.
 
 			auto bnoForwardVec = Bno055::getForwardVec();
-			auto bnoHeading = getGlobalHeading(bnoForwardVec);
+			const bool bnoHeadingJumped = resetBnoCorrection;
+			auto bnoHeading = correctBnoHeading(getGlobalHeading(bnoForwardVec), tempRobotState.wheelSpeeds, dt, realDt);
 
-			auto excpectedHeading = lastHeading + tempRobotState.angularVel.x / freq;
+			auto excpectedHeading = lastHeading + tempRobotState.angularVel.x * dt;
 			bool bnoErr = false;
 
 			if (Bno055::getRotSpeed() * DEG_TO_RAD > JAFDSettings::MotorControl::maxRotSpeed * 1.5f)
@@ -61,19 +363,31 @@ namespace JAFD
 				bnoErr = true;
 			}
 
-			if (trustWheels)
-			{
-				currHeading = (MotorControl::getDistance(Motor::right) - MotorControl::getDistance(Motor::left)) / (JAFDSettings::Mechanics::wheelDistToMiddle * 2.0f * 1.173f);
-				currHeading -= totalHeadingOff;
-				currHeading = interpolateAngle(fitAngleToInterval(currHeading), bnoHeading, JAFDSettings::SensorFusion::bno055RotPortion);
-			}
-			else
-			{
-				currHeading = bnoHeading;
-			}
+			// Compare wheels with Bno055 and distance sensors
+			SlipMeasurement slipMeasurement;
+			slipMeasurement.wheelSpeeds = tempRobotState.wheelSpeeds;
+			slipMeasurement.desSpeeds = MotorControl::getDesSpeeds();
+			slipMeasurement.leftCurrent = MotorControl::getCurrent(Motor::left);
+			slipMeasurement.rightCurrent = MotorControl::getCurrent(Motor::right);
+			slipMeasurement.bnoYawVel = fitAngleToInterval(bnoHeading - lastBnoHeading) / realDt;
+			slipMeasurement.bnoYawValid = !bnoErr && !bnoHeadingJumped;
+			slipMeasurement.bnoForwardAcc = Bno055::getLinAcc().x * 100.0f;
+			slipMeasurement.distSensSpeed = distSensSpeed;
+			slipMeasurement.distSensSpeedTrust = distSensSpeedTrust;
+
+			lastBnoHeading = bnoHeading;
+			wheelTrust = slipDetector.update(slipMeasurement, dt, realDt);
+			wheelStalled = slipDetector.isStalled();
+
+			// The less I trust the wheels, the more the Bno055 counts
+			const float encoderHeading = (MotorControl::getDistance(Motor::right) - MotorControl::getDistance(Motor::left)) / (JAFDSettings::Mechanics::wheelDistToMiddle * 2.0f * 1.173f);
+			currHeading = interpolateAngle(fitAngleToInterval(encoderHeading - totalHeadingOff), bnoHeading, 1.0f - wheelTrust * (1.0f - JAFDSettings::SensorFusion::bno055RotPortion));
 
 			currHeading = interpolateAngle(currHeading, fitAngleToInterval(distSensAngle), distSensAngleTrust * JAFDSettings::SensorFusion::distAngularPortion);
 
+			// Slipping wheels lose their heading offset -> resynchronize
+			totalHeadingOff = interpolateAngle(totalHeadingOff, fitAngleToInterval(encoderHeading - currHeading), 1.0f - wheelTrust);
+
 			if (bnoErr)
 			{
 				tempRobotState.pitch += tempRobotState.angularVel.z * 0.5f;
@@ -92,19 +406,21 @@ namespace JAFD
 
 			auto lastAngularVel = tempRobotState.angularVel;
 
-			tempRobotState.angularVel.x = encoderYawVel * (1.0f - JAFDSettings::SensorFusion::angularVelDiffPortion) + ((tempRobotState.globalHeading - lastHeading) / freq) * JAFDSettings::SensorFusion::angularVelDiffPortion;
-			tempRobotState.angularVel.z = (tempRobotState.pitch - lastPitch) / freq;
+			tempRobotState.angularVel.x = encoderYawVel * (1.0f - JAFDSettings::SensorFusion::angularVelDiffPortion) + ((tempRobotState.globalHeading - lastHeading) / realDt) * JAFDSettings::SensorFusion::angularVelDiffPortion;
+			tempRobotState.angularVel.z = (tempRobotState.pitch - lastPitch) / realDt;
 			tempRobotState.angularVel.y = 0.0f;
 
 			tempRobotState.angularVel = tempRobotState.angularVel * JAFDSettings::SensorFusion::angularVelIIRFactor + lastAngularVel * (1.0f - JAFDSettings::SensorFusion::angularVelIIRFactor);
 
-			// Linear velocitys
-			tempRobotState.forwardVel = ((tempRobotState.wheelSpeeds.left + tempRobotState.wheelSpeeds.right) / 2.0f) * (1.0f - distSensSpeedTrust * JAFDSettings::SensorFusion::distSpeedPortion) + distSensSpeed * (distSensSpeedTrust * JAFDSettings::SensorFusion::distSpeedPortion);
+			// Linear velocitys; the less I trust the wheels, the more the distance sensors count
+			const float distSpeedPortion = JAFDSettings::SensorFusion::distSpeedPortion + (1.0f - wheelTrust) * (1.0f - JAFDSettings::SensorFusion::distSpeedPortion);
+
+			tempRobotState.forwardVel = ((tempRobotState.wheelSpeeds.left + tempRobotState.wheelSpeeds.right) / 2.0f) * (1.0f - distSensSpeedTrust * distSpeedPortion) + distSensSpeed * (distSensSpeedTrust * distSpeedPortion);
 
-			tempRobotState.forwardVel = distSensSpeed * (distSensSpeedTrust * JAFDSettings::SensorFusion::distSpeedPortion) + tempRobotState.forwardVel * (1.0f - distSensSpeedTrust * JAFDSettings::SensorFusion::distSpeedPortion);
+			tempRobotState.forwardVel = distSensSpeed * (distSensSpeedTrust * distSpeedPortion) + tempRobotState.forwardVel * (1.0f - distSensSpeedTrust * distSpeedPortion);
 
 			// Position
-			tempRobotState.position += tempRobotState.forwardVec * (tempRobotState.forwardVel / (float)freq);
+			tempRobotState.position += tempRobotState.forwardVec * (tempRobotState.forwardVel * dt);
 
 			tempRobotState.position.x = distSensX * (JAFDSettings::SensorFusion::distSensOffsetPortion * distSensXTrust) + tempRobotState.position.x * (1.0f - JAFDSettings::SensorFusion::distSensOffsetPortion * distSensXTrust);
 			tempRobotState.position.y = distSensY * (JAFDSettings::SensorFusion::distSensOffsetPortion * distSensYTrust) + tempRobotState.position.y * (1.0f - JAFDSettings::SensorFusion::distSensOffsetPortion * distSensYTrust);
@@ -124,32 +440,94 @@ namespace JAFD
 			else if (RAD_TO_DEG * positiveAngle > 135.0f && RAD_TO_DEG * positiveAngle < 225.0f) tempRobotState.heading = AbsoluteDir::south;
 			else tempRobotState.heading = AbsoluteDir::east;
 
+			fusedDataSeq.beginWrite();
 			fusedData.robotState = tempRobotState;
+			addPoseToHistory(millis(), tempRobotState);
+			updateCounts.robotState++;
+			fusedDataSeq.endWrite();
 		}
 
-		void untimedFusion()
+		bool untimedFusion()
 		{
-			static uint32_t lastTime = 0;
-			uint32_t now = millis();
+			FusedData tempFusedData;
+			UpdateCounts counts;
+			static UpdateCounts lastCounts;
+			uint32_t seq;
+
+			do
+			{
+				seq = fusedDataSeq.beginRead();
+				tempFusedData = fusedData;
+				counts = updateCounts;
+			} while (fusedDataSeq.retryRead(seq));
+
+			// Dirty flags - every stage only runs if its inputs changed
+			const bool newRobotState = counts.robotState != lastCounts.robotState;
+			const bool newDistances = counts.distances != lastCounts.distances;
+			const bool newDistSensStates = counts.distSensStates != lastCounts.distSensStates;
+
+			if (!newRobotState && !newDistances && !newDistSensStates) return false;
 
-			auto tempFusedData = fusedData;
+			lastCounts = counts;
+
+			// Freshness of every single sensor - only use every distance measurement once for the map, the wall lines, the edges and the speed
+			static DistSensTimestamps lastTimestamps;
+
+			const struct
+			{
+				bool fl;
+				bool fr;
+				bool flong;
+				bool lf;
+				bool lb;
+				bool rf;
+				bool rb;
+			} fresh = {
+				tempFusedData.distSensTimestamps.frontLeft != lastTimestamps.frontLeft,
+				tempFusedData.distSensTimestamps.frontRight != lastTimestamps.frontRight,
+				tempFusedData.distSensTimestamps.frontLong != lastTimestamps.frontLong,
+				tempFusedData.distSensTimestamps.leftFront != lastTimestamps.leftFront,
+				tempFusedData.distSensTimestamps.leftBack != lastTimestamps.leftBack,
+				tempFusedData.distSensTimestamps.rightFront != lastTimestamps.rightFront,
+				tempFusedData.distSensTimestamps.rightBack != lastTimestamps.rightBack
+			};
+
+			lastTimestamps = tempFusedData.distSensTimestamps;
 
 			// Speed measurement with distances
 			uint8_t validDistSpeedSamples = 0;			// Number of valid speed measurements by distance sensor
 			static uint16_t lastLeftDist = 0;			// Last distance left
 			static uint16_t lastRightDist = 0;			// Last distance right
 			static uint16_t lastMiddleFrontDist = 0;	// Last distance middle front
+			static uint32_t lastLeftTime = 0;			// Timestamp of the last distance left
+			static uint32_t lastRightTime = 0;			// Timestamp of the last distance right
+			static uint32_t lastMiddleFrontTime = 0;	// Timestamp of the last distance middle front
 			float tempDistSensSpeed = 0.0f;				// Measured speed 
 
 			// Angle measurement with distances
 			float tempDistSensAngle = 0.0f;				// Angle measured by distance sensors
 			float tempDistSensAngleTrust = 0.0f;		// How much can I trust the measured angle? (0.0 - 1.0)
+			uint32_t tempDistSensAngleTime = 0;			// Time of the newest distance used for the angle
+			bool newDistSensAngle = false;				// Is the angle based on at least one new distance?
 
 			// Wall detection (only for current segment)
 			uint8_t frontWallsDetected = 0;		// How many times did a wall in front of us get detected
 			uint8_t leftWallsDetected = 0;		// How many times did a wall left of us get detected
 			uint8_t rightWallsDetected = 0;		// How many times did a wall right of us get detected
 
+			// Free space detection (only for current segment)
+			uint8_t frontFreeDetected = 0;		// How many times did we look through the front wall position
+			uint8_t leftFreeDetected = 0;		// How many times did we look through the left wall position
+			uint8_t rightFreeDetected = 0;		// How many times did we look through the right wall position
+
+			// Walls / free space seen by new measurements (only these change the map)
+			uint8_t frontWallsObserved = 0;
+			uint8_t leftWallsObserved = 0;
+			uint8_t rightWallsObserved = 0;
+			uint8_t frontFreeObserved = 0;
+			uint8_t leftFreeObserved = 0;
+			uint8_t rightFreeObserved = 0;
+
 			// Border detection (wall with any offset front/back or length)
 			uint8_t leftBorderDetected = 0;		// How many times did a border left of us get detected
 			uint8_t rightBorderDetected = 0;		// How many times did a border right of us get detected
@@ -171,33 +549,45 @@ namespace JAFD
 			// MazeMapping
 			static MapCoordinate lastDifferentPosittion = homePosition;
 			static MapCoordinate lastPosition = homePosition;
+			static bool cellsCached = false;
 			GridCell tempCell;
-			float updateCertainty = 1.0f;
-			tempCell.cellState = CellState::visited;
-			tempCell.cellConnections = EntranceDirections::nowhere;
-			uint8_t walls = 0b0000;											// Where are the walls; inverted to cellConnections
+			const bool enteredNewCell = lastPosition != tempFusedData.robotState.mapCoordinate;
+
+			// Wall lines
+			static AbsoluteDir lastHeading = AbsoluteDir::north;
 
-			if (lastPosition != tempFusedData.robotState.mapCoordinate)
+			if (tempFusedData.robotState.heading != lastHeading)
 			{
-				lastDifferentPosittion = lastPosition;
+				leftWallLine.reset();
+				rightWallLine.reset();
+				leftFrontEdges.reset();
+				leftBackEdges.reset();
+				rightFrontEdges.reset();
+				rightBackEdges.reset();
+				lastHeading = tempFusedData.robotState.heading;
+			}
 
-				MazeMapping::getGridCell(&tempFusedData.gridCell, tempFusedData.robotState.mapCoordinate);
+			if (enteredNewCell || !cellsCached)
+			{
+				if (enteredNewCell) lastDifferentPosittion = lastPosition;
 
-				if (tempFusedData.gridCell.cellState & CellState::visited)
-				{
-					tempFusedData.gridCellCertainty = 0.6f;
-					tempCell.cellState = tempFusedData.gridCell.cellState;
-				}
-				else
-				{
-					tempFusedData.gridCellCertainty = 0.0f;
-				}
+				// The new cell and its neighbours are read over SPI only once
+				MazeMapping::cacheCells(tempFusedData.robotState.mapCoordinate);
+				cellsCached = true;
+
+				// Certainty of the new cell is recalculated from its wall log-odds
+				MazeMapping::getGridCell(&tempFusedData.gridCell, tempFusedData.robotState.mapCoordinate);
 			}
 
 			if (fabsf(tempFusedData.robotState.pitch) < JAFDSettings::SensorFusion::maxPitchForDistSensor)
 			{
-				float headingCos = cosf(tempFusedData.robotState.globalHeading);
-				float headingSin = sinf(tempFusedData.robotState.globalHeading);
+				// Poses of the robot when the distances got measured
+				const SensorPose flPose = getSensorPose(tempFusedData.distSensTimestamps.frontLeft, tempFusedData.robotState);
+				const SensorPose frPose = getSensorPose(tempFusedData.distSensTimestamps.frontRight, tempFusedData.robotState);
+				const SensorPose lfPose = getSensorPose(tempFusedData.distSensTimestamps.leftFront, tempFusedData.robotState);
+				const SensorPose lbPose = getSensorPose(tempFusedData.distSensTimestamps.leftBack, tempFusedData.robotState);
+				const SensorPose rfPose = getSensorPose(tempFusedData.distSensTimestamps.rightFront, tempFusedData.robotState);
+				const SensorPose rbPose = getSensorPose(tempFusedData.distSensTimestamps.rightBack, tempFusedData.robotState);
 
 				if (tempFusedData.distSensorState.frontLeft == DistSensorStatus::ok)
 				{
@@ -207,66 +597,75 @@ namespace JAFD
 					// Check if resulting hit point is a 90 wall in front of us
 					if (tempFusedData.robotState.heading == AbsoluteDir::north || tempFusedData.robotState.heading == AbsoluteDir::south)
 					{
-						float hitY = headingSin * tempFusedData.distances.frontLeft / 10.0f + tempFusedData.robotState.position.y + sinf(tempFusedData.robotState.globalHeading + JAFDSettings::Mechanics::distSensFrontAngleToMiddle) * JAFDSettings::Mechanics::distSensFrontDistToMiddle;
+						float hitY = flPose.headingSin * tempFusedData.distances.frontLeft / 10.0f + flPose.position.y + sinf(flPose.globalHeading + JAFDSettings::Mechanics::distSensFrontAngleToMiddle) * JAFDSettings::Mechanics::distSensFrontDistToMiddle;
 
 						if (fabsf(hitY - tempFusedData.robotState.mapCoordinate.y * JAFDSettings::Field::cellWidth) < JAFDSettings::MazeMapping::widthSecureDetectFactor * JAFDSettings::Field::cellWidth / 2.0f)
 						{
 							hitPointIsOk = true;
 
 							// Helper variables for trig-calculations
-							float cos1 = headingCos * tempFusedData.distances.frontLeft / 10.0f;
-							float cos2 = cosf(tempFusedData.robotState.globalHeading + JAFDSettings::Mechanics::distSensFrontAngleToMiddle) * JAFDSettings::Mechanics::distSensFrontDistToMiddle;
+							float cos1 = flPose.headingCos * tempFusedData.distances.frontLeft / 10.0f;
+							float cos2 = cosf(flPose.globalHeading + JAFDSettings::Mechanics::distSensFrontAngleToMiddle) * JAFDSettings::Mechanics::distSensFrontDistToMiddle;
 
-							float hitX = cos1 + tempFusedData.robotState.position.x + cos2;
+							float hitX = cos1 + flPose.position.x + cos2;
 
 							if (fabsf(hitX - tempFusedData.robotState.mapCoordinate.x * JAFDSettings::Field::cellWidth) < JAFDSettings::Field::cellWidth / 2.0f + JAFDSettings::MazeMapping::distLongerThanBorder)
 							{
 								// Wall is directly in front of us
-								frontWallsDetected++;
+								frontWallsDetected++; frontWallsObserved += fresh.fl;
 
 								// Cell-Midpoint offset calculation
-								tempXOffset += JAFDSettings::Field::cellWidth / 2.0f * sgn(cos1) - cos1 - cos2;
+								tempXOffset += JAFDSettings::Field::cellWidth / 2.0f * sgn(cos1) - cos1 - cos2 + flPose.shift.x;
 								tempXOffTrust += 1.0f;
 							}
+							else
+							{
+								frontFreeDetected++; frontFreeObserved += fresh.fl;
+							}
 						}
 					}
 					else
 					{
-						float hitX = headingCos * tempFusedData.distances.frontLeft / 10.0f + tempFusedData.robotState.position.x + cosf(tempFusedData.robotState.globalHeading + JAFDSettings::Mechanics::distSensFrontAngleToMiddle) * JAFDSettings::Mechanics::distSensFrontDistToMiddle;
+						float hitX = flPose.headingCos * tempFusedData.distances.frontLeft / 10.0f + flPose.position.x + cosf(flPose.globalHeading + JAFDSettings::Mechanics::distSensFrontAngleToMiddle) * JAFDSettings::Mechanics::distSensFrontDistToMiddle;
 
 						if (fabsf(hitX - tempFusedData.robotState.mapCoordinate.x * JAFDSettings::Field::cellWidth) < JAFDSettings::MazeMapping::widthSecureDetectFactor * JAFDSettings::Field::cellWidth / 2.0f)
 						{
 							hitPointIsOk = true;
 
 							// Helper variables for trig-calculations
-							float sin1 = headingSin * tempFusedData.distances.frontLeft / 10.0f;
-							float sin2 = sinf(tempFusedData.robotState.globalHeading + JAFDSettings::Mechanics::distSensFrontAngleToMiddle) * JAFDSettings::Mechanics::distSensFrontDistToMiddle;
+							float sin1 = flPose.headingSin * tempFusedData.distances.frontLeft / 10.0f;
+							float sin2 = sinf(flPose.globalHeading + JAFDSettings::Mechanics::distSensFrontAngleToMiddle) * JAFDSettings::Mechanics::distSensFrontDistToMiddle;
 
-							float hitY = sin1 + tempFusedData.robotState.position.y + sin2;
+							float hitY = sin1 + flPose.position.y + sin2;
 
 							if (fabsf(hitY - tempFusedData.robotState.mapCoordinate.y * JAFDSettings::Field::cellWidth) < JAFDSettings::Field::cellWidth / 2.0f + JAFDSettings::MazeMapping::distLongerThanBorder)
 							{
 								// Wall is directly in front of us
-								frontWallsDetected++;
+								frontWallsDetected++; frontWallsObserved += fresh.fl;
 
 								// Cell-Midpoint offset calculation
-								tempYOffset += JAFDSettings::Field::cellWidth / 2.0f * sgn(sin1) - sin1 - sin2;
+								tempYOffset += JAFDSettings::Field::cellWidth / 2.0f * sgn(sin1) - sin1 - sin2 + flPose.shift.y;
 								tempYOffTrust += 1.0f;
 							}
+							else
+							{
+								frontFreeDetected++; frontFreeObserved += fresh.fl;
+							}
 						}
 					}
 
-					if (hitPointIsOk)
+					if (hitPointIsOk && fresh.fl)
 					{
-						if (lastLeftDist != 0 && lastTime != 0)
+						if (lastLeftDist != 0 && tempFusedData.distSensTimestamps.frontLeft != lastLeftTime)
 						{
-							tempDistSensSpeed = (tempFusedData.distances.frontLeft - lastLeftDist) / 10.0f * 1000.0f / (now - lastTime);
+							tempDistSensSpeed += (tempFusedData.distances.frontLeft - lastLeftDist) / 10.0f * 1000.0f / (tempFusedData.distSensTimestamps.frontLeft - lastLeftTime);
 							validDistSpeedSamples++;
 						}
 
 						lastLeftDist = tempFusedData.distances.frontLeft;
+						lastLeftTime = tempFusedData.distSensTimestamps.frontLeft;
 					}
-					else
+					else if (!hitPointIsOk)
 					{
 						lastLeftDist = 0;
 					}
@@ -277,29 +676,13 @@ namespace JAFD
 
 					if (tempFusedData.distSensorState.frontLeft == DistSensorStatus::underflow)
 					{
-						frontWallsDetected++;
+						frontWallsDetected++; frontWallsObserved += fresh.fl;
 
-						switch (tempFusedData.robotState.heading)
-						{
-						case AbsoluteDir::north:
-							tempXOffset += 15.0f - JAFDSettings::Mechanics::robotLength / 2.0f;
-							tempXOffTrust += 1.0f;
-							break;
-						case AbsoluteDir::east:
-							tempYOffset += JAFDSettings::Mechanics::robotLength / 2.0f - 15.0f;
-							tempYOffTrust += 1.0f;
-							break;
-						case AbsoluteDir::south:
-							tempXOffset += JAFDSettings::Mechanics::robotLength / 2.0f - 15.0f;
-							tempXOffTrust += 1.0f;
-							break;
-						case AbsoluteDir::west:
-							tempYOffset += 15.0f - JAFDSettings::Mechanics::robotLength / 2.0f;
-							tempYOffTrust += 1.0f;
-							break;
-						default:
-							break;
-						}
+						addWallOffset(makeAbsolute(RelativeDir::forward, tempFusedData.robotState.heading), 15.0f - JAFDSettings::Mechanics::robotLength / 2.0f, flPose.shift, tempXOffset, tempYOffset, tempXOffTrust, tempYOffTrust);
+					}
+					else if (tempFusedData.distSensorState.frontLeft == DistSensorStatus::overflow)
+					{
+						frontFreeDetected++; frontFreeObserved += fresh.fl;
 					}
 				}
 
@@ -311,66 +694,75 @@ namespace JAFD
 					// Check if resulting hit point is a 90 wall in front of us
 					if (tempFusedData.robotState.heading == AbsoluteDir::north || tempFusedData.robotState.heading == AbsoluteDir::south)
 					{
-						float hitY = headingSin * tempFusedData.distances.frontRight / 10.0f + tempFusedData.robotState.position.y + sinf(tempFusedData.robotState.globalHeading - JAFDSettings::Mechanics::distSensFrontAngleToMiddle) * JAFDSettings::Mechanics::distSensFrontDistToMiddle;
+						float hitY = frPose.headingSin * tempFusedData.distances.frontRight / 10.0f + frPose.position.y + sinf(frPose.globalHeading - JAFDSettings::Mechanics::distSensFrontAngleToMiddle) * JAFDSettings::Mechanics::distSensFrontDistToMiddle;
 
 						if (fabsf(hitY - tempFusedData.robotState.mapCoordinate.y * JAFDSettings::Field::cellWidth) < JAFDSettings::MazeMapping::widthSecureDetectFactor * JAFDSettings::Field::cellWidth / 2.0f)
 						{
 							hitPointIsOk = true;
 
 							// Helper variables for trig-calculations
-							float cos1 = headingCos * tempFusedData.distances.frontRight / 10.0f;
-							float cos2 = cosf(tempFusedData.robotState.globalHeading - JAFDSettings::Mechanics::distSensFrontAngleToMiddle) * JAFDSettings::Mechanics::distSensFrontDistToMiddle;
+							float cos1 = frPose.headingCos * tempFusedData.distances.frontRight / 10.0f;
+							float cos2 = cosf(frPose.globalHeading - JAFDSettings::Mechanics::distSensFrontAngleToMiddle) * JAFDSettings::Mechanics::distSensFrontDistToMiddle;
 
-							float hitX = cos1 + tempFusedData.robotState.position.x + cos2;
+							float hitX = cos1 + frPose.position.x + cos2;
 
 							if (fabsf(hitX - tempFusedData.robotState.mapCoordinate.x * JAFDSettings::Field::cellWidth) < JAFDSettings::Field::cellWidth / 2.0f + JAFDSettings::MazeMapping::distLongerThanBorder)
 							{
 								// Wall is directly in front of us
-								frontWallsDetected++;
+								frontWallsDetected++; frontWallsObserved += fresh.fr;
 
 								// Cell-Midpoint offset calculation
-								tempXOffset += JAFDSettings::Field::cellWidth / 2.0f * sgn(cos1) - cos1 - cos2;
+								tempXOffset += JAFDSettings::Field::cellWidth / 2.0f * sgn(cos1) - cos1 - cos2 + frPose.shift.x;
 								tempXOffTrust += 1.0f;
 							}
+							else
+							{
+								frontFreeDetected++; frontFreeObserved += fresh.fr;
+							}
 						}
 					}
 					else
 					{
-						float hitX = headingCos * tempFusedData.distances.frontRight / 10.0f + tempFusedData.robotState.position.x + cosf(tempFusedData.robotState.globalHeading - JAFDSettings::Mechanics::distSensFrontAngleToMiddle) * JAFDSettings::Mechanics::distSensFrontDistToMiddle;
+						float hitX = frPose.headingCos * tempFusedData.distances.frontRight / 10.0f + frPose.position.x + cosf(frPose.globalHeading - JAFDSettings::Mechanics::distSensFrontAngleToMiddle) * JAFDSettings::Mechanics::distSensFrontDistToMiddle;
 
 						if (fabsf(hitX - tempFusedData.robotState.mapCoordinate.x * JAFDSettings::Field::cellWidth) < JAFDSettings::MazeMapping::widthSecureDetectFactor * JAFDSettings::Field::cellWidth / 2.0f)
 						{
 							hitPointIsOk = true;
 
 							// Helper variables for trig-calculation
-							float sin1 = headingSin * tempFusedData.distances.frontRight / 10.0f;
-							float sin2 = sinf(tempFusedData.robotState.globalHeading - JAFDSettings::Mechanics::distSensFrontAngleToMiddle) * JAFDSettings::Mechanics::distSensFrontDistToMiddle;
+							float sin1 = frPose.headingSin * tempFusedData.distances.frontRight / 10.0f;
+							float sin2 = sinf(frPose.globalHeading - JAFDSettings::Mechanics::distSensFrontAngleToMiddle) * JAFDSettings::Mechanics::distSensFrontDistToMiddle;
 
-							float hitY = sin1 + tempFusedData.robotState.position.y + sin2;
+							float hitY = sin1 + frPose.position.y + sin2;
 
 							if (fabsf(hitY - tempFusedData.robotState.mapCoordinate.y * JAFDSettings::Field::cellWidth) < JAFDSettings::Field::cellWidth / 2.0f + JAFDSettings::MazeMapping::distLongerThanBorder)
 							{
 								// Wall is directly in front of us
-								frontWallsDetected++;
+								frontWallsDetected++; frontWallsObserved += fresh.fr;
 
 								// Cell-Midpoint offset calculation
-								tempYOffset += JAFDSettings::Field::cellWidth / 2.0f * sgn(sin1) - sin1 - sin2;
+								tempYOffset += JAFDSettings::Field::cellWidth / 2.0f * sgn(sin1) - sin1 - sin2 + frPose.shift.y;
 								tempYOffTrust += 1.0f;
 							}
+							else
+							{
+								frontFreeDetected++; frontFreeObserved += fresh.fr;
+							}
 						}
 					}
 
-					if (hitPointIsOk)
+					if (hitPointIsOk && fresh.fr)
 					{
-						if (lastRightDist != 0 && lastTime != 0)
+						if (lastRightDist != 0 && tempFusedData.distSensTimestamps.frontRight != lastRightTime)
 						{
-							tempDistSensSpeed += (tempFusedData.distances.frontRight - lastRightDist) / 10.0f * 1000.0f / (now - lastTime);
+							tempDistSensSpeed += (tempFusedData.distances.frontRight - lastRightDist) / 10.0f * 1000.0f / (tempFusedData.distSensTimestamps.frontRight - lastRightTime);
 							validDistSpeedSamples++;
 						}
 
 						lastRightDist = tempFusedData.distances.frontRight;
+						lastRightTime = tempFusedData.distSensTimestamps.frontRight;
 					}
-					else
+					else if (!hitPointIsOk)
 					{
 						lastRightDist = 0;
 					}
@@ -381,29 +773,13 @@ namespace JAFD
 
 					if (tempFusedData.distSensorState.frontRight == DistSensorStatus::underflow)
 					{
-						frontWallsDetected++;
+						frontWallsDetected++; frontWallsObserved += fresh.fr;
 
-						switch (tempFusedData.robotState.heading)
-						{
-						case AbsoluteDir::north:
-							tempXOffset += 15.0f - JAFDSettings::Mechanics::robotLength / 2.0f;
-							tempXOffTrust += 1.0f;
-							break;
-						case AbsoluteDir::east:
-							tempYOffset += JAFDSettings::Mechanics::robotLength / 2.0f - 15.0f;
-							tempYOffTrust += 1.0f;
-							break;
-						case AbsoluteDir::south:
-							tempXOffset += JAFDSettings::Mechanics::robotLength / 2.0f - 15.0f;
-							tempXOffTrust += 1.0f;
-							break;
-						case AbsoluteDir::west:
-							tempYOffset += 15.0f - JAFDSettings::Mechanics::robotLength / 2.0f;
-							tempYOffTrust += 1.0f;
-							break;
-						default:
-							break;
-						}
+						addWallOffset(makeAbsolute(RelativeDir::forward, tempFusedData.robotState.heading), 15.0f - JAFDSettings::Mechanics::robotLength / 2.0f, frPose.shift, tempXOffset, tempYOffset, tempXOffTrust, tempYOffTrust);
+					}
+					else if (tempFusedData.distSensorState.frontRight == DistSensorStatus::overflow)
+					{
+						frontFreeDetected++; frontFreeObserved += fresh.fr;
 					}
 				}
 
@@ -413,76 +789,72 @@ namespace JAFD
 					// Check if resulting hit point is a 90 wall in front of us
 					if (tempFusedData.robotState.heading == AbsoluteDir::north || tempFusedData.robotState.heading == AbsoluteDir::south)
 					{
-						float cos1 = headingCos * tempFusedData.distances.leftFront / 10.0f;
-						float cos2 = cosf(tempFusedData.robotState.globalHeading - JAFDSettings::Mechanics::distSensLRAngleToMiddle) * JAFDSettings::Mechanics::distSensLRDistToMiddle;
+						float cos1 = lfPose.headingCos * tempFusedData.distances.leftFront / 10.0f;
+						float cos2 = cosf(lfPose.globalHeading - JAFDSettings::Mechanics::distSensLRAngleToMiddle) * JAFDSettings::Mechanics::distSensLRDistToMiddle;
 
-						float hitY = cos1 + tempFusedData.robotState.position.y + cos2;
+						float hitY = cos1 + lfPose.position.y + cos2;
 
 						if (fabsf(hitY - tempFusedData.robotState.mapCoordinate.y * JAFDSettings::Field::cellWidth) < JAFDSettings::Field::cellWidth / 2.0f + JAFDSettings::MazeMapping::distLongerThanBorder)
 						{
 							leftBorderDetected++; borderDetected.lf = true;
 
-							float hitX = -headingSin * tempFusedData.distances.leftFront / 10.0f + tempFusedData.robotState.position.x - sinf(tempFusedData.robotState.globalHeading - JAFDSettings::Mechanics::distSensLRAngleToMiddle) * JAFDSettings::Mechanics::distSensLRDistToMiddle;
+							float hitX = -lfPose.headingSin * tempFusedData.distances.leftFront / 10.0f + lfPose.position.x - sinf(lfPose.globalHeading - JAFDSettings::Mechanics::distSensLRAngleToMiddle) * JAFDSettings::Mechanics::distSensLRDistToMiddle;
+
+							if (fresh.lf) leftWallLine.addPoint(hitX, hitY);
 
 							if (fabsf(hitX - tempFusedData.robotState.mapCoordinate.x * JAFDSettings::Field::cellWidth) < JAFDSettings::MazeMapping::widthSecureDetectFactor * JAFDSettings::Field::cellWidth / 2.0f)
 							{
 								// Wall is directly left of us
-								leftWallsDetected++;
+								leftWallsDetected++; leftWallsObserved += fresh.lf;
 
-								tempYOffset += JAFDSettings::Field::cellWidth / 2.0f * sgn(cos1) - cos1 - cos2;
+								tempYOffset += JAFDSettings::Field::cellWidth / 2.0f * sgn(cos1) - cos1 - cos2 + lfPose.shift.y;
 								tempYOffTrust += 1.0f;
 							}
 						}
+						else
+						{
+							leftFreeDetected++; leftFreeObserved += fresh.lf;
+						}
 					}
 					else
 					{
-						float sin1 = -headingSin * tempFusedData.distances.leftFront / 10.0f;
-						float sin2 = -sinf(tempFusedData.robotState.globalHeading + JAFDSettings::Mechanics::distSensLRAngleToMiddle) * JAFDSettings::Mechanics::distSensLRDistToMiddle;
+						float sin1 = -lfPose.headingSin * tempFusedData.distances.leftFront / 10.0f;
+						float sin2 = -sinf(lfPose.globalHeading + JAFDSettings::Mechanics::distSensLRAngleToMiddle) * JAFDSettings::Mechanics::distSensLRDistToMiddle;
 
-						float hitX = sin1 + tempFusedData.robotState.position.x + sin2;
+						float hitX = sin1 + lfPose.position.x + sin2;
 
 						if (fabsf(hitX - tempFusedData.robotState.mapCoordinate.x * JAFDSettings::Field::cellWidth) < JAFDSettings::Field::cellWidth / 2.0f + JAFDSettings::MazeMapping::distLongerThanBorder)
 						{
 							leftBorderDetected++; borderDetected.lf = true;
 
-							float hitY = headingCos * tempFusedData.distances.leftFront / 10.0f + tempFusedData.robotState.position.y + cosf(tempFusedData.robotState.globalHeading + JAFDSettings::Mechanics::distSensLRAngleToMiddle) * JAFDSettings::Mechanics::distSensLRDistToMiddle;
+							float hitY = lfPose.headingCos * tempFusedData.distances.leftFront / 10.0f + lfPose.position.y + cosf(lfPose.globalHeading + JAFDSettings::Mechanics::distSensLRAngleToMiddle) * JAFDSettings::Mechanics::distSensLRDistToMiddle;
+
+							if (fresh.lf) leftWallLine.addPoint(hitY, hitX);
 
 							if (fabsf(hitY - tempFusedData.robotState.mapCoordinate.y * JAFDSettings::Field::cellWidth) < JAFDSettings::MazeMapping::widthSecureDetectFactor * JAFDSettings::Field::cellWidth / 2.0f)
 							{
 								// Wall is directly left of us
-								leftWallsDetected++;
+								leftWallsDetected++; leftWallsObserved += fresh.lf;
 
-								tempXOffset += JAFDSettings::Field::cellWidth / 2.0f * sgn(sin1) - sin1 - sin2;
+								tempXOffset += JAFDSettings::Field::cellWidth / 2.0f * sgn(sin1) - sin1 - sin2 + lfPose.shift.x;
 								tempXOffTrust += 1.0;
 							}
 						}
+						else
+						{
+							leftFreeDetected++; leftFreeObserved += fresh.lf;
+						}
 					}
 				}
 				else if (tempFusedData.distSensorState.leftFront == DistSensorStatus::underflow)
 				{
-					leftWallsDetected++;
+					leftWallsDetected++; leftWallsObserved += fresh.lf;
 
-					switch (tempFusedData.robotState.heading)
-					{
-					case AbsoluteDir::north:
-						tempYOffset += 15.0f - JAFDSettings::Mechanics::robotWidth / 2.0f;
-						tempYOffTrust += 1.0f;
-						break;
-					case AbsoluteDir::east:
-						tempXOffset += JAFDSettings::Mechanics::robotWidth / 2.0f - 15.0f;
-						tempXOffTrust += 1.0f;
-						break;
-					case AbsoluteDir::south:
-						tempYOffset += JAFDSettings::Mechanics::robotWidth / 2.0f - 15.0f;
-						tempYOffTrust += 1.0f;
-						break;
-					case AbsoluteDir::west:
-						tempXOffset += 15.0f - JAFDSettings::Mechanics::robotWidth / 2.0f;
-						tempXOffTrust += 1.0f;
-						break;
-					default:
-						break;
-					}
+					addWallOffset(makeAbsolute(RelativeDir::left, tempFusedData.robotState.heading), 15.0f - JAFDSettings::Mechanics::robotWidth / 2.0f, lfPose.shift, tempXOffset, tempYOffset, tempXOffTrust, tempYOffTrust);
+				}
+				else if (tempFusedData.distSensorState.leftFront == DistSensorStatus::overflow)
+				{
+					leftFreeDetected++; leftFreeObserved += fresh.lf;
 				}
 
 				if (tempFusedData.distSensorState.leftBack == DistSensorStatus::ok)
@@ -491,76 +863,72 @@ namespace JAFD
 					// Check if resulting hit point is a 90 wall left of us
 					if (tempFusedData.robotState.heading == AbsoluteDir::north || tempFusedData.robotState.heading == AbsoluteDir::south)
 					{
-						float cos1 = headingCos * tempFusedData.distances.leftBack / 10.0f;
-						float cos2 = cosf(tempFusedData.robotState.globalHeading + JAFDSettings::Mechanics::distSensLRAngleToMiddle) * JAFDSettings::Mechanics::distSensLRDistToMiddle;
+						float cos1 = lbPose.headingCos * tempFusedData.distances.leftBack / 10.0f;
+						float cos2 = cosf(lbPose.globalHeading + JAFDSettings::Mechanics::distSensLRAngleToMiddle) * JAFDSettings::Mechanics::distSensLRDistToMiddle;
 
-						float hitY = cos1 + tempFusedData.robotState.position.y + cos2;
+						float hitY = cos1 + lbPose.position.y + cos2;
 
 						if (fabsf(hitY - tempFusedData.robotState.mapCoordinate.y * JAFDSettings::Field::cellWidth) < JAFDSettings::Field::cellWidth / 2.0f + JAFDSettings::MazeMapping::distLongerThanBorder)
 						{
 							leftBorderDetected++; borderDetected.lb = true;
 
-							float hitX = -headingSin * tempFusedData.distances.leftBack / 10.0f + tempFusedData.robotState.position.x - sinf(tempFusedData.robotState.globalHeading + JAFDSettings::Mechanics::distSensLRAngleToMiddle) * JAFDSettings::Mechanics::distSensLRDistToMiddle;
+							float hitX = -lbPose.headingSin * tempFusedData.distances.leftBack / 10.0f + lbPose.position.x - sinf(lbPose.globalHeading + JAFDSettings::Mechanics::distSensLRAngleToMiddle) * JAFDSettings::Mechanics::distSensLRDistToMiddle;
+
+							if (fresh.lb) leftWallLine.addPoint(hitX, hitY);
 
 							if (fabsf(hitX - tempFusedData.robotState.mapCoordinate.x * JAFDSettings::Field::cellWidth) < JAFDSettings::MazeMapping::widthSecureDetectFactor * JAFDSettings::Field::cellWidth / 2.0f)
 							{
 								// Wall is directly left of us
-								leftWallsDetected++;
+								leftWallsDetected++; leftWallsObserved += fresh.lb;
 
-								tempYOffset += JAFDSettings::Field::cellWidth / 2.0f * sgn(cos1) - cos1 - cos2;
+								tempYOffset += JAFDSettings::Field::cellWidth / 2.0f * sgn(cos1) - cos1 - cos2 + lbPose.shift.y;
 								tempYOffTrust += 1.0f;
 							}
 						}
+						else
+						{
+							leftFreeDetected++; leftFreeObserved += fresh.lb;
+						}
 					}
 					else
 					{
-						float sin1 = -headingSin * tempFusedData.distances.leftBack / 10.0f;
-						float sin2 = -sinf(tempFusedData.robotState.globalHeading + JAFDSettings::Mechanics::distSensLRAngleToMiddle) * JAFDSettings::Mechanics::distSensLRDistToMiddle;
+						float sin1 = -lbPose.headingSin * tempFusedData.distances.leftBack / 10.0f;
+						float sin2 = -sinf(lbPose.globalHeading + JAFDSettings::Mechanics::distSensLRAngleToMiddle) * JAFDSettings::Mechanics::distSensLRDistToMiddle;
 
-						float hitX = sin1 + tempFusedData.robotState.position.x + sin2;
+						float hitX = sin1 + lbPose.position.x + sin2;
 
 						if (fabsf(hitX - tempFusedData.robotState.mapCoordinate.x * JAFDSettings::Field::cellWidth) < JAFDSettings::Field::cellWidth / 2.0f + JAFDSettings::MazeMapping::distLongerThanBorder)
 						{
 							leftBorderDetected++; borderDetected.lb = true;
 
-							float hitY = headingCos * tempFusedData.distances.leftBack / 10.0f + tempFusedData.robotState.position.y + cosf(tempFusedData.robotState.globalHeading + JAFDSettings::Mechanics::distSensLRAngleToMiddle) * JAFDSettings::Mechanics::distSensLRDistToMiddle;
+							float hitY = lbPose.headingCos * tempFusedData.distances.leftBack / 10.0f + lbPose.position.y + cosf(lbPose.globalHeading + JAFDSettings::Mechanics::distSensLRAngleToMiddle) * JAFDSettings::Mechanics::distSensLRDistToMiddle;
+
+							if (fresh.lb) leftWallLine.addPoint(hitY, hitX);
 
 							if (fabsf(hitY - tempFusedData.robotState.mapCoordinate.y * JAFDSettings::Field::cellWidth) < JAFDSettings::MazeMapping::widthSecureDetectFactor * JAFDSettings::Field::cellWidth / 2.0f)
 							{
 								// Wall is directly left of us
-								leftWallsDetected++;
+								leftWallsDetected++; leftWallsObserved += fresh.lb;
 
-								tempXOffset += JAFDSettings::Field::cellWidth / 2.0f * sgn(sin1) - sin1 - sin2;
+								tempXOffset += JAFDSettings::Field::cellWidth / 2.0f * sgn(sin1) - sin1 - sin2 + lbPose.shift.x;
 								tempXOffTrust += 1.0f;
 							}
 						}
+						else
+						{
+							leftFreeDetected++; leftFreeObserved += fresh.lb;
+						}
 					}
 				}
 				else if (tempFusedData.distSensorState.leftBack == DistSensorStatus::underflow)
 				{
-					leftWallsDetected++;
+					leftWallsDetected++; leftWallsObserved += fresh.lb;
 
-					switch (tempFusedData.robotState.heading)
-					{
-					case AbsoluteDir::north:
-						tempYOffset += 15.0f - JAFDSettings::Mechanics::robotWidth / 2.0f;
-						tempYOffTrust += 1.0f;
-						break;
-					case AbsoluteDir::east:
-						tempXOffset += JAFDSettings::Mechanics::robotWidth / 2.0f - 15.0f;
-						tempXOffTrust += 1.0f;
-						break;
-					case AbsoluteDir::south:
-						tempYOffset += JAFDSettings::Mechanics::robotWidth / 2.0f - 15.0f;
-						tempYOffTrust += 1.0f;
-						break;
-					case AbsoluteDir::west:
-						tempXOffset += 15.0f - JAFDSettings::Mechanics::robotWidth / 2.0f;
-						tempXOffTrust += 1.0f;
-						break;
-					default:
-						break;
-					}
+					addWallOffset(makeAbsolute(RelativeDir::left, tempFusedData.robotState.heading), 15.0f - JAFDSettings::Mechanics::robotWidth / 2.0f, lbPose.shift, tempXOffset, tempYOffset, tempXOffTrust, tempYOffTrust);
+				}
+				else if (tempFusedData.distSensorState.leftBack == DistSensorStatus::overflow)
+				{
+					leftFreeDetected++; leftFreeObserved += fresh.lb;
 				}
 
 				if (tempFusedData.distSensorState.rightFront == DistSensorStatus::ok)
@@ -569,76 +937,72 @@ namespace JAFD
 					// Check if resulting hit point is a 90 wall right of us
 					if (tempFusedData.robotState.heading == AbsoluteDir::north || tempFusedData.robotState.heading == AbsoluteDir::south)
 					{
-						float cos1 = -headingCos * tempFusedData.distances.rightFront / 10.0f;
-						float cos2 = -cosf(tempFusedData.robotState.globalHeading + JAFDSettings::Mechanics::distSensLRAngleToMiddle) * JAFDSettings::Mechanics::distSensLRDistToMiddle;
+						float cos1 = -rfPose.headingCos * tempFusedData.distances.rightFront / 10.0f;
+						float cos2 = -cosf(rfPose.globalHeading + JAFDSettings::Mechanics::distSensLRAngleToMiddle) * JAFDSettings::Mechanics::distSensLRDistToMiddle;
 
-						float hitY = cos1 + tempFusedData.robotState.position.y + cos2;
+						float hitY = cos1 + rfPose.position.y + cos2;
 
 						if (fabsf(hitY - tempFusedData.robotState.mapCoordinate.y * JAFDSettings::Field::cellWidth) < JAFDSettings::Field::cellWidth / 2.0f + JAFDSettings::MazeMapping::distLongerThanBorder)
 						{
 							rightBorderDetected++; borderDetected.rf = true;
 
-							float hitX = headingSin * tempFusedData.distances.rightFront / 10.0f + tempFusedData.robotState.position.x + sinf(tempFusedData.robotState.globalHeading + JAFDSettings::Mechanics::distSensLRAngleToMiddle) * JAFDSettings::Mechanics::distSensLRDistToMiddle;
+							float hitX = rfPose.headingSin * tempFusedData.distances.rightFront / 10.0f + rfPose.position.x + sinf(rfPose.globalHeading + JAFDSettings::Mechanics::distSensLRAngleToMiddle) * JAFDSettings::Mechanics::distSensLRDistToMiddle;
+
+							if (fresh.rf) rightWallLine.addPoint(hitX, hitY);
 
 							if (fabsf(hitX - tempFusedData.robotState.mapCoordinate.x * JAFDSettings::Field::cellWidth) < JAFDSettings::MazeMapping::widthSecureDetectFactor * JAFDSettings::Field::cellWidth / 2.0f)
 							{
 								// Wall is directly right of us
-								rightWallsDetected++;
+								rightWallsDetected++; rightWallsObserved += fresh.rf;
 
-								tempYOffset += JAFDSettings::Field::cellWidth / 2.0f * sgn(cos1) - cos1 - cos2;
+								tempYOffset += JAFDSettings::Field::cellWidth / 2.0f * sgn(cos1) - cos1 - cos2 + rfPose.shift.y;
 								tempYOffTrust += 1.0f;
 							}
 						}
+						else
+						{
+							rightFreeDetected++; rightFreeObserved += fresh.rf;
+						}
 					}
 					else
 					{
-						float sin1 = headingSin * tempFusedData.distances.rightFront / 10.0f;
-						float sin2 = sinf(tempFusedData.robotState.globalHeading + JAFDSettings::Mechanics::distSensLRAngleToMiddle) * JAFDSettings::Mechanics::distSensLRDistToMiddle;
+						float sin1 = rfPose.headingSin * tempFusedData.distances.rightFront / 10.0f;
+						float sin2 = sinf(rfPose.globalHeading + JAFDSettings::Mechanics::distSensLRAngleToMiddle) * JAFDSettings::Mechanics::distSensLRDistToMiddle;
 
-						float hitX = sin1 + tempFusedData.robotState.position.x + sin2;
+						float hitX = sin1 + rfPose.position.x + sin2;
 
 						if (fabsf(hitX - tempFusedData.robotState.mapCoordinate.x * JAFDSettings::Field::cellWidth) < JAFDSettings::Field::cellWidth / 2.0f + JAFDSettings::MazeMapping::distLongerThanBorder)
 						{
 							rightBorderDetected++; borderDetected.rf = true;
 
-							float hitY = -headingCos * tempFusedData.distances.rightFront / 10.0f + tempFusedData.robotState.position.y - cosf(tempFusedData.robotState.globalHeading + JAFDSettings::Mechanics::distSensLRAngleToMiddle) * JAFDSettings::Mechanics::distSensLRDistToMiddle;
+							float hitY = -rfPose.headingCos * tempFusedData.distances.rightFront / 10.0f + rfPose.position.y - cosf(rfPose.globalHeading + JAFDSettings::Mechanics::distSensLRAngleToMiddle) * JAFDSettings::Mechanics::distSensLRDistToMiddle;
+
+							if (fresh.rf) rightWallLine.addPoint(hitY, hitX);
 
 							if (fabsf(hitY - tempFusedData.robotState.mapCoordinate.y * JAFDSettings::Field::cellWidth) < JAFDSettings::MazeMapping::widthSecureDetectFactor * JAFDSettings::Field::cellWidth / 2.0f)
 							{
 								// Wall is directly right of us
-								rightWallsDetected++;
+								rightWallsDetected++; rightWallsObserved += fresh.rf;
 
-								tempXOffset += JAFDSettings::Field::cellWidth / 2.0f * sgn(sin1) - sin1 - sin2;
+								tempXOffset += JAFDSettings::Field::cellWidth / 2.0f * sgn(sin1) - sin1 - sin2 + rfPose.shift.x;
 								tempXOffTrust += 1.0f;
 							}
 						}
+						else
+						{
+							rightFreeDetected++; rightFreeObserved += fresh.rf;
+						}
 					}
 				}
 				else if (tempFusedData.distSensorState.rightFront == DistSensorStatus::underflow)
 				{
-					rightWallsDetected++;
+					rightWallsDetected++; rightWallsObserved += fresh.rf;
 
-					switch (tempFusedData.robotState.heading)
-					{
-					case AbsoluteDir::south:
-						tempYOffset += 15.0f - JAFDSettings::Mechanics::robotWidth / 2.0f;
-						tempYOffTrust += 1.0f;
-						break;
-					case AbsoluteDir::west:
-						tempXOffset += JAFDSettings::Mechanics::robotWidth / 2.0f - 15.0f;
-						tempXOffTrust += 1.0f;
-						break;
-					case AbsoluteDir::north:
-						tempYOffset += JAFDSettings::Mechanics::robotWidth / 2.0f - 15.0f;
-						tempYOffTrust += 1.0f;
-						break;
-					case AbsoluteDir::east:
-						tempXOffset += 15.0f - JAFDSettings::Mechanics::robotWidth / 2.0f;
-						tempXOffTrust += 1.0f;
-						break;
-					default:
-						break;
-					}
+					addWallOffset(makeAbsolute(RelativeDir::right, tempFusedData.robotState.heading), 15.0f - JAFDSettings::Mechanics::robotWidth / 2.0f, rfPose.shift, tempXOffset, tempYOffset, tempXOffTrust, tempYOffTrust);
+				}
+				else if (tempFusedData.distSensorState.rightFront == DistSensorStatus::overflow)
+				{
+					rightFreeDetected++; rightFreeObserved += fresh.rf;
 				}
 
 				if (tempFusedData.distSensorState.rightBack == DistSensorStatus::ok)
@@ -647,75 +1011,71 @@ namespace JAFD
 					// Check if resulting hit point is a 90 wall right of us
 					if (tempFusedData.robotState.heading == AbsoluteDir::north || tempFusedData.robotState.heading == AbsoluteDir::south)
 					{
-						float cos1 = -headingCos * tempFusedData.distances.rightBack / 10.0f;
-						float cos2 = -cosf(tempFusedData.robotState.globalHeading - JAFDSettings::Mechanics::distSensLRAngleToMiddle) * JAFDSettings::Mechanics::distSensLRDistToMiddle;
+						float cos1 = -rbPose.headingCos * tempFusedData.distances.rightBack / 10.0f;
+						float cos2 = -cosf(rbPose.globalHeading - JAFDSettings::Mechanics::distSensLRAngleToMiddle) * JAFDSettings::Mechanics::distSensLRDistToMiddle;
 
-						float hitY = cos1 + tempFusedData.robotState.position.y + cos2;
+						float hitY = cos1 + rbPose.position.y + cos2;
 
 						if (fabsf(hitY - tempFusedData.robotState.mapCoordinate.y * JAFDSettings::Field::cellWidth) < JAFDSettings::Field::cellWidth / 2.0f + JAFDSettings::MazeMapping::distLongerThanBorder)
 						{
 							rightBorderDetected++; borderDetected.rb = true;
 
-							float hitX = headingSin * tempFusedData.distances.rightBack / 10.0f + tempFusedData.robotState.position.x + sinf(tempFusedData.robotState.globalHeading - JAFDSettings::Mechanics::distSensLRAngleToMiddle) * JAFDSettings::Mechanics::distSensLRDistToMiddle;
+							float hitX = rbPose.headingSin * tempFusedData.distances.rightBack / 10.0f + rbPose.position.x + sinf(rbPose.globalHeading - JAFDSettings::Mechanics::distSensLRAngleToMiddle) * JAFDSettings::Mechanics::distSensLRDistToMiddle;
+
+							if (fresh.rb) rightWallLine.addPoint(hitX, hitY);
 
 							if (fabsf(hitX - tempFusedData.robotState.mapCoordinate.x * JAFDSettings::Field::cellWidth) < JAFDSettings::MazeMapping::widthSecureDetectFactor * JAFDSettings::Field::cellWidth / 2.0f)
 							{
 								// Wall is directly right of us
-								rightWallsDetected++;
+								rightWallsDetected++; rightWallsObserved += fresh.rb;
 
-								tempYOffset += JAFDSettings::Field::cellWidth / 2.0f * sgn(cos1) - cos1 - cos2;
+								tempYOffset += JAFDSettings::Field::cellWidth / 2.0f * sgn(cos1) - cos1 - cos2 + rbPose.shift.y;
 								tempYOffTrust += 1.0f;
 							}
 						}
+						else
+						{
+							rightFreeDetected++; rightFreeObserved += fresh.rb;
+						}
 					}
 					else
 					{
-						float sin1 = headingSin * tempFusedData.distances.rightBack / 10.0f;
-						float sin2 = sinf(tempFusedData.robotState.globalHeading - JAFDSettings::Mechanics::distSensLRAngleToMiddle) * JAFDSettings::Mechanics::distSensLRDistToMiddle;
+						float sin1 = rbPose.headingSin * tempFusedData.distances.rightBack / 10.0f;
+						float sin2 = sinf(rbPose.globalHeading - JAFDSettings::Mechanics::distSensLRAngleToMiddle) * JAFDSettings::Mechanics::distSensLRDistToMiddle;
 
-						float hitX = sin1 + tempFusedData.robotState.position.x + sin2;
+						float hitX = sin1 + rbPose.position.x + sin2;
 						if (fabsf(hitX - tempFusedData.robotState.mapCoordinate.x * JAFDSettings::Field::cellWidth) < JAFDSettings::Field::cellWidth / 2.0f + JAFDSettings::MazeMapping::distLongerThanBorder)
 						{
 							rightBorderDetected++; borderDetected.rb = true;
 
-							float hitY = -headingCos * tempFusedData.distances.rightBack / 10.0f + tempFusedData.robotState.position.y - cosf(tempFusedData.robotState.globalHeading - JAFDSettings::Mechanics::distSensLRAngleToMiddle) * JAFDSettings::Mechanics::distSensLRDistToMiddle;
+							float hitY = -rbPose.headingCos * tempFusedData.distances.rightBack / 10.0f + rbPose.position.y - cosf(rbPose.globalHeading - JAFDSettings::Mechanics::distSensLRAngleToMiddle) * JAFDSettings::Mechanics::distSensLRDistToMiddle;
+
+							if (fresh.rb) rightWallLine.addPoint(hitY, hitX);
 
 							if (fabsf(hitY - tempFusedData.robotState.mapCoordinate.y * JAFDSettings::Field::cellWidth) < JAFDSettings::MazeMapping::widthSecureDetectFactor * JAFDSettings::Field::cellWidth / 2.0f)
 							{
 								// Wall is directly right of us
-								rightWallsDetected++;
+								rightWallsDetected++; rightWallsObserved += fresh.rb;
 
-								tempXOffset += JAFDSettings::Field::cellWidth / 2.0f * sgn(sin1) - sin1 - sin2;
+								tempXOffset += JAFDSettings::Field::cellWidth / 2.0f * sgn(sin1) - sin1 - sin2 + rbPose.shift.x;
 								tempXOffTrust += 1.0f;
 							}
 						}
+						else
+						{
+							rightFreeDetected++; rightFreeObserved += fresh.rb;
+						}
 					}
 				}
 				else if (tempFusedData.distSensorState.rightBack == DistSensorStatus::underflow)
 				{
-					rightWallsDetected++;
+					rightWallsDetected++; rightWallsObserved += fresh.rb;
 
-					switch (tempFusedData.robotState.heading)
-					{
-					case AbsoluteDir::south:
-						tempYOffset += 15.0f - JAFDSettings::Mechanics::robotWidth / 2.0f;
-						tempYOffTrust += 1.0f;
-						break;
-					case AbsoluteDir::west:
-						tempXOffset += JAFDSettings::Mechanics::robotWidth / 2.0f - 15.0f;
-						tempXOffTrust += 1.0f;
-						break;
-					case AbsoluteDir::north:
-						tempYOffset += JAFDSettings::Mechanics::robotWidth / 2.0f - 15.0f;
-						tempYOffTrust += 1.0f;
-						break;
-					case AbsoluteDir::east:
-						tempXOffset += 15.0f - JAFDSettings::Mechanics::robotWidth / 2.0f;
-						tempXOffTrust += 1.0f;
-						break;
-					default:
-						break;
-					}
+					addWallOffset(makeAbsolute(RelativeDir::right, tempFusedData.robotState.heading), 15.0f - JAFDSettings::Mechanics::robotWidth / 2.0f, rbPose.shift, tempXOffset, tempYOffset, tempXOffTrust, tempYOffTrust);
+				}
+				else if (tempFusedData.distSensorState.rightBack == DistSensorStatus::overflow)
+				{
+					rightFreeDetected++; rightFreeObserved += fresh.rb;
 				}
 
 				// Calculate angle
@@ -724,21 +1084,49 @@ namespace JAFD
 					// Calculate angle if both front distance sensors detected a wall directly in front of the robot.
 					tempDistSensAngle += asinf((tempFusedData.distances.frontLeft - tempFusedData.distances.frontRight) / sqrtf(JAFDSettings::Mechanics::distSensFrontSpacing * JAFDSettings::Mechanics::distSensFrontSpacing * 100.0f + (tempFusedData.distances.frontLeft - tempFusedData.distances.frontRight) * (tempFusedData.distances.frontLeft - tempFusedData.distances.frontRight)));
 					tempDistSensAngleTrust += 1.0f / 3.0f;
+					useForAngle(tempFusedData.distSensTimestamps.frontLeft, fresh.fl, tempDistSensAngleTime, newDistSensAngle);
+					useForAngle(tempFusedData.distSensTimestamps.frontRight, fresh.fr, tempDistSensAngleTime, newDistSensAngle);
 				}
 
-				if (leftBorderDetected == 2 && tempFusedData.distSensorState.leftFront == DistSensorStatus::ok && tempFusedData.distSensorState.leftBack == DistSensorStatus::ok)
+				// Heading relative to the maze axes and the position along the wall lines
+				const uint8_t headingIndex = static_cast<uint8_t>(tempFusedData.robotState.heading);
+				const float relativeHeading = fitAngleToInterval(tempFusedData.robotState.globalHeading - dirAngle[headingIndex]);
+				const float alongCoor = (headingIndex & 0x1) ? tempFusedData.robotState.position.y : tempFusedData.robotState.position.x;
+				WallLine wallLine;
+				float wallLineError;
+
+				if (leftWallLine.fit(alongCoor, wallLine) && wallLineHeadingError(wallLine, headingIndex, wallLineError))
+				{
+					// Calculate angle from the wall line fitted to the recent left hit points
+					tempDistSensAngle += relativeHeading - wallLineError;
+					tempDistSensAngleTrust += 1.0f / 3.0f;
+					useForAngle(tempFusedData.distSensTimestamps.leftFront, fresh.lf, tempDistSensAngleTime, newDistSensAngle);
+					useForAngle(tempFusedData.distSensTimestamps.leftBack, fresh.lb, tempDistSensAngleTime, newDistSensAngle);
+				}
+				else if (leftBorderDetected == 2 && tempFusedData.distSensorState.leftFront == DistSensorStatus::ok && tempFusedData.distSensorState.leftBack == DistSensorStatus::ok)
 				{
 					// Calculate angle if both left distance sensors detected a border directly left of the robot.
 					tempDistSensAngle += asinf((tempFusedData.distances.leftBack - tempFusedData.distances.leftFront) / sqrtf(JAFDSettings::Mechanics::distSensLRSpacing * JAFDSettings::Mechanics::distSensLRSpacing * 100.0f + (tempFusedData.distances.leftBack - tempFusedData.distances.leftFront) * (tempFusedData.distances.leftBack - tempFusedData.distances.leftFront)));
 					tempDistSensAngleTrust += 1.0f / 3.0f;
+					useForAngle(tempFusedData.distSensTimestamps.leftFront, fresh.lf, tempDistSensAngleTime, newDistSensAngle);
+					useForAngle(tempFusedData.distSensTimestamps.leftBack, fresh.lb, tempDistSensAngleTime, newDistSensAngle);
 				}
 
-				if (rightBorderDetected == 2 && tempFusedData.distSensorState.rightFront == DistSensorStatus::ok && tempFusedData.distSensorState.rightBack == DistSensorStatus::ok)
-
+				if (rightWallLine.fit(alongCoor, wallLine) && wallLineHeadingError(wallLine, headingIndex, wallLineError))
+				{
+					// Calculate angle from the wall line fitted to the recent right hit points
+					tempDistSensAngle += relativeHeading - wallLineError;
+					tempDistSensAngleTrust += 1.0f / 3.0f;
+					useForAngle(tempFusedData.distSensTimestamps.rightFront, fresh.rf, tempDistSensAngleTime, newDistSensAngle);
+					useForAngle(tempFusedData.distSensTimestamps.rightBack, fresh.rb, tempDistSensAngleTime, newDistSensAngle);
+				}
+				else if (rightBorderDetected == 2 && tempFusedData.distSensorState.rightFront == DistSensorStatus::ok && tempFusedData.distSensorState.rightBack == DistSensorStatus::ok)
 				{
 					// Calculate angle if both right distance sensors detected a wall directly right of the robot.
 					tempDistSensAngle += asinf((tempFusedData.distances.rightFront - tempFusedData.distances.rightBack) / sqrtf(JAFDSettings::Mechanics::distSensLRSpacing * JAFDSettings::Mechanics::distSensLRSpacing * 100.0f + (tempFusedData.distances.rightFront - tempFusedData.distances.rightBack) * (tempFusedData.distances.rightFront - tempFusedData.distances.rightBack)));
 					tempDistSensAngleTrust += 1.0f / 3.0f;
+					useForAngle(tempFusedData.distSensTimestamps.rightFront, fresh.rf, tempDistSensAngleTime, newDistSensAngle);
+					useForAngle(tempFusedData.distSensTimestamps.rightBack, fresh.rb, tempDistSensAngleTime, newDistSensAngle);
 				}
 
 				// !!! need to update factor of trust (new factor 3)
@@ -754,53 +1142,77 @@ namespace JAFD
 				if (tempXOffTrust < 0.01f) tempXOffset = 0.0f;
 				if (tempYOffTrust < 0.01f) tempYOffset = 0.0f;
 
-				switch (tempFusedData.robotState.heading)
-				{
-
-				case AbsoluteDir::north:
-					distSensAngle = tempDistSensAngle;
-					tempXOffTrust /= 2.0f;		// If facing north, two sensors (front) could give an X-Offset
-					tempYOffTrust /= 4.0f;		// If facing north, four sensors (left & right) could give an Y-Offset
-					break;
-
-				case AbsoluteDir::east:
-					distSensAngle = tempDistSensAngle - DEG_TO_RAD * 90.0f;
-					tempXOffTrust /= 4.0f;
-					tempYOffTrust /= 2.0f;
-					break;
-
-				case AbsoluteDir::south:
-					distSensAngle = tempDistSensAngle + DEG_TO_RAD * 180.0f;
-					tempXOffTrust /= 2.0f;
-					tempYOffTrust /= 4.0f;
-					break;
-
-				case AbsoluteDir::west:
-					distSensAngle = tempDistSensAngle + DEG_TO_RAD * 90.0f;
-					tempXOffTrust /= 4.0f;
-					tempYOffTrust /= 2.0f;
-					break;
-
-				default:
-					break;
-				}
+				// If facing north / south, two sensors (front) could give an X-Offset and four sensors (left & right) could give an Y-Offset; vice versa for east / west
+				tempXOffTrust /= (headingIndex & 0x1) ? 4.0f : 2.0f;
+				tempYOffTrust /= (headingIndex & 0x1) ? 2.0f : 4.0f;
 
 				distSensX = tempXOffset + tempFusedData.robotState.mapCoordinate.x * JAFDSettings::Field::cellWidth;
 				distSensY = tempYOffset + tempFusedData.robotState.mapCoordinate.y * JAFDSettings::Field::cellWidth;
 				distSensXTrust = tempXOffTrust;
 				distSensYTrust = tempYOffTrust;
 
+				// The heading reference of the Bno055 correction reads the angle and its time together
+				__disable_irq();
+
+				distSensAngle = tempDistSensAngle + dirAngle[headingIndex];
 				distSensAngleTrust = tempDistSensAngleTrust;
 
-				if (tempFusedData.distSensorState.frontLong == DistSensorStatus::ok)
+				if (newDistSensAngle)
+				{
+					distSensAngleTime = tempDistSensAngleTime;
+					distSensAngleCount = distSensAngleCount + 1;
+				}
+
+				__enable_irq();
+
+				// Wall edges of the side sensors
+				if (fresh.lf || fresh.lb || fresh.rf || fresh.rb)
+				{
+					// Repeating an old sample would confirm a pending edge, so only new samples get processed
+					const WallEdge edges[4] = {
+						fresh.lf ? leftFrontEdges.process(tempFusedData.distSensTimestamps.leftFront, tempFusedData.distances.leftFront, tempFusedData.distSensorState.leftFront) : WallEdge(),
+						fresh.lb ? leftBackEdges.process(tempFusedData.distSensTimestamps.leftBack, tempFusedData.distances.leftBack, tempFusedData.distSensorState.leftBack) : WallEdge(),
+						fresh.rf ? rightFrontEdges.process(tempFusedData.distSensTimestamps.rightFront, tempFusedData.distances.rightFront, tempFusedData.distSensorState.rightFront) : WallEdge(),
+						fresh.rb ? rightBackEdges.process(tempFusedData.distSensTimestamps.rightBack, tempFusedData.distances.rightBack, tempFusedData.distSensorState.rightBack) : WallEdge()
+					};
+
+					const float sensorOffsets[4] = { JAFDSettings::Mechanics::distSensLRSpacing / 2.0f, -JAFDSettings::Mechanics::distSensLRSpacing / 2.0f, JAFDSettings::Mechanics::distSensLRSpacing / 2.0f, -JAFDSettings::Mechanics::distSensLRSpacing / 2.0f };
+
+					if (fabsf(relativeHeading) < JAFDSettings::SensorFusion::edgeMaxHeadingDiff)
+					{
+						float correctionSum = 0.0f;
+						uint8_t numCorrections = 0;
+
+						for (uint8_t i = 0; i < 4; i++)
+						{
+							float correction;
+
+							if (edgeCorrection(edges[i], sensorOffsets[i], headingIndex, correction))
+							{
+								correctionSum += correction;
+								numCorrections++;
+							}
+						}
+
+						if (numCorrections > 0)
+						{
+							const float correction = correctionSum / numCorrections * JAFDSettings::SensorFusion::edgeCorrectionPortion;
+
+							shiftPosition((headingIndex & 0x1) ? Vec3f(0.0f, correction, 0.0f) : Vec3f(correction, 0.0f, 0.0f));
+						}
+					}
+				}
+
+				if (fresh.flong && tempFusedData.distSensorState.frontLong == DistSensorStatus::ok)
 				{
+					const SensorPose flongPose = getSensorPose(tempFusedData.distSensTimestamps.frontLong, tempFusedData.robotState);
 					bool hitPointIsOk = false;
 
 					// Measurement is ok
 					// Check if resulting hit point is a 90 wall in front of us
 					if (tempFusedData.robotState.heading == AbsoluteDir::north || tempFusedData.robotState.heading == AbsoluteDir::south)
 					{
-						float hitY = headingSin * (tempFusedData.distances.frontLong / 10.0f + JAFDSettings::Mechanics::distSensFrontBackDist / 2.0f) + tempFusedData.robotState.position.y;
+						float hitY = flongPose.headingSin * (tempFusedData.distances.frontLong / 10.0f + JAFDSettings::Mechanics::distSensFrontBackDist / 2.0f) + flongPose.position.y;
 
 						if (fabsf(hitY - tempFusedData.robotState.mapCoordinate.y * JAFDSettings::Field::cellWidth) < JAFDSettings::MazeMapping::widthSecureDetectFactor * JAFDSettings::Field::cellWidth / 2.0f)
 						{
@@ -809,7 +1221,7 @@ namespace JAFD
 					}
 					else
 					{
-						float hitX = headingCos * (tempFusedData.distances.frontRight / 10.0f + JAFDSettings::Mechanics::distSensFrontBackDist / 2.0f) + tempFusedData.robotState.position.x;
+						float hitX = flongPose.headingCos * (tempFusedData.distances.frontLong / 10.0f + JAFDSettings::Mechanics::distSensFrontBackDist / 2.0f) + flongPose.position.x;
 
 						if (fabsf(hitX - tempFusedData.robotState.mapCoordinate.x * JAFDSettings::Field::cellWidth) < JAFDSettings::MazeMapping::widthSecureDetectFactor * JAFDSettings::Field::cellWidth / 2.0f)
 						{
@@ -819,13 +1231,14 @@ namespace JAFD
 
 					if (hitPointIsOk)
 					{
-						if (lastMiddleFrontDist != 0 && lastTime != 0)
+						if (lastMiddleFrontDist != 0 && tempFusedData.distSensTimestamps.frontLong != lastMiddleFrontTime)
 						{
-							tempDistSensSpeed += (tempFusedData.distances.frontLong - lastMiddleFrontDist) / 10.0f * 1000.0f / (now - lastTime);
+							tempDistSensSpeed += (tempFusedData.distances.frontLong - lastMiddleFrontDist) / 10.0f * 1000.0f / (tempFusedData.distSensTimestamps.frontLong - lastMiddleFrontTime);
 							validDistSpeedSamples++;
 						}
 
 						lastMiddleFrontDist = tempFusedData.distances.frontLong;
+						lastMiddleFrontTime = tempFusedData.distSensTimestamps.frontLong;
 					}
 					else
 					{
@@ -840,423 +1253,237 @@ namespace JAFD
 				lastMiddleFrontDist = 0;
 			}
 
-			if (frontWallsDetected > 0)
+			// The map only changes with new walls observations or a new cell
+			if (newDistances || enteredNewCell)
 			{
-				switch (makeAbsolute(RelativeDir::forward, tempFusedData.robotState.heading))
-				{
+				// Wall observations of this cycle as log-odds changes (index = AbsoluteDir)
+				int8_t wallObservations[4] = { 0, 0, 0, 0 };
 
-				case AbsoluteDir::north:
+				if (newDistances)
 				{
-					if ((~tempFusedData.gridCell.cellConnections & EntranceDirections::north && tempFusedData.gridCell.cellState & CellState::visited) || frontWallsDetected > 1)
-					{
-						walls |= EntranceDirections::north;
-					}
-					else if (!(tempFusedData.gridCell.cellState & CellState::visited))
-					{
-						walls |= EntranceDirections::north;
-						updateCertainty -= 0.08f;
-					}
-					else if (frontWallsDetected < 2)
-					{
-						updateCertainty -= 0.15f;
-					}
-					else
-					{
-						updateCertainty -= 0.25f;
-					}
-
-					break;
+					wallObservations[static_cast<uint8_t>(makeAbsolute(RelativeDir::forward, tempFusedData.robotState.heading))] += wallObservation(frontWallsObserved, frontFreeObserved);
+					wallObservations[static_cast<uint8_t>(makeAbsolute(RelativeDir::left, tempFusedData.robotState.heading))] += wallObservation(leftWallsObserved, leftFreeObserved);
+					wallObservations[static_cast<uint8_t>(makeAbsolute(RelativeDir::right, tempFusedData.robotState.heading))] += wallObservation(rightWallsObserved, rightFreeObserved);
 				}
 
-				case AbsoluteDir::east:
+				// We just drove through the wall to the last cell, so there is no wall
+				if (enteredNewCell)
 				{
-					if ((~tempFusedData.gridCell.cellConnections & EntranceDirections::east && tempFusedData.gridCell.cellState & CellState::visited) || frontWallsDetected > 1)
-					{
-						walls |= EntranceDirections::east;
-					}
-					else if (!(tempFusedData.gridCell.cellState & CellState::visited))
-					{
-						walls |= EntranceDirections::east;
-						updateCertainty -= 0.08f;
-					}
-					else if (frontWallsDetected < 2)
-					{
-						updateCertainty -= 0.15f;
-					}
-					else
-					{
-						updateCertainty -= 0.25f;
-					}
+					if (tempFusedData.robotState.mapCoordinate.x > lastDifferentPosittion.x) wallObservations[static_cast<uint8_t>(AbsoluteDir::south)] -= JAFDSettings::MazeMapping::wallLogOddsPassed;
+					else if (tempFusedData.robotState.mapCoordinate.x < lastDifferentPosittion.x) wallObservations[static_cast<uint8_t>(AbsoluteDir::north)] -= JAFDSettings::MazeMapping::wallLogOddsPassed;
 
-					break;
+					if (tempFusedData.robotState.mapCoordinate.y > lastDifferentPosittion.y) wallObservations[static_cast<uint8_t>(AbsoluteDir::east)] -= JAFDSettings::MazeMapping::wallLogOddsPassed;
+					else if (tempFusedData.robotState.mapCoordinate.y < lastDifferentPosittion.y) wallObservations[static_cast<uint8_t>(AbsoluteDir::west)] -= JAFDSettings::MazeMapping::wallLogOddsPassed;
 				}
 
-				case AbsoluteDir::south:
-				{
-					if ((~tempFusedData.gridCell.cellConnections & EntranceDirections::south && tempFusedData.gridCell.cellState & CellState::visited) || frontWallsDetected > 1)
-					{
-						walls |= EntranceDirections::south;
-					}
-					else if (!(tempFusedData.gridCell.cellState & CellState::visited))
-					{
-						walls |= EntranceDirections::south;
-						updateCertainty -= 0.08f;
-					}
-					else if (frontWallsDetected < 2)
-					{
-						updateCertainty -= 0.15f;
-					}
-					else
-					{
-						updateCertainty -= 0.25f;
-					}
-
-					break;
-				}
-
-				case AbsoluteDir::west:
-				{
-					if ((~tempFusedData.gridCell.cellConnections & EntranceDirections::west && tempFusedData.gridCell.cellState & CellState::visited) || frontWallsDetected > 1)
-					{
-						walls |= EntranceDirections::west;
-					}
-					else if (!(tempFusedData.gridCell.cellState & CellState::visited))
-					{
-						walls |= EntranceDirections::west;
-						updateCertainty -= 0.08f;
-					}
-					else if (frontWallsDetected < 2)
-					{
-						updateCertainty -= 0.15f;
-					}
-					else
-					{
-						updateCertainty -= 0.25f;
-					}
-
-					break;
-				}
+				// Observations against certain walls of a visited cell mean that the robot is lost -> re-localization
+				static uint8_t contradictions = 0;
 
-				default:
-					break;
-				}
-			}
+				if (enteredNewCell) contradictions = 0;
 
-			if (leftWallsDetected > 0)
-			{
-				switch (makeAbsolute(RelativeDir::left, tempFusedData.robotState.heading))
+				if (tempFusedData.gridCell.cellState & CellState::visited)
 				{
+					int8_t storedLogOdds[4];
+					MazeMapping::getWallLogOdds(storedLogOdds, tempFusedData.robotState.mapCoordinate);
 
-				case AbsoluteDir::north:
-				{
-					if ((~tempFusedData.gridCell.cellConnections & EntranceDirections::north && tempFusedData.gridCell.cellState & CellState::visited) || leftWallsDetected > 1)
-					{
-						walls |= EntranceDirections::north;
-					}
-					else if (!(tempFusedData.gridCell.cellState & CellState::visited))
+					for (uint8_t i = 0; i < 4; i++)
 					{
-						walls |= EntranceDirections::north;
-						updateCertainty -= 0.08f;
-					}
-					else if (leftWallsDetected < 2)
-					{
-						updateCertainty -= 0.15f;
-					}
-					else
-					{
-						updateCertainty -= 0.25f;
-					}
+						if (wallObservations[i] == 0 || abs(storedLogOdds[i]) < JAFDSettings::MazeMapping::wallLogOddsCertain) continue;
 
-					break;
-				}
-
-				case AbsoluteDir::east:
-				{
-					if ((~tempFusedData.gridCell.cellConnections & EntranceDirections::east && tempFusedData.gridCell.cellState & CellState::visited) || leftWallsDetected > 1)
-					{
-						walls |= EntranceDirections::east;
-					}
-					else if (!(tempFusedData.gridCell.cellState & CellState::visited))
-					{
-						walls |= EntranceDirections::east;
-						updateCertainty -= 0.08f;
+						if ((wallObservations[i] > 0) != (storedLogOdds[i] > 0)) contradictions++;
+						else if (contradictions > 0) contradictions--;
 					}
-					else if (leftWallsDetected < 2)
-					{
-						updateCertainty -= 0.15f;
-					}
-					else
-					{
-						updateCertainty -= 0.25f;
-					}
-
-					break;
 				}
 
-				case AbsoluteDir::south:
+				if (contradictions >= JAFDSettings::Localization::lostContradictions && !Localization::isRunning())
 				{
-					if ((~tempFusedData.gridCell.cellConnections & EntranceDirections::south && tempFusedData.gridCell.cellState & CellState::visited) || leftWallsDetected > 1)
-					{
-						walls |= EntranceDirections::south;
-					}
-					else if (!(tempFusedData.gridCell.cellState & CellState::visited))
-					{
-						walls |= EntranceDirections::south;
-						updateCertainty -= 0.08f;
-					}
-					else if (leftWallsDetected < 2)
-					{
-						updateCertainty -= 0.15f;
-					}
-					else
-					{
-						updateCertainty -= 0.25f;
-					}
-
-					break;
+					Localization::start();
+					contradictions = 0;
 				}
 
-				case AbsoluteDir::west:
-				{
-					if ((~tempFusedData.gridCell.cellConnections & EntranceDirections::west && tempFusedData.gridCell.cellState & CellState::visited) || leftWallsDetected > 1)
-					{
-						walls |= EntranceDirections::west;
-					}
-					else if (!(tempFusedData.gridCell.cellState & CellState::visited))
-					{
-						walls |= EntranceDirections::west;
-						updateCertainty -= 0.08f;
-					}
-					else if (leftWallsDetected < 2)
-					{
-						updateCertainty -= 0.15f;
-					}
-					else
-					{
-						updateCertainty -= 0.25f;
-					}
+				tempCell = tempFusedData.gridCell;
 
-					break;
-				}
+				MazeMapping::setCurrentCell(tempCell, tempFusedData.gridCellCertainty, wallObservations, tempFusedData.robotState.mapCoordinate);
 
-				default:
-					break;
-				}
+				__disable_irq();
+				fusedDataSeq.beginWrite();
+				fusedData.gridCell = tempCell;
+				fusedData.gridCellCertainty = tempFusedData.gridCellCertainty;
+				fusedDataSeq.endWrite();
+				__enable_irq();
 			}
 
-			if (rightWallsDetected > 0)
-			{
-				switch (makeAbsolute(RelativeDir::right, tempFusedData.robotState.heading))
-				{
-
-				case AbsoluteDir::north:
-				{
-					if ((~tempFusedData.gridCell.cellConnections & EntranceDirections::north && tempFusedData.gridCell.cellState & CellState::visited) || rightWallsDetected > 1)
-					{
-						walls |= EntranceDirections::north;
-					}
-					else if (!(tempFusedData.gridCell.cellState & CellState::visited))
-					{
-						walls |= EntranceDirections::north;
-						updateCertainty -= 0.08f;
-					}
-					else if (rightWallsDetected < 2)
-					{
-						updateCertainty -= 0.15f;
-					}
-					else
-					{
-						updateCertainty -= 0.25f;
-					}
-
-					break;
-				}
+			// Speed from the front distances (only with new front samples, otherwise every sample would be zero)
+			const uint8_t freshFrontSensors = fresh.fl + fresh.fr + fresh.flong;
 
-				case AbsoluteDir::east:
+			if (freshFrontSensors > 0)
+			{
+				if (validDistSpeedSamples > 0)
 				{
-					if ((~tempFusedData.gridCell.cellConnections & EntranceDirections::east && tempFusedData.gridCell.cellState & CellState::visited) || rightWallsDetected > 1)
-					{
-						walls |= EntranceDirections::east;
-					}
-					else if (!(tempFusedData.gridCell.cellState & CellState::visited))
-					{
-						walls |= EntranceDirections::east;
-						updateCertainty -= 0.08f;
-					}
-					else if (rightWallsDetected < 2)
-					{
-						updateCertainty -= 0.15f;
-					}
-					else
-					{
-						updateCertainty -= 0.25f;
-					}
-
-					break;
+					distSensSpeedTrust = validDistSpeedSamples / (float)(freshFrontSensors) * 0.75f;
+					distSensSpeed = (-tempDistSensSpeed / (float)(validDistSpeedSamples)) * JAFDSettings::SensorFusion::distSensSpeedIIRFactor + distSensSpeed * (1.0f - JAFDSettings::SensorFusion::distSensSpeedIIRFactor);	// Negative, because increasing distance means driving away; 
 				}
-
-				case AbsoluteDir::south:
-				{
-					if ((~tempFusedData.gridCell.cellConnections & EntranceDirections::south && tempFusedData.gridCell.cellState & CellState::visited) || rightWallsDetected > 1)
-					{
-						walls |= EntranceDirections::south;
-					}
-					else if (!(tempFusedData.gridCell.cellState & CellState::visited))
-					{
-						walls |= EntranceDirections::south;
-						updateCertainty -= 0.08f;
-					}
-					else if (rightWallsDetected < 2)
-					{
-						updateCertainty -= 0.15f;
-					}
-					else
-					{
-						updateCertainty -= 0.25f;
-					}
-
-					break;
-				}
-
-				case AbsoluteDir::west:
+				else
 				{
-					if ((~tempFusedData.gridCell.cellConnections & EntranceDirections::west && tempFusedData.gridCell.cellState & CellState::visited) || rightWallsDetected > 1)
-					{
-						walls |= EntranceDirections::west;
-					}
-					else if (!(tempFusedData.gridCell.cellState & CellState::visited))
-					{
-						walls |= EntranceDirections::west;
-						updateCertainty -= 0.08f;
-					}
-					else if (rightWallsDetected < 2)
-					{
-						updateCertainty -= 0.15f;
-					}
-					else
-					{
-						updateCertainty -= 0.25f;
-					}
-
-					break;
-				}
-
-				default:
-					break;
+					distSensSpeedTrust = 0.0f;
 				}
 			}
 
-			if (tempFusedData.robotState.mapCoordinate.x > lastDifferentPosittion.x)
-			{
-				walls |= EntranceDirections::south;
+			lastPosition = tempFusedData.robotState.mapCoordinate;
 
-				if (!(~tempFusedData.gridCell.cellConnections & EntranceDirections::south) && tempFusedData.gridCell.cellState & CellState::visited)
-				{
-					updateCertainty -= 0.25f;
-				}
-			}
-			else if (tempFusedData.robotState.mapCoordinate.x < lastDifferentPosittion.x)
-			{
-				walls |= EntranceDirections::north;
+			return true;
+		}
 
-				if (!(~tempFusedData.gridCell.cellConnections & EntranceDirections::north) && tempFusedData.gridCell.cellState & CellState::visited)
-				{
-					updateCertainty -= 0.25f;
-				}
-			}
+		// "heading" in rad
+		void setCertainRobotPosition(Vec3f pos, float heading)
+		{
+			float currentRotEncAngle = (MotorControl::getDistance(Motor::right) - MotorControl::getDistance(Motor::left)) / (JAFDSettings::Mechanics::wheelDistToMiddle * 2.0f * 1.173f);
 
-			if (tempFusedData.robotState.mapCoordinate.y > lastDifferentPosittion.y)
-			{
-				walls |= EntranceDirections::east;
+			Bno055::tare(heading);
+			resetBnoCorrection = true;	// Bno055 heading jumped
 
-				if (!(~tempFusedData.gridCell.cellConnections & EntranceDirections::east) && tempFusedData.gridCell.cellState & CellState::visited)
-				{
-					updateCertainty -= 0.25f;
-				}
-			}
-			else if (tempFusedData.robotState.mapCoordinate.y < lastDifferentPosittion.y)
-			{
-				walls |= EntranceDirections::west;
+			// Read-modify-write of the robot state must not be interleaved with sensorFiltering()
+			__disable_irq();
+			fusedDataSeq.beginWrite();
 
-				if (!(~tempFusedData.gridCell.cellConnections & EntranceDirections::west) && tempFusedData.gridCell.cellState & CellState::visited)
-				{
-					updateCertainty -= 0.25f;
-				}
-			}
+			fusedData.robotState.position = pos;
+			fusedData.robotState.globalHeading = makeRotationCoherent(fusedData.robotState.globalHeading, heading);
+			totalHeadingOff = fitAngleToInterval(heading - currentRotEncAngle);
+			updateCounts.robotState++;
+			poseHistoryCount = 0;		// Old poses are not consistent with the new position anymore
+			leftWallLine.reset();		// Same for old hit points
+			rightWallLine.reset();
+			leftFrontEdges.reset();
+			leftBackEdges.reset();
+			rightFrontEdges.reset();
+			rightBackEdges.reset();
+
+			fusedDataSeq.endWrite();
+			__enable_irq();
+		}
 
-			if (updateCertainty < 0.0f) updateCertainty = 0.0f;
+		float getWheelTrust()
+		{
+			return wheelTrust;
+		}
 
-			tempCell.cellConnections = (~walls) & CellConnections::directionMask;
+		bool isWheelStalled()
+		{
+			return wheelStalled;
+		}
 
-			MazeMapping::setCurrentCell(tempCell, tempFusedData.gridCellCertainty, updateCertainty, tempFusedData.robotState.mapCoordinate);
+		void readSnapshot(FusedData& data)
+		{
+			uint32_t seq;
 
-			if (validDistSpeedSamples > 0)
-			{
-				distSensSpeedTrust = validDistSpeedSamples / 4.0f;
-				distSensSpeed = (-tempDistSensSpeed / (float)(validDistSpeedSamples)) * JAFDSettings::SensorFusion::distSensSpeedIIRFactor + distSensSpeed * (1.0f - JAFDSettings::SensorFusion::distSensSpeedIIRFactor);	// Negative, because increasing distance means driving away; 
-			}
-			else
+			do
 			{
-				distSensSpeedTrust = 0.0f;
-			}
-
-			lastPosition = tempFusedData.robotState.mapCoordinate;
-			fusedData.gridCell = tempCell;
-			fusedData.gridCellCertainty = tempFusedData.gridCellCertainty;
-			lastTime = now;
+				seq = fusedDataSeq.beginRead();
+				data = fusedData;
+			} while (fusedDataSeq.retryRead(seq));
 		}
 
-		// "heading" in rad
-		void setCertainRobotPosition(Vec3f pos, float heading)
+		RobotState getRobotState()
 		{
-			auto tempRobotState = fusedData.robotState;
+			RobotState robotState;
+			uint32_t seq;
 
-			tempRobotState.position = pos;
-			tempRobotState.globalHeading = makeRotationCoherent(tempRobotState.globalHeading, heading);
-
-			float currentRotEncAngle = (MotorControl::getDistance(Motor::right) - MotorControl::getDistance(Motor::left)) / (JAFDSettings::Mechanics::wheelDistToMiddle * 2.0f * 1.173f);
+			do
+			{
+				seq = fusedDataSeq.beginRead();
+				robotState = fusedData.robotState;
+			} while (fusedDataSeq.retryRead(seq));
 
-			totalHeadingOff = fitAngleToInterval(heading - currentRotEncAngle);
+			return robotState;
+		}
 
-			Bno055::tare(heading);
+		void readDistances(Distances& distances, DistSensorStates& distSensorStates)
+		{
+			uint32_t seq;
 
-			fusedData.robotState = tempRobotState;
+			do
+			{
+				seq = fusedDataSeq.beginRead();
+				distances = fusedData.distances;
+				distSensorStates = fusedData.distSensorState;
+			} while (fusedDataSeq.retryRead(seq));
 		}
 
-		const volatile FusedData& getFusedData()
+		void readGridCell(GridCell& gridCell, float& gridCellCertainty)
 		{
-			return fusedData;
+			uint32_t seq;
+
+			do
+			{
+				seq = fusedDataSeq.beginRead();
+				gridCell = fusedData.gridCell;
+				gridCellCertainty = fusedData.gridCellCertainty;
+			} while (fusedDataSeq.retryRead(seq));
 		}
 
 		void updateSensors()
 		{
-			DistanceSensors::forceNewMeasurement();
+			I2CBus::update();
+			AsyncI2C::update();
 
-			if (ColorSensor::dataIsReady())
+			// Wire1 can't be used while it is recovered; the last values are kept meanwhile
+			if (!I2CBus::isRecovering(AsyncI2C::Bus::wire1))
 			{
-				uint16_t colorTemp = 0;
-				uint16_t lux = 0;
-				ColorSensor::getData(&colorTemp, &lux);
+				if (I2CBus::takeSetupRequest(I2CBus::Device::colorSensor)) ColorSensor::setup();
 
-				fusedData.colorSensData.colorTemp = colorTemp;
-				fusedData.colorSensData.lux = lux;
-			}
+				if (ColorSensor::dataIsReady())
+				{
+					uint16_t colorTemp = 0;
+					uint16_t lux = 0;
+					ColorSensor::getData(&colorTemp, &lux);
+
+					__disable_irq();
+					fusedDataSeq.beginWrite();
+					fusedData.colorSensData.colorTemp = colorTemp;
+					fusedData.colorSensData.lux = lux;
+					fusedDataSeq.endWrite();
+					__enable_irq();
+				}
+
+				// The Bno055 boots for some time after a power reset; the last values are kept meanwhile
+				static bool bnoSetupRunning = false;
+
+				if (I2CBus::takeSetupRequest(I2CBus::Device::bno055)) bnoSetupRunning = true;
 
-			Bno055::updateValues();
+				if (bnoSetupRunning)
+				{
+					if (Bno055::resetup() != ReturnCode::aborted) bnoSetupRunning = false;
+				}
+				else
+				{
+					Bno055::updateValues();
+				}
+			}
 
 			RobotLogic::timeBetweenUpdate();
 
 			DistanceSensors::updateDistSensors();
 		}
 
-		void setDistances(Distances distances)
+		void setDistances(Distances distances, DistSensTimestamps timestamps)
 		{
+			__disable_irq();
+			fusedDataSeq.beginWrite();
 			fusedData.distances = distances;
+			fusedData.distSensTimestamps = timestamps;
+			updateCounts.distances++;
+			fusedDataSeq.endWrite();
+			__enable_irq();
 		}
 
 		void setDistSensStates(DistSensorStates distSensorStates)
 		{
+			__disable_irq();
+			fusedDataSeq.beginWrite();
 			fusedData.distSensorState = distSensorStates;
+			updateCounts.distSensStates++;
+			fusedDataSeq.endWrite();
+			__enable_irq();
 		}
 	}
 }
\ No newline at end of file
@@ -0,0 +1,87 @@
+/*
+This part is responsible for detecting slipping or stalled wheels and deciding how much the wheel measurements can be trusted
+*/
+
+#if defined(ARDUINO) && ARDUINO >= 100
+#include "arduino.h"
+#else
+#include "WProgram.h"
+#endif
+
+#include "../header/SlipDetector.h"
+#include "../../JAFDSettings.h"
+
+namespace JAFD
+{
+	namespace
+	{
+		// Update the time a wheel stalls: Current is high, but the wheel doesn't turn although it should
+		void updateStallTime(float& stallTime, const float speed, const int16_t desSpeed, const float current, const float dt)
+		{
+			if (desSpeed != 0 && fabsf(speed) < JAFDSettings::SensorFusion::stallMaxSpeed && current >= JAFDSettings::SensorFusion::stallMinCurrent) stallTime += dt;
+			else stallTime = 0.0f;
+		}
+	}
+
+	SlipDetector::SlipDetector() : trust(1.0f), residual(0.0f), lastForwardVel(0.0f), hasLast(false), leftStallTime(0.0f), rightStallTime(0.0f) {}
+
+	float SlipDetector::update(const SlipMeasurement& measurement, const float dt, const float realDt)
+	{
+		const float forwardVel = (measurement.wheelSpeeds.left + measurement.wheelSpeeds.right) / 2.0f;
+		const float yawVel = (measurement.wheelSpeeds.right - measurement.wheelSpeeds.left) / (JAFDSettings::Mechanics::wheelDistToMiddle * 2.0f * 1.173f);
+
+		// Differences to the other sensors, normalized to their tolerance
+		float newResidual = 0.0f;
+
+		if (measurement.bnoYawValid)
+		{
+			newResidual = fabsf(yawVel - measurement.bnoYawVel) / JAFDSettings::SensorFusion::slipYawVelTolerance;
+		}
+
+		if (measurement.distSensSpeedTrust > 0.0f)
+		{
+			newResidual = fmaxf(newResidual, fabsf(forwardVel - measurement.distSensSpeed) / JAFDSettings::SensorFusion::slipSpeedTolerance * measurement.distSensSpeedTrust);
+		}
+
+		if (hasLast)
+		{
+			newResidual = fmaxf(newResidual, fabsf((forwardVel - lastForwardVel) / realDt - measurement.bnoForwardAcc) / JAFDSettings::SensorFusion::slipAccTolerance);
+		}
+
+		lastForwardVel = forwardVel;
+		hasLast = true;
+
+		residual = newResidual * JAFDSettings::SensorFusion::slipResidualIIRFactor + residual * (1.0f - JAFDSettings::SensorFusion::slipResidualIIRFactor);
+
+		// Stalled wheels
+		updateStallTime(leftStallTime, measurement.wheelSpeeds.left, measurement.desSpeeds.left, measurement.leftCurrent, dt);
+		updateStallTime(rightStallTime, measurement.wheelSpeeds.right, measurement.desSpeeds.right, measurement.rightCurrent, dt);
+
+		const float targetTrust = isStalled() ? 0.0f : 1.0f - fminf(residual, 1.0f);
+
+		// Drop immediately, but recover slowly
+		if (targetTrust < trust) trust = targetTrust;
+		else trust = fminf(targetTrust, trust + JAFDSettings::SensorFusion::wheelTrustRecoveryRate * dt);
+
+		return trust;
+	}
+
+	float SlipDetector::getTrust() const
+	{
+		return trust;
+	}
+
+	bool SlipDetector::isStalled() const
+	{
+		return leftStallTime >= JAFDSettings::SensorFusion::stallMinTime || rightStallTime >= JAFDSettings::SensorFusion::stallMinTime;
+	}
+
+	void SlipDetector::reset()
+	{
+		trust = 1.0f;
+		residual = 0.0f;
+		hasLast = false;
+		leftStallTime = 0.0f;
+		rightStallTime = 0.0f;
+	}
+}
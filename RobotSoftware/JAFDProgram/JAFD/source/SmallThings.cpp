@@ -6,6 +6,7 @@
 
 #include "../../JAFDSettings.h"
 #include "../header/SmallThings.h"
+#include "../header/AsyncI2C.h"
 #include "../header/DistanceSensors.h"
 #include "../header/HeatSensor.h"
 #include "../header/SensorFusion.h"
@@ -179,6 +180,126 @@ namespace JAFD
 
 				Wire1.begin();
 			}
+
+			// Reset the bus (blocking)
+			ReturnCode resetBusBlocking()
+			{
+				static auto lastReset = millis();
+
+				ReturnCode result = ReturnCode::ok;
+
+				manualClockingWire1();
+				manualClockingWire0();
+
+				Wire.begin();
+				Wire1.begin();
+
+				if ((millis() - lastReset) > 1000)
+				{
+					for (uint8_t ch = 0; ch < I2CMultiplexer::maxCh; ch++)
+					{
+						I2CMultiplexer::selectChannel(ch);
+						manualClockingWire0();
+					}
+
+					if (I2CMultiplexer::setup() == ReturnCode::ok)
+					{
+						lastReset = millis();
+
+						return ReturnCode::ok;
+					}
+				}
+
+				Wire.end();
+				Wire1.end();
+
+				resetBusPin.port->PIO_CODR = resetBusPin.pin;
+				delay(5);
+				resetBusPin.port->PIO_SODR = resetBusPin.pin;
+
+				delay(10);
+
+				Wire.begin();
+				Wire1.begin();
+
+				if (DistanceSensors::reset() != ReturnCode::ok) result = ReturnCode::error;
+
+				if (HeatSensor::reset() != ReturnCode::ok) result = ReturnCode::error;
+
+				if (I2CMultiplexer::setup() != ReturnCode::ok) result = ReturnCode::error;
+
+				if (Bno055::setup() != ReturnCode::ok) result = ReturnCode::error;
+
+				if (ColorSensor::setup() != ReturnCode::ok) result = ReturnCode::error;
+
+				lastReset = millis();
+
+				return result;
+			}
+
+			// Pins and peripheral of a bus for the non blocking recovery
+			struct BusPins
+			{
+				Pio* const port;
+				const uint32_t scl;
+				const uint32_t sda;
+				Twi* const twi;
+				TwoWire& wire;
+			};
+
+			const BusPins busPins[2] = {
+				{ PIOB, PIO_PB13, PIO_PB12, TWI1, Wire },	// Wire: TWCK1 (SCL), TWD1 (SDA)
+				{ PIOA, PIO_PA18, PIO_PA17, TWI0, Wire1 }	// Wire1: TWCK0 (SCL1), TWD0 (SDA1)
+			};
+
+			constexpr uint8_t allBuses = 0x03;
+			constexpr uint8_t allDevices = 0x0f;
+
+			enum class RecoveryState : uint8_t
+			{
+				idle,
+				toGpio,		// TWI pins back to GPIO
+				clockLow,
+				clockHigh,
+				stopLow,	// SCL and SDA low
+				stopClock,	// SCL high
+				stopData,	// SDA high -> STOP
+				powerOff,
+				powerOn,
+				toTwi,		// Pins back to the TWI
+				begin,		// Wire.begin()
+				finished	// Waiting for update()
+			};
+
+			volatile RecoveryState state = RecoveryState::idle;
+			volatile uint8_t recoveringBuses = 0;	// Bit mask of the buses being recovered
+			uint8_t pendingBuses = 0;				// Buses which started to hang during the recovery of the other bus
+			bool powerReset = false;				// Does the current recovery include a power reset?
+			uint8_t pulses = 0;						// Generated clock pulses
+			uint8_t waitSteps = 0;					// Steps (ms) to wait before the next state
+			uint32_t recoveryStart = 0;				// Start of the current recovery (us)
+			uint32_t lastRecovery[2] = { 0, 0 };	// End of the last recovery of each bus (ms)
+			uint8_t setupRequests = 0;				// Bit mask of the devices which have to be set up again
+			RecoveryStats recoveryStats = RecoveryStats();
+
+			inline uint8_t busMask(const AsyncI2C::Bus bus)
+			{
+				return 1 << static_cast<uint8_t>(bus);
+			}
+
+			// Set the given lines of all buses being recovered
+			void setLines(const bool scl, const bool sda, const bool high)
+			{
+				for (uint8_t i = 0; i < 2; i++)
+				{
+					if (!(recoveringBuses & (1 << i))) continue;
+
+					const uint32_t mask = (scl ? busPins[i].scl : 0) | (sda ? busPins[i].sda : 0);
+
+					if (high) busPins[i].port->PIO_SODR = mask;
+					else busPins[i].port->PIO_CODR = mask;
+				}
+			}
 		}
 
 		ReturnCode setup()
@@ -186,6 +307,10 @@ namespace JAFD
 			Wire.begin();
 			Wire1.begin();
 
+			// Wire.begin() keeps the clock
+			Wire.setClock(JAFDSettings::I2CBus::clock);
+			Wire1.setClock(JAFDSettings::I2CBus::clock);
+
 			manualClockingWire0();
 			manualClockingWire1();
 
@@ -205,57 +330,222 @@ namespace JAFD
 
 		ReturnCode resetBus()
 		{
-			static auto lastReset = millis();
+			// The bus gets reset with blocking Wire / Wire1 calls
+			AsyncI2C::lock(AsyncI2C::Bus::wire);
+			AsyncI2C::lock(AsyncI2C::Bus::wire1);
 
-			ReturnCode result = ReturnCode::ok;
+			const ReturnCode result = resetBusBlocking();
 
-			manualClockingWire1();
-			manualClockingWire0();
+			AsyncI2C::unlock(AsyncI2C::Bus::wire1);
+			AsyncI2C::unlock(AsyncI2C::Bus::wire);
 
-			Wire.begin();
-			Wire1.begin();
+			return result;
+		}
+
+		void startRecovery(const AsyncI2C::Bus bus)
+		{
+			const uint8_t mask = busMask(bus);
+
+			if (recoveringBuses & mask) return;
+
+			// Only one recovery at once; the other bus follows afterwards
+			if (state != RecoveryState::idle)
+			{
+				pendingBuses |= mask;
+				return;
+			}
+
+			// A bus hanging again shortly after its recovery needs a power reset; the power is shared by both buses
+			powerReset = millis() - lastRecovery[static_cast<uint8_t>(bus)] < JAFDSettings::I2CBus::Recovery::powerResetInterval;
+
+			const uint8_t buses = powerReset ? allBuses : mask;
+
+			if (buses & busMask(AsyncI2C::Bus::wire)) AsyncI2C::suspend(AsyncI2C::Bus::wire);
+			if (buses & busMask(AsyncI2C::Bus::wire1)) AsyncI2C::suspend(AsyncI2C::Bus::wire1);
+
+			pulses = 0;
+			waitSteps = 0;
+			recoveryStart = micros();
+			recoveringBuses = buses;
+
+			// TC3 continues from here
+			state = RecoveryState::toGpio;
+		}
+
+		void recoveryStep()
+		{
+			if (state == RecoveryState::idle || state == RecoveryState::finished) return;
+
+			if (waitSteps > 0)
+			{
+				waitSteps--;
+				return;
+			}
+
+			const uint32_t stepStart = micros();
 
-			if ((millis() - lastReset) > 1000)
+			switch (state)
 			{
-				for (uint8_t ch = 0; ch < I2CMultiplexer::maxCh; ch++)
+			case RecoveryState::toGpio:
+				for (uint8_t i = 0; i < 2; i++)
 				{
-					I2CMultiplexer::selectChannel(ch);
-					manualClockingWire0();
+					if (!(recoveringBuses & (1 << i))) continue;
+
+					busPins[i].wire.end();
+					busPins[i].twi->TWI_CR = TWI_CR_SVDIS | TWI_CR_MSDIS;
+
+					busPins[i].port->PIO_SODR = busPins[i].scl | busPins[i].sda;
+					busPins[i].port->PIO_OER = busPins[i].scl | busPins[i].sda;
+					busPins[i].port->PIO_PER = busPins[i].scl | busPins[i].sda;
+				}
+
+				state = RecoveryState::clockLow;
+				break;
+
+			case RecoveryState::clockLow:
+				setLines(true, false, false);
+				state = RecoveryState::clockHigh;
+				break;
+
+			case RecoveryState::clockHigh:
+				setLines(true, false, true);
+				state = ++pulses < JAFDSettings::I2CBus::Recovery::clockPulses ? RecoveryState::clockLow : RecoveryState::stopLow;
+				break;
+
+			case RecoveryState::stopLow:
+				setLines(true, true, false);
+				waitSteps = JAFDSettings::I2CBus::Recovery::stopTime;
+				state = RecoveryState::stopClock;
+				break;
+
+			case RecoveryState::stopClock:
+				setLines(true, false, true);
+				state = RecoveryState::stopData;
+				break;
+
+			case RecoveryState::stopData:
+				setLines(false, true, true);
+				state = powerReset ? RecoveryState::powerOff : RecoveryState::toTwi;
+				break;
+
+			case RecoveryState::powerOff:
+				// Don't supply the devices over the bus lines
+				for (uint8_t i = 0; i < 2; i++)
+				{
+					if (recoveringBuses & (1 << i)) busPins[i].port->PIO_ODR = busPins[i].scl | busPins[i].sda;
 				}
 
-				if (I2CMultiplexer::setup() == ReturnCode::ok)
+				resetBusPin.port->PIO_CODR = resetBusPin.pin;
+				waitSteps = JAFDSettings::I2CBus::Recovery::powerOffTime;
+				state = RecoveryState::powerOn;
+				break;
+
+			case RecoveryState::powerOn:
+				resetBusPin.port->PIO_SODR = resetBusPin.pin;
+				waitSteps = JAFDSettings::I2CBus::Recovery::powerOnTime;
+				state = RecoveryState::toTwi;
+				break;
+
+			case RecoveryState::toTwi:
+				for (uint8_t i = 0; i < 2; i++)
 				{
-					lastReset = millis();
+					if (!(recoveringBuses & (1 << i))) continue;
+
+					busPins[i].port->PIO_PDR = busPins[i].scl | busPins[i].sda;		// Enable peripheral control
+					busPins[i].port->PIO_ABSR &= ~(busPins[i].scl | busPins[i].sda);	// Peripherals type A
+					busPins[i].twi->TWI_CR = TWI_CR_MSEN;
+				}
+
+				waitSteps = JAFDSettings::I2CBus::Recovery::settleTime;
+				state = RecoveryState::begin;
+				break;
 
-					return ReturnCode::ok;
+			case RecoveryState::begin:
+				for (uint8_t i = 0; i < 2; i++)
+				{
+					if (recoveringBuses & (1 << i)) busPins[i].wire.begin();
 				}
+
+				// The multiplexer channel is unknown now
+				if (recoveringBuses & busMask(AsyncI2C::Bus::wire)) I2CMultiplexer::channelSelected(I2CMultiplexer::maxCh);
+
+				state = RecoveryState::finished;
+				break;
+
+			default:
+				break;
 			}
 
-			Wire.end();
-			Wire1.end();
+			const uint32_t stepTime = micros() - stepStart;
 
-			resetBusPin.port->PIO_CODR = resetBusPin.pin;
-			delay(5);
-			resetBusPin.port->PIO_SODR = resetBusPin.pin;
+			if (stepTime > recoveryStats.maxStepTime) recoveryStats.maxStepTime = stepTime;
+		}
 
-			delay(10);
+		void update()
+		{
+			if (state != RecoveryState::finished) return;
 
-			Wire.begin();
-			Wire1.begin();
+			const uint32_t duration = micros() - recoveryStart;
+			const uint32_t now = millis();
+
+			// The devices are set up again lazily when they are used next
+			if (powerReset) setupRequests = allDevices;
 
-			if (DistanceSensors::reset() != ReturnCode::ok) result = ReturnCode::error;
+			for (uint8_t i = 0; i < 2; i++)
+			{
+				if (!(recoveringBuses & (1 << i))) continue;
 
-			if (HeatSensor::reset() != ReturnCode::ok) result = ReturnCode::error;
+				lastRecovery[i] = now;
+				AsyncI2C::unlock(static_cast<AsyncI2C::Bus>(i));
+			}
 
-			if (I2CMultiplexer::setup() != ReturnCode::ok) result = ReturnCode::error;
+			__disable_irq();
+			recoveryStats.recoveries++;
+			if (powerReset) recoveryStats.powerResets++;
+			if (duration > recoveryStats.maxDuration) recoveryStats.maxDuration = duration;
+			__enable_irq();
 
-			if (Bno055::setup() != ReturnCode::ok) result = ReturnCode::error;
+			recoveringBuses = 0;
+			state = RecoveryState::idle;
 
-			if (ColorSensor::setup() != ReturnCode::ok) result = ReturnCode::error;
+			// Recover the bus which started to hang meanwhile
+			const uint8_t pending = pendingBuses;
+			pendingBuses = 0;
 
-			lastReset = millis();
+			if (pending & busMask(AsyncI2C::Bus::wire)) startRecovery(AsyncI2C::Bus::wire);
+			if (pending & busMask(AsyncI2C::Bus::wire1)) startRecovery(AsyncI2C::Bus::wire1);
+		}
 
-			return result;
+		bool isRecovering(const AsyncI2C::Bus bus)
+		{
+			return recoveringBuses & busMask(bus);
+		}
+
+		bool takeSetupRequest(const Device device)
+		{
+			const uint8_t mask = 1 << static_cast<uint8_t>(device);
+
+			if (!(setupRequests & mask)) return false;
+
+			setupRequests &= ~mask;
+
+			return true;
+		}
+
+		RecoveryStats getRecoveryStats()
+		{
+			__disable_irq();
+			const RecoveryStats stats = recoveryStats;
+			__enable_irq();
+
+			return stats;
+		}
+
+		void resetRecoveryStats()
+		{
+			__disable_irq();
+			recoveryStats = RecoveryStats();
+			__enable_irq();
 		}
 	}
 
@@ -289,6 +579,68 @@ namespace JAFD
 		}
 	}
 
+	namespace LoopWatcher
+	{
+		namespace
+		{
+			constexpr uint32_t windowLength = 1000000;	// Length of a measurement window (us)
+
+			uint32_t windowStart = 0;					// Start of the current window (us)
+			uint32_t windowIterations = 0;				// Iterations in the current window
+			uint32_t windowIdleTime = 0;				// Time spent in idle iterations in the current window (us)
+			uint32_t windowMuxSwitches = 0;				// Multiplexer switch count at the start of the current window
+
+			float loopFreq = 0.0f;						// Iterations per second in the last window
+			float idlePortion = 0.0f;					// Idle portion in the last window
+			float muxSwitchesPerLoop = 0.0f;			// Multiplexer switches per iteration in the last window
+			uint32_t windowMaxLoopTime = 0;				// Longest iteration in the current window (us)
+			uint32_t maxLoopTime = 0;					// Longest iteration in the last window (us)
+		}
+
+		void loopDone(const uint32_t loopTime, const bool idle)
+		{
+			const uint32_t now = micros();
+
+			windowIterations++;
+			if (idle) windowIdleTime += loopTime;
+			if (loopTime > windowMaxLoopTime) windowMaxLoopTime = loopTime;
+
+			if (now - windowStart >= windowLength)
+			{
+				loopFreq = windowIterations * 1000000.0f / (now - windowStart);
+				idlePortion = static_cast<float>(windowIdleTime) / (now - windowStart);
+				muxSwitchesPerLoop = static_cast<float>(I2CMultiplexer::getSwitchCount() - windowMuxSwitches) / windowIterations;
+				maxLoopTime = windowMaxLoopTime;
+
+				windowStart = now;
+				windowIterations = 0;
+				windowIdleTime = 0;
+				windowMuxSwitches = I2CMultiplexer::getSwitchCount();
+				windowMaxLoopTime = 0;
+			}
+		}
+
+		float getLoopFreq()
+		{
+			return loopFreq;
+		}
+
+		float getIdlePortion()
+		{
+			return idlePortion;
+		}
+
+		float getMuxSwitchesPerLoop()
+		{
+			return muxSwitchesPerLoop;
+		}
+
+		uint32_t getMaxLoopTime()
+		{
+			return maxLoopTime;
+		}
+	}
+
 	namespace Wait
 	{
 		namespace
@@ -87,7 +87,7 @@ namespace JAFD
 		}
 
 		// Update speeds for both wheels
-		WheelSpeeds Accelerate::updateSpeeds(const uint8_t freq)
+		WheelSpeeds Accelerate::updateSpeeds(const float dt)
 		{
 			Vec2f currentPosition;			// Current position of robot
 			float currentHeading;			// Current heading of robot;
@@ -101,7 +101,7 @@ namespace JAFD
 			float correctedAngularVel;		// Corrected angular velocity
 			WheelSpeeds output;				// Speed output for both wheels
 
-			const auto tempRobotState = SensorFusion::getFusedData().robotState;
+			const auto tempRobotState = SensorFusion::getRobotState();
 
 			currentPosition = (Vec2f)(tempRobotState.position);
 			currentHeading = tempRobotState.globalHeading;
@@ -174,8 +174,8 @@ namespace JAFD
 			//desAngularVel = desiredSpeed * desCurvature;
 
 			// Kind of PID - controller
-			correctedForwardVel = desiredSpeed * PID::nonePIDPart + _forwardVelPID.process(desiredSpeed, tempRobotState.forwardVel, 1.0f / freq);
-			correctedAngularVel = desAngularVel * PID::nonePIDPart + _angularVelPID.process(desAngularVel, tempRobotState.angularVel.x, 1.0f / freq);
+			correctedForwardVel = desiredSpeed * PID::nonePIDPart + _forwardVelPID.process(desiredSpeed, tempRobotState.forwardVel, dt);
+			correctedAngularVel = desAngularVel * PID::nonePIDPart + _angularVelPID.process(desAngularVel, tempRobotState.angularVel.x, dt);
 
 			// Compute wheel speeds - v = (v_r + v_l) / 2; w = (v_r - v_l) / wheelDistance => v_l = v - w * wheelDistance / 2; v_r = v + w * wheelDistance / 2
 			output = WheelSpeeds{ correctedForwardVel - JAFDSettings::Mechanics::wheelDistance * correctedAngularVel / 2.0f, correctedForwardVel + JAFDSettings::Mechanics::wheelDistance * correctedAngularVel / 2.0f };
@@ -200,6 +200,11 @@ namespace JAFD
 			return output;
 		}
 
+		TaskType Accelerate::getType() const
+		{
+			return TaskType::accelerate;
+		}
+
 		// Accelerate class - end
 
 		// DriveStraight class - begin
@@ -230,7 +235,7 @@ namespace JAFD
 		}
 
 		// Update speeds for both wheels
-		WheelSpeeds DriveStraight::updateSpeeds(const uint8_t freq)
+		WheelSpeeds DriveStraight::updateSpeeds(const float dt)
 		{
 			Vec2f currentPosition;			// Current position of robot
 			float currentHeading;			// Current heading of robot;
@@ -244,7 +249,7 @@ namespace JAFD
 			float correctedForwardVel;		// Corrected forward velocity
 			float correctedAngularVel;		// Corrected angular velocity
 
-			const auto tempRobotState = SensorFusion::getFusedData().robotState;
+			const auto tempRobotState = SensorFusion::getRobotState();
 
 			currentPosition = (Vec2f)(tempRobotState.position);
 			currentHeading = tempRobotState.globalHeading;
@@ -293,8 +298,8 @@ namespace JAFD
 			//desAngularVel = _speeds * desCurvature;
 
 			// Kind of PID - controller
-			correctedForwardVel = desiredSpeed * PID::nonePIDPart + _forwardVelPID.process(_speeds, tempRobotState.forwardVel, 1.0f / freq);
-			correctedAngularVel = desAngularVel * PID::nonePIDPart + _angularVelPID.process(desAngularVel, tempRobotState.angularVel.x, 1.0f / freq);
+			correctedForwardVel = desiredSpeed * PID::nonePIDPart + _forwardVelPID.process(_speeds, tempRobotState.forwardVel, dt);
+			correctedAngularVel = desAngularVel * PID::nonePIDPart + _angularVelPID.process(desAngularVel, tempRobotState.angularVel.x, dt);
 
 			// Compute wheel speeds - v = (v_r + v_l) / 2; w = (v_r - v_l) / wheelDistance => v_l = v - w * wheelDistance / 2; v_r = v + w * wheelDistance / 2
 			output = WheelSpeeds{ correctedForwardVel - JAFDSettings::Mechanics::wheelDistance * correctedAngularVel / 2.0f, correctedForwardVel + JAFDSettings::Mechanics::wheelDistance * correctedAngularVel / 2.0f };
@@ -319,6 +324,11 @@ namespace JAFD
 			return output;
 		}
 
+		TaskType DriveStraight::getType() const
+		{
+			return TaskType::straight;
+		}
+
 		// DriveStraight class - end
 
 		// Stop class - begin
@@ -338,12 +348,17 @@ namespace JAFD
 			return ReturnCode::ok;
 		}
 
-		WheelSpeeds Stop::updateSpeeds(const uint8_t freq)
+		WheelSpeeds Stop::updateSpeeds(const float dt)
 		{
 			_finished = true;
 			return WheelSpeeds{ 0, 0 };
 		}
 
+		TaskType Stop::getType() const
+		{
+			return TaskType::stop;
+		}
+
 		// Stop class - end
 
 		// Rotate class - begin
@@ -375,14 +390,14 @@ namespace JAFD
 		}
 
 		// Update speeds for both wheels
-		WheelSpeeds Rotate::updateSpeeds(const uint8_t freq)
+		WheelSpeeds Rotate::updateSpeeds(const float dt)
 		{
 			float rotatedAngle;			// Rotated angle since start
 			float desAngularVel;		// Desired angular velocity
 			float correctedAngularVel;	// By PID Controller corrected angular velocity
 			WheelSpeeds output;			// Output
 
-			const auto tempRobotState = SensorFusion::getFusedData().robotState;
+			const auto tempRobotState = SensorFusion::getRobotState();
 
 			// Calculate rotated angle
 			rotatedAngle = tempRobotState.globalHeading - _startAngle;
@@ -415,7 +430,7 @@ namespace JAFD
 			}
 
 			// Kind of PID - controller
-			correctedAngularVel = desAngularVel * 0.8f + _angularVelPID.process(desAngularVel, tempRobotState.angularVel.x, 1.0f / freq);
+			correctedAngularVel = desAngularVel * 0.8f + _angularVelPID.process(desAngularVel, tempRobotState.angularVel.x, dt);
 	
 			// Compute wheel speeds -- w = (v_r - v_l) / wheelDistance; v_l = -v_r; => v_l = -w * wheelDistance / 2; v_r = w * wheelDistance / 2
 			output = WheelSpeeds{ -JAFDSettings::Mechanics::wheelDistance * correctedAngularVel / 2.0f, JAFDSettings::Mechanics::wheelDistance * correctedAngularVel / 2.0f };
@@ -431,6 +446,11 @@ namespace JAFD
 			return output;
 		}
 
+		TaskType Rotate::getType() const
+		{
+			return TaskType::rotate;
+		}
+
 		// Rotate class - end
 
 		// ForceSpeed class - begin
@@ -460,7 +480,7 @@ namespace JAFD
 		}
 
 		// Update speeds for both wheels
-		WheelSpeeds ForceSpeed::updateSpeeds(const uint8_t freq)
+		WheelSpeeds ForceSpeed::updateSpeeds(const float dt)
 		{
 			Vec2f currentPosition;			// Current position of robot
 			float currentHeading;			// Current heading of robot;
@@ -474,7 +494,7 @@ namespace JAFD
 			float correctedForwardVel;		// Corrected forward velocity
 			float correctedAngularVel;		// Corrected angular velocity
 
-			const auto tempRobotState = SensorFusion::getFusedData().robotState;
+			const auto tempRobotState = SensorFusion::getRobotState();
 
 			currentPosition = (Vec2f)(tempRobotState.position);
 			currentHeading = tempRobotState.globalHeading;
@@ -523,8 +543,8 @@ namespace JAFD
 			//desAngularVel = _speeds * desCurvature;
 
 			// Kind of PID - controller
-			correctedForwardVel = desiredSpeed * PID::nonePIDPart + _forwardVelPID.process(_speeds, tempRobotState.forwardVel, 1.0f / freq);
-			correctedAngularVel = desAngularVel * PID::nonePIDPart + _angularVelPID.process(desAngularVel, tempRobotState.angularVel.x, 1.0f / freq);
+			correctedForwardVel = desiredSpeed * PID::nonePIDPart + _forwardVelPID.process(_speeds, tempRobotState.forwardVel, dt);
+			correctedAngularVel = desAngularVel * PID::nonePIDPart + _angularVelPID.process(desAngularVel, tempRobotState.angularVel.x, dt);
 
 			// Compute wheel speeds - v = (v_r + v_l) / 2; w = (v_r - v_l) / wheelDistance => v_l = v - w * wheelDistance / 2; v_r = v + w * wheelDistance / 2
 			output = WheelSpeeds{ correctedForwardVel - JAFDSettings::Mechanics::wheelDistance * correctedAngularVel / 2.0f, correctedForwardVel + JAFDSettings::Mechanics::wheelDistance * correctedAngularVel / 2.0f };
@@ -543,6 +563,11 @@ namespace JAFD
 			return output;
 		}
 
+		TaskType ForceSpeed::getType() const
+		{
+			return TaskType::forceSpeed;
+		}
+
 		// ForceSpeed class - end
 
 		// AlignFront class - begin
@@ -608,11 +633,12 @@ namespace JAFD
 
 		// Update speeds for both wheels
 		// Check for distance sensor errors is missing.
-		WheelSpeeds AlignFront::updateSpeeds(const uint8_t freq)
+		WheelSpeeds AlignFront::updateSpeeds(const float dt)
 		{
 			static WheelSpeeds output;
-			const auto tempDistances = SensorFusion::getFusedData().distances;
-			const auto tempDistSensStates = SensorFusion::getFusedData().distSensorState;
+			Distances tempDistances;
+			DistSensorStates tempDistSensStates;
+			SensorFusion::readDistances(tempDistances, tempDistSensStates);
 
 			if (_finished)
 			{
@@ -670,6 +696,11 @@ namespace JAFD
 			return output;
 		}
 
+		TaskType AlignFront::getType() const
+		{
+			return TaskType::alignFront;
+		}
+
 		// AlignFront class - end
 
 		// TaskArray class - begin
@@ -775,9 +806,9 @@ namespace JAFD
 			return code;
 		}
 
-		WheelSpeeds TaskArray::updateSpeeds(const uint8_t freq)
+		WheelSpeeds TaskArray::updateSpeeds(const float dt)
 		{
-			WheelSpeeds speeds = _taskArray[_currentTaskNum]->updateSpeeds(freq);
+			WheelSpeeds speeds = _taskArray[_currentTaskNum]->updateSpeeds(dt);
 
 			if (_taskArray[_currentTaskNum]->isFinished())
 			{
@@ -795,14 +826,19 @@ namespace JAFD
 			return speeds;
 		}
 
+		TaskType TaskArray::getType() const
+		{
+			return _taskArray[_currentTaskNum]->getType();
+		}
+
 		// TaskArray class - end
 
 		// Update speeds for both wheels
-		void updateSpeeds(const uint8_t freq)
+		void updateSpeeds(const float dt)
 		{
 			if (!_stopped)
 			{
-				MotorControl::setSpeeds(_currentTask->updateSpeeds(freq));
+				MotorControl::setSpeeds(_currentTask->updateSpeeds(dt));
 			}
 			else
 			{
@@ -855,7 +891,7 @@ namespace JAFD
 			if (_currentTask->isFinished() || forceOverride)
 			{
 				temp = newTask;
-				returnCode = temp.startTask(SensorFusion::getFusedData().robotState);
+				returnCode = temp.startTask(SensorFusion::getRobotState());
 
 				if (returnCode == ReturnCode::ok)
 				{
@@ -938,7 +974,7 @@ namespace JAFD
 			if (_currentTask->isFinished() || forceOverride)
 			{
 				temp = newTask;
-				returnCode = temp.startTask(SensorFusion::getFusedData().robotState);
+				returnCode = temp.startTask(SensorFusion::getRobotState());
 
 				if (returnCode == ReturnCode::ok)
 				{
@@ -1021,7 +1057,7 @@ namespace JAFD
 			if (_currentTask->isFinished() || forceOverride)
 			{
 				temp = newTask;
-				returnCode = temp.startTask(SensorFusion::getFusedData().robotState);
+				returnCode = temp.startTask(SensorFusion::getRobotState());
 
 				if (returnCode == ReturnCode::ok)
 				{
@@ -1104,7 +1140,7 @@ namespace JAFD
 			if (_currentTask->isFinished() || forceOverride)
 			{
 				temp = newTask;
-				returnCode = temp.startTask(SensorFusion::getFusedData().robotState);
+				returnCode = temp.startTask(SensorFusion::getRobotState());
 
 				if (returnCode == ReturnCode::ok)
 				{
@@ -1187,7 +1223,7 @@ namespace JAFD
 			if (_currentTask->isFinished() || forceOverride)
 			{
 				temp = newTask;
-				returnCode = temp.startTask(SensorFusion::getFusedData().robotState);
+				returnCode = temp.startTask(SensorFusion::getRobotState());
 
 				if (returnCode == ReturnCode::ok)
 				{
@@ -1270,7 +1306,7 @@ namespace JAFD
 			if (_currentTask->isFinished() || forceOverride)
 			{
 				temp = newTask;
-				returnCode = temp.startTask(SensorFusion::getFusedData().robotState);
+				returnCode = temp.startTask(SensorFusion::getRobotState());
 
 				if (returnCode == ReturnCode::ok)
 				{
@@ -1351,7 +1387,7 @@ namespace JAFD
 			if (_currentTask->isFinished() || forceOverride)
 			{
 				TaskArray temp = newTask;
-				returnCode = temp.startTask(SensorFusion::getFusedData().robotState);
+				returnCode = temp.startTask(SensorFusion::getRobotState());
 
 				if (returnCode == ReturnCode::ok)
 				{
@@ -1395,6 +1431,11 @@ namespace JAFD
 			return _currentTask->isFinished();
 		}
 
+		TaskType getCurrentTaskType()
+		{
+			return _currentTask->getType();
+		}
+
 		void stopTask()
 		{
 			_stopped = true;
@@ -10,6 +10,7 @@ namespace JAFD
 		namespace
 		{
 			uint8_t _currentChannel;
+			volatile uint32_t _switchCount = 0;
 		}
 		
 		ReturnCode setup()
@@ -33,11 +34,25 @@ namespace JAFD
 				Wire.beginTransmission(0x70);
 				Wire.write(1 << channel);
 
+				if (channel != _currentChannel) _switchCount++;
+
 				_currentChannel = channel;
 				return(Wire.endTransmission());
 			}
 
 			return 4;
 		}
+
+		void channelSelected(uint8_t channel)
+		{
+			if (channel < maxCh && channel != _currentChannel) _switchCount++;
+
+			_currentChannel = channel;
+		}
+
+		uint32_t getSwitchCount()
+		{
+			return _switchCount;
+		}
 	}
 }
\ No newline at end of file
@@ -1,6 +1,8 @@
 #include <Wire.h>
 
 #include "../header/TCS34725.h"
+#include "../header/DuePinMapping.h"
+#include "../header/AsyncI2C.h"
 #include "../../JAFDSettings.h"
 
 namespace JAFD
@@ -13,6 +15,8 @@ namespace JAFD
 
 		Adafruit_TCS34725 sensor;
 		volatile bool dataReady;
+
+		constexpr uint8_t autoIncrement = 0x20;		// Command type for reading several registers in one burst
 		
 		ReturnCode setup()
 		{
@@ -29,11 +33,20 @@ namespace JAFD
 
 			sensor = Adafruit_TCS34725(tcsIntegrationTime, tcsGain);
 
-			if (!sensor.begin(TCS34725_ADDRESS, &Wire1)) return ReturnCode::error;
+			// The Bno055 is read asynchronously on the same bus
+			AsyncI2C::lock(AsyncI2C::Bus::wire1);
+
+			if (!sensor.begin(TCS34725_ADDRESS, &Wire1))
+			{
+				AsyncI2C::unlock(AsyncI2C::Bus::wire1);
+				return ReturnCode::error;
+			}
 
 			sensor.write8(TCS34725_PERS, TCS34725_PERS_NONE);
 			sensor.setInterrupt(true);
 
+			AsyncI2C::unlock(AsyncI2C::Bus::wire1);
+
 			return ReturnCode::ok;
 		}
 
@@ -54,16 +67,32 @@ namespace JAFD
 		{
 			if (dataReady)
 			{
-				uint16_t c = sensor.read16(TCS34725_CDATAL);
-				uint16_t r = sensor.read16(TCS34725_RDATAL);
-				uint16_t g = sensor.read16(TCS34725_GDATAL);
-				uint16_t b = sensor.read16(TCS34725_BDATAL);
+				// The Bno055 is read asynchronously on the same bus
+				AsyncI2C::lock(AsyncI2C::Bus::wire1);
+
+				// Read C, R, G and B in one burst
+				uint8_t data[8];
+
+				Wire1.beginTransmission(TCS34725_ADDRESS);
+				Wire1.write(TCS34725_COMMAND_BIT | autoIncrement | TCS34725_CDATAL);
+				Wire1.endTransmission();
+
+				Wire1.requestFrom((uint8_t)TCS34725_ADDRESS, (uint8_t)8);
+
+				for (uint8_t i = 0; i < 8; i++) data[i] = Wire1.read();
+
+				uint16_t c = data[0] | (data[1] << 8);
+				uint16_t r = data[2] | (data[3] << 8);
+				uint16_t g = data[4] | (data[5] << 8);
+				uint16_t b = data[6] | (data[7] << 8);
 
 				*colorTemp = sensor.calculateColorTemperature(r, g, b);
 				*lux = sensor.calculateLux(r, g, b);
 
 				dataReady = false;
 				sensor.clearInterrupt();
+
+				AsyncI2C::unlock(AsyncI2C::Bus::wire1);
 			}
 			else
 			{
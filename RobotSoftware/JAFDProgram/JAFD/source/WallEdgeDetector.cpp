@@ -0,0 +1,79 @@
+/*
+This part is responsible for detecting wall edges (start / end of a wall) in the measurements of a side distance sensor
+*/
+
+#include "../header/WallEdgeDetector.h"
+
+namespace JAFD
+{
+	namespace
+	{
+		constexpr uint16_t farDistance = UINT16_MAX;	// Distance used for an overflow (no wall in range)
+
+		inline uint16_t absDiff(const uint16_t a, const uint16_t b)
+		{
+			return a > b ? a - b : b - a;
+		}
+	}
+
+	WallEdgeDetector::WallEdgeDetector(const uint16_t minDelta) : minDelta(minDelta), lastDistance(0), lastTime(0), hasLast(false), pendingEdge(), pendingDistance(0) {}
+
+	WallEdge WallEdgeDetector::process(const uint32_t time, const uint16_t distance, const DistSensorStatus status)
+	{
+		uint16_t newDistance;
+
+		switch (status)
+		{
+		case DistSensorStatus::ok:
+			newDistance = distance;
+			break;
+		case DistSensorStatus::overflow:
+			newDistance = farDistance;
+			break;
+		case DistSensorStatus::underflow:
+			newDistance = 0;
+			break;
+		default:
+			// Faulty measurements are ignored
+			return WallEdge();
+		}
+
+		// A pending edge is only reported if the next measurement stays at the new level (no single outlier)
+		if (pendingEdge.type != WallEdgeType::none)
+		{
+			const WallEdge edge = pendingEdge;
+
+			pendingEdge = WallEdge();
+
+			if (absDiff(newDistance, pendingDistance) < minDelta)
+			{
+				lastDistance = newDistance;
+				lastTime = time;
+
+				return edge;
+			}
+		}
+
+		if (hasLast && absDiff(newDistance, lastDistance) >= minDelta)
+		{
+			pendingEdge.type = newDistance < lastDistance ? WallEdgeType::started : WallEdgeType::ended;
+			pendingEdge.time = lastTime + (time - lastTime) / 2;
+			pendingDistance = newDistance;
+
+			// Keep the level before the jump, in case this is an outlier
+			return WallEdge();
+		}
+
+		lastDistance = newDistance;
+		lastTime = time;
+		hasLast = true;
+
+		return WallEdge();
+	}
+
+	void WallEdgeDetector::reset()
+	{
+		hasLast = false;
+		pendingEdge = WallEdge();
+	}
+}
@@ -0,0 +1,86 @@
+/*
+This part is responsible for fitting a wall line to the hit points of a side distance sensor pair
+*/
+
+#if defined(ARDUINO) && ARDUINO >= 100
+#include "arduino.h"
+#else
+#include "WProgram.h"
+#endif
+
+#include "../header/WallLineEstimator.h"
+
+namespace JAFD
+{
+	WallLineEstimator::WallLineEstimator() : next(0), count(0) {}
+
+	void WallLineEstimator::addPoint(const float alongCoor, const float acrossCoor)
+	{
+		// A jump means we see a different wall (or no wall) now
+		if (count > 0 && fabsf(acrossCoor - across[(next + JAFDSettings::SensorFusion::wallLinePoints - 1) % JAFDSettings::SensorFusion::wallLinePoints]) > JAFDSettings::SensorFusion::wallLineMaxJump) reset();
+
+		along[next] = alongCoor;
+		across[next] = acrossCoor;
+		next = (next + 1) % JAFDSettings::SensorFusion::wallLinePoints;
+
+		if (count < JAFDSettings::SensorFusion::wallLinePoints) count++;
+	}
+
+	bool WallLineEstimator::fit(const float alongCoor, WallLine& line) const
+	{
+		if (count < JAFDSettings::SensorFusion::wallLineMinPoints) return false;
+
+		float meanAlong = 0.0f;
+		float meanAcross = 0.0f;
+		float minAlong = along[0];
+		float maxAlong = along[0];
+
+		for (uint8_t i = 0; i < count; i++)
+		{
+			meanAlong += along[i];
+			meanAcross += across[i];
+
+			if (along[i] < minAlong) minAlong = along[i];
+			else if (along[i] > maxAlong) maxAlong = along[i];
+		}
+
+		// Points have to be spread along the wall, otherwise the slope is meaningless
+		if (maxAlong - minAlong < JAFDSettings::SensorFusion::wallLineMinSpan) return false;
+
+		meanAlong /= count;
+		meanAcross /= count;
+
+		// Centered sums
+		float sxx = 0.0f;
+		float sxy = 0.0f;
+		float syy = 0.0f;
+
+		for (uint8_t i = 0; i < count; i++)
+		{
+			const float dx = along[i] - meanAlong;
+			const float dy = across[i] - meanAcross;
+
+			sxx += dx * dx;
+			sxy += dx * dy;
+			syy += dy * dy;
+		}
+
+		line.slope = sxy / sxx;
+
+		// Residual variance
+		float residualVar = (syy - line.slope * sxy) / (count - 2);
+		if (residualVar < 0.0f) residualVar = 0.0f;
+
+		line.slopeVariance = residualVar / sxx;
+		line.across = meanAcross + line.slope * (alongCoor - meanAlong);
+		line.acrossVariance = residualVar * (1.0f / count + (alongCoor - meanAlong) * (alongCoor - meanAlong) / sxx);
+
+		return true;
+	}
+
+	void WallLineEstimator::reset()
+	{
+		next = 0;
+		count = 0;
+	}
+}
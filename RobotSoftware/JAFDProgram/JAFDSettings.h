@@ -13,11 +13,16 @@ In this file are all settings needed for the robot
 
 #include "JAFD/header/AllDatatypes.h"
 #include "JAFD/header/PIDController.h"
+#include "JAFD/header/RobustFilter.h"
 #include <Adafruit_TCS34725.h>
 
 // We use the TPA81 at the moment
 //#define USE_AMG8833
 
+// Read the encoders with the quadrature decoders of the TCs instead of PIO interrupts (the right encoder has to be on pins 2 / 13)
+// The edge times are then only known to the 1ms poll -> the speed is the number of edges over whole ms, not the time between the edges
+//#define USE_TC_QDEC
+
 namespace JAFDSettings
 {
 	namespace Switch
@@ -25,6 +30,32 @@ namespace JAFDSettings
 		constexpr uint8_t pin = 12;
 	}
 
+	namespace TimedLoop
+	{
+		constexpr float freq = 20.0f;				// Start frequency of the trajectory loop (TC5; 20 - 50Hz); can be changed at runtime
+		constexpr float maxDtFactor = 3.0f;			// Maximum dt used for integration as a multiple of the nominal dt
+
+		// Stages of the timed loops; lower priority number = higher priority (the PIO and TWI interrupts have 0)
+		namespace Speed
+		{
+			constexpr uint8_t priority = 1;			// TC3 (1kHz): Speed estimation and speed PID-Controller
+			constexpr uint16_t budget = 200;		// Maximum run time (us)
+		}
+
+		namespace Fusion
+		{
+			constexpr float freq = 100.0f;			// Frequency of the fusion loop (TC4)
+			constexpr uint8_t priority = 2;			// TC4: Sensor filtering
+			constexpr uint16_t budget = 2000;		// Maximum run time (us)
+		}
+
+		namespace Trajectory
+		{
+			constexpr uint8_t priority = 3;			// TC5: Smooth driving
+			constexpr uint16_t budget = 10000;		// Maximum run time (us)
+		}
+	}
+
 	namespace Field
 	{
 		constexpr float cellWidth = 30.0f;	// Cell width in cm
@@ -76,15 +107,28 @@ namespace JAFDSettings
 		constexpr uint8_t maxSpeed = 1.0f / cmPSToPerc;		// Calculated maximum speed
 		constexpr float maxRotSpeed = 2.0f * maxSpeed / Mechanics::wheelDistance;	// Calculated maximum rotation speed
 
+#ifdef USE_TC_QDEC
+		constexpr float pulsePerRev = 4741.44f;			// Rotary-Encoder pulses per revolution (both edges of both channels)
+		constexpr uint8_t qdecFilter = 63;				// Pulses shorter than (qdecFilter + 1) MCK cycles are ignored by the quadrature decoders (max. 63)
+#else
 		constexpr float pulsePerRev = 4741.44f / 4.0f;	// Rotary-Encoder pulses per revolution
+#endif
+
+		// Speed estimation by the time between encoder edges
+		constexpr float standstillTime = 0.2f;			// The wheel stands still if there was no edge for this time (s)
 
-		constexpr uint8_t currentADCSampleCount = 2;		// How often to sample and average the ADC measurement for the current
+		// Current and voltage feedback: The ADC converts the six channels once per PWM period in the middle of the on phase; the PDC writes them to a buffer
+		constexpr uint8_t adcBlockPeriods = 20;				// PWM periods per buffer block (20 = 1ms); the mean of each block is filtered
+		constexpr float adcIIRFactor = 0.2f;				// IIR factor for the block means
+		constexpr float adcSampleLead = 3.0f;				// Start of the conversions before the middle of the on phase (us); about half the time for the six channels
+		constexpr uint8_t adcInterruptPriority = 0;			// Priority of the ADC interrupt (buffer block full)
 		constexpr float currentSensFactor = 1.0f / 0.14f;	// 140mv/A
 		
 		constexpr float voltageSensFactor = 2.585f;			// "Real Voltage" / "Measured Voltage" for voltage feedback
 
 		constexpr float initPWMReduction = 0.71f;			// Starting with this reduction of the pwm to prevent overvoltage
 		constexpr float pwmRedIIRFactor = 0.5f;				// IIR factor for PWM reduction value
+		constexpr float pwmRedIIRTime = 0.05f;				// Time step pwmRedIIRFactor refers to (s)
 
 		namespace Left
 		{
@@ -94,8 +138,8 @@ namespace JAFDSettings
 			constexpr uint8_t curFbPin = A8;		// Current feedback output left motor
 			constexpr uint8_t voltFbPinA = A1;		// Voltage feedback output left motor / A
 			constexpr uint8_t voltFbPinB = A3;		// Voltage feedback output left motor / B
-			constexpr uint8_t encA = 4;				// Encoder Pin A
-			constexpr uint8_t encB = 5;				// Encoder Pin B
+			constexpr uint8_t encA = 4;				// Encoder Pin A (TIOB6)
+			constexpr uint8_t encB = 5;				// Encoder Pin B (TIOA6)
 		}
 
 		namespace Right
@@ -106,8 +150,13 @@ namespace JAFDSettings
 			constexpr uint8_t curFbPin = A9;		// Current feedback output left motor
 			constexpr uint8_t voltFbPinA = A7;		// Voltage feedback output left motor / A
 			constexpr uint8_t voltFbPinB = A5;		// Voltage feedback output left motor / b
+#ifdef USE_TC_QDEC
+			constexpr uint8_t encA = 2;				// Encoder Pin A (TIOA0)
+			constexpr uint8_t encB = 13;			// Encoder Pin B (TIOB0)
+#else
 			constexpr uint8_t encA = 6;				// Encoder Pin A
 			constexpr uint8_t encB = 9;				// Encoder Pin B
+#endif
 		}
 	}
 
@@ -117,6 +166,22 @@ namespace JAFDSettings
 		constexpr float maxPitchForDistSensor = DEG_TO_RAD * 10.0f;		// Maximum pitch of robot for correct front distance measurements
 		constexpr uint16_t minDeltaDistForEdge = 30;					// Minimum change in distance that corresponds to an edge (in mm)
 
+		// Latency compensation
+		constexpr uint16_t maxSampleAge = 500;							// Oldest measurement whose pose can be looked up (ms); has to cover the delay of the distance filters
+		constexpr uint8_t poseHistoryLength = static_cast<uint8_t>(maxSampleAge / 1000.0f * TimedLoop::Fusion::freq) + 3;	// Number of past poses stored for latency compensation (one per sensorFiltering() call; rounded up + 2 spare)
+
+		// Wall line fitting (side distance sensors)
+		constexpr uint8_t wallLinePoints = 16;							// Number of hit points per side used for the line fit
+		constexpr uint8_t wallLineMinPoints = 6;						// Minimum number of hit points for a line fit
+		constexpr float wallLineMinSpan = 8.0f;							// Minimum length of wall covered by the hit points (cm)
+		constexpr float wallLineMaxJump = 3.0f;							// Maximum lateral jump between two hit points of the same wall (cm)
+		constexpr float wallLineMaxAngleVar = 0.001f;					// Maximum variance of the wall angle (rad^2) to use the line instead of the sensor pair
+
+		// Wall edges (side distance sensors)
+		constexpr float edgeMaxHeadingDiff = DEG_TO_RAD * 10.0f;		// Maximum angle between robot and maze axis to use wall edges
+		constexpr float edgeMaxCorrection = 6.0f;						// Maximum distance between a wall edge and the nearest cell border to use the edge (cm)
+		constexpr float edgeCorrectionPortion = 0.5f;					// How much of the distance between wall edge and cell border is corrected?
+
 		// Distance & Speed
 		constexpr float distSensSpeedIIRFactor = 0.8f;					// Factor used for IIR-Filter for speed measured by distance sensors
 		constexpr float longDistSensIIRFactor = 0.8f;					// Factor used for IIR-Filter for high range distance measurements
@@ -128,6 +193,24 @@ namespace JAFDSettings
 
 		// Rotation
 		constexpr float bno055RotPortion = 0.1f;						// How much is a Bno055 rotation measurement worth?
+		constexpr float zeroVelMaxSpeed = 0.5f;							// Maximum wheel speed at standstill (cm/s)
+		constexpr float zeroVelMinTime = 0.5f;							// Minimum time at standstill before the Bno055 drift gets estimated (s)
+		constexpr float bno055BiasIIRFactor = 0.05f;					// Factor used for IIR-Filter for the Bno055 heading drift
+		constexpr float bno055MaxBias = DEG_TO_RAD * 1.0f;				// Maximum absolute Bno055 heading drift (rad/s)
+		constexpr float bno055ScaleIIRFactor = 0.2f;					// Factor used for IIR-Filter for the Bno055 heading scale
+		constexpr float bno055MaxScaleError = 0.05f;					// Maximum deviation of the Bno055 heading scale from 1.0
+		constexpr float bno055ScaleMinTurn = DEG_TO_RAD * 60.0f;		// Minimum turn between two heading references to estimate the scale
+		constexpr float headingRefMinTrust = 0.6f;						// Minimum trust of the distance sensor angle to be used as heading reference
+
+		// Slip detection
+		constexpr float slipYawVelTolerance = DEG_TO_RAD * 30.0f;		// Difference between wheel and Bno055 yaw velocity at which the wheels aren't trusted anymore (rad/s)
+		constexpr float slipSpeedTolerance = 10.0f;						// Difference between wheel and distance sensor speed at which the wheels aren't trusted anymore (cm/s)
+		constexpr float slipAccTolerance = 150.0f;						// Difference between wheel and Bno055 acceleration at which the wheels aren't trusted anymore (cm/s^2)
+		constexpr float slipResidualIIRFactor = 0.6f;					// Factor used for IIR-Filter for the slip residual
+		constexpr float wheelTrustRecoveryRate = 1.0f;					// Maximum increase of the wheel trust per second
+		constexpr float stallMinCurrent = 2.5f;							// Minimum motor current of a stalled wheel (A)
+		constexpr float stallMaxSpeed = 1.0f;							// Maximum speed of a stalled wheel (cm/s)
+		constexpr float stallMinTime = 0.2f;							// Minimum time before a wheel counts as stalled (s)
 		constexpr float angularVelIIRFactor = 0.9f;						// Factor used for IIR-Filter for angular velocity
 		constexpr float angularVelDiffPortion = 0.5f;					// How much of the angular yaw velocity is based on differentiation?
 		constexpr float pitchIIRFactor = 0.5f;							// Factor used for IIR-Filter for pitch angle
@@ -138,7 +221,8 @@ namespace JAFDSettings
 	{
 		namespace Motor
 		{
-			constexpr JAFD::PIDSettings pidSettings(0.85f, 5.2f, 0.01f, 1.0f / MotorControl::cmPSToPerc, 0.5f / MotorControl::cmPSToPerc, -1.0f / MotorControl::cmPSToPerc, 1.0f / MotorControl::cmPSToPerc);
+			// Gains of the 20Hz loop until the 1kHz speed stage is tuned on the robot (the controller scales with dt); no D term: at 1kHz the speed differences are mostly encoder quantization noise
+			constexpr JAFD::PIDSettings pidSettings(0.85f, 5.2f, 0.0f, 1.0f / MotorControl::cmPSToPerc, 0.5f / MotorControl::cmPSToPerc, -1.0f / MotorControl::cmPSToPerc, 1.0f / MotorControl::cmPSToPerc);
 		}
 
 		namespace GoToAngle
@@ -194,56 +278,156 @@ namespace JAFDSettings
 	{
 		constexpr float distLongerThanBorder = 7.0f;		// Distance longer than border from which next field is empty (cm)
 		constexpr float widthSecureDetectFactor = 0.85f;	// Factor of cell width in which border the distance measurement safely hits the front wall	
+
+		// Wall log-odds (1 = 0.1 in natural log-odds)
+		constexpr int8_t wallLogOddsHit = 3;				// Change per distance sensor that detected the wall
+		constexpr int8_t wallLogOddsFree = 2;				// Change per distance sensor that looked through the wall position
+		constexpr int8_t wallLogOddsPassed = 60;			// Change if the robot drove through the wall position
+		constexpr int8_t wallLogOddsThreshold = 10;			// Absolute value from which a wall / an opening is committed to the cell connections
+		constexpr int8_t wallLogOddsCertain = 30;			// Absolute value from which a wall counts as certain
+		constexpr int8_t wallLogOddsMax = 100;				// Saturation
+	}
+
+	namespace Localization
+	{
+		constexpr uint16_t numParticles = 200;						// Number of particles
+		constexpr uint8_t particlesPerUpdate = 40;					// Particles weighted per update() call
+		constexpr uint8_t mapWindowRadius = 3;						// Cells around the robot that are cached for raycasting
+		constexpr float startSpread = 30.0f;						// Maximum position error when the localization is started (cm)
+		constexpr float startHeadingSpread = DEG_TO_RAD * 15.0f;	// Maximum heading error when the localization is started
+		constexpr float motionNoise = 0.5f;							// Standard deviation of position noise per round (cm)
+		constexpr float headingNoise = DEG_TO_RAD * 1.0f;			// Standard deviation of heading noise per round
+		constexpr float distSensSigma = 2.0f;						// Standard deviation of a distance measurement (cm)
+		constexpr float minLikelihood = 0.05f;						// Likelihood of a measurement which doesn't fit at all (outliers)
+		constexpr float convergedSpread = 2.0f;						// Position spread at which the localization has converged (cm)
+		constexpr uint8_t maxRounds = 30;							// Rounds after which the localization is given up
+		constexpr uint8_t lostContradictions = 20;					// Wall observations against certain walls of a visited cell (minus the agreeing ones) that start the localization
 	}
 
 	namespace DistanceSensors
 	{
 		constexpr uint16_t minCalibDataDiff = 20;		// Minimum difference in calibration data
-		constexpr uint8_t bytesPerCalibData = 8;
+		constexpr uint8_t calibTablePoints = 16;		// Maximum number of points in the calibration table of a sensor
+		constexpr uint8_t calibVersion = 2;				// Version of the stored calibration data (1 = linear k / d)
+		constexpr uint8_t bytesPerCalibData = 6 + 2 * calibTablePoints + 1;		// Header, points and checksum
+		constexpr uint8_t legacyBytesPerCalibData = 8;	// Space per sensor of the linear k / d data (version 1, no header)
 
 		constexpr uint8_t multiplexerAddr = 0x70;
 
 		constexpr uint16_t timeout = 200;
 
+		constexpr uint16_t vl6180Period = 100;			// Inter measurement period of the VL6180 in continuous mode (ms, 10 - 2550 in steps of 10)
+		constexpr uint16_t vl6180StopTime = 100;		// Time the VL6180 needs to stop the continuous mode before it can be started again (ms)
+
+		// Only read the VL6180 / VL53L0X after their GPIO1 signaled a new measurement; false = poll the interrupt status
+		// Needs GPIO1 of every sensor wired to its interruptPin below (open drain, active low, internal pull-up) - not verified on the robot yet
+		constexpr bool dataReadyInterrupt = false;
+
+		constexpr uint8_t filterWindow = 5;				// Number of measurements in the window of the robust filters
+
 		namespace LeftFront
 		{
 			constexpr uint8_t multiplexCh = 2;
+			constexpr uint8_t interruptPin = 24;	// GPIO1
+			constexpr JAFD::RobustFilterSettings filter(JAFD::RobustFilterType::hampel, 3.0f);		// Removes single multipath outliers
 		}
 
 		namespace LeftBack
 		{
 			constexpr uint8_t multiplexCh = 3;
+			constexpr uint8_t interruptPin = 25;	// GPIO1
+			constexpr JAFD::RobustFilterSettings filter(JAFD::RobustFilterType::hampel, 3.0f);		// Removes single multipath outliers
 		}
 
 		namespace RightFront
 		{
 			constexpr uint8_t multiplexCh = 4;
+			constexpr uint8_t interruptPin = 26;	// GPIO1
+			constexpr JAFD::RobustFilterSettings filter(JAFD::RobustFilterType::hampel, 3.0f);		// Removes single multipath outliers
 		}
 
 		namespace RightBack
 		{
 			constexpr uint8_t multiplexCh = 5;
+			constexpr uint8_t interruptPin = 27;	// GPIO1
+			constexpr JAFD::RobustFilterSettings filter(JAFD::RobustFilterType::hampel, 3.0f);		// Removes single multipath outliers
 		}
 
 		namespace FrontLeft
 		{
 			constexpr uint8_t multiplexCh = 0;
+			constexpr uint8_t interruptPin = 22;	// GPIO1
+			constexpr JAFD::RobustFilterSettings filter(JAFD::RobustFilterType::median);
 		}
 
 		namespace FrontRight
 		{
 			constexpr uint8_t multiplexCh = 1;
+			constexpr uint8_t interruptPin = 23;	// GPIO1
+			constexpr JAFD::RobustFilterSettings filter(JAFD::RobustFilterType::median);
 		}
 
 		namespace FrontLong
 		{
 			constexpr JAFD::SerialType serialType = JAFD::SerialType::two;
+			constexpr JAFD::RobustFilterSettings filter(JAFD::RobustFilterType::trimmedMean, 3.0f, 1);	// Fast enough (100Hz) to average over the window
+			constexpr uint16_t calibOffset = 0;		// Distance of the TFMini behind the front short distance sensors (mm)
+		}
+
+		// Adaptive sampling of the short distance sensors
+		namespace Sampling
+		{
+			constexpr uint16_t fastInterval = 0;		// Sampling interval of the important sensors (ms); 0 = every measurement
+			constexpr uint16_t slowInterval = 2 * vl6180Period;	// Sampling interval of the less important sensors (ms); has to be longer than the VL6180 period to have an effect
+			constexpr uint16_t longRangeDist = 1000;	// Front distance from which on the front short distance sensors are less important (mm)
+		}
+
+		// Health monitor of the short distance sensors
+		namespace Health
+		{
+			constexpr uint8_t maxFailures = 5;			// Consecutive errors / timeouts until a sensor gets quarantined
+			constexpr uint16_t quarantineTime = 2000;	// Time a quarantined sensor isn't read before it gets restarted (ms)
+		}
+
+		// Automatic calibration of the front sensors; the robot starts straight in front of a wall and drives backwards
+		namespace AutoCalib
+		{
+			constexpr uint16_t startDist = 50;		// Distance of the front short distance sensors to the wall at the start (mm)
+			constexpr float stepDist = 5.0f;		// Distance driven between two points (cm)
+			constexpr uint8_t steps = 16;			// Number of points
+			constexpr int16_t speed = 10;			// Speed while driving backwards (cm/s)
+			constexpr uint16_t settleTime = 300;	// Time to wait for the filters after stopping (ms)
+			constexpr uint16_t averageTime = 500;	// Time to average the measurements at a point (ms)
 		}
 	}
 
 	namespace I2CBus
 	{
 		constexpr uint8_t powerResetPin = 38;
+		constexpr uint32_t clock = 400000;			// Fast mode; all devices except the TPA81 support it (Hz)
+		constexpr uint32_t tpa81Clock = 100000;		// The TPA81 only supports standard mode (Hz)
+
+		// Non blocking recovery of a hanging bus (one step per ms in TC3)
+		namespace Recovery
+		{
+			constexpr uint8_t clockPulses = 9;				// SCL pulses to make a slave release SDA
+			constexpr uint8_t stopTime = 2;					// Time SCL and SDA are low before the STOP (ms)
+			constexpr uint8_t powerOffTime = 5;				// Time the devices are switched off during a power reset (ms)
+			constexpr uint8_t powerOnTime = 10;				// Time the devices get to start after a power reset (ms)
+			constexpr uint8_t settleTime = 30;				// Time between switching back to the TWI and using the bus (ms)
+			constexpr uint16_t powerResetInterval = 1000;	// A bus failing again within this time after a recovery gets a power reset (ms)
+			constexpr uint16_t bno055BootTime = 650;		// Time the Bno055 needs to boot after a power reset; the bus isn't accessed meanwhile (ms)
+			constexpr uint16_t bno055BootTimeout = 2000;	// Time after a power reset after which the Bno055 has to answer (ms)
+		}
+	}
+
+	namespace AsyncI2C
+	{
+		constexpr uint8_t queueLength = 16;				// Maximum number of waiting transactions per bus
+		constexpr uint16_t defaultTimeout = 10;			// Timeout of a transaction if none is given (ms)
+		constexpr uint8_t interruptPriority = 0;		// Priority of the TWI interrupts
+		constexpr uint8_t maxChannelDeferrals = 4;		// How often the oldest transaction may be passed over to stay on the current multiplexer channel
+		constexpr bool parallelBno055 = true;			// Read the Bno055 on Wire1 while the distance sensors are read on Wire (false: blocking reads, e.g. to compare the sensor update rate)
 	}
 
 	namespace PowerLEDs
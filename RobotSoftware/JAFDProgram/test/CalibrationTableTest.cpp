@@ -0,0 +1,177 @@
+/*
+This part is responsible for the host test of the calibration tables of the distance sensors
+*/
+
+#include <string.h>
+
+#include "Test.h"
+#include "../JAFD/header/CalibrationTable.h"
+#include "../JAFD/header/SpiNVSRAM.h"
+
+using namespace JAFD;
+
+// SPI NVSRAM in the RAM
+namespace JAFD
+{
+	namespace SpiNVSRAM
+	{
+		uint8_t memory[1024];
+
+		void readStream(const uint32_t address, uint8_t* buffer, const uint32_t length)
+		{
+			memcpy(buffer, memory + address, length);
+		}
+
+		void writeStream(uint32_t address, uint8_t* buffer, const uint32_t length)
+		{
+			memcpy(memory + address, buffer, length);
+		}
+	}
+}
+
+namespace
+{
+	constexpr uint32_t tableAddr = 0;
+	constexpr uint32_t legacyAddr = 512;
+
+	// Linear sensor error, measured at unevenly spaced distances
+	void testLinearUneven()
+	{
+		const uint16_t measured[] = { 20, 25, 40, 70, 71, 110, 150 };
+		uint16_t trueDist[7];
+
+		for (uint8_t i = 0; i < 7; i++) trueDist[i] = roundf(1.1f * measured[i] - 5.0f);
+
+		CalibrationTable table;
+
+		CHECK(table.build(trueDist, measured, 7) == ReturnCode::ok);
+		CHECK(table.getPoints() == 7);
+
+		for (uint16_t m = 20; m <= 150; m += 5) CHECK_NEAR(table.apply(m), 1.1f * m - 5.0f, 1.0f);
+
+		// Outside of the measurements, the outer segments are extended
+		CHECK_NEAR(table.apply(0), -5.0f, 1.5f);
+		CHECK_NEAR(table.apply(10), 6.0f, 1.5f);
+		CHECK_NEAR(table.apply(200), 215.0f, 1.5f);
+		CHECK_NEAR(table.apply(255), 275.5f, 2.0f);
+	}
+
+	// Non linear sensor error (like the VL6180 near its range limits), dense at short distances
+	void testNonLinear()
+	{
+		const uint16_t measured[] = { 15, 18, 22, 27, 33, 40, 48, 57, 67, 78, 90, 103, 117, 132, 148, 165, 183, 200 };
+		const uint8_t count = sizeof(measured) / sizeof(measured[0]);
+		uint16_t trueDist[count];
+
+		auto sensor = [](const float m) { return m + 0.0015f * (m - 100.0f) * (m - 100.0f) - 8.0f; };
+
+		for (uint8_t i = 0; i < count; i++) trueDist[i] = roundf(sensor(measured[i]));
+
+		CalibrationTable table;
+
+		CHECK(table.build(trueDist, measured, count) == ReturnCode::ok);
+		CHECK(table.getPoints() == JAFDSettings::DistanceSensors::calibTablePoints);
+
+		// A straight line would be up to 10mm off
+		for (uint8_t i = 0; i < count; i++) CHECK_NEAR(table.apply(measured[i]), sensor(measured[i]), 2.0f);
+		for (uint16_t m = 20; m <= 195; m += 5) CHECK_NEAR(table.apply(m), sensor(m), 2.0f);
+	}
+
+	// All measurements close together -> only the offset gets corrected
+	void testOffsetOnly()
+	{
+		const uint16_t measured[] = { 100, 104, 110 };
+		const uint16_t trueDist[] = { 112, 116, 122 };
+		CalibrationTable table;
+
+		CHECK(table.build(trueDist, measured, 3) == ReturnCode::ok);
+		CHECK(table.getPoints() == 2);
+		CHECK_NEAR(table.apply(104), 116.0f, 0.5f);
+		CHECK_NEAR(table.apply(20), 32.0f, 0.5f);
+		CHECK_NEAR(table.apply(300), 312.0f, 0.5f);
+
+		// A single measurement
+		const uint16_t singleMeasured[] = { 50 };
+		const uint16_t singleTrue[] = { 45 };
+
+		CHECK(table.build(singleTrue, singleMeasured, 1) == ReturnCode::ok);
+		CHECK_NEAR(table.apply(50), 45.0f, 0.5f);
+		CHECK_NEAR(table.apply(150), 145.0f, 0.5f);
+
+		CHECK(table.build(singleTrue, singleMeasured, 0) == ReturnCode::error);
+	}
+
+	// No calibration: The measured distance is the true distance
+	void testReset()
+	{
+		CalibrationTable table;
+
+		CHECK_NEAR(table.apply(0), 0.0f, 0.001f);
+		CHECK_NEAR(table.apply(1234), 1234.0f, 0.001f);
+	}
+
+	void testStoreRestore()
+	{
+		const uint16_t measured[] = { 300, 800, 1500, 3000, 6000, 12000 };
+		const uint16_t trueDist[] = { 310, 805, 1490, 2980, 6050, 12100 };
+		CalibrationTable table;
+		CalibrationTable restored;
+
+		memset(SpiNVSRAM::memory, 0xff, sizeof(SpiNVSRAM::memory));
+
+		CHECK(table.build(trueDist, measured, 6) == ReturnCode::ok);
+		table.store(tableAddr);
+
+		CHECK(restored.restore(tableAddr, legacyAddr) == ReturnCode::ok);
+		CHECK(restored.getPoints() == table.getPoints());
+
+		for (uint16_t m = 0; m <= 13000; m += 250) CHECK(restored.apply(m) == table.apply(m));
+
+		// A broken table
+		SpiNVSRAM::memory[tableAddr + 7] ^= 0x01;
+
+		CHECK(restored.restore(tableAddr, legacyAddr) == ReturnCode::error);
+		CHECK_NEAR(restored.apply(500), 500.0f, 0.001f);
+	}
+
+	// Linear k / d data of version 1 (k * 100, d with sign bit) become a 2 point table
+	void testLegacy()
+	{
+		CalibrationTable table;
+
+		memset(SpiNVSRAM::memory, 0xff, sizeof(SpiNVSRAM::memory));
+
+		const uint16_t k = 105;
+		const uint16_t d = 7 | (1 << 15);	// -7
+
+		SpiNVSRAM::memory[legacyAddr] = k & 0xff;
+		SpiNVSRAM::memory[legacyAddr + 1] = k >> 8;
+		SpiNVSRAM::memory[legacyAddr + 2] = d & 0xff;
+		SpiNVSRAM::memory[legacyAddr + 3] = d >> 8;
+
+		CHECK(table.restore(tableAddr, legacyAddr) == ReturnCode::aborted);
+		CHECK(table.getPoints() == 2);
+		CHECK_NEAR(table.apply(0), -7.0f, 0.001f);
+		CHECK_NEAR(table.apply(100), 98.0f, 0.001f);
+		CHECK_NEAR(table.apply(1000), 1043.0f, 0.01f);
+
+		// Implausible data (e.g. never written) -> no calibration
+		SpiNVSRAM::memory[legacyAddr] = 0;
+		SpiNVSRAM::memory[legacyAddr + 1] = 0;
+
+		CHECK(table.restore(tableAddr, legacyAddr) == ReturnCode::error);
+		CHECK_NEAR(table.apply(100), 100.0f, 0.001f);
+	}
+}
+
+int main()
+{
+	testLinearUneven();
+	testNonLinear();
+	testOffsetOnly();
+	testReset();
+	testStoreRestore();
+	testLegacy();
+
+	return testResult("CalibrationTableTest");
+}
@@ -0,0 +1,145 @@
+/*
+This part is responsible for the host test of the robust filters
+*/
+
+#include "Test.h"
+#include "../JAFD/header/RobustFilter.h"
+
+using namespace JAFD;
+
+namespace
+{
+	// The Hampel filter follows a step once the new level is the majority of the window
+	void testHampelStep()
+	{
+		RobustFilter<uint16_t, 5> filter(RobustFilterSettings(RobustFilterType::hampel, 3.0f));
+		uint16_t output = 0;
+
+		for (uint8_t i = 0; i < 5; i++) output = filter.process(100);
+
+		CHECK(output == 100);
+		CHECK(filter.process(200) == 100);
+		CHECK(filter.process(200) == 100);
+		CHECK(filter.process(200) == 200);
+		CHECK(filter.process(200) == 200);
+		CHECK(filter.process(200) == 200);
+	}
+
+	// A single outlier in noisy values is replaced by the median; the next normal value passes through
+	void testHampelOutlier()
+	{
+		RobustFilter<uint16_t, 5> filter(RobustFilterSettings(RobustFilterType::hampel, 3.0f));
+		const uint16_t values[] = { 100, 104, 97, 102, 99 };
+
+		for (const auto value : values) CHECK(filter.process(value) == value);
+
+		CHECK(filter.process(500) == 102);	// Window 97, 99, 102, 104, 500
+		CHECK(filter.process(101) == 101);
+	}
+
+	// Without any spread in the window, every deviation is an outlier
+	void testZeroMAD()
+	{
+		RobustFilter<uint16_t, 5> filter(RobustFilterSettings(RobustFilterType::hampel, 3.0f));
+
+		for (uint8_t i = 0; i < 5; i++) filter.process(100);
+
+		CHECK(filter.medianAbsDeviation() == 0);
+		CHECK(filter.process(101) == 100);
+		CHECK(filter.process(100) == 100);
+
+		// A constant window of floats
+		RobustFilter<float, 5> floatFilter(RobustFilterSettings(RobustFilterType::hampel, 3.0f));
+
+		for (uint8_t i = 0; i < 5; i++) floatFilter.process(1.0f);
+
+		CHECK(floatFilter.medianAbsDeviation() == 0.0f);
+		CHECK(floatFilter.process(1.5f) == 1.0f);
+	}
+
+	// Median: The output has the timestamp of the middle value
+	void testMedianTimestamps()
+	{
+		RobustFilter<uint16_t, 5> filter(RobustFilterSettings(RobustFilterType::median));
+		uint32_t timestamp;
+
+		timestamp = 0;
+		filter.process(10, timestamp);
+		CHECK(timestamp == 0);
+
+		timestamp = 10;
+		filter.process(20, timestamp);
+		CHECK(timestamp == 5);		// Between both values
+
+		timestamp = 20;
+		filter.process(30, timestamp);
+		CHECK(timestamp == 10);
+
+		timestamp = 30;
+		filter.process(40, timestamp);
+		CHECK(timestamp == 15);
+
+		timestamp = 40;
+		filter.process(50, timestamp);
+		CHECK(timestamp == 20);
+
+		timestamp = 50;
+		filter.process(60, timestamp);
+		CHECK(timestamp == 30);
+	}
+
+	// Hampel: Switching between the latest value and the median never makes the timestamps go back
+	void testHampelTimestampsMonotonic()
+	{
+		RobustFilter<uint16_t, 5> filter(RobustFilterSettings(RobustFilterType::hampel, 3.0f));
+		const uint16_t values[] = { 100, 101, 99, 100, 102, 500, 100, 600, 101, 99, 700, 800, 100, 98, 100 };
+		uint32_t lastTimestamp = 0;
+		uint32_t time = 1000;
+
+		for (const auto value : values)
+		{
+			uint32_t timestamp = time;
+			const uint16_t output = filter.process(value, timestamp);
+
+			CHECK(timestamp >= lastTimestamp);
+			CHECK(timestamp <= time);
+
+			// A value passed through keeps its own timestamp
+			if (output == value && value < 500) CHECK(timestamp == time);
+
+			lastTimestamp = timestamp;
+			time += 10;
+		}
+	}
+
+	// The timestamps are compared modulo 2^32 (millis() overflows)
+	void testTimestampOverflow()
+	{
+		RobustFilter<uint16_t, 3> filter(RobustFilterSettings(RobustFilterType::median));
+		uint32_t lastTimestamp = 0;
+		uint32_t time = UINT32_MAX - 25;
+
+		for (uint8_t i = 0; i < 6; i++)
+		{
+			uint32_t timestamp = time;
+			filter.process(100 + i, timestamp);
+
+			if (i > 0) CHECK(static_cast<int32_t>(timestamp - lastTimestamp) > 0);
+
+			lastTimestamp = timestamp;
+			time += 10;
+		}
+	}
+}
+
+int main()
+{
+	testHampelStep();
+	testHampelOutlier();
+	testZeroMAD();
+	testMedianTimestamps();
+	testHampelTimestampsMonotonic();
+	testTimestampOverflow();
+
+	return testResult("RobustFilterTest");
+}
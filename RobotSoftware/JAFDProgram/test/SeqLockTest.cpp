@@ -0,0 +1,184 @@
+/*
+This part is responsible for the host test of the sequence lock (interleavings of readers and writers, simulated on a single thread)
+*/
+
+#include "Test.h"
+#include "../JAFD/header/SeqLock.h"
+
+using namespace JAFD;
+
+namespace
+{
+	constexpr uint8_t dataSize = 4;
+
+	// Guarded data; consistent if all words are equal
+	struct Data
+	{
+		uint32_t words[dataSize];
+	};
+
+	struct Guarded
+	{
+		SeqLock lock;
+		Data data;
+
+		Guarded() : lock(), data() {}
+	};
+
+	bool consistent(const Data& data)
+	{
+		for (uint8_t i = 1; i < dataSize; i++)
+		{
+			if (data.words[i] != data.words[0]) return false;
+		}
+
+		return true;
+	}
+
+	// Complete write, like an ISR of a higher priority preempting a reader
+	void write(Guarded& guarded, const uint32_t value)
+	{
+		guarded.lock.beginWrite();
+
+		for (uint8_t i = 0; i < dataSize; i++) guarded.data.words[i] = value;
+
+		guarded.lock.endWrite();
+	}
+
+	// One read attempt; a complete write is injected after copying "writeAt" words (dataSize: before retryRead(), larger: no write)
+	bool tryRead(Guarded& guarded, Data& copy, const uint8_t writeAt, const uint32_t value)
+	{
+		const uint32_t seq = guarded.lock.beginRead();
+
+		for (uint8_t i = 0; i < dataSize; i++)
+		{
+			if (i == writeAt) write(guarded, value);
+			copy.words[i] = guarded.data.words[i];
+		}
+
+		if (writeAt == dataSize) write(guarded, value);
+
+		return guarded.lock.retryRead(seq);
+	}
+
+	// Without a write in between, the first copy is used
+	void testNoWrite()
+	{
+		Guarded guarded;
+		Data copy;
+
+		write(guarded, 1);
+
+		CHECK(!tryRead(guarded, copy, dataSize + 1, 0));
+		CHECK(consistent(copy));
+		CHECK(copy.words[0] == 1);
+	}
+
+	// A write at every point of the copy: Every torn copy is retried, the retry returns the new data
+	void testWriteDuringRead()
+	{
+		for (uint8_t writeAt = 0; writeAt <= dataSize; writeAt++)
+		{
+			Guarded guarded;
+			Data copy;
+
+			write(guarded, 1);
+
+			CHECK(tryRead(guarded, copy, writeAt, 2));
+
+			// A write before the first word was copied gives a consistent, but already retried copy; all others are torn
+			if (writeAt > 0 && writeAt < dataSize) CHECK(!consistent(copy));
+
+			CHECK(!tryRead(guarded, copy, dataSize + 1, 0));
+			CHECK(consistent(copy));
+			CHECK(copy.words[0] == 2);
+		}
+	}
+
+	// A reader starting during a write (not possible with interrupts disabled around writes in the main loop) retries as well
+	void testReadDuringWrite()
+	{
+		Guarded guarded;
+		Data copy;
+
+		write(guarded, 1);
+
+		for (uint8_t written = 0; written <= dataSize; written++)
+		{
+			guarded.lock.beginWrite();
+
+			for (uint8_t i = 0; i < written; i++) guarded.data.words[i] = 3;
+
+			// Even if nothing changes between beginRead() and retryRead()
+			CHECK(tryRead(guarded, copy, dataSize + 1, 0));
+
+			for (uint8_t i = written; i < dataSize; i++) guarded.data.words[i] = 3;
+
+			guarded.lock.endWrite();
+
+			CHECK(!tryRead(guarded, copy, dataSize + 1, 0));
+			CHECK(copy.words[0] == 3);
+
+			write(guarded, 1);
+		}
+	}
+
+	// Two writes in one read attempt (e.g. the fusion stage twice during a slow main loop reader)
+	void testTwoWrites()
+	{
+		Guarded guarded;
+		Data copy;
+
+		write(guarded, 1);
+
+		const uint32_t seq = guarded.lock.beginRead();
+
+		copy.words[0] = guarded.data.words[0];
+		write(guarded, 2);
+		for (uint8_t i = 1; i < dataSize; i++) copy.words[i] = guarded.data.words[i];
+		write(guarded, 1);
+
+		CHECK(!consistent(copy));
+		CHECK(guarded.lock.retryRead(seq));
+	}
+
+	// Retry loop as used by the readers: Many writes at varying points, every accepted copy is consistent
+	void testReaderLoop()
+	{
+		Guarded guarded;
+		uint32_t value = 1;
+		uint32_t retries = 0;
+
+		write(guarded, value);
+
+		for (uint32_t n = 0; n < 1000; n++)
+		{
+			Data copy;
+			uint8_t attempts = 0;
+
+			// Pseudo random write points; a write in up to 3 attempts in a row
+			while (tryRead(guarded, copy, attempts < 3 ? (n * 7 + attempts) % (dataSize + 3) : dataSize + 1, value + 1))
+			{
+				value++;
+				attempts++;
+				retries++;
+			}
+
+			CHECK(consistent(copy));
+			CHECK(copy.words[0] == value);
+		}
+
+		CHECK(retries > 0);
+	}
+}
+
+int main()
+{
+	testNoWrite();
+	testWriteDuringRead();
+	testReadDuringWrite();
+	testTwoWrites();
+	testReaderLoop();
+
+	return testResult("SeqLockTest");
+}
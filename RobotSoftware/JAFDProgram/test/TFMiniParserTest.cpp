@@ -0,0 +1,168 @@
+/*
+This part is responsible for the host test of the TFMini frame parser
+*/
+
+#include "Test.h"
+#include "../JAFD/header/TFMiniParser.h"
+
+using namespace JAFD;
+
+namespace
+{
+	// Complete frame (header, distance in cm, strength, mode, spare, checksum)
+	struct Frame
+	{
+		uint8_t bytes[9];
+	};
+
+	Frame makeFrame(const uint16_t distance, const uint16_t strength = 500)
+	{
+		Frame frame = { { 0x59, 0x59, static_cast<uint8_t>(distance), static_cast<uint8_t>(distance >> 8), static_cast<uint8_t>(strength), static_cast<uint8_t>(strength >> 8), 0x02, 0x00, 0x00 } };
+
+		for (uint8_t i = 0; i < 8; i++) frame.bytes[8] += frame.bytes[i];
+
+		return frame;
+	}
+
+	// Counts of the results for a byte stream
+	struct Counts
+	{
+		uint16_t frames;
+		uint16_t badChecksums;
+	};
+
+	Counts parse(TFMiniParser& parser, const uint8_t* bytes, const uint16_t length)
+	{
+		Counts counts = { 0, 0 };
+
+		for (uint16_t i = 0; i < length; i++)
+		{
+			switch (parser.parseByte(bytes[i]))
+			{
+			case TFMiniParser::Result::frame:
+				counts.frames++;
+				break;
+
+			case TFMiniParser::Result::badChecksum:
+				counts.badChecksums++;
+				break;
+
+			default:
+				break;
+			}
+		}
+
+		return counts;
+	}
+
+	Counts parse(TFMiniParser& parser, const Frame& frame)
+	{
+		return parse(parser, frame.bytes, sizeof(frame.bytes));
+	}
+
+	void testFrame()
+	{
+		TFMiniParser parser;
+		const Counts counts = parse(parser, makeFrame(123));
+
+		CHECK(counts.frames == 1);
+		CHECK(counts.badChecksums == 0);
+		CHECK(parser.getDistance() == 1230);
+	}
+
+	// Distance bytes equal to the header mustn't confuse the parser
+	void testHeaderInData()
+	{
+		TFMiniParser parser;
+		const Counts counts = parse(parser, makeFrame(0x5959, 0x5959));
+
+		CHECK(counts.frames == 1);
+		CHECK(parser.getDistance() == UINT16_MAX);	// 22873cm -> clamped
+	}
+
+	// A frame split into single bytes (one USART interrupt per byte) or delivered in parts
+	void testSplitFrame()
+	{
+		TFMiniParser parser;
+		const Frame frame = makeFrame(456);
+
+		for (uint8_t i = 0; i < 8; i++) CHECK(parser.parseByte(frame.bytes[i]) == TFMiniParser::Result::none);
+
+		CHECK(parser.parseByte(frame.bytes[8]) == TFMiniParser::Result::frame);
+		CHECK(parser.getDistance() == 4560);
+
+		// Frame in two parts with a lost byte in between -> the parser waits for the next header
+		const Frame second = makeFrame(789);
+
+		CHECK(parse(parser, second.bytes, 4).frames == 0);
+		parser.reset();
+		CHECK(parse(parser, second.bytes + 4, 5).frames == 0);
+		CHECK(parse(parser, makeFrame(321)).frames == 1);
+		CHECK(parser.getDistance() == 3210);
+	}
+
+	// Noise between frames, also single header bytes
+	void testNoise()
+	{
+		TFMiniParser parser;
+		const uint8_t noise[] = { 0x00, 0xff, 0x59, 0x12, 0x59, 0x00, 0x34 };
+
+		CHECK(parse(parser, noise, sizeof(noise)).frames == 0);
+		CHECK(parse(parser, makeFrame(200)).frames == 1);
+		CHECK(parse(parser, noise, sizeof(noise)).frames == 0);
+		CHECK(parse(parser, makeFrame(201)).frames == 1);
+		CHECK(parser.getDistance() == 2010);
+	}
+
+	// Noise ending with a header makes the parser lose at most one frame
+	void testFalseHeader()
+	{
+		TFMiniParser parser;
+		const uint8_t noise[] = { 0x12, 0x59, 0x59, 0x03 };
+		Counts counts = parse(parser, noise, sizeof(noise));
+
+		for (uint8_t i = 0; i < 3; i++)
+		{
+			const Counts frameCounts = parse(parser, makeFrame(300 + i));
+
+			counts.frames += frameCounts.frames;
+			counts.badChecksums += frameCounts.badChecksums;
+		}
+
+		CHECK(counts.frames >= 2);
+		CHECK(parser.getDistance() == 3020);
+	}
+
+	// A frame with a wrong checksum is reported and keeps the last distance
+	void testBadChecksum()
+	{
+		TFMiniParser parser;
+
+		CHECK(parse(parser, makeFrame(100)).frames == 1);
+
+		Frame frame = makeFrame(555);
+		frame.bytes[3] ^= 0x10;		// Bit error in the distance
+
+		const Counts counts = parse(parser, frame);
+
+		CHECK(counts.frames == 0);
+		CHECK(counts.badChecksums == 1);
+		CHECK(parser.getDistance() == 1000);
+
+		// The next frame is parsed again
+		CHECK(parse(parser, makeFrame(556)).frames == 1);
+		CHECK(parser.getDistance() == 5560);
+	}
+}
+
+int main()
+{
+	testFrame();
+	testHeaderInData();
+	testSplitFrame();
+	testNoise();
+	testFalseHeader();
+	testBadChecksum();
+
+	return testResult("TFMiniParserTest");
+}
@@ -0,0 +1,22 @@
+/*
+This part is responsible for the checks of the host tests
+*/
+
+#pragma once
+
+#include <stdio.h>
+#include <math.h>
+
+static int testFailures = 0;	// Failed checks of this test
+
+#define CHECK(condition) do { if (!(condition)) { printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); testFailures++; } } while (0)
+#define CHECK_NEAR(value, expected, tolerance) CHECK(fabs((value) - (expected)) <= (tolerance))
+
+// Print the result of the test; exit code for main()
+inline int testResult(const char* name)
+{
+	if (testFailures == 0) printf("%s: ok\n", name);
+	else printf("%s: %d failed checks\n", name, testFailures);
+
+	return testFailures == 0 ? 0 : 1;
+}
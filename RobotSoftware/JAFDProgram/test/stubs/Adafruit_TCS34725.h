@@ -0,0 +1,15 @@
+/*
+This part is responsible for the types of the TCS34725 library used by JAFDSettings.h in the host tests
+*/
+
+#pragma once
+
+typedef enum
+{
+	TCS34725_INTEGRATIONTIME_154MS = 0xC0
+} tcs34725IntegrationTime_t;
+
+typedef enum
+{
+	TCS34725_GAIN_1X = 0x00
+} tcs34725Gain_t;
@@ -0,0 +1,5 @@
+/*
+This part is responsible for the SPI library of the host tests (no SPI; the tests replace the NVSRAM functions)
+*/
+
+#pragma once
@@ -0,0 +1,29 @@
+/*
+This part is responsible for the parts of the Arduino core needed by the host tests
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <math.h>
+
+// Memory barrier of the Cortex-M3 (single thread on the host)
+inline void __DMB() {}
+
+#define DEG_TO_RAD 0.017453292519943295769236907684886
+#define RAD_TO_DEG 57.295779513082320876798154814105
+
+// Analog pins of the Arduino Due
+#define A0 54
+#define A1 55
+#define A2 56
+#define A3 57
+#define A4 58
+#define A5 59
+#define A6 60
+#define A7 61
+#define A8 62
+#define A9 63
+#define A10 64
+#define A11 65